@@ -9,123 +9,169 @@
 #include <string.h>
 #include "strides.h"
 
+// The gradients are stored in GCC vectors of AUTODIFF_NLANES doubles, so the
+// gradient arithmetic uses whole SIMD registers. The gradient array is padded
+// to a whole number of vectors. The padding is always 0, and is never
+// reported. Every operation updates the values in place when it can, to avoid
+// copying the whole object
+#if defined __AVX__
+#define AUTODIFF_NLANES 4
+#else
+#define AUTODIFF_NLANES 2
+#endif
+typedef double autodiff_vec_t __attribute__((vector_size(AUTODIFF_NLANES*sizeof(double))));
+
 template<int NGRAD, int NVEC> struct vec_withgrad_t;
 
 
 template<int NGRAD>
 struct val_withgrad_t
 {
+    // How many autodiff_vec_t the gradient occupies
+    static const int NJV = (NGRAD + AUTODIFF_NLANES-1) / AUTODIFF_NLANES;
+
     double x;
-    double j[NGRAD];
+    union
+    {
+        double         j [NJV*AUTODIFF_NLANES];
+        autodiff_vec_t jv[NJV];
+    };
 
     val_withgrad_t(double _x = 0.0) : x(_x)
     {
-        for(int i=0; i<NGRAD; i++) j[i] = 0.0;
+        for(int i=0; i<NJV; i++) jv[i] = (autodiff_vec_t){};
     }
 
+    val_withgrad_t<NGRAD>& operator+=( const val_withgrad_t<NGRAD>& b )
+    {
+        x += b.x;
+        for(int i=0; i<NJV; i++)
+            jv[i] += b.jv[i];
+        return *this;
+    }
+    val_withgrad_t<NGRAD>& operator+=( double b )
+    {
+        x += b;
+        return *this;
+    }
     val_withgrad_t<NGRAD> operator+( const val_withgrad_t<NGRAD>& b ) const
     {
         val_withgrad_t<NGRAD> y = *this;
-        y.x += b.x;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] += b.j[i];
-        return y;
+        return y += b;
     }
     val_withgrad_t<NGRAD> operator+( double b ) const
     {
         val_withgrad_t<NGRAD> y = *this;
-        y.x += b;
-        return y;
+        return y += b;
     }
-    void operator+=( const val_withgrad_t<NGRAD>& b )
+
+    val_withgrad_t<NGRAD>& operator-=( const val_withgrad_t<NGRAD>& b )
+    {
+        x -= b.x;
+        for(int i=0; i<NJV; i++)
+            jv[i] -= b.jv[i];
+        return *this;
+    }
+    val_withgrad_t<NGRAD>& operator-=( double b )
     {
-        *this = (*this) + b;
+        x -= b;
+        return *this;
     }
     val_withgrad_t<NGRAD> operator-( const val_withgrad_t<NGRAD>& b ) const
     {
         val_withgrad_t<NGRAD> y = *this;
-        y.x -= b.x;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] -= b.j[i];
-        return y;
+        return y -= b;
     }
     val_withgrad_t<NGRAD> operator-( double b ) const
     {
         val_withgrad_t<NGRAD> y = *this;
-        y.x -= b;
-        return y;
+        return y -= b;
+    }
+
+    val_withgrad_t<NGRAD>& operator*=( const val_withgrad_t<NGRAD>& b )
+    {
+        for(int i=0; i<NJV; i++)
+            jv[i] = jv[i]*b.x + x*b.jv[i];
+        x *= b.x;
+        return *this;
+    }
+    val_withgrad_t<NGRAD>& operator*=( double b )
+    {
+        x *= b;
+        for(int i=0; i<NJV; i++)
+            jv[i] *= b;
+        return *this;
     }
     val_withgrad_t<NGRAD> operator*( const val_withgrad_t<NGRAD>& b ) const
     {
-        val_withgrad_t<NGRAD> y;
-        y.x = x * b.x;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] = j[i]*b.x + x*b.j[i];
-        return y;
+        val_withgrad_t<NGRAD> y = *this;
+        return y *= b;
     }
     val_withgrad_t<NGRAD> operator*( double b ) const
     {
-        val_withgrad_t<NGRAD> y;
-        y.x = x * b;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] = j[i]*b;
-        return y;
+        val_withgrad_t<NGRAD> y = *this;
+        return y *= b;
+    }
+
+    val_withgrad_t<NGRAD>& operator/=( const val_withgrad_t<NGRAD>& b )
+    {
+        // d(x/b) = (dx - x/b db) / b
+        const double b_recip = 1. / b.x;
+        x *= b_recip;
+        for(int i=0; i<NJV; i++)
+            jv[i] = (jv[i] - x*b.jv[i]) * b_recip;
+        return *this;
     }
-    void operator*=( const val_withgrad_t<NGRAD>& b )
+    val_withgrad_t<NGRAD>& operator/=( double b )
     {
-        *this = (*this) * b;
+        return (*this) *= 1./b;
     }
     val_withgrad_t<NGRAD> operator/( const val_withgrad_t<NGRAD>& b ) const
     {
-        val_withgrad_t<NGRAD> y;
-        y.x = x / b.x;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] = (j[i]*b.x - x*b.j[i]) / (b.x*b.x);
-        return y;
+        val_withgrad_t<NGRAD> y = *this;
+        return y /= b;
     }
     val_withgrad_t<NGRAD> operator/( double b ) const
     {
         return (*this) * (1./b);
     }
 
+    // Sets this to a function of x: y(x), with the given derivative dy/dx
+    val_withgrad_t<NGRAD>& apply(double y, double dy_dx)
+    {
+        x = y;
+        for(int i=0; i<NJV; i++)
+            jv[i] *= dy_dx;
+        return *this;
+    }
+
     val_withgrad_t<NGRAD> sqrt(void) const
     {
-        val_withgrad_t<NGRAD> y;
-        y.x = ::sqrt(x);
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] = j[i] / (2. * y.x);
-        return y;
+        val_withgrad_t<NGRAD> y = *this;
+        const double s = ::sqrt(x);
+        return y.apply(s, 1. / (2. * s));
     }
 
     val_withgrad_t<NGRAD> square(void) const
     {
-        val_withgrad_t<NGRAD> s;
-        s.x = x*x;
-        for(int i=0; i<NGRAD; i++)
-            s.j[i] = 2. * x * j[i];
-        return s;
+        val_withgrad_t<NGRAD> y = *this;
+        return y.apply(x*x, 2. * x);
     }
 
     val_withgrad_t<NGRAD> sin(void) const
     {
         double s, c;
         ::sincos(x, &s, &c);
-        val_withgrad_t<NGRAD> y;
-        y.x = s;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] = c*j[i];
-        return y;
+        val_withgrad_t<NGRAD> y = *this;
+        return y.apply(s, c);
     }
 
     val_withgrad_t<NGRAD> cos(void) const
     {
         double s, c;
         ::sincos(x, &s, &c);
-        val_withgrad_t<NGRAD> y;
-        y.x = c;
-        for(int i=0; i<NGRAD; i++)
-            y.j[i] = -s*j[i];
-        return y;
+        val_withgrad_t<NGRAD> y = *this;
+        return y.apply(c, -s);
     }
 
     vec_withgrad_t<NGRAD, 2> sincos(void) const
@@ -135,22 +181,18 @@ struct val_withgrad_t
         vec_withgrad_t<NGRAD, 2> sc;
         sc.v[0].x = s;
         sc.v[1].x = c;
-        for(int i=0; i<NGRAD; i++)
+        for(int i=0; i<NJV; i++)
         {
-            sc.v[0].j[i] =  c*j[i];
-            sc.v[1].j[i] = -s*j[i];
+            sc.v[0].jv[i] =  c*jv[i];
+            sc.v[1].jv[i] = -s*jv[i];
         }
         return sc;
     }
 
     val_withgrad_t<NGRAD> acos(void) const
     {
-        val_withgrad_t<NGRAD> th;
-        th.x = ::acos(x);
-        double dacos_dx = -1. / ::sqrt( 1. - x*x );
-        for(int i=0; i<NGRAD; i++)
-            th.j[i] = dacos_dx * j[i];
-        return th;
+        val_withgrad_t<NGRAD> th = *this;
+        return th.apply(::acos(x), -1. / ::sqrt( 1. - x*x ));
     }
 };
 
@@ -192,148 +234,148 @@ struct vec_withgrad_t
         return v[i];
     }
 
-    void operator+=( const vec_withgrad_t<NGRAD,NVEC>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator+=( const vec_withgrad_t<NGRAD,NVEC>& x )
     {
-        (*this) = (*this) + x;
+        for(int i=0; i<NVEC; i++)
+            v[i] += x.v[i];
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator+( const vec_withgrad_t<NGRAD,NVEC>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] + x.v[i];
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p += x;
     }
 
-    void operator+=( const val_withgrad_t<NGRAD>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator+=( const val_withgrad_t<NGRAD>& x )
     {
-        (*this) = (*this) + x;
+        for(int i=0; i<NVEC; i++)
+            v[i] += x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator+( const val_withgrad_t<NGRAD>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] + x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p += x;
     }
 
-    void operator+=( double x )
+    vec_withgrad_t<NGRAD,NVEC>& operator+=( double x )
     {
-        (*this) = (*this) + x;
+        for(int i=0; i<NVEC; i++)
+            v[i] += x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator+( double x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] + x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p += x;
     }
 
-    void operator-=( const vec_withgrad_t<NGRAD,NVEC>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator-=( const vec_withgrad_t<NGRAD,NVEC>& x )
     {
-        (*this) = (*this) - x;
+        for(int i=0; i<NVEC; i++)
+            v[i] -= x.v[i];
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator-( const vec_withgrad_t<NGRAD,NVEC>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] - x.v[i];
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p -= x;
     }
 
-    void operator-=( const val_withgrad_t<NGRAD>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator-=( const val_withgrad_t<NGRAD>& x )
     {
-        (*this) = (*this) - x;
+        for(int i=0; i<NVEC; i++)
+            v[i] -= x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator-( const val_withgrad_t<NGRAD>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] - x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p -= x;
     }
 
-    void operator-=( double x )
+    vec_withgrad_t<NGRAD,NVEC>& operator-=( double x )
     {
-        (*this) = (*this) - x;
+        for(int i=0; i<NVEC; i++)
+            v[i] -= x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator-( double x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] - x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p -= x;
     }
 
-    void operator*=( const vec_withgrad_t<NGRAD,NVEC>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator*=( const vec_withgrad_t<NGRAD,NVEC>& x )
     {
-        (*this) = (*this) * x;
+        for(int i=0; i<NVEC; i++)
+            v[i] *= x.v[i];
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator*( const vec_withgrad_t<NGRAD,NVEC>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] * x.v[i];
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p *= x;
     }
 
-    void operator*=( const val_withgrad_t<NGRAD>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator*=( const val_withgrad_t<NGRAD>& x )
     {
-        (*this) = (*this) * x;
+        for(int i=0; i<NVEC; i++)
+            v[i] *= x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator*( const val_withgrad_t<NGRAD>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] * x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p *= x;
     }
 
-    void operator*=( double x )
+    vec_withgrad_t<NGRAD,NVEC>& operator*=( double x )
     {
-        (*this) = (*this) * x;
+        for(int i=0; i<NVEC; i++)
+            v[i] *= x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator*( double x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] * x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p *= x;
     }
 
-    void operator/=( const vec_withgrad_t<NGRAD,NVEC>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator/=( const vec_withgrad_t<NGRAD,NVEC>& x )
     {
-        (*this) = (*this) / x;
+        for(int i=0; i<NVEC; i++)
+            v[i] /= x.v[i];
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator/( const vec_withgrad_t<NGRAD,NVEC>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] / x.v[i];
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p /= x;
     }
 
-    void operator/=( const val_withgrad_t<NGRAD>& x )
+    vec_withgrad_t<NGRAD,NVEC>& operator/=( const val_withgrad_t<NGRAD>& x )
     {
-        (*this) = (*this) / x;
+        for(int i=0; i<NVEC; i++)
+            v[i] /= x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator/( const val_withgrad_t<NGRAD>& x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] / x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p /= x;
     }
 
-    void operator/=( double x )
+    vec_withgrad_t<NGRAD,NVEC>& operator/=( double x )
     {
-        (*this) = (*this) / x;
+        for(int i=0; i<NVEC; i++)
+            v[i] /= x;
+        return *this;
     }
     vec_withgrad_t<NGRAD,NVEC> operator/( double x ) const
     {
-        vec_withgrad_t<NGRAD,NVEC> p;
-        for(int i=0; i<NVEC; i++)
-            p[i] = v[i] / x;
-        return p;
+        vec_withgrad_t<NGRAD,NVEC> p = *this;
+        return p /= x;
     }
 
     val_withgrad_t<NGRAD> dot( const vec_withgrad_t<NGRAD,NVEC>& x) const
@@ -341,8 +383,10 @@ struct vec_withgrad_t
         val_withgrad_t<NGRAD> d; // initializes to 0
         for(int i=0; i<NVEC; i++)
         {
-            val_withgrad_t<NGRAD> e = x.v[i]*v[i];
-            d += e;
+            // d += x[i]*v[i], without the temporaries
+            d.x += x.v[i].x * v[i].x;
+            for(int k=0; k<val_withgrad_t<NGRAD>::NJV; k++)
+                d.jv[k] += x.v[i].jv[k]*v[i].x + x.v[i].x*v[i].jv[k];
         }
         return d;
     }
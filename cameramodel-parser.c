@@ -0,0 +1,462 @@
+// A parser for .cameramodel files, to read camera models from C without
+// Python. The text format is a Python dict literal. This parser understands the
+// subset of that syntax that mrcal writes: strings, numbers, (nested) lists,
+// bytes, and comments. The model components that C code needs are extracted;
+// everything else is skipped
+//
+// The parser does not allocate any memory other than the returned model, so it
+// is fast even for models that contain large optimization_inputs: those are
+// skipped without being decoded
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mrcal.h"
+
+#define MSG(fmt, ...) fprintf(stderr, "%s(%d): " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+typedef struct
+{
+    const char* s;
+    const char* end;
+    // for error messages
+    const char* start;
+} parser_t;
+
+static int lineno(const parser_t* p)
+{
+    int n = 1;
+    for(const char* s = p->start; s < p->s; s++)
+        if(*s == '\n') n++;
+    return n;
+}
+
+#define BARF(p, fmt, ...) MSG("Error parsing cameramodel on line %d: " fmt, lineno(p), ##__VA_ARGS__)
+
+// Skips whitespace and comments. Returns false if we hit the end
+static bool skip_space(parser_t* p)
+{
+    while(p->s < p->end)
+    {
+        if(isspace(*p->s))
+            p->s++;
+        else if(*p->s == '#')
+        {
+            const char* eol = memchr(p->s, '\n', p->end - p->s);
+            p->s = eol != NULL ? eol : p->end;
+        }
+        else
+            return true;
+    }
+    return false;
+}
+
+static bool expect(parser_t* p, char c)
+{
+    if(!skip_space(p) || *p->s != c)
+    {
+        BARF(p, "expected '%c'", c);
+        return false;
+    }
+    p->s++;
+    return true;
+}
+
+// If the next token is c, consume it, and return true
+static bool accept(parser_t* p, char c)
+{
+    if(skip_space(p) && *p->s == c)
+    {
+        p->s++;
+        return true;
+    }
+    return false;
+}
+
+// Reads a quoted string. The contents are reported in [*s0,*s1), with any
+// escapes left in place. Python bytes literals (b'...') are accepted too
+static bool parse_string(parser_t* p, const char** s0, const char** s1)
+{
+    if(!skip_space(p))
+    {
+        BARF(p, "expected a string");
+        return false;
+    }
+    if(*p->s == 'b' && p->s+1 < p->end)
+        p->s++;
+    const char quote = *p->s;
+    if(quote != '\'' && quote != '"')
+    {
+        BARF(p, "expected a string");
+        return false;
+    }
+    p->s++;
+
+    *s0 = p->s;
+    while(true)
+    {
+        // The optimization_inputs strings are big. memchr() gets through them
+        // quickly
+        const char* q = memchr(p->s, quote, p->end - p->s);
+        if(q == NULL)
+        {
+            BARF(p, "unterminated string");
+            return false;
+        }
+        // Is this quote escaped? It is if an odd number of backslashes
+        // precede it
+        int Nbackslashes = 0;
+        for(const char* b = q-1; b >= *s0 && *b == '\\'; b--)
+            Nbackslashes++;
+        p->s = q+1;
+        if(Nbackslashes % 2 == 0)
+        {
+            *s1 = q;
+            return true;
+        }
+    }
+}
+
+static bool parse_double(parser_t* p, double* x)
+{
+    if(!skip_space(p))
+    {
+        BARF(p, "expected a number");
+        return false;
+    }
+
+    // The buffer isn't necessarily NUL-terminated, so I copy the number out
+    // before calling strtod()
+    char number[64];
+    int  n = 0;
+    while(p->s + n < p->end &&
+          n < (int)sizeof(number)-1 &&
+          (isalnum(p->s[n]) || p->s[n] == '.' || p->s[n] == '-' || p->s[n] == '+'))
+    {
+        number[n] = p->s[n];
+        n++;
+    }
+    number[n] = '\0';
+
+    char* endptr;
+    *x = strtod(number, &endptr);
+    if(n == 0 || *endptr != '\0')
+    {
+        BARF(p, "expected a number; got '%s'", number);
+        return false;
+    }
+    p->s += n;
+    return true;
+}
+
+// Parses a list of numbers: [x0, x1, ...]. Up to Nmax are stored into x (if
+// x != NULL). The number of elements is returned in *N
+static bool parse_list(parser_t* p, double* x, int Nmax, int* N)
+{
+    if(!expect(p, '['))
+        return false;
+
+    *N = 0;
+    while(!accept(p, ']'))
+    {
+        double value;
+        if(!parse_double(p, &value))
+            return false;
+        if(x != NULL && *N < Nmax)
+            x[*N] = value;
+        (*N)++;
+
+        if(!accept(p, ','))
+            return expect(p, ']');
+    }
+    return true;
+}
+
+// Skips any value: a string, a number, a list or a dict, and the names
+// True/False/None
+static bool skip_value(parser_t* p)
+{
+    if(!skip_space(p))
+    {
+        BARF(p, "expected a value");
+        return false;
+    }
+
+    const char c = *p->s;
+    if(c == '\'' || c == '"' ||
+       (c == 'b' && p->s+1 < p->end && (p->s[1] == '\'' || p->s[1] == '"')))
+    {
+        const char *s0, *s1;
+        return parse_string(p, &s0, &s1);
+    }
+
+    if(c == '[' || c == '(' || c == '{')
+    {
+        const char close = c == '[' ? ']' : (c == '(' ? ')' : '}');
+        p->s++;
+        while(!accept(p, close))
+        {
+            if(!skip_value(p))
+                return false;
+            // dict values
+            if(close == '}' && (!expect(p, ':') || !skip_value(p)))
+                return false;
+            if(!accept(p, ','))
+                return expect(p, close);
+        }
+        return true;
+    }
+
+    if(isalpha(c))
+    {
+        while(p->s < p->end && (isalnum(*p->s) || *p->s == '_'))
+            p->s++;
+        return true;
+    }
+
+    double x;
+    return parse_double(p, &x);
+}
+
+static bool key_is(const char* s0, const char* s1, const char* key)
+{
+    return
+        (int)strlen(key) == (int)(s1-s0) &&
+        0 == strncmp(s0, key, s1-s0);
+}
+
+// Copies the binary model into a newly-allocated mrcal_cameramodel_t
+static mrcal_cameramodel_t*
+cameramodel_from_binary(const void* buffer, size_t size)
+{
+    mrcal_cameramodel_binary_t binary;
+    if(!mrcal_cameramodel_binary_parse(&binary, buffer, size))
+        return NULL;
+
+    mrcal_cameramodel_t* cameramodel =
+        malloc(sizeof(mrcal_cameramodel_t) + binary.Nintrinsics*sizeof(double));
+    if(cameramodel == NULL)
+    {
+        MSG("malloc() failed");
+        return NULL;
+    }
+
+    cameramodel->lensmodel     = binary.lensmodel;
+    cameramodel->imagersize[0] = binary.imagersize[0];
+    cameramodel->imagersize[1] = binary.imagersize[1];
+    memcpy(cameramodel->rt_cam_ref, binary.rt_cam_ref,
+           sizeof(cameramodel->rt_cam_ref));
+    memcpy(cameramodel->intrinsics, binary.intrinsics,
+           binary.Nintrinsics*sizeof(double));
+    return cameramodel;
+}
+
+mrcal_cameramodel_t* mrcal_read_cameramodel_string(const char* string, int len)
+{
+    if(len <= 0)
+        len = (int)strlen(string);
+
+    if((size_t)len >= sizeof(MRCAL_CAMERAMODEL_BINARY_MAGIC)-1 &&
+       0 == memcmp(string,
+                   MRCAL_CAMERAMODEL_BINARY_MAGIC,
+                   sizeof(MRCAL_CAMERAMODEL_BINARY_MAGIC)-1))
+        return cameramodel_from_binary(string, (size_t)len);
+
+    parser_t p = {.s     = string,
+                  .end   = &string[len],
+                  .start = string};
+
+    // First pass: I find the values I care about. The number of intrinsics
+    // depends on the lens model, and I need to know it to allocate the
+    // result. The lens model can come after the intrinsics, so I note where the
+    // intrinsics are, and come back to them after I've seen everything
+    const char* lensmodel0  = NULL;
+    const char* lensmodel1  = NULL;
+    const char* intrinsics  = NULL;
+    bool        have_extrinsics = false;
+    bool        have_imagersize = false;
+    double      rt_cam_ref[6];
+    double      imagersize[2];
+
+    if(!expect(&p, '{'))
+        return NULL;
+    while(!accept(&p, '}'))
+    {
+        const char *key0, *key1;
+        if(!parse_string(&p, &key0, &key1) ||
+           !expect(&p, ':'))
+            return NULL;
+
+        int N;
+        if(key_is(key0, key1, "lensmodel") ||
+           // legacy names
+           key_is(key0, key1, "lens_model") ||
+           key_is(key0, key1, "distortion_model"))
+        {
+            if(!parse_string(&p, &lensmodel0, &lensmodel1))
+                return NULL;
+        }
+        else if(key_is(key0, key1, "intrinsics"))
+        {
+            intrinsics = p.s;
+            if(!skip_value(&p))
+                return NULL;
+        }
+        else if(key_is(key0, key1, "extrinsics"))
+        {
+            if(!parse_list(&p, rt_cam_ref, 6, &N))
+                return NULL;
+            if(N != 6)
+            {
+                BARF(&p, "the extrinsics must have exactly 6 values. Got %d", N);
+                return NULL;
+            }
+            have_extrinsics = true;
+        }
+        else if(key_is(key0, key1, "imagersize"))
+        {
+            if(!parse_list(&p, imagersize, 2, &N))
+                return NULL;
+            if(N != 2 ||
+               imagersize[0] <= 0 || imagersize[0] != (double)(unsigned int)imagersize[0] ||
+               imagersize[1] <= 0 || imagersize[1] != (double)(unsigned int)imagersize[1])
+            {
+                BARF(&p, "the imagersize must be 2 positive integers");
+                return NULL;
+            }
+            have_imagersize = true;
+        }
+        else if(!skip_value(&p))
+            return NULL;
+
+        if(!accept(&p, ','))
+        {
+            if(!expect(&p, '}'))
+                return NULL;
+            break;
+        }
+    }
+    if(skip_space(&p))
+    {
+        BARF(&p, "garbage after the end of the model");
+        return NULL;
+    }
+
+    if(lensmodel0 == NULL || intrinsics == NULL ||
+       !have_extrinsics   || !have_imagersize)
+    {
+        MSG("The cameramodel must have at least 'lensmodel', 'intrinsics', 'extrinsics', 'imagersize'");
+        return NULL;
+    }
+
+    // Legacy models have "DISTORTION_..." instead of "LENSMODEL_..."
+    char lensmodel_name[1024];
+    const char* legacy_prefix = "DISTORTION_";
+    const char* prefix        = "";
+    if(lensmodel1 - lensmodel0 > (int)strlen(legacy_prefix) &&
+       0 == strncmp(lensmodel0, legacy_prefix, strlen(legacy_prefix)))
+    {
+        lensmodel0 += strlen(legacy_prefix);
+        prefix = "LENSMODEL_";
+    }
+    if(snprintf(lensmodel_name, sizeof(lensmodel_name), "%s%.*s",
+                prefix, (int)(lensmodel1 - lensmodel0), lensmodel0)
+       >= (int)sizeof(lensmodel_name))
+    {
+        MSG("The lensmodel name is too long");
+        return NULL;
+    }
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name(lensmodel_name);
+    if(!mrcal_lensmodel_type_is_valid(lensmodel.type))
+    {
+        MSG("Couldn't parse the lensmodel '%s'", lensmodel_name);
+        return NULL;
+    }
+    const int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
+
+    mrcal_cameramodel_t* cameramodel =
+        malloc(sizeof(mrcal_cameramodel_t) + Nintrinsics*sizeof(double));
+    if(cameramodel == NULL)
+    {
+        MSG("malloc() failed");
+        return NULL;
+    }
+
+    // Second pass: the intrinsics
+    p.s = intrinsics;
+    int N;
+    if(!parse_list(&p, cameramodel->intrinsics, Nintrinsics, &N))
+    {
+        free(cameramodel);
+        return NULL;
+    }
+    if(N != Nintrinsics)
+    {
+        MSG("Lensmodel '%s' should have %d intrinsics, but the model has %d",
+            lensmodel_name, Nintrinsics, N);
+        free(cameramodel);
+        return NULL;
+    }
+
+    cameramodel->lensmodel     = lensmodel;
+    cameramodel->imagersize[0] = (unsigned int)imagersize[0];
+    cameramodel->imagersize[1] = (unsigned int)imagersize[1];
+    memcpy(cameramodel->rt_cam_ref, rt_cam_ref, sizeof(rt_cam_ref));
+    return cameramodel;
+}
+
+mrcal_cameramodel_t* mrcal_read_cameramodel_file(const char* filename)
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        MSG("Couldn't open '%s': %s", filename, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if(0 != fstat(fd, &st))
+    {
+        MSG("Couldn't stat '%s': %s", filename, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if(st.st_size <= 0 || st.st_size > INT32_MAX)
+    {
+        MSG("'%s' has an unsupported size", filename);
+        close(fd);
+        return NULL;
+    }
+
+    // I map the file instead of reading it, so that no buffer needs to be
+    // allocated
+    void* buffer = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(buffer == MAP_FAILED)
+    {
+        MSG("Couldn't mmap '%s': %s", filename, strerror(errno));
+        return NULL;
+    }
+
+    mrcal_cameramodel_t* cameramodel =
+        mrcal_read_cameramodel_string((const char*)buffer, (int)st.st_size);
+    munmap(buffer, (size_t)st.st_size);
+
+    if(cameramodel == NULL)
+        MSG("Couldn't read the cameramodel from '%s'", filename);
+    return cameramodel;
+}
+
+void mrcal_free_cameramodel(mrcal_cameramodel_t** cameramodel)
+{
+    free(*cameramodel);
+    *cameramodel = NULL;
+}
@@ -360,48 +360,56 @@ mrcal-genpywrap.py. Please keep them in sync """,
 '''},
 )
 
-m.function( "_A_Jt_J_At",
-            """Computes matmult(A,Jt,J,At) for a sparse J
-
-This is used in the internals of projection_uncertainty().
+m.function( "_unprojection_lut_interpolate",
+            """Interpolates an unprojection lookup table
 
-A has shape (2,Nstate)
+This is the internals for mrcal.unprojection_lut.unproject(). As a user, please
+call THAT function, and see the docs for that function.
 
-J has shape (Nmeasurements,Nstate). J is large and sparse
-
-We use the Nleading_rows_J leading rows of J. This integer is passed-in as an
-argument.
-
-matmult(A, Jt, J, At) has shape (2,2)
-
-The input matrices are large, but the result is very small. I can't see a way to
-do this efficiently in pure Python, so I'm writing this.
-
-J is sparse, stored by row. This is the scipy.sparse.csr_matrix representation,
-and is also how CHOLMOD stores Jt (CHOLMOD stores by column, so the same data
-looks like Jt to CHOLMOD). The sparse J is given here as the p,i,x arrays from
-CHOLMOD, equivalent to the indptr,indices,data members of
-scipy.sparse.csr_matrix respectively.
- """,
+The grid has shape (gridn_height,gridn_width,3). Grid point (i,j) is the
+observation vector at pixel (j*grid_spacing_x, i*grid_spacing_y). If bicubic:
+we use Catmull-Rom interpolation. Otherwise we interpolate bilinearly
+""",
 
-            args_input       = ('A', 'Jp', 'Ji', 'Jx'),
-            prototype_input  = ((2,'Nstate'), ('Np',), ('Nix',), ('Nix',)),
-            prototype_output = (2,2),
+            args_input       = ('q', 'grid'),
+            prototype_input  = ((2,), ('gridn_height','gridn_width',3)),
+            prototype_output = (3,),
 
-            extra_args = (("int", "Nleading_rows_J", "-1", "i"),),
+            extra_args = (("double", "grid_spacing_x", "0", "d"),
+                          ("double", "grid_spacing_y", "0", "d"),
+                          ("int",    "bicubic",        "0", "p"),),
 
             Ccode_validate = r'''
-            if(*Nleading_rows_J <= 0)
+            if(!(*grid_spacing_x > 0 && *grid_spacing_y > 0))
             {
                 PyErr_Format(PyExc_RuntimeError,
-                             "Nleading_rows_J must be passed, and must be > 0");
+                             "grid_spacing_x and grid_spacing_y must be passed, and must be > 0");
+                return false;
+            }
+            if(dims_slice__grid[0] < 2 || dims_slice__grid[1] < 2)
+            {
+                PyErr_Format(PyExc_RuntimeError,
+                             "The grid must have at least 2 points in each direction");
                 return false;
             }
             return CHECK_CONTIGUOUS_AND_SETERROR_ALL();''',
 
             Ccode_slice_eval = \
-                { (np.float64, np.int32, np.int32, np.float64, np.float64):
+                {np.float64:
                  r'''
+                 mrcal_unprojection_lut_interpolate((mrcal_point3_t*)data_slice__output,
+                                                    (const mrcal_point2_t*)data_slice__q,
+                                                    1,
+                                                    (const mrcal_point3_t*)data_slice__grid,
+                                                    dims_slice__grid[1], dims_slice__grid[0],
+                                                    *grid_spacing_x, *grid_spacing_y,
+                                                    *bicubic);
+                 return true;
+'''},
+)
+
+A_Jt_J_At_body = \
+r'''
 
                  // I'm computing A Jt J At = sum(outer(ja,ja)) where ja is each
                  // row of matmult(J,At). Rows of matmult(J,At) are
@@ -414,24 +422,24 @@ scipy.sparse.csr_matrix respectively.
 
                  int32_t Nstate = dims_slice__A[1];
 
-                 const double*   A = (const double* )data_slice__A;
-                 const int32_t* Jp = (const int32_t*)data_slice__Jp;
-                 const int32_t* Ji = (const int32_t*)data_slice__Ji;
-                 const double*  Jx = (const double* )data_slice__Jx;
-                 double* out       = (      double* )data_slice__output;
+                 const double*     A = (const double*   )data_slice__A;
+                 const ctype__Jp* Jp = (const ctype__Jp*)data_slice__Jp;
+                 const ctype__Ji* Ji = (const ctype__Ji*)data_slice__Ji;
+                 const double*    Jx = (const double*   )data_slice__Jx;
+                 double*         out = (      double*   )data_slice__output;
 
                  out[0] = 0.0;
                  out[1] = 0.0;
                  out[2] = 0.0;
                  out[3] = 0.0;
 
-                 for(int irow=0; irow<*Nleading_rows_J; irow++)
+                 for(ctype__Jp irow=0; irow<*Nleading_rows_J; irow++)
                  {
                      double jta[2] = {};
 
-                     for(int32_t i = Jp[irow]; i < Jp[irow+1]; i++)
+                     for(ctype__Jp i = Jp[irow]; i < Jp[irow+1]; i++)
                      {
-                         int32_t icol = Ji[i];
+                         ctype__Ji icol = Ji[i];
                          double x     = Jx[i];
 
                          jta[0] += A[icol + 0*Nstate] * x;
@@ -444,7 +452,54 @@ scipy.sparse.csr_matrix respectively.
                      out[3] += jta[1]*jta[1];
                  }
                  return true;
-'''},
+'''
+m.function( "_A_Jt_J_At",
+            """Computes matmult(A,Jt,J,At) for a sparse J
+
+This is used in the internals of projection_uncertainty().
+
+A has shape (2,Nstate)
+
+J has shape (Nmeasurements,Nstate). J is large and sparse
+
+We use the Nleading_rows_J leading rows of J. This integer is passed-in as an
+argument.
+
+matmult(A, Jt, J, At) has shape (2,2)
+
+The input matrices are large, but the result is very small. I can't see a way to
+do this efficiently in pure Python, so I'm writing this.
+
+J is sparse, stored by row. This is the scipy.sparse.csr_matrix representation,
+and is also how CHOLMOD stores Jt (CHOLMOD stores by column, so the same data
+looks like Jt to CHOLMOD). The sparse J is given here as the p,i,x arrays from
+CHOLMOD, equivalent to the indptr,indices,data members of
+scipy.sparse.csr_matrix respectively. The indices may be 32-bit or 64-bit, as
+long as Jp and Ji have the same type.
+ """,
+
+            args_input       = ('A', 'Jp', 'Ji', 'Jx'),
+            prototype_input  = ((2,'Nstate'), ('Np',), ('Nix',), ('Nix',)),
+            prototype_output = (2,2),
+
+            extra_args = (("int", "Nleading_rows_J", "-1", "i"),),
+
+            Ccode_validate = r'''
+            if(*Nleading_rows_J <= 0)
+            {
+                PyErr_Format(PyExc_RuntimeError,
+                             "Nleading_rows_J must be passed, and must be > 0");
+                return false;
+            }
+            return CHECK_CONTIGUOUS_AND_SETERROR_ALL();''',
+
+            Ccode_slice_eval = \
+                { (np.float64, np.int32, np.int32, np.float64, np.float64):
+                  A_Jt_J_At_body,
+                  # The optimizer_callback() returns 64-bit indices for
+                  # problems too large for 32-bit ones
+                  (np.float64, np.int64, np.int64, np.float64, np.float64):
+                  A_Jt_J_At_body },
 )
 
 
@@ -5,6 +5,7 @@
 #include <structmember.h>
 #include <numpy/arrayobject.h>
 #include <signal.h>
+#include <limits.h>
 #include <dogleg.h>
 
 #if (CHOLMOD_VERSION > (CHOLMOD_VER_CODE(2,2)))
@@ -197,6 +198,10 @@ typedef struct {
     cholmod_common  common;
     cholmod_factor* factorization;
 
+    // if(is_long), the factorization uses 64-bit indices, and we must use the
+    // cholmod_l_...() functions
+    bool            is_long;
+
     // optimizer_callback should return it
     // and I should have two solve methods:
 } CHOLMOD_factorization;
@@ -218,11 +223,15 @@ static void _CHOLMOD_factorization_release_internal(CHOLMOD_factorization* self)
 {
     if( self->factorization )
     {
-        cholmod_free_factor(&self->factorization, &self->common);
+        if(self->is_long) cholmod_l_free_factor(&self->factorization, &self->common);
+        else              cholmod_free_factor  (&self->factorization, &self->common);
         self->factorization = NULL;
     }
     if( self->inited_common )
-        cholmod_finish(&self->common);
+    {
+        if(self->is_long) cholmod_l_finish(&self->common);
+        else              cholmod_finish  (&self->common);
+    }
     self->inited_common = false;
 }
 
@@ -230,14 +239,20 @@ static void _CHOLMOD_factorization_release_internal(CHOLMOD_factorization* self)
 static bool
 _CHOLMOD_factorization_init_from_cholmod_sparse(CHOLMOD_factorization* self, cholmod_sparse* Jt)
 {
+    const bool is_long = (Jt->itype == CHOLMOD_LONG);
+    if( self->inited_common && self->is_long != is_long )
+        // The cholmod_common was started for the other index type. Start over
+        _CHOLMOD_factorization_release_internal(self);
+
     if( !self->inited_common )
     {
-        if( !cholmod_start(&self->common) )
+        if( !(is_long ? cholmod_l_start(&self->common) : cholmod_start(&self->common)) )
         {
             BARF("Error trying to cholmod_start");
             return false;
         }
         self->inited_common = true;
+        self->is_long       = is_long;
 
         // stolen from libdogleg
 
@@ -254,14 +269,19 @@ _CHOLMOD_factorization_init_from_cholmod_sparse(CHOLMOD_factorization* self, cho
 #endif
     }
 
-    self->factorization = cholmod_analyze(Jt, &self->common);
+    self->factorization =
+        is_long ?
+        cholmod_l_analyze(Jt, &self->common) :
+        cholmod_analyze  (Jt, &self->common);
 
     if(self->factorization == NULL)
     {
         BARF("cholmod_analyze() failed");
         return false;
     }
-    if( !cholmod_factorize(Jt, self->factorization, &self->common) )
+    if( !(is_long ?
+          cholmod_l_factorize(Jt, self->factorization, &self->common) :
+          cholmod_factorize  (Jt, self->factorization, &self->common)) )
     {
         BARF("cholmod_factorize() failed");
         return false;
@@ -418,8 +438,22 @@ CHOLMOD_factorization_init(CHOLMOD_factorization* self, PyObject* args, PyObject
     }
 
     CHECK_NUMPY_ARRAY(data,    NPY_FLOAT64);
-    CHECK_NUMPY_ARRAY(indices, NPY_INT32);
-    CHECK_NUMPY_ARRAY(indptr,  NPY_INT32);
+
+    // The indices are 32-bit usually, but scipy uses 64-bit indices for huge
+    // matrices. CHOLMOD supports both
+    const bool is_long =
+        PyArray_Check(Py_indices) &&
+        PyArray_TYPE((PyArrayObject*)Py_indices) == NPY_INT64;
+    if(is_long)
+    {
+        CHECK_NUMPY_ARRAY(indices, NPY_INT64);
+        CHECK_NUMPY_ARRAY(indptr,  NPY_INT64);
+    }
+    else
+    {
+        CHECK_NUMPY_ARRAY(indices, NPY_INT32);
+        CHECK_NUMPY_ARRAY(indptr,  NPY_INT32);
+    }
 
     // OK, the input looks good. I guess I can tell CHOLMOD about it
 
@@ -434,7 +468,7 @@ CHOLMOD_factorization_init(CHOLMOD_factorization* self, PyObject* args, PyObject
         .i      = PyArray_DATA((PyArrayObject*)Py_indices),
         .x      = PyArray_DATA((PyArrayObject*)Py_data),
         .stype  = 0,            // not symmetric
-        .itype  = CHOLMOD_INT,
+        .itype  = is_long ? CHOLMOD_LONG : CHOLMOD_INT,
         .xtype  = CHOLMOD_REAL,
         .dtype  = CHOLMOD_DOUBLE,
         .sorted = PyObject_IsTrue(Py_has_sorted_indices),
@@ -577,10 +611,15 @@ CHOLMOD_factorization_solve_xt_JtJ_bt(CHOLMOD_factorization* self, PyObject* arg
     cholmod_dense* Y = NULL;
     cholmod_dense* E = NULL;
 
-    if(!cholmod_solve2( CHOLMOD_A, self->factorization,
-                        &b, NULL,
-                        &M, NULL, &Y, &E,
-                        &self->common))
+    if(!(self->is_long ?
+         cholmod_l_solve2( CHOLMOD_A, self->factorization,
+                           &b, NULL,
+                           &M, NULL, &Y, &E,
+                           &self->common) :
+         cholmod_solve2  ( CHOLMOD_A, self->factorization,
+                           &b, NULL,
+                           &M, NULL, &Y, &E,
+                           &self->common)))
     {
         BARF("cholmod_solve2() failed");
         goto done;
@@ -591,8 +630,16 @@ CHOLMOD_factorization_solve_xt_JtJ_bt(CHOLMOD_factorization* self, PyObject* arg
         goto done;
     }
 
-    cholmod_free_dense (&E, &self->common);
-    cholmod_free_dense (&Y, &self->common);
+    if(self->is_long)
+    {
+        cholmod_l_free_dense (&E, &self->common);
+        cholmod_l_free_dense (&Y, &self->common);
+    }
+    else
+    {
+        cholmod_free_dense (&E, &self->common);
+        cholmod_free_dense (&Y, &self->common);
+    }
 
     Py_INCREF(Py_out);
     result = Py_out;
@@ -687,6 +734,76 @@ static bool parse_lensmodel_from_arg(// output
     return true;
 }
 
+// The solver is given as a string: "cholmod", "schur", "pcg" or "cholmod-lm".
+// None selects the default
+static bool parse_solver_from_arg(// output
+                                  mrcal_solver_t* solver,
+                                  // input
+                                  PyObject* solver_string)
+{
+    if(solver_string == NULL || solver_string == Py_None)
+    {
+        *solver = MRCAL_SOLVER_CHOLMOD;
+        return true;
+    }
+
+    const char* solver_cstring = PyString_AsString(solver_string);
+    if( solver_cstring == NULL)
+    {
+        BARF("The solver must be given as a string");
+        return false;
+    }
+    if(0 == strcmp(solver_cstring, "cholmod"))
+        *solver = MRCAL_SOLVER_CHOLMOD;
+    else if(0 == strcmp(solver_cstring, "schur"))
+        *solver = MRCAL_SOLVER_SCHUR;
+    else if(0 == strcmp(solver_cstring, "pcg"))
+        *solver = MRCAL_SOLVER_PCG;
+    else if(0 == strcmp(solver_cstring, "cholmod-lm"))
+        *solver = MRCAL_SOLVER_CHOLMOD_LM;
+    else
+    {
+        BARF("Unknown solver '%s'. Must be one of ('cholmod', 'schur', 'pcg', 'cholmod-lm')",
+             solver_cstring);
+        return false;
+    }
+    return true;
+}
+
+// The loss is given as a string: "squared", "huber" or "cauchy". None selects
+// the default
+static bool parse_loss_from_arg(// output
+                                mrcal_loss_t* loss,
+                                // input
+                                PyObject* loss_string)
+{
+    if(loss_string == NULL || loss_string == Py_None)
+    {
+        *loss = MRCAL_LOSS_SQUARED;
+        return true;
+    }
+
+    const char* loss_cstring = PyString_AsString(loss_string);
+    if( loss_cstring == NULL)
+    {
+        BARF("The loss must be given as a string");
+        return false;
+    }
+    if(0 == strcmp(loss_cstring, "squared"))
+        *loss = MRCAL_LOSS_SQUARED;
+    else if(0 == strcmp(loss_cstring, "huber"))
+        *loss = MRCAL_LOSS_HUBER;
+    else if(0 == strcmp(loss_cstring, "cauchy"))
+        *loss = MRCAL_LOSS_CAUCHY;
+    else
+    {
+        BARF("Unknown loss '%s'. Must be one of ('squared', 'huber', 'cauchy')",
+             loss_cstring);
+        return false;
+    }
+    return true;
+}
+
 static PyObject* lensmodel_metadata(PyObject* NPY_UNUSED(self),
                                 PyObject* args)
 {
@@ -1023,6 +1140,295 @@ static PyObject* unproject_stereographic(PyObject* self,
 }
 
 
+#define IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(_)                  \
+    _(lensmodel_from,  PyObject*,      NULL, STRING_OBJECT,  ,                                  NULL,            -1,         {} ) \
+    _(intrinsics_from, PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, intrinsics_from, NPY_DOUBLE, {-1} ) \
+    _(lensmodel_to,    PyObject*,      NULL, STRING_OBJECT,  ,                                  NULL,            -1,         {} ) \
+    _(intrinsics_to,   PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, intrinsics_to,   NPY_DOUBLE, {-1} ) \
+    _(W_to,            int,            -1,   "i",  ,                                  NULL,            -1,         {} ) \
+    _(H_to,            int,            -1,   "i",  ,                                  NULL,            -1,         {} )
+#define IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(_)                  \
+    _(M_from_to,       PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, M_from_to,       NPY_DOUBLE, {3 COMMA 3} ) \
+    _(Nthreads,        int,            1,    "i",  ,                                  NULL,            -1,         {} )
+
+static bool _image_transformation_map_validate_args(// in
+                                                    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(ARG_LIST_DEFINE)
+                                                    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(ARG_LIST_DEFINE)
+                                                    void* dummy __attribute__((unused)))
+{
+    if( IS_NULL(intrinsics_from) || IS_NULL(intrinsics_to) )
+    {
+        BARF("intrinsics_from and intrinsics_to must be given");
+        return false;
+    }
+    if(W_to <= 0 || H_to <= 0)
+    {
+        BARF("W_to and H_to must be given, and must be > 0");
+        return false;
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(CHECK_LAYOUT);
+    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(CHECK_LAYOUT);
+#pragma GCC diagnostic pop
+
+    return true;
+}
+
+static PyObject* _image_transformation_map(PyObject* NPY_UNUSED(self),
+                                           PyObject* args,
+                                           PyObject* kwargs)
+{
+    PyObject*      result = NULL;
+    PyArrayObject* mapxy  = NULL;
+    SET_SIGINT();
+
+    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(ARG_DEFINE);
+    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(ARG_DEFINE);
+
+    char* keywords[] = { IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(NAMELIST)
+                         IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(NAMELIST)
+                         NULL};
+    if(!PyArg_ParseTupleAndKeywords( args, kwargs,
+                                     IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(PARSECODE) "|"
+                                     IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(PARSECODE),
+
+                                     keywords,
+
+                                     IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(PARSEARG)
+                                     IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(PARSEARG) NULL))
+        goto done;
+
+    mrcal_lensmodel_t lensmodel_from_parsed, lensmodel_to_parsed;
+    if(!parse_lensmodel_from_arg(&lensmodel_from_parsed, lensmodel_from) ||
+       !parse_lensmodel_from_arg(&lensmodel_to_parsed,   lensmodel_to))
+        goto done;
+
+    if(!_image_transformation_map_validate_args( IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(ARG_LIST_CALL)
+                                                 IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(ARG_LIST_CALL)
+                                                 NULL))
+        goto done;
+
+    if( mrcal_lensmodel_num_params(lensmodel_from_parsed) != PyArray_DIMS(intrinsics_from)[0] )
+    {
+        BARF("intrinsics_from has %ld values, but the lens model expects %d",
+             PyArray_DIMS(intrinsics_from)[0],
+             mrcal_lensmodel_num_params(lensmodel_from_parsed));
+        goto done;
+    }
+    if( mrcal_lensmodel_num_params(lensmodel_to_parsed) != PyArray_DIMS(intrinsics_to)[0] )
+    {
+        BARF("intrinsics_to has %ld values, but the lens model expects %d",
+             PyArray_DIMS(intrinsics_to)[0],
+             mrcal_lensmodel_num_params(lensmodel_to_parsed));
+        goto done;
+    }
+    mapxy = (PyArrayObject*)PyArray_SimpleNew(3, ((npy_intp[]){H_to, W_to, 2}), NPY_FLOAT32);
+    if(mapxy == NULL)
+    {
+        BARF("Couldn't allocate the %dx%d map", W_to, H_to);
+        goto done;
+    }
+
+    if(!mrcal_image_transformation_map((float*)PyArray_DATA(mapxy),
+                                       lensmodel_from_parsed,
+                                       (const double*)PyArray_DATA(intrinsics_from),
+                                       lensmodel_to_parsed,
+                                       (const double*)PyArray_DATA(intrinsics_to),
+                                       W_to, H_to,
+                                       IS_NULL(M_from_to) ? NULL : (const double*)PyArray_DATA(M_from_to),
+                                       Nthreads))
+    {
+        BARF("mrcal_image_transformation_map() failed");
+        goto done;
+    }
+
+    result = (PyObject*)mapxy;
+    mapxy  = NULL;
+
+ done:
+    Py_XDECREF(mapxy);
+    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_REQUIRED(FREE_PYARRAY) ;
+    IMAGE_TRANSFORMATION_MAP_ARGUMENTS_OPTIONAL(FREE_PYARRAY) ;
+    RESET_SIGINT();
+    return result;
+}
+
+#define TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(_)                           \
+    _(image,      PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, image,      -1,         {} )
+#define TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(_)                           \
+    _(mapxy,      PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, mapxy,      NPY_FLOAT32, {-1 COMMA -1 COMMA 2} ) \
+    _(mapxy_int,  PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, mapxy_int,  NPY_INT16,   {-1 COMMA -1 COMMA 2} ) \
+    _(mapxy_frac, PyArrayObject*, NULL, "O&", PyArray_Converter_leaveNone COMMA, mapxy_frac, NPY_UINT16,  {-1 COMMA -1} ) \
+    _(bicubic,    int,            0,    "p",  ,                                  NULL,       -1,          {} ) \
+    _(Nthreads,   int,            1,    "i",  ,                                  NULL,       -1,          {} )
+
+static bool _transform_image_validate_args(// in
+                                           TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(ARG_LIST_DEFINE)
+                                           TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(ARG_LIST_DEFINE)
+                                           void* dummy __attribute__((unused)))
+{
+    if( IS_NULL(image) )
+    {
+        BARF("The image must be given");
+        return false;
+    }
+    if( !(PyArray_NDIM(image) == 2 || PyArray_NDIM(image) == 3) )
+    {
+        BARF("The image must have shape (H,W) or (H,W,Nchannels). Got %d dims",
+             PyArray_NDIM(image));
+        return false;
+    }
+    if( !PyArray_IS_C_CONTIGUOUS(image) )
+    {
+        BARF("The image must be c-style contiguous");
+        return false;
+    }
+    if( IS_NULL(mapxy) == (IS_NULL(mapxy_int) || IS_NULL(mapxy_frac)) ||
+        IS_NULL(mapxy_int) != IS_NULL(mapxy_frac) )
+    {
+        BARF("Exactly one of mapxy or (mapxy_int,mapxy_frac) must be given");
+        return false;
+    }
+    if( !IS_NULL(mapxy_int) &&
+        !( PyArray_DIMS(mapxy_int)[0] == PyArray_DIMS(mapxy_frac)[0] &&
+           PyArray_DIMS(mapxy_int)[1] == PyArray_DIMS(mapxy_frac)[1]) )
+    {
+        BARF("mapxy_int and mapxy_frac must describe the same image");
+        return false;
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+    TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(CHECK_LAYOUT);
+#pragma GCC diagnostic pop
+
+    return true;
+}
+
+static PyObject* _transform_image(PyObject* NPY_UNUSED(self),
+                                  PyObject* args,
+                                  PyObject* kwargs)
+{
+    PyObject*      result = NULL;
+    PyArrayObject* out    = NULL;
+    SET_SIGINT();
+
+    TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(ARG_DEFINE);
+    TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(ARG_DEFINE);
+
+    char* keywords[] = { TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(NAMELIST)
+                         TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(NAMELIST)
+                         NULL};
+    if(!PyArg_ParseTupleAndKeywords( args, kwargs,
+                                     TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(PARSECODE) "|"
+                                     TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(PARSECODE),
+
+                                     keywords,
+
+                                     TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(PARSEARG)
+                                     TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(PARSEARG) NULL))
+        goto done;
+
+    if(!_transform_image_validate_args( TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(ARG_LIST_CALL)
+                                        TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(ARG_LIST_CALL)
+                                        NULL))
+        goto done;
+
+    mrcal_image_type_t type;
+    switch(PyArray_TYPE(image))
+    {
+    case NPY_UINT8:   type = MRCAL_IMAGE_UINT8;  break;
+    case NPY_UINT16:  type = MRCAL_IMAGE_UINT16; break;
+    case NPY_FLOAT32: type = MRCAL_IMAGE_FLOAT;  break;
+    default:
+        BARF("The image must contain uint8, uint16 or float32 pixels");
+        goto done;
+    }
+
+    {
+        const npy_intp* dims_map = IS_NULL(mapxy) ? PyArray_DIMS(mapxy_int) : PyArray_DIMS(mapxy);
+        const int Nchannels = PyArray_NDIM(image) == 3 ? (int)PyArray_DIMS(image)[2] : 1;
+
+        npy_intp dims_out[3] = {dims_map[0], dims_map[1], Nchannels};
+        out = (PyArrayObject*)PyArray_SimpleNew(PyArray_NDIM(image), dims_out, PyArray_TYPE(image));
+        if(out == NULL)
+        {
+            BARF("Couldn't allocate the output image");
+            goto done;
+        }
+
+        if(!mrcal_transform_image(PyArray_DATA(out),
+                                  PyArray_DATA(image),
+                                  (int)PyArray_DIMS(image)[1], (int)PyArray_DIMS(image)[0],
+                                  Nchannels, type,
+                                  (int)dims_map[1], (int)dims_map[0],
+                                  IS_NULL(mapxy)      ? NULL : (const float*)   PyArray_DATA(mapxy),
+                                  IS_NULL(mapxy_int)  ? NULL : (const int16_t*) PyArray_DATA(mapxy_int),
+                                  IS_NULL(mapxy_frac) ? NULL : (const uint16_t*)PyArray_DATA(mapxy_frac),
+                                  bicubic, Nthreads))
+        {
+            BARF("mrcal_transform_image() failed");
+            goto done;
+        }
+    }
+
+    result = (PyObject*)out;
+    out    = NULL;
+
+ done:
+    Py_XDECREF(out);
+    TRANSFORM_IMAGE_ARGUMENTS_REQUIRED(FREE_PYARRAY) ;
+    TRANSFORM_IMAGE_ARGUMENTS_OPTIONAL(FREE_PYARRAY) ;
+    RESET_SIGINT();
+    return result;
+}
+
+static PyObject* _transformation_map_compact(PyObject* NPY_UNUSED(self),
+                                             PyObject* args)
+{
+    PyObject*      result     = NULL;
+    PyArrayObject* mapxy      = NULL;
+    PyArrayObject* mapxy_int  = NULL;
+    PyArrayObject* mapxy_frac = NULL;
+    SET_SIGINT();
+
+    if(!PyArg_ParseTuple( args, "O&", PyArray_Converter, &mapxy ))
+        goto done;
+    if( !(PyArray_NDIM(mapxy) == 3 &&
+          PyArray_DIMS(mapxy)[2] == 2 &&
+          PyArray_TYPE(mapxy) == NPY_FLOAT32 &&
+          PyArray_IS_C_CONTIGUOUS(mapxy)) )
+    {
+        BARF("mapxy must be a c-style contiguous float32 array of shape (H,W,2)");
+        goto done;
+    }
+
+    mapxy_int  = (PyArrayObject*)PyArray_SimpleNew(3, PyArray_DIMS(mapxy), NPY_INT16);
+    mapxy_frac = (PyArrayObject*)PyArray_SimpleNew(2, PyArray_DIMS(mapxy), NPY_UINT16);
+    if(mapxy_int == NULL || mapxy_frac == NULL)
+    {
+        BARF("Couldn't allocate the compact map");
+        goto done;
+    }
+
+    mrcal_transformation_map_compact((int16_t*) PyArray_DATA(mapxy_int),
+                                     (uint16_t*)PyArray_DATA(mapxy_frac),
+                                     (const float*)PyArray_DATA(mapxy),
+                                     (int)(PyArray_DIMS(mapxy)[0]*PyArray_DIMS(mapxy)[1]));
+
+    result = Py_BuildValue("OO", mapxy_int, mapxy_frac);
+
+ done:
+    Py_XDECREF(mapxy);
+    Py_XDECREF(mapxy_int);
+    Py_XDECREF(mapxy_frac);
+    RESET_SIGINT();
+    return result;
+}
+
+
 
 #define OPTIMIZE_ARGUMENTS_REQUIRED(_)                                  \
     _(intrinsics,                         PyArrayObject*, NULL,    "O&", PyArray_Converter_leaveNone COMMA, intrinsics,                  NPY_DOUBLE, {-1 COMMA -1       } ) \
@@ -1049,6 +1455,10 @@ static PyObject* unproject_stereographic(PyObject* self,
     _(calibration_object_spacing,         double,         -1.0,    "d",  ,                                  NULL,           -1,         {})  \
     _(point_min_range,                    double,         -1.0,    "d",  ,                                  NULL,           -1,         {})  \
     _(point_max_range,                    double,         -1.0,    "d",  ,                                  NULL,           -1,         {})  \
+    _(Nthreads,                           int,            0,       "i",  ,                                  NULL,           -1,         {})  \
+    _(solver,                             PyObject*,      NULL,    "O",  ,                                  NULL,           -1,         {})  \
+    _(loss,                               PyObject*,      NULL,    "O",  ,                                  NULL,           -1,         {})  \
+    _(loss_scale,                         double,         -1.0,    "d",  ,                                  NULL,           -1,         {})  \
     _(verbose,                            int,            0,       "p",  ,                                  NULL,           -1,         {})  \
     _(do_apply_regularization,            int,            1,       "p",  ,                                  NULL,           -1,         {})  \
     _(do_apply_outlier_rejection,         int,            1,       "p",  ,                                  NULL,           -1,         {})
@@ -1458,7 +1868,13 @@ PyObject* _optimize(bool is_optimize, // or optimizer_callback
 
         mrcal_problem_constants_t problem_constants =
             {.point_min_range = point_min_range,
-             .point_max_range = point_max_range};
+             .point_max_range = point_max_range,
+             .Nthreads        = Nthreads,
+             .loss_scale      = loss_scale};
+        if(!parse_solver_from_arg(&problem_constants.solver, solver))
+            goto done;
+        if(!parse_loss_from_arg(&problem_constants.loss, loss))
+            goto done;
 
         int Nmeasurements = mrcal_num_measurements(Nobservations_board,
                                                    Nobservations_point,
@@ -1524,7 +1940,8 @@ PyObject* _optimize(bool is_optimize, // or optimizer_callback
                                 calibration_object_height_n,
                                 verbose,
 
-                                false);
+                                false,
+                                NULL);
 
             if(stats.rms_reproj_error__pixels < 0.0)
             {
@@ -1577,7 +1994,7 @@ PyObject* _optimize(bool is_optimize, // or optimizer_callback
         {
             // we're wrapping mrcal_optimizer_callback()
 
-            int N_j_nonzero = _mrcal_num_j_nonzero(Nobservations_board,
+            int64_t N_j_nonzero = _mrcal_num_j_nonzero(Nobservations_board,
                                                    Nobservations_point,
                                                    calibration_object_width_n,
                                                    calibration_object_height_n,
@@ -1593,17 +2010,20 @@ PyObject* _optimize(bool is_optimize, // or optimizer_callback
                 .ncol   = Nmeasurements,
                 .nzmax  = N_j_nonzero,
                 .stype  = 0,
-                .itype  = CHOLMOD_INT,
+                // Huge problems need 64-bit indices
+                .itype  = N_j_nonzero > INT_MAX ? CHOLMOD_LONG : CHOLMOD_INT,
                 .xtype  = CHOLMOD_REAL,
                 .dtype  = CHOLMOD_DOUBLE,
                 .sorted = 1,
                 .packed = 1 };
+            const int index_type =
+                Jt.itype == CHOLMOD_LONG ? NPY_INT64 : NPY_INT32;
 
             if(!no_jacobian)
             {
                 // above I made sure that no_jacobian was false if !no_factorization
-                P = (PyArrayObject*)PyArray_SimpleNew(1, ((npy_intp[]){Nmeasurements + 1}), NPY_INT32);
-                I = (PyArrayObject*)PyArray_SimpleNew(1, ((npy_intp[]){N_j_nonzero      }), NPY_INT32);
+                P = (PyArrayObject*)PyArray_SimpleNew(1, ((npy_intp[]){Nmeasurements + 1}), index_type);
+                I = (PyArrayObject*)PyArray_SimpleNew(1, ((npy_intp[]){N_j_nonzero      }), index_type);
                 X = (PyArrayObject*)PyArray_SimpleNew(1, ((npy_intp[]){N_j_nonzero      }), NPY_DOUBLE);
                 Jt.p = PyArray_DATA(P);
                 Jt.i = PyArray_DATA(I);
@@ -1642,7 +2062,8 @@ PyObject* _optimize(bool is_optimize, // or optimizer_callback
                                          calibration_object_spacing,
                                          calibration_object_width_n,
                                          calibration_object_height_n,
-                                         verbose) )
+                                         verbose,
+                                         NULL) )
             {
                 BARF("mrcal_optimizer_callback() failed!'");
                 goto done;
@@ -2799,6 +3220,15 @@ static const char project_stereographic_docstring[] =
 static const char unproject_stereographic_docstring[] =
 #include "unproject_stereographic.docstring.h"
     ;
+static const char _image_transformation_map_docstring[] =
+#include "_image_transformation_map.docstring.h"
+    ;
+static const char _transform_image_docstring[] =
+#include "_transform_image.docstring.h"
+    ;
+static const char _transformation_map_compact_docstring[] =
+#include "_transformation_map_compact.docstring.h"
+    ;
 static PyMethodDef methods[] =
     { PYMETHODDEF_ENTRY(,optimize,                         METH_VARARGS | METH_KEYWORDS),
       PYMETHODDEF_ENTRY(,optimizer_callback,               METH_VARARGS | METH_KEYWORDS),
@@ -2830,6 +3260,9 @@ static PyMethodDef methods[] =
       PYMETHODDEF_ENTRY(,knots_for_splined_models, METH_VARARGS),
       PYMETHODDEF_ENTRY(,project_stereographic,    METH_VARARGS | METH_KEYWORDS),
       PYMETHODDEF_ENTRY(,unproject_stereographic,  METH_VARARGS | METH_KEYWORDS),
+      PYMETHODDEF_ENTRY(,_image_transformation_map,METH_VARARGS | METH_KEYWORDS),
+      PYMETHODDEF_ENTRY(,_transform_image,         METH_VARARGS | METH_KEYWORDS),
+      PYMETHODDEF_ENTRY(,_transformation_map_compact,METH_VARARGS),
       {}
     };
 
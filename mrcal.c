@@ -8,9 +8,18 @@
 #include <stdbool.h>
 #include <math.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "mrcal.h"
 #include "minimath/minimath.h"
+#include "solver.h"
 
 // These are parameter variable scales. They have the units of the parameters
 // themselves, so the optimizer sees x/SCALE_X for each parameter. I.e. as far
@@ -448,26 +457,14 @@ int mrcal_num_measurements(int Nobservations_board,
                                               lensmodel);
 }
 
-int _mrcal_num_j_nonzero(int Nobservations_board,
-                         int Nobservations_point,
-                         int calibration_object_width_n,
-                         int calibration_object_height_n,
-                         int Ncameras_intrinsics, int Ncameras_extrinsics,
-                         int Nframes,
-                         int Npoints, int Npoints_fixed,
-                         const mrcal_observation_board_t* observations_board,
-                         const mrcal_observation_point_t* observations_point,
-                         mrcal_problem_selections_t problem_selections,
-                         mrcal_lensmodel_t lensmodel)
-{
-    // each observation depends on all the parameters for THAT frame and for
-    // THAT camera. Camera0 doesn't have extrinsics, so I need to loop through
-    // all my observations
-
-    // Each projected point has an x and y measurement, and each one depends on
-    // some number of the intrinsic parameters. Parametric models are simple:
-    // each one depends on ALL of the intrinsics. Splined models are sparse,
-    // however, and there's only a partial dependence
+// The number of intrinsics parameters each projected-point measurement depends
+// on. Each projected point has an x and y measurement, and each one depends on
+// some number of the intrinsic parameters. Parametric models are simple: each
+// one depends on ALL of the intrinsics. Splined models are sparse, however, and
+// there's only a partial dependence
+static int num_intrinsics_optimization_params_per_measurement(mrcal_problem_selections_t problem_selections,
+                                                              mrcal_lensmodel_t lensmodel)
+{
     int Nintrinsics_per_measurement;
     if(lensmodel.type == MRCAL_LENSMODEL_SPLINED_STEREOGRAPHIC)
     {
@@ -486,42 +483,88 @@ int _mrcal_num_j_nonzero(int Nobservations_board,
         modelHasCore_fxfycxcy(lensmodel) )
         Nintrinsics_per_measurement -= 2;
 
-    int N = Nobservations_board * ( (problem_selections.do_optimize_frames         ? 6 : 0) +
-                                    (problem_selections.do_optimize_extrinsics     ? 6 : 0) +
-                                    (problem_selections.do_optimize_calobject_warp ? 2 : 0) +
-                                  Nintrinsics_per_measurement );
-
-    // initial estimate counts extrinsics for the reference camera, which need
-    // to be subtracted off
-    if(problem_selections.do_optimize_extrinsics)
-        for(int i=0; i<Nobservations_board; i++)
-            if(observations_board[i].icam.extrinsics < 0)
-                N -= 6;
+    return Nintrinsics_per_measurement;
+}
+
+// The number of non-zero jacobian entries produced by one board observation.
+// Each observation depends on all the parameters for THAT frame and for THAT
+// camera. Camera0 doesn't have extrinsics
+static int num_j_nonzero_observation_board(const mrcal_observation_board_t* observation,
+                                           int calibration_object_width_n,
+                                           int calibration_object_height_n,
+                                           mrcal_problem_selections_t problem_selections,
+                                           int Nintrinsics_per_measurement)
+{
+    int N =
+        (problem_selections.do_optimize_frames         ? 6 : 0) +
+        (problem_selections.do_optimize_calobject_warp ? 2 : 0) +
+        Nintrinsics_per_measurement;
+    if( problem_selections.do_optimize_extrinsics &&
+        observation->icam.extrinsics >= 0 )
+        N += 6;
+
     // *2 because I have separate x and y measurements
-    N *= 2*calibration_object_width_n*calibration_object_height_n;
+    return N * 2*calibration_object_width_n*calibration_object_height_n;
+}
 
-    // Now the point observations
-    for(int i=0; i<Nobservations_point; i++)
-    {
-        N += 2*Nintrinsics_per_measurement;
-        if( problem_selections.do_optimize_frames &&
-            observations_point[i].i_point < Npoints-Npoints_fixed )
-            N += 2*3;
-        if( problem_selections.do_optimize_extrinsics &&
-            observations_point[i].icam.extrinsics >= 0 )
-            N += 2*6;
+// The number of non-zero jacobian entries produced by one point observation:
+// the x and y reprojection errors and the range normalization
+static int num_j_nonzero_observation_point(const mrcal_observation_point_t* observation,
+                                           int Npoints, int Npoints_fixed,
+                                           mrcal_problem_selections_t problem_selections,
+                                           int Nintrinsics_per_measurement)
+{
+    int N = 2*Nintrinsics_per_measurement;
+    if( problem_selections.do_optimize_frames &&
+        observation->i_point < Npoints-Npoints_fixed )
+        N += 2*3;
+    if( problem_selections.do_optimize_extrinsics &&
+        observation->icam.extrinsics >= 0 )
+        N += 2*6;
+
+    // range normalization
+    if(problem_selections.do_optimize_frames &&
+       observation->i_point < Npoints-Npoints_fixed )
+        N += 3;
+    if( problem_selections.do_optimize_extrinsics &&
+        observation->icam.extrinsics >= 0 )
+        N += 6;
 
-        // range normalization
-        if(problem_selections.do_optimize_frames &&
-            observations_point[i].i_point < Npoints-Npoints_fixed )
-            N += 3;
-        if( problem_selections.do_optimize_extrinsics &&
-            observations_point[i].icam.extrinsics >= 0 )
-            N += 6;
-    }
+    return N;
+}
+
+int64_t _mrcal_num_j_nonzero(int Nobservations_board,
+                             int Nobservations_point,
+                             int calibration_object_width_n,
+                             int calibration_object_height_n,
+                             int Ncameras_intrinsics, int Ncameras_extrinsics,
+                             int Nframes,
+                             int Npoints, int Npoints_fixed,
+                             const mrcal_observation_board_t* observations_board,
+                             const mrcal_observation_point_t* observations_point,
+                             mrcal_problem_selections_t problem_selections,
+                             mrcal_lensmodel_t lensmodel)
+{
+    // optimizer_callback() splits the observations between threads using these
+    // same per-observation counts. The two MUST stay consistent
+    const int Nintrinsics_per_measurement =
+        num_intrinsics_optimization_params_per_measurement(problem_selections,
+                                                           lensmodel);
+    int64_t N = 0;
+    for(int i=0; i<Nobservations_board; i++)
+        N += num_j_nonzero_observation_board(&observations_board[i],
+                                             calibration_object_width_n,
+                                             calibration_object_height_n,
+                                             problem_selections,
+                                             Nintrinsics_per_measurement);
+    for(int i=0; i<Nobservations_point; i++)
+        N += num_j_nonzero_observation_point(&observations_point[i],
+                                             Npoints, Npoints_fixed,
+                                             problem_selections,
+                                             Nintrinsics_per_measurement);
 
     N +=
-        Ncameras_intrinsics *
+        (int64_t)Ncameras_intrinsics *
         num_regularization_terms_percamera(problem_selections,
                                            lensmodel);
 
@@ -692,19 +735,15 @@ void sample_bspline_surface_quadratic(double* out,
         interp(dout_dy, ABCx,     ABCgrady);
 }
 
+// A rotation matrix R = R_from_r(r), and its gradient dR/dr. Converting the
+// Rodrigues vectors is the expensive part of the geometry in project(), so
+// the optimizer callback does it once per camera and once per frame, and not
+// once per observation
 typedef struct
 {
-    double _d_rj_rf[3*3];
-    double _d_rj_rc[3*3];
-    double _d_tj_tf[3*3];
-    double _d_tj_rc[3*3];
-
-    // _d_tj_tc is always identity
-    // _d_tj_rf is always 0
-    // _d_rj_tf is always 0
-    // _d_rj_tc is always 0
-
-} geometric_gradients_t;
+    double R    [3*3];
+    double d_R_r[9*3];
+} rotation_precomputed_t;
 
 // The implementation of _mrcal_project_internal_opencv is based on opencv. The
 // sources have been heavily modified, but the opencv logic remains. This
@@ -742,9 +781,11 @@ typedef struct
 // and on any theory of liability, whether in contract, strict liability,
 // or tort (including negligence or otherwise) arising in any way out of
 
-// NOT A PART OF THE EXTERNAL API. This is exported for the mrcal python wrapper
-// only
-void _mrcal_project_internal_opencv( // outputs
+// The implementation of _mrcal_project_internal_opencv(). This is inlined into
+// the projection functions specialized for each lens model, so Nintrinsics is
+// a constant there, and the unused coefficients are folded away
+static inline __attribute__((always_inline))
+void project_opencv( // outputs
                                     mrcal_point2_t* q,
                                     mrcal_point3_t* dq_dp,               // may be NULL
                                     double* dq_dintrinsics_nocore, // may be NULL
@@ -848,8 +889,138 @@ void _mrcal_project_internal_opencv( // outputs
     }
 }
 
+// NOT A PART OF THE EXTERNAL API. This is exported for the mrcal python wrapper
+// only
+void _mrcal_project_internal_opencv( // outputs
+                                    mrcal_point2_t* q,
+                                    mrcal_point3_t* dq_dp,               // may be NULL
+                                    double* dq_dintrinsics_nocore, // may be NULL
+
+                                    // inputs
+                                    const mrcal_point3_t* p,
+                                    int N,
+                                    const double* intrinsics,
+                                    int Nintrinsics)
+{
+    project_opencv(q, dq_dp, dq_dintrinsics_nocore,
+                   p, N, intrinsics, Nintrinsics);
+}
+
+// The batch projection kernels. The same code is compiled for each SIMD width
+// we support. The x86 SIMD variants are compiled for their target ISA
+// regardless of the flags the library was built with, and
+// project_batch_nlanes() picks one at runtime, based on what the CPU can do
+#define PROJECT_BATCH_KERNEL project_batch_kernel_1
+#define PROJECT_BATCH_NLANES 1
+#include "mrcal_project_batch_kernel.h"
+#undef PROJECT_BATCH_KERNEL
+#undef PROJECT_BATCH_NLANES
+
+#if defined __x86_64__ || defined __i386__
+#define PROJECT_BATCH_HAVE_X86_SIMD 1
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define PROJECT_BATCH_KERNEL project_batch_kernel_4
+#define PROJECT_BATCH_NLANES 4
+#include "mrcal_project_batch_kernel.h"
+#undef PROJECT_BATCH_KERNEL
+#undef PROJECT_BATCH_NLANES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define PROJECT_BATCH_KERNEL project_batch_kernel_8
+#define PROJECT_BATCH_NLANES 8
+#include "mrcal_project_batch_kernel.h"
+#undef PROJECT_BATCH_KERNEL
+#undef PROJECT_BATCH_NLANES
+#pragma GCC pop_options
+#endif
+
+// The widest batch-projection kernel this CPU can run
+static int project_batch_nlanes(void)
+{
+#if defined PROJECT_BATCH_HAVE_X86_SIMD
+    // This is cached. Races are benign: everybody computes the same answer
+    static int Nlanes = 0;
+    if(Nlanes == 0)
+    {
+        if(__builtin_cpu_supports("avx512f"))
+            Nlanes = 8;
+        else if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            Nlanes = 4;
+        else
+            Nlanes = 1;
+    }
+    return Nlanes;
+#else
+    return 1;
+#endif
+}
+
+// NOT A PART OF THE EXTERNAL API. This is exported for the tests only, to be
+// able to exercise each kernel explicitly. Nlanes selects the kernel; <= 0
+// means "the best one available". Returns false if the requested kernel isn't
+// available here
+bool _mrcal_project_batch_internal( // out
+                                   mrcal_point2_t* q,
+                                   mrcal_point3_t* dq_dp,
+                                   double*         dq_dintrinsics,
+
+                                   // in
+                                   const double* px,
+                                   const double* py,
+                                   const double* pz,
+                                   int stride,
+                                   int N,
+                                   const double* intrinsics,
+                                   int Nintrinsics,
+                                   int Nlanes)
+{
+    if(Nlanes <= 0)
+        Nlanes = project_batch_nlanes();
+
+    void (*kernel)(mrcal_point2_t*, mrcal_point3_t*, double*,
+                   const double*, const double*, const double*, int, int,
+                   const double*, int);
+    switch(Nlanes)
+    {
+    case 1: kernel = &project_batch_kernel_1; break;
+#if defined PROJECT_BATCH_HAVE_X86_SIMD
+    case 4:
+        if(!(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")))
+            return false;
+        kernel = &project_batch_kernel_4;
+        break;
+    case 8:
+        if(!__builtin_cpu_supports("avx512f"))
+            return false;
+        kernel = &project_batch_kernel_8;
+        break;
+#endif
+    default:
+        return false;
+    }
+
+    // The bulk of the points go through the SIMD kernel. The few left over go
+    // through the scalar one
+    const int Nbulk = N - N%Nlanes;
+    kernel(q, dq_dp, dq_dintrinsics,
+           px, py, pz, stride, Nbulk,
+           intrinsics, Nintrinsics);
+    if(Nbulk < N)
+        project_batch_kernel_1(&q[Nbulk],
+                               dq_dp          != NULL ? &dq_dp[2*Nbulk]                      : NULL,
+                               dq_dintrinsics != NULL ? &dq_dintrinsics[2*Nbulk*Nintrinsics] : NULL,
+                               &px[Nbulk*stride], &py[Nbulk*stride], &pz[Nbulk*stride], stride,
+                               N - Nbulk,
+                               intrinsics, Nintrinsics);
+    return true;
+}
+
 // These are all internals for project(). It was getting unwieldy otherwise
-static
+static inline __attribute__((always_inline))
 void _project_point_parametric( // outputs
                                mrcal_point2_t* q,
                                mrcal_point2_t* dq_dfxy, double* dq_dintrinsics_nocore,
@@ -866,6 +1037,7 @@ void _project_point_parametric( // outputs
                                const mrcal_point3_t* dp_dtf,
 
                                const double* restrict intrinsics,
+                               int Nintrinsics,
                                bool camera_at_identity,
                                mrcal_lensmodel_t lensmodel)
 {
@@ -903,12 +1075,9 @@ void _project_point_parametric( // outputs
                                         p, 1, fx,fy,cx,cy);
         }
         else
-        {
-            int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
-            _mrcal_project_internal_opencv( q, dq_dp,
-                                            dq_dintrinsics_nocore,
-                                            p, 1, intrinsics, Nintrinsics);
-        }
+            project_opencv( q, dq_dp,
+                            dq_dintrinsics_nocore,
+                            p, 1, intrinsics, Nintrinsics);
 
         // dq/deee = dq/dp dp/deee
         if(camera_at_identity)
@@ -937,7 +1106,7 @@ void _project_point_parametric( // outputs
     }
     else if( lensmodel.type == MRCAL_LENSMODEL_CAHVOR )
     {
-        int NdistortionParams = mrcal_lensmodel_num_params(lensmodel) - 4;
+        const int NdistortionParams = Nintrinsics - 4;
 
         // I perturb p, and then apply the focal length, center pixel stuff
         // normally
@@ -1595,6 +1764,369 @@ void _project_point_splined( // outputs
     }
 }
 
+// The batched splined evaluator bins SPLINED_BATCH_CHUNK points at a time by
+// spline cell, and processes the points of each cell in blocks of
+// SPLINED_BATCH_BLOCK points
+#define SPLINED_BATCH_CHUNK 1024
+#define SPLINED_BATCH_BLOCK 64
+
+// Computes the spline basis weights (and their derivatives) for n points at a
+// time. This is the same math as get_sample_coeffs() in
+// sample_bspline_surface_cubic() and sample_bspline_surface_quadratic(), but
+// laid out as a loop over points that the compiler can vectorize. With
+// quadratic splines only the first 3 rows are used
+static void splined_batch_basis( // out
+                                 double ABCD    [4][SPLINED_BATCH_BLOCK],
+                                 double ABCDgrad[4][SPLINED_BATCH_BLOCK],
+
+                                 // in
+                                 const double* x,
+                                 int n,
+                                 int spline_order)
+{
+    if(spline_order == 3)
+        for(int i=0; i<n; i++)
+        {
+            double x1 = x[i];
+            double x2 = x1*x1;
+            double x3 = x2*x1;
+            ABCD[0][i] =  (-x3 + 3*x2 - 3*x1 + 1)/6;
+            ABCD[1][i] = (3 * x3/2 - 3*x2 + 2)/3;
+            ABCD[2][i] = (-3 * x3 + 3*x2 + 3*x1 + 1)/6;
+            ABCD[3][i] = x3 / 6;
+
+            ABCDgrad[0][i] =  -x2/2 + x1 - 1./2.;
+            ABCDgrad[1][i] = 3*x2/2 - 2*x1;
+            ABCDgrad[2][i] = -3*x2/2 + x1 + 1./2.;
+            ABCDgrad[3][i] = x2 / 2;
+        }
+    else
+        for(int i=0; i<n; i++)
+        {
+            double x1 = x[i];
+            double x2 = x1*x1;
+            ABCD[0][i] = (4*x2 - 4*x1 + 1)/8;
+            ABCD[1][i] = (3 - 4*x2)/4;
+            ABCD[2][i] = (4*x2 + 4*x1 + 1)/8;
+
+            ABCDgrad[0][i] = x1 - 1./2.;
+            ABCDgrad[1][i] = -2.*x1;
+            ABCDgrad[2][i] = x1 + 1./2.;
+        }
+}
+
+// Samples both spline surfaces at point i of the current block: L control
+// points along x, and then one sample along y, as in interp() in
+// sample_bspline_surface_cubic(). The x-interpolated control points are shared
+// by the value and by d/dy, so I compute them once. If ddeltau_dix is NULL, the
+// gradients are not computed. L is a compile-time constant at each call site,
+// so the loops unroll
+static inline
+void splined_batch_sample(// out
+                          double* deltau,
+                          double* ddeltau_dix, // may be NULL
+                          double* ddeltau_diy,
+
+                          // in
+                          const double ABCDx    [4][SPLINED_BATCH_BLOCK],
+                          const double ABCDy    [4][SPLINED_BATCH_BLOCK],
+                          const double ABCDgradx[4][SPLINED_BATCH_BLOCK],
+                          const double ABCDgrady[4][SPLINED_BATCH_BLOCK],
+                          int i,
+
+                          // control points
+                          const double* c,
+                          int stridey,
+                          const int L)
+{
+    const int stridex = 2;
+
+    double cinterp[4][2];
+    for(int iy=0; iy<L; iy++)
+        for(int k=0;k<2;k++)
+        {
+            cinterp[iy][k] = ABCDx[0][i] * c[iy*stridey + 0*stridex + k];
+            for(int ix=1; ix<L; ix++)
+                cinterp[iy][k] += ABCDx[ix][i] * c[iy*stridey + ix*stridex + k];
+        }
+    for(int k=0;k<2;k++)
+    {
+        deltau[k] = ABCDy[0][i] * cinterp[0][k];
+        for(int iy=1; iy<L; iy++)
+            deltau[k] += ABCDy[iy][i] * cinterp[iy][k];
+    }
+
+    if(ddeltau_dix == NULL) return;
+
+    for(int k=0;k<2;k++)
+    {
+        ddeltau_diy[k] = ABCDgrady[0][i] * cinterp[0][k];
+        for(int iy=1; iy<L; iy++)
+            ddeltau_diy[k] += ABCDgrady[iy][i] * cinterp[iy][k];
+    }
+
+    for(int iy=0; iy<L; iy++)
+        for(int k=0;k<2;k++)
+        {
+            cinterp[iy][k] = ABCDgradx[0][i] * c[iy*stridey + 0*stridex + k];
+            for(int ix=1; ix<L; ix++)
+                cinterp[iy][k] += ABCDgradx[ix][i] * c[iy*stridey + ix*stridex + k];
+        }
+    for(int k=0;k<2;k++)
+    {
+        ddeltau_dix[k] = ABCDy[0][i] * cinterp[0][k];
+        for(int iy=1; iy<L; iy++)
+            ddeltau_dix[k] += ABCDy[iy][i] * cinterp[iy][k];
+    }
+}
+
+// NOT A PART OF THE EXTERNAL API. Batched LENSMODEL_SPLINED_STEREOGRAPHIC
+// projection. See the docs in mrcal_internal.h
+//
+// _project_point_splined() looks up the spline cell, computes the basis weights
+// and reads the control points separately for each point. When projecting many
+// points (dense image maps, say) it's much better to take the points
+// SPLINED_BATCH_CHUNK at a time, and for each chunk
+//
+// 1. Compute the stereographic projection u and the spline cell of all the
+//    points in one pass over the arrays
+// 2. Bin the points by spline cell, with a counting sort
+// 3. Go through the cells. For each one, compute the basis weights of all its
+//    points together in a vectorizable loop, and evaluate the surfaces at each
+//    of these points while the cell's control-point block is hot in cache
+//
+// I bin each chunk separately instead of binning all N points at once: the
+// outputs are then written in a small window of memory that stays in cache.
+// Neighboring points usually live in neighboring cells, so each chunk touches
+// only a narrow range of cells, and I only bin over that range
+//
+// The math is identical to _project_point_splined()
+bool _mrcal_project_splined_batch( // out
+                                  mrcal_point2_t* q,
+                                  mrcal_point3_t* dq_dp,
+                                  mrcal_point2_t* dq_dfxy,
+                                  int*            ivar0,
+                                  double*         grad_ABCDx_ABCDy,
+
+                                  // in
+                                  const mrcal_point3_t* p,
+                                  int N,
+                                  const mrcal_LENSMODEL_SPLINED_STEREOGRAPHIC__config_t* config,
+                                  const double* intrinsics,
+                                  const mrcal_LENSMODEL_SPLINED_STEREOGRAPHIC__precomputed_t* precomputed)
+{
+    const int spline_order = config->order;
+    if(spline_order != 2 && spline_order != 3)
+    {
+        MSG("I only support spline order==2 or 3. Somehow got %d. This is a bug. Barfing",
+            spline_order);
+        return false;
+    }
+    if(N <= 0) return true;
+
+    const int    Nx             = config->Nx;
+    const int    Ny             = config->Ny;
+    const int    L              = spline_order + 1;
+    const double segments_per_u = precomputed->segments_per_u;
+    const double fx = intrinsics[0];
+    const double fy = intrinsics[1];
+    const double cx = intrinsics[2];
+    const double cy = intrinsics[3];
+
+    // Each cell is identified by its (ix0,iy0): cell = iy0*Nx + ix0
+    const int Ncells = Nx*Ny;
+
+    double* ux = malloc( 4*SPLINED_BATCH_CHUNK*sizeof(double) +
+                         (2*SPLINED_BATCH_CHUNK + Ncells+1)*sizeof(int) );
+    if(ux == NULL)
+    {
+        MSG("Couldn't allocate the scratch space");
+        return false;
+    }
+    double* uy         = &ux[  SPLINED_BATCH_CHUNK];
+    // The position of each point inside its cell
+    double* tx         = &ux[2*SPLINED_BATCH_CHUNK];
+    double* ty         = &ux[3*SPLINED_BATCH_CHUNK];
+    int*    cell       = (int*)&ux[4*SPLINED_BATCH_CHUNK];
+    int*    perm       = &cell[SPLINED_BATCH_CHUNK];
+    int*    cell_start = &perm[SPLINED_BATCH_CHUNK];
+
+    double ABCDx    [4][SPLINED_BATCH_BLOCK];
+    double ABCDy    [4][SPLINED_BATCH_BLOCK];
+    double ABCDgradx[4][SPLINED_BATCH_BLOCK];
+    double ABCDgrady[4][SPLINED_BATCH_BLOCK];
+    double txblock  [SPLINED_BATCH_BLOCK];
+    double tyblock  [SPLINED_BATCH_BLOCK];
+
+    for(int i_chunk0=0; i_chunk0<N; i_chunk0 += SPLINED_BATCH_CHUNK)
+    {
+        const int Nchunk =
+            N-i_chunk0 < SPLINED_BATCH_CHUNK ?
+            N-i_chunk0 : SPLINED_BATCH_CHUNK;
+        const mrcal_point3_t* pchunk = &p[i_chunk0];
+
+        // Pass 1: the stereographic projection and the cell of each point. See
+        // _project_point_splined() for the derivation. Out-of-bounds points
+        // clamp to the nearest valid spline segment
+        for(int i=0; i<Nchunk; i++)
+        {
+            double mag_p = sqrt( pchunk[i].x*pchunk[i].x +
+                                 pchunk[i].y*pchunk[i].y +
+                                 pchunk[i].z*pchunk[i].z );
+            double scale = 2.0 / (mag_p + pchunk[i].z);
+            ux[i] = pchunk[i].x * scale;
+            uy[i] = pchunk[i].y * scale;
+
+            double ix = ux[i]*segments_per_u + (double)(Nx-1)/2.;
+            double iy = uy[i]*segments_per_u + (double)(Ny-1)/2.;
+            int ix0, iy0;
+            if(spline_order == 3)
+            {
+                ix0 = (int)ix;
+                iy0 = (int)iy;
+            }
+            else
+            {
+                ix0 = (int)(ix + 0.5);
+                iy0 = (int)(iy + 0.5);
+            }
+            if(     ix0 < 1)               ix0 = 1;
+            else if(ix0 > Nx-spline_order) ix0 = Nx-spline_order;
+            if(     iy0 < 1)               iy0 = 1;
+            else if(iy0 > Ny-spline_order) iy0 = Ny-spline_order;
+
+            tx  [i] = ix - ix0;
+            ty  [i] = iy - iy0;
+            cell[i] = iy0*Nx + ix0;
+        }
+
+        int cell_min = cell[0];
+        int cell_max = cell[0];
+        for(int i=1; i<Nchunk; i++)
+        {
+            if(cell[i] < cell_min) cell_min = cell[i];
+            if(cell[i] > cell_max) cell_max = cell[i];
+        }
+
+        // Pass 2: bin the points by cell. When done, the points in cell c are
+        // perm[cell_start[c-1-cell_min] .. cell_start[c-cell_min]-1]
+        const int Ncells_chunk = cell_max - cell_min + 1;
+        memset(cell_start, 0, (Ncells_chunk+1)*sizeof(int));
+        for(int i=0; i<Nchunk; i++)
+            cell_start[cell[i]-cell_min+1]++;
+        for(int c=0; c<Ncells_chunk; c++)
+            cell_start[c+1] += cell_start[c];
+        for(int i=0; i<Nchunk; i++)
+            perm[ cell_start[cell[i]-cell_min]++ ] = i;
+
+        // Pass 3: evaluate the surfaces, one cell at a time
+        int istart = 0;
+        for(int c=0; c<Ncells_chunk; c++)
+        {
+            const int iend = cell_start[c];
+            if(iend == istart) continue;
+
+            const int ix0 = (c+cell_min) % Nx;
+            const int iy0 = (c+cell_min) / Nx;
+            const int ivar0_cell =
+                4 + // skip the core
+                2*( (iy0-1)*Nx +
+                    (ix0-1) );
+            const double* cp = &intrinsics[ivar0_cell];
+
+            for(int i0=istart; i0<iend; i0 += SPLINED_BATCH_BLOCK)
+            {
+                const int n =
+                    iend-i0 < SPLINED_BATCH_BLOCK ?
+                    iend-i0 : SPLINED_BATCH_BLOCK;
+
+                for(int j=0; j<n; j++)
+                {
+                    txblock[j] = tx[perm[i0+j]];
+                    tyblock[j] = ty[perm[i0+j]];
+                }
+                splined_batch_basis(ABCDx, ABCDgradx, txblock, n, spline_order);
+                splined_batch_basis(ABCDy, ABCDgrady, tyblock, n, spline_order);
+
+                for(int j=0; j<n; j++)
+                {
+                    const int ichunk = perm[i0+j];
+                    const int i      = i_chunk0 + ichunk;
+
+                    mrcal_point2_t deltau;
+                    double ddeltau_dux[2];
+                    double ddeltau_duy[2];
+                    double* ddeltau_dix = dq_dp != NULL ? ddeltau_dux : NULL;
+                    if(spline_order == 3)
+                        splined_batch_sample(deltau.xy, ddeltau_dix, ddeltau_duy,
+                                             ABCDx, ABCDy, ABCDgradx, ABCDgrady, j,
+                                             cp, 2*Nx, 4);
+                    else
+                        splined_batch_sample(deltau.xy, ddeltau_dix, ddeltau_duy,
+                                             ABCDx, ABCDy, ABCDgradx, ABCDgrady, j,
+                                             cp, 2*Nx, 3);
+
+                    q[i].x = (ux[ichunk] + deltau.x) * fx + cx;
+                    q[i].y = (uy[ichunk] + deltau.y) * fy + cy;
+
+                    if(dq_dfxy != NULL)
+                    {
+                        dq_dfxy[i].x = ux[ichunk] + deltau.x;
+                        dq_dfxy[i].y = uy[ichunk] + deltau.y;
+                    }
+                    if(ivar0 != NULL)
+                        ivar0[i] = ivar0_cell;
+                    if(grad_ABCDx_ABCDy != NULL)
+                        for(int k=0; k<L; k++)
+                        {
+                            grad_ABCDx_ABCDy[i*2*L +     k] = ABCDx[k][j];
+                            grad_ABCDx_ABCDy[i*2*L + L + k] = ABCDy[k][j];
+                        }
+
+                    if(dq_dp == NULL) continue;
+
+                    // convert ddeltau_dixy to ddeltau_duxy
+                    for(int k=0; k<2; k++)
+                    {
+                        ddeltau_dux[k] *= segments_per_u;
+                        ddeltau_duy[k] *= segments_per_u;
+                    }
+
+                    // du/dp. Same as in _project_point_splined()
+                    double mag_p = sqrt( p[i].x*p[i].x +
+                                         p[i].y*p[i].y +
+                                         p[i].z*p[i].z );
+                    double scale = 2.0 / (mag_p + p[i].z);
+                    double A = -scale*scale / 2.;
+                    double B = A / mag_p;
+                    double du_dp[2][3] = { { p[i].x * (B * p[i].x)      + scale,
+                                             p[i].x * (B * p[i].y),
+                                             p[i].x * (B * p[i].z + A) },
+                                           { p[i].y * (B * p[i].x),
+                                             p[i].y * (B * p[i].y)      + scale,
+                                             p[i].y * (B * p[i].z + A) } };
+                    for(int k=0; k<3; k++)
+                    {
+                        dq_dp[2*i + 0].xyz[k] =
+                            fx *
+                            ( du_dp[0][k] * (1. + ddeltau_dux[0]) +
+                              ddeltau_duy[0] * du_dp[1][k]);
+                        dq_dp[2*i + 1].xyz[k] =
+                            fy *
+                            ( du_dp[1][k] * (1. + ddeltau_duy[1]) +
+                              ddeltau_dux[1] * du_dp[0][k]);
+                    }
+                }
+            }
+
+            istart = iend;
+        }
+    }
+
+    free(ux);
+    return true;
+}
+
 typedef struct
 {
     double* pool;
@@ -1602,6 +2134,53 @@ typedef struct
     uint16_t ivar_stridey;
 } gradient_sparse_meta_t;
 
+// Computes the reference geometry of the calibration object: a grid of
+// calibration_object_width_n*calibration_object_height_n points,
+// calibration_object_spacing apart, flexed by calobject_warp. The board is
+// flat if calobject_warp is NULL. The warp moves each point along z only, so
+// dpt_ref2_dwarp reports d(pt_ref.z)/dcalobject_warp. This doesn't depend on
+// the warp, and is computed even if calobject_warp is NULL
+static void
+calibration_object_points( // out
+                          mrcal_point3_t* pt_ref,
+                          mrcal_point2_t* dpt_ref2_dwarp,
+
+                          // in
+                          const mrcal_point2_t* calobject_warp,
+                          double calibration_object_spacing,
+                          int    calibration_object_width_n,
+                          int    calibration_object_height_n)
+{
+    int i_pt = 0;
+    // The calibration object has a simple grid geometry
+    for(int y = 0; y<calibration_object_height_n; y++)
+        for(int x = 0; x<calibration_object_width_n; x++)
+        {
+            // Add a board warp here. I have two parameters, and they describe
+            // additive flex along the x axis and along the y axis, in that
+            // order. In each direction the flex is a parabola, with the
+            // parameter k describing the max deflection at the center. If the
+            // ends are at +- 1 I have d = k*(1 - x^2). If the ends are at
+            // (0,N-1) the equivalent expression is: d = k*( 1 - 4*x^2/(N-1)^2 +
+            // 4*x/(N-1) - 1 ) = d = 4*k*(x/(N-1) - x^2/(N-1)^2) = d =
+            // 4.*k*x*r(1. - x*r)
+            double xr = (double)x / (double)(calibration_object_width_n -1);
+            double yr = (double)y / (double)(calibration_object_height_n-1);
+            double dx = 4. * xr * (1. - xr);
+            double dy = 4. * yr * (1. - yr);
+
+            pt_ref[i_pt] = (mrcal_point3_t){.x = (double)x * calibration_object_spacing,
+                                            .y = (double)y * calibration_object_spacing};
+            if(calobject_warp != NULL)
+            {
+                pt_ref[i_pt].z += calobject_warp->x * dx;
+                pt_ref[i_pt].z += calobject_warp->y * dy;
+            }
+            dpt_ref2_dwarp[i_pt] = (mrcal_point2_t){.x = dx, .y = dy};
+            i_pt++;
+        }
+}
+
 // Projects 3D point(s), and reports the projection, and all the gradients. This
 // is the main internal callback in the optimizer. This operates in one of two modes:
 //
@@ -1612,9 +2191,16 @@ typedef struct
 // if(calibration_object_width_n > 0) then we're projecting a whole calibration
 // object. The pose of this object is given in frame_rt. We project ALL
 // calibration_object_width_n*calibration_object_height_n points. q and the
-// gradients reference ALL of these points
-static
-void project( // out
+// gradients reference ALL of these points. The geometry of the object comes
+// from calibration_object_points(): the optimizer computes it once per callback,
+// and shares it among all the observations
+//
+// This isn't called directly. It is compiled separately for each lens model in
+// the _project__LENSMODEL_...() functions below, with the model type and the
+// parameter count known at compile time. Thus the model dispatch and the unused
+// distortion terms are folded away. project_function() picks the right one
+static inline __attribute__((always_inline))
+void _project( // out
              mrcal_point2_t* restrict q,
 
              // The intrinsics gradients. These are split among several arrays.
@@ -1642,13 +2228,23 @@ void project( // out
              const double* restrict intrinsics,
              const mrcal_pose_t* restrict camera_rt,
              const mrcal_pose_t* restrict frame_rt,
-             const mrcal_point2_t* restrict calobject_warp,
 
-             bool camera_at_identity, // if true, camera_rt is unused
+             // The calibration object points, from calibration_object_points().
+             // Used only if calibration_object_width_n > 0. dcalobject_ref_dwarp
+             // may be NULL if we don't want dq_dcalobject_warp
+             const mrcal_point3_t* restrict calobject_ref,
+             const mrcal_point2_t* restrict dcalobject_ref_dwarp,
+
+             // R_from_r() of camera_rt->r and frame_rt->r. Either may be NULL,
+             // and then it is computed here
+             const rotation_precomputed_t* restrict camera_R,
+             const rotation_precomputed_t* restrict frame_R,
+
+             bool camera_at_identity, // if true, camera_rt, camera_R are unused
              mrcal_lensmodel_t lensmodel,
+             int Nintrinsics, // mrcal_lensmodel_num_params(lensmodel)
              const mrcal_projection_precomputed_t* precomputed,
 
-             double calibration_object_spacing,
              int    calibration_object_width_n,
              int    calibration_object_height_n)
 {
@@ -1683,7 +2279,6 @@ void project( // out
     const int Npoints =
         calibration_object_width_n ?
         calibration_object_width_n*calibration_object_height_n : 1;
-    const int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
 
     // I need to compose two transformations
     //
@@ -1697,13 +2292,12 @@ void project( // out
     // [Rc tc] [Rf tf] = [Rc*Rf  Rc*tf + tc]
     // [0  1 ] [0  1 ]   [0      1         ]
     //
-    // This transformation (and its gradients) is handled by mrcal_compose_rt()
-    // I refer to the camera*frame transform as the "joint" transform, or the
-    // letter j
-    geometric_gradients_t gg;
-
-    double _joint_rt[6];
-    double* joint_rt;
+    // I compose the rotation matrices directly, and propagate the gradients
+    // through dRc/drc and dRf/drf. I never need the Rodrigues vector of the
+    // joint transform. I refer to the camera*frame transform as the "joint"
+    // transform, or the letter j
+    //
+    // When projecting discrete points, the "frame" has no rotation: Rf = I
 
     // The caller has an odd-looking array reference [-3]. This is intended, but
     // the compiler throws a warning. I silence it here. gcc-10 produces a very
@@ -1711,39 +2305,41 @@ void project( // out
     // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=97261
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Warray-bounds"
-    mrcal_pose_t frame_rt_validr = {.t = frame_rt->t};
+    const double* tf = frame_rt->t.xyz;
 #pragma GCC diagnostic pop
-    if(calibration_object_width_n) frame_rt_validr.r = frame_rt->r;
 
-    if(!camera_at_identity)
+    rotation_precomputed_t _camera_R, _frame_R;
+    if(!camera_at_identity && camera_R == NULL)
     {
-        // make sure I can pass mrcal_pose_t.r as an rt[] transformation
-        static_assert( offsetof(mrcal_pose_t, r) == 0,                   "mrcal_pose_t has expected structure");
-        static_assert( offsetof(mrcal_pose_t, t) == 3*sizeof(double),    "mrcal_pose_t has expected structure");
-        mrcal_compose_rt( _joint_rt,
-                          gg._d_rj_rc, gg._d_rj_rf,
-                          gg._d_tj_rc, gg._d_tj_tf,
-                          camera_rt     ->r.xyz,
-                          frame_rt_validr.r.xyz);
-        joint_rt = _joint_rt;
+        mrcal_R_from_r(_camera_R.R, _camera_R.d_R_r, camera_rt->r.xyz);
+        camera_R = &_camera_R;
     }
-    else
+    if(calibration_object_width_n && frame_R == NULL)
     {
-        // We're looking at the reference frame, so this camera transform is
-        // fixed at the identity. We don't need to compose anything, nor
-        // propagate gradients for the camera extrinsics, since those don't
-        // exist in the parameter vector
-
-        // Here the "joint" transform is just the "frame" transform
-        joint_rt = frame_rt_validr.r.xyz;
+        mrcal_R_from_r(_frame_R.R, _frame_R.d_R_r, frame_rt->r.xyz);
+        frame_R = &_frame_R;
     }
 
-    // Not using OpenCV distortions, the distortion and projection are not
-    // coupled
+    // Rj = Rc Rf, tj = Rc tf + tc
     double Rj[3*3];
-    double d_Rj_rj[9*3];
-
-    mrcal_R_from_r(Rj, d_Rj_rj, joint_rt);
+    double tj[3];
+    if(calibration_object_width_n)
+    {
+        if(!camera_at_identity) mul_genN3_gen33_vout(3, camera_R->R, frame_R->R, Rj);
+        else                    memcpy(Rj, frame_R->R, sizeof(Rj));
+    }
+    else
+    {
+        if(!camera_at_identity) memcpy(Rj, camera_R->R, sizeof(Rj));
+        else                    memcpy(Rj, ((double[]){1,0,0, 0,1,0, 0,0,1}), sizeof(Rj));
+    }
+    if(!camera_at_identity)
+    {
+        mul_vec3_gen33t_vout(tf, camera_R->R, tj);
+        add_vec(3, tj, camera_rt->t.xyz);
+    }
+    else
+        memcpy(tj, tf, sizeof(tj));
 
     mrcal_point2_t* p_dq_dfxy                  = NULL;
     double*   p_dq_dintrinsics_nocore    = NULL;
@@ -1804,72 +2400,53 @@ void project( // out
     mrcal_point3_t* dp_drf;
     mrcal_point3_t* dp_dtf;
 
-    mrcal_point3_t propagate_extrinsics( const mrcal_point3_t* pt_ref,
-                                   const geometric_gradients_t* gg,
-                                   const double* Rj, const double* d_Rj_rj,
-                                   const double* _tj )
+    mrcal_point3_t propagate_extrinsics( const mrcal_point3_t* pt_ref )
     {
         // Rj * pt + tj -> pt
         mrcal_point3_t p;
         mul_vec3_gen33t_vout(pt_ref->xyz, Rj, p.xyz);
-        add_vec(3, p.xyz,  _tj);
+        add_vec(3, p.xyz, tj);
 
-        void propagate_extrinsics_one(mrcal_point3_t* dp_dparam,
-                                      const double* drj_dparam,
-                                      const double* dtj_dparam,
-                                      const double* d_Rj_rj)
+        // dp/drf = Rc reshape(dRf/drf pt_ref). This is 0 if projecting
+        // discrete points: the frame has no rotation
+        if(calibration_object_width_n)
         {
-            // dRj[row0]/drj is 3x3 matrix at &d_Rj_rj[0]
-            // dRj[row0]/drc = dRj[row0]/drj * drj_drc
+            // dRf[row i]/drf is 3x3 matrix at &d_R_r[9*i]
+            mrcal_point3_t dpf_drf[3];
             for(int i=0; i<3; i++)
-            {
-                mul_vec3_gen33_vout( pt_ref->xyz, &d_Rj_rj[9*i], dp_dparam[i].xyz );
-                mul_vec3_gen33     ( dp_dparam[i].xyz,   drj_dparam);
-                add_vec(3, dp_dparam[i].xyz, &dtj_dparam[3*i] );
-            }
-        }
-        void propagate_extrinsics_one_rzero(mrcal_point3_t* dp_dparam,
-                                            const double* dtj_dparam,
-                                            const double* d_Rj_rj)
-        {
-            // dRj[row0]/drj is 3x3 matrix at &d_Rj_rj[0]
-            // dRj[row0]/drc = dRj[row0]/drj * drj_drc
-            memcpy(dp_dparam->xyz, dtj_dparam, 9*sizeof(double));
+                mul_vec3_gen33_vout( pt_ref->xyz, &frame_R->d_R_r[9*i], dpf_drf[i].xyz );
+            if(!camera_at_identity)
+                mul_genN3_gen33_vout(3, camera_R->R, dpf_drf[0].xyz, _dp_drf[0].xyz);
+            else
+                memcpy(_dp_drf, dpf_drf, sizeof(_dp_drf));
         }
-        void propagate_extrinsics_one_tzero(mrcal_point3_t* dp_dparam,
-                                            const double* drj_dparam,
-                                            const double* d_Rj_rj)
+        else
+            memset(_dp_drf, 0, sizeof(_dp_drf));
+
+        if(!camera_at_identity)
         {
-            // dRj[row0]/drj is 3x3 matrix at &d_Rj_rj[0]
-            // dRj[row0]/drc = dRj[row0]/drj * drj_drc
-            for(int i=0; i<3; i++)
+            //   p_cam = Rc pf + tc
+            //   pf    = Rf p_ref + tf
+            //
+            // dp/drc = reshape(dRc_drc pf)
+            // dp/dtc = I
+            // dp/dtf = Rc
+            mrcal_point3_t pf;
+            if(calibration_object_width_n)
             {
-                mul_vec3_gen33_vout( pt_ref->xyz, &d_Rj_rj[9*i], dp_dparam[i].xyz );
-                mul_vec3_gen33     ( dp_dparam[i].xyz,   drj_dparam);
+                mul_vec3_gen33t_vout(pt_ref->xyz, frame_R->R, pf.xyz);
+                add_vec(3, pf.xyz, tf);
             }
-        }
-        void propagate_extrinsics_one_rzero_tidentity(mrcal_point3_t* dp_dparam,
-                                                      const double* d_Rj_rj)
-        {
-            dp_dparam[0] = (mrcal_point3_t){.x = 1.0};
-            dp_dparam[1] = (mrcal_point3_t){.y = 1.0};
-            dp_dparam[2] = (mrcal_point3_t){.z = 1.0};
-        }
+            else
+                memcpy(pf.xyz, tf, 3*sizeof(double));
 
-        void propagate_extrinsics_one_cam0(mrcal_point3_t* dp_rf,
-                                           const double* _d_Rf_rf)
-        {
-            // dRj[row0]/drj is 3x3 matrix at &_d_Rf_rf[0]
-            // dRj[row0]/drc = dRj[row0]/drj * drj_drc
             for(int i=0; i<3; i++)
-                mul_vec3_gen33_vout( pt_ref->xyz, &_d_Rf_rf[9*i], dp_rf[i].xyz );
-        }
-        if(gg != NULL)
-        {
-            propagate_extrinsics_one(                _dp_drc, gg->_d_rj_rc, gg->_d_tj_rc, d_Rj_rj);
-            propagate_extrinsics_one_rzero_tidentity(_dp_dtc,                             d_Rj_rj);
-            propagate_extrinsics_one_tzero(          _dp_drf, gg->_d_rj_rf,               d_Rj_rj);
-            propagate_extrinsics_one_rzero(          _dp_dtf,               gg->_d_tj_tf, d_Rj_rj);
+                mul_vec3_gen33_vout( pf.xyz, &camera_R->d_R_r[9*i], _dp_drc[i].xyz );
+            _dp_dtc[0] = (mrcal_point3_t){.x = 1.0};
+            _dp_dtc[1] = (mrcal_point3_t){.y = 1.0};
+            _dp_dtc[2] = (mrcal_point3_t){.z = 1.0};
+            memcpy(_dp_dtf, camera_R->R, 9*sizeof(double));
+
             dp_drc = _dp_drc;
             dp_dtc = _dp_dtc;
             dp_drf = _dp_drf;
@@ -1886,8 +2463,6 @@ void project( // out
             // dp/dtc = 0
             // dp/drf = reshape(dRf_drf p_ref)
             // dp/dtf = I
-            propagate_extrinsics_one_cam0(_dp_drf, d_Rj_rj);
-
             dp_drc = NULL;
             dp_dtc = NULL;
             dp_drf = _dp_drf;
@@ -1957,7 +2532,7 @@ void project( // out
                                       // inputs
                                       p,
                                       dp_drc, dp_dtc, dp_drf, dp_dtf,
-                                      intrinsics,
+                                      intrinsics, Nintrinsics,
                                       camera_at_identity,
                                       lensmodel);
         }
@@ -2000,9 +2575,7 @@ void project( // out
     if( calibration_object_width_n == 0 )
     { // projecting discrete points
         mrcal_point3_t p =
-            propagate_extrinsics( &(mrcal_point3_t){},
-                                  camera_at_identity ? NULL : &gg,
-                                  Rj, d_Rj_rj, &joint_rt[3]);
+            propagate_extrinsics( &(mrcal_point3_t){} );
         project_point(  q,
                         p_dq_dfxy, p_dq_dintrinsics_nocore,
                         gradient_sparse_meta ? gradient_sparse_meta->pool : NULL,
@@ -2016,39 +2589,10 @@ void project( // out
     }
     else
     { // projecting a chessboard
-        int i_pt = 0;
-         // The calibration object has a simple grid geometry
-        for(int y = 0; y<calibration_object_height_n; y++)
-            for(int x = 0; x<calibration_object_width_n; x++)
+        for(int i_pt = 0; i_pt < Npoints; i_pt++)
             {
-                mrcal_point3_t pt_ref = {.x = (double)x * calibration_object_spacing,
-                                         .y = (double)y * calibration_object_spacing};
-                mrcal_point2_t dpt_ref2_dwarp = {};
-
-                if(calobject_warp != NULL)
-                {
-                    // Add a board warp here. I have two parameters, and they describe
-                    // additive flex along the x axis and along the y axis, in that
-                    // order. In each direction the flex is a parabola, with the
-                    // parameter k describing the max deflection at the center. If the
-                    // ends are at +- 1 I have d = k*(1 - x^2). If the ends are at
-                    // (0,N-1) the equivalent expression is: d = k*( 1 - 4*x^2/(N-1)^2 +
-                    // 4*x/(N-1) - 1 ) = d = 4*k*(x/(N-1) - x^2/(N-1)^2) = d =
-                    // 4.*k*x*r(1. - x*r)
-                    double xr = (double)x / (double)(calibration_object_width_n -1);
-                    double yr = (double)y / (double)(calibration_object_height_n-1);
-                    double dx = 4. * xr * (1. - xr);
-                    double dy = 4. * yr * (1. - yr);
-                    pt_ref.z += calobject_warp->x * dx;
-                    pt_ref.z += calobject_warp->y * dy;
-                    dpt_ref2_dwarp.x = dx;
-                    dpt_ref2_dwarp.y = dy;
-                }
-
                 mrcal_point3_t p =
-                    propagate_extrinsics( &pt_ref,
-                                          camera_at_identity ? NULL : &gg,
-                                          Rj, d_Rj_rj, &joint_rt[3]);
+                    propagate_extrinsics( &calobject_ref[i_pt] );
 
                 mrcal_point3_t* dq_drcamera_here        = dq_drcamera        ? &dq_drcamera        [2*i_pt] : NULL;
                 mrcal_point3_t* dq_dtcamera_here        = dq_dtcamera        ? &dq_dtcamera        [2*i_pt] : NULL;
@@ -2076,13 +2620,81 @@ void project( // out
                               dq_drcamera_here, dq_dtcamera_here, dq_drframe_here, dq_dtframe_here, dq_dcalobject_warp_here,
                               &p,
                               intrinsics, lensmodel,
-                              &dpt_ref2_dwarp,
+                              dcalobject_ref_dwarp ? &dcalobject_ref_dwarp[i_pt] : NULL,
                               camera_at_identity, Rj);
-                i_pt++;
             }
     }
 }
 
+// _project(), specialized for each lens model. A model with a configuration
+// (n <= 0) has a parameter count that isn't known at compile time
+#define PROJECT_SPECIALIZED(s,n)                                        \
+static void _project__ ## s                                             \
+    ( /* out */                                                         \
+      mrcal_point2_t* restrict q,                                       \
+      double*  restrict dq_dintrinsics_pool_double,                     \
+      int*     restrict dq_dintrinsics_pool_int,                        \
+      double** restrict dq_dfxy,                                        \
+      double** restrict dq_dintrinsics_nocore,                          \
+      gradient_sparse_meta_t* gradient_sparse_meta,                     \
+      mrcal_point3_t* restrict dq_drcamera,                             \
+      mrcal_point3_t* restrict dq_dtcamera,                             \
+      mrcal_point3_t* restrict dq_drframe,                              \
+      mrcal_point3_t* restrict dq_dtframe,                              \
+      mrcal_point2_t* restrict dq_dcalobject_warp,                      \
+                                                                        \
+      /* in */                                                          \
+      const double* restrict intrinsics,                                \
+      const mrcal_pose_t* restrict camera_rt,                           \
+      const mrcal_pose_t* restrict frame_rt,                            \
+      const mrcal_point3_t* restrict calobject_ref,                     \
+      const mrcal_point2_t* restrict dcalobject_ref_dwarp,              \
+      const rotation_precomputed_t* restrict camera_R,                  \
+      const rotation_precomputed_t* restrict frame_R,                   \
+      bool camera_at_identity,                                          \
+      mrcal_lensmodel_t lensmodel,                                      \
+      const mrcal_projection_precomputed_t* precomputed,                \
+      int    calibration_object_width_n,                                \
+      int    calibration_object_height_n)                               \
+{                                                                       \
+    /* Same as what we were given, but the compiler now knows it */     \
+    lensmodel.type = MRCAL_ ## s;                                       \
+    _project(q,                                                         \
+             dq_dintrinsics_pool_double, dq_dintrinsics_pool_int,       \
+             dq_dfxy, dq_dintrinsics_nocore, gradient_sparse_meta,      \
+             dq_drcamera, dq_dtcamera, dq_drframe, dq_dtframe,          \
+             dq_dcalobject_warp,                                        \
+             intrinsics, camera_rt, frame_rt,                           \
+             calobject_ref, dcalobject_ref_dwarp,                       \
+             camera_R, frame_R,                                         \
+             camera_at_identity,                                        \
+             lensmodel,                                                 \
+             (n) > 0 ? (n) : mrcal_lensmodel_num_params(lensmodel),     \
+             precomputed,                                               \
+             calibration_object_width_n, calibration_object_height_n);  \
+}
+MRCAL_LENSMODEL_LIST( PROJECT_SPECIALIZED )
+#undef PROJECT_SPECIALIZED
+
+typedef __typeof__(_project__LENSMODEL_PINHOLE) project_function_t;
+
+// Returns the _project__...() function for this lens model. The callers look
+// this up once for a batch of projections, and then call it directly
+static project_function_t* project_function(const mrcal_lensmodel_t lensmodel)
+{
+    switch(lensmodel.type)
+    {
+#define CASE_PROJECT_FUNCTION(s,n) case MRCAL_ ## s: return &_project__ ## s;
+        MRCAL_LENSMODEL_LIST( CASE_PROJECT_FUNCTION )
+#undef CASE_PROJECT_FUNCTION
+    default: ;
+    }
+    MSG("Unhandled lens model: %d (%s)",
+        lensmodel.type, mrcal_lensmodel_name_unconfigured(lensmodel));
+    assert(0);
+    return NULL;
+}
+
 // NOT A PART OF THE EXTERNAL API. This is exported for the mrcal python wrapper
 // only
 bool _mrcal_project_internal_cahvore( // out
@@ -2289,6 +2901,8 @@ bool _mrcal_project_internal( // out
                              int Nintrinsics,
                              const mrcal_projection_precomputed_t* precomputed)
 {
+    project_function_t* project = project_function(lensmodel);
+
     if( dq_dintrinsics == NULL )
     {
         for(int i=0; i<N; i++)
@@ -2303,9 +2917,11 @@ bool _mrcal_project_internal( // out
                      NULL, NULL, NULL, dq_dp, NULL,
 
                      // in
-                     intrinsics, NULL, &frame, NULL, true,
+                     intrinsics, NULL, &frame,
+                     NULL, NULL,
+                     NULL, NULL, true,
                      lensmodel, precomputed,
-                     0.0, 0,0);
+                     0,0);
         }
         return true;
     }
@@ -2332,9 +2948,11 @@ bool _mrcal_project_internal( // out
                  NULL, NULL, NULL, dq_dp, NULL,
 
                  // in
-                 intrinsics, NULL, &frame, NULL, true,
+                 intrinsics, NULL, &frame,
+                 NULL, NULL,
+                 NULL, NULL, true,
                  lensmodel, precomputed,
-                 0.0, 0,0);
+                 0,0);
 
         int Ncore = 0;
         if(dq_dfxy != NULL)
@@ -2448,17 +3066,79 @@ bool mrcal_project( // out
 
     int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
 
-    // Special-case for opencv/pinhole and projection-only. cvProjectPoints2 and
-    // project() have a lot of overhead apparently, and calling either in a loop
-    // is very slow. I can call it once, and use its fast internal loop,
-    // however. This special case does the same thing, but much faster.
-    if(dq_dintrinsics == NULL && dq_dp == NULL &&
-       (MRCAL_LENSMODEL_IS_OPENCV(lensmodel.type) ||
-        lensmodel.type == MRCAL_LENSMODEL_PINHOLE))
+    // Special-case for opencv/pinhole. cvProjectPoints2 and project() have a
+    // lot of overhead apparently, and calling either in a loop is very slow.
+    // The batch kernels do the same thing, but much faster, many points at a
+    // time. These produce dense gradients, so I use them with or without
+    // gradients
+    if(MRCAL_LENSMODEL_IS_OPENCV(lensmodel.type) ||
+       lensmodel.type == MRCAL_LENSMODEL_PINHOLE)
+        return
+            _mrcal_project_batch_internal(q, dq_dp, dq_dintrinsics,
+                                          &p[0].x, &p[0].y, &p[0].z, 3,
+                                          N, intrinsics, Nintrinsics,
+                                          0);
+
+    // Splined models: the batched evaluator bins the points by spline cell.
+    // It reports the intrinsics gradients sparsely, and I densify them here
+    if(lensmodel.type == MRCAL_LENSMODEL_SPLINED_STEREOGRAPHIC)
     {
-        _mrcal_project_internal_opencv( q, NULL,NULL,
-                                        p, N, intrinsics, Nintrinsics);
-        return true;
+        mrcal_projection_precomputed_t precomputed;
+        _mrcal_precompute_lensmodel_data(&precomputed, lensmodel);
+
+        const mrcal_LENSMODEL_SPLINED_STEREOGRAPHIC__config_t* config =
+            &lensmodel.LENSMODEL_SPLINED_STEREOGRAPHIC__config;
+
+        if(dq_dintrinsics == NULL)
+            return
+                _mrcal_project_splined_batch(q, dq_dp, NULL, NULL, NULL,
+                                             p, N, config, intrinsics,
+                                             &precomputed.LENSMODEL_SPLINED_STEREOGRAPHIC__precomputed);
+
+        const int len = config->order + 1;
+        mrcal_point2_t* dq_dfxy = malloc(N*( sizeof(mrcal_point2_t) +
+                                             2*len*sizeof(double) +
+                                             sizeof(int)));
+        if(dq_dfxy == NULL)
+        {
+            MSG("Couldn't allocate the sparse gradients for %d points", N);
+            return false;
+        }
+        double* grad_ABCDx_ABCDy = (double*)&dq_dfxy[N];
+        int*    ivar0            = (int*)&grad_ABCDx_ABCDy[N*2*len];
+
+        bool result =
+            _mrcal_project_splined_batch(q, dq_dp, dq_dfxy, ivar0, grad_ABCDx_ABCDy,
+                                         p, N, config, intrinsics,
+                                         &precomputed.LENSMODEL_SPLINED_STEREOGRAPHIC__precomputed);
+        if(result)
+        {
+            memset(dq_dintrinsics, 0, N*2*Nintrinsics*sizeof(double));
+            const int     ivar_stridey = 2*config->Nx;
+            const double* fxy          = &intrinsics[0];
+            for(int i=0; i<N; i++)
+            {
+                double* dq_dintrinsics_here = &dq_dintrinsics[i*2*Nintrinsics];
+                const double* ABCDx = &grad_ABCDx_ABCDy[i*2*len];
+                const double* ABCDy = &grad_ABCDx_ABCDy[i*2*len + len];
+
+                dq_dintrinsics_here[0*Nintrinsics + 0] = dq_dfxy[i].x;
+                dq_dintrinsics_here[1*Nintrinsics + 1] = dq_dfxy[i].y;
+                dq_dintrinsics_here[0*Nintrinsics + 2] = 1.0;
+                dq_dintrinsics_here[1*Nintrinsics + 3] = 1.0;
+
+                for(int i_xy=0; i_xy<2; i_xy++)
+                    for(int iy=0; iy<len; iy++)
+                        for(int ix=0; ix<len; ix++)
+                        {
+                            int ivar = ivar0[i] + ivar_stridey*iy + ix*2 + i_xy;
+                            dq_dintrinsics_here[ivar + i_xy*Nintrinsics] =
+                                ABCDx[ix]*ABCDy[iy]*fxy[i_xy];
+                        }
+            }
+        }
+        free(dq_dfxy);
+        return result;
     }
 
     // Some models have sparse gradients, but I'm returning a dense array here.
@@ -2476,6 +3156,38 @@ bool mrcal_project( // out
 }
 
 
+// Batch projection for the pinhole and OpenCV models, with the points in a
+// structure-of-arrays layout. See the docs in mrcal.h
+bool mrcal_project_batch( // out
+                         mrcal_point2_t* q,
+                         mrcal_point3_t* dq_dp,
+                         double*         dq_dintrinsics,
+
+                         // in
+                         const double* px,
+                         const double* py,
+                         const double* pz,
+                         int N,
+                         mrcal_lensmodel_t lensmodel,
+                         // core, distortions concatenated
+                         const double* intrinsics)
+{
+    if(!(MRCAL_LENSMODEL_IS_OPENCV(lensmodel.type) ||
+         lensmodel.type == MRCAL_LENSMODEL_PINHOLE))
+    {
+        MSG("mrcal_project_batch() supports only the pinhole and opencv models. Use mrcal_project() for %s",
+            mrcal_lensmodel_name_unconfigured(lensmodel));
+        return false;
+    }
+
+    return
+        _mrcal_project_batch_internal(q, dq_dp, dq_dintrinsics,
+                                      px, py, pz, 1,
+                                      N, intrinsics,
+                                      mrcal_lensmodel_num_params(lensmodel),
+                                      0);
+}
+
 // Maps a set of distorted 2D imager points q to a 3D vector in camera
 // coordinates that produced these pixel observations. The 3D vector is defined
 // up-to-length. The returned vectors v are not normalized, and may have any
@@ -2498,7 +3210,43 @@ bool mrcal_unproject( // out
                      // core, distortions concatenated
                      const double* intrinsics)
 {
-    if( lensmodel.type == MRCAL_LENSMODEL_CAHVORE )
+    return mrcal_unproject_threaded(out, q, N, lensmodel, intrinsics, 1);
+}
+
+typedef struct
+{
+    mrcal_point3_t*                       out;
+    const mrcal_point2_t*                 q;
+    int                                   N;
+    mrcal_lensmodel_t                     lensmodel;
+    const double*                         intrinsics;
+    const mrcal_projection_precomputed_t* precomputed;
+} unproject_chunk_t;
+
+// Unprojects one contiguous chunk of points. Usable as a pthread entry point
+static void* unproject_chunk(void* _chunk)
+{
+    const unproject_chunk_t* chunk = (const unproject_chunk_t*)_chunk;
+    _mrcal_unproject_internal(chunk->out, chunk->q, chunk->N,
+                              chunk->lensmodel, chunk->intrinsics,
+                              chunk->precomputed);
+    return NULL;
+}
+
+// Same as mrcal_unproject(), but the work is split among Nthreads threads. See
+// the docs in mrcal.h
+bool mrcal_unproject_threaded( // out
+                              mrcal_point3_t* out,
+
+                              // in
+                              const mrcal_point2_t* q,
+                              int N,
+                              mrcal_lensmodel_t lensmodel,
+                              // core, distortions concatenated
+                              const double* intrinsics,
+                              int Nthreads)
+{
+    if( lensmodel.type == MRCAL_LENSMODEL_CAHVORE )
     {
         fprintf(stderr, "mrcal_unproject(MRCAL_LENSMODEL_CAHVORE) not yet implemented. No gradients available\n");
         return false;
@@ -2538,7 +3286,853 @@ bool mrcal_unproject( // out
     mrcal_projection_precomputed_t precomputed;
     _mrcal_precompute_lensmodel_data(&precomputed, lensmodel);
 
-    return _mrcal_unproject_internal(out, q, N, lensmodel, intrinsics, &precomputed);
+    if(Nthreads > N) Nthreads = N;
+    if(Nthreads <= 1)
+        return _mrcal_unproject_internal(out, q, N, lensmodel, intrinsics, &precomputed);
+
+    // Each thread gets a contiguous chunk of points, so that the neighbor
+    // seeding in _mrcal_unproject_internal() keeps working. Chunk 0 is done in
+    // this thread. If I can't create a thread for some chunk, I do that chunk
+    // in this thread also
+    unproject_chunk_t chunks     [Nthreads];
+    pthread_t         threads    [Nthreads];
+    bool              have_thread[Nthreads];
+    for(int ichunk=0; ichunk<Nthreads; ichunk++)
+    {
+        int i0 = (int)((long)N *  ichunk    / Nthreads);
+        int i1 = (int)((long)N * (ichunk+1) / Nthreads);
+        chunks[ichunk] = (unproject_chunk_t)
+            { .out         = &out[i0],
+              .q           = &q[i0],
+              .N           = i1 - i0,
+              .lensmodel   = lensmodel,
+              .intrinsics  = intrinsics,
+              .precomputed = &precomputed };
+    }
+    for(int ichunk=1; ichunk<Nthreads; ichunk++)
+        have_thread[ichunk] =
+            0 == pthread_create(&threads[ichunk], NULL,
+                                &unproject_chunk, &chunks[ichunk]);
+    unproject_chunk(&chunks[0]);
+    for(int ichunk=1; ichunk<Nthreads; ichunk++)
+    {
+        if(have_thread[ichunk])
+            pthread_join(threads[ichunk], NULL);
+        else
+            unproject_chunk(&chunks[ichunk]);
+    }
+    return true;
+}
+
+// The library is built with -ffast-math, so isfinite() can't be relied upon. I
+// look at the exponent bits instead
+static bool float_is_finite(float x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return (u & 0x7f800000) != 0x7f800000;
+}
+static bool double_is_finite(double x)
+{
+    uint64_t u;
+    memcpy(&u, &x, sizeof(u));
+    return (u & 0x7ff0000000000000ULL) != 0x7ff0000000000000ULL;
+}
+
+// Interpolates a lookup table of observation vectors sampled on a regular grid
+// of pixels. See the docs in mrcal.h
+void mrcal_unprojection_lut_interpolate( // out
+                                        mrcal_point3_t* v,
+
+                                        // in
+                                        const mrcal_point2_t* q,
+                                        int N,
+                                        const mrcal_point3_t* grid,
+                                        int gridn_width, int gridn_height,
+                                        double grid_spacing_x,
+                                        double grid_spacing_y,
+                                        bool bicubic)
+{
+    // Grid point (ix,iy). The bicubic interpolation reads one point past the
+    // edge of the grid in each direction. Those are extrapolated quadratically
+    // (linearly if the grid is only 2 points across), so the edge cells are as
+    // accurate as the interior ones
+    int extrapolation_weights(int* i, double* w, int i_want, int n)
+    {
+        if(i_want >= 0 && i_want < n)
+        {
+            i[0] = i_want; w[0] = 1.;
+            return 1;
+        }
+        int i0 = i_want < 0 ? 0 : n-1;
+        int di = i_want < 0 ? 1 : -1;
+        if(n < 3)
+        {
+            i[0] = i0;      w[0] =  2.;
+            i[1] = i0 + di; w[1] = -1.;
+            return 2;
+        }
+        i[0] = i0;        w[0] =  3.;
+        i[1] = i0 +   di; w[1] = -3.;
+        i[2] = i0 + 2*di; w[2] =  1.;
+        return 3;
+    }
+    mrcal_point3_t grid_at(int ix, int iy)
+    {
+        int    ixs[3], iys[3];
+        double wxs[3], wys[3];
+        int Nx = extrapolation_weights(ixs, wxs, ix, gridn_width);
+        int Ny = extrapolation_weights(iys, wys, iy, gridn_height);
+
+        mrcal_point3_t p = {};
+        for(int jy=0; jy<Ny; jy++)
+            for(int jx=0; jx<Nx; jx++)
+                for(int k=0; k<3; k++)
+                    p.xyz[k] += wxs[jx]*wys[jy] *
+                        grid[iys[jy]*gridn_width + ixs[jx]].xyz[k];
+        return p;
+    }
+
+    // Catmull-Rom weights for the 4 grid points around t in [0,1]
+    void catmull_rom_weights(double* w, double t)
+    {
+        double t2 = t*t;
+        double t3 = t2*t;
+        w[0] = (-t3 + 2.*t2 - t   ) / 2.;
+        w[1] = (3.*t3 - 5.*t2 + 2.) / 2.;
+        w[2] = (-3.*t3 + 4.*t2 + t) / 2.;
+        w[3] = (t3 - t2           ) / 2.;
+    }
+
+    for(int i=0; i<N; i++)
+    {
+        mrcal_point3_t* out = &v[i];
+
+        // Continuous grid coordinates. Points off the imager use the edge cells
+        double x = q[i].x / grid_spacing_x;
+        double y = q[i].y / grid_spacing_y;
+        if(!double_is_finite(x) || !double_is_finite(y))
+        {
+            *out = (mrcal_point3_t){.x = NAN, .y = NAN, .z = NAN};
+            continue;
+        }
+
+        // I clamp in floating-point before casting: casting a huge value to
+        // int is undefined
+        double xclamped = x, yclamped = y;
+        if(     xclamped < 0.)              xclamped = 0.;
+        else if(xclamped > gridn_width -2)  xclamped = gridn_width -2;
+        if(     yclamped < 0.)              yclamped = 0.;
+        else if(yclamped > gridn_height-2)  yclamped = gridn_height-2;
+        int ix = (int)floor(xclamped);
+        int iy = (int)floor(yclamped);
+        double tx = x - ix;
+        double ty = y - iy;
+
+        *out = (mrcal_point3_t){};
+
+        if(!bicubic)
+        {
+            const mrcal_point3_t* p00 = &grid[ iy   *gridn_width + ix  ];
+            const mrcal_point3_t* p01 = &grid[ iy   *gridn_width + ix+1];
+            const mrcal_point3_t* p10 = &grid[(iy+1)*gridn_width + ix  ];
+            const mrcal_point3_t* p11 = &grid[(iy+1)*gridn_width + ix+1];
+            for(int k=0; k<3; k++)
+                out->xyz[k] =
+                    (p00->xyz[k]*(1.-tx) + p01->xyz[k]*tx) * (1.-ty) +
+                    (p10->xyz[k]*(1.-tx) + p11->xyz[k]*tx) * ty;
+            continue;
+        }
+
+        double wx[4], wy[4];
+        catmull_rom_weights(wx, tx);
+        catmull_rom_weights(wy, ty);
+
+        const bool interior =
+            ix >= 1 && ix+2 < gridn_width &&
+            iy >= 1 && iy+2 < gridn_height;
+        for(int j=0; j<4; j++)
+        {
+            mrcal_point3_t row = {};
+            for(int l=0; l<4; l++)
+            {
+                mrcal_point3_t p =
+                    interior ?
+                    grid[(iy-1+j)*gridn_width + ix-1+l] :
+                    grid_at(ix-1+l, iy-1+j);
+                for(int k=0; k<3; k++)
+                    row.xyz[k] += wx[l]*p.xyz[k];
+            }
+            for(int k=0; k<3; k++)
+                out->xyz[k] += wy[j]*row.xyz[k];
+        }
+    }
+}
+
+// mrcal_image_transformation_map() works on tiles of this many rows. The tiles
+// are dealt out to the threads round-robin
+#define TRANSFORMATION_MAP_ROWS_PER_TILE 8
+
+typedef struct
+{
+    float*                                mapxy;
+    int                                   W, H;
+    mrcal_lensmodel_t                     lensmodel_from;
+    const double*                         intrinsics_from;
+    mrcal_lensmodel_t                     lensmodel_to;
+    const double*                         intrinsics_to;
+    const mrcal_projection_precomputed_t* precomputed_to;
+    const double*                         M_from_to;
+    int                                   itile0, itile_stride;
+    bool                                  result;
+} transformation_map_chunk_t;
+
+// Computes the map for tiles itile0, itile0+itile_stride, ... Usable as a
+// pthread entry point. Each row is unprojected, rotated and projected in
+// row-sized scratch buffers, so nothing image-sized is allocated
+static void* transformation_map_chunk(void* _chunk)
+{
+    transformation_map_chunk_t* chunk = (transformation_map_chunk_t*)_chunk;
+    const int W = chunk->W;
+    const int H = chunk->H;
+
+    chunk->result = false;
+
+    mrcal_point2_t* q = malloc(W*(2*sizeof(mrcal_point2_t) + sizeof(mrcal_point3_t)));
+    if(q == NULL)
+    {
+        MSG("Couldn't allocate the scratch buffers for a row of %d pixels", W);
+        return NULL;
+    }
+    mrcal_point2_t* q_from = &q[W];
+    mrcal_point3_t* v      = (mrcal_point3_t*)&q_from[W];
+
+    const bool unproject_closed_form =
+        chunk->lensmodel_to.type == MRCAL_LENSMODEL_PINHOLE ||
+        chunk->lensmodel_to.type == MRCAL_LENSMODEL_STEREOGRAPHIC;
+    const double* M = chunk->M_from_to;
+
+    for(int y0 = chunk->itile0*TRANSFORMATION_MAP_ROWS_PER_TILE;
+        y0 < H;
+        y0 += chunk->itile_stride*TRANSFORMATION_MAP_ROWS_PER_TILE)
+    {
+        const int y1 = y0 + TRANSFORMATION_MAP_ROWS_PER_TILE < H ?
+            y0 + TRANSFORMATION_MAP_ROWS_PER_TILE : H;
+        for(int y=y0; y<y1; y++)
+        {
+            for(int x=0; x<W; x++)
+                q[x] = (mrcal_point2_t){.x = (double)x, .y = (double)y};
+
+            // Points that can't be unprojected come out as nan, and stay that
+            // way through the projection
+            if(unproject_closed_form)
+            {
+                if(!mrcal_unproject(v, q, W,
+                                    chunk->lensmodel_to, chunk->intrinsics_to))
+                    goto done;
+            }
+            else if(!_mrcal_unproject_internal(v, q, W,
+                                               chunk->lensmodel_to, chunk->intrinsics_to,
+                                               chunk->precomputed_to))
+                goto done;
+
+            if(M != NULL)
+                for(int x=0; x<W; x++)
+                {
+                    mrcal_point3_t p = v[x];
+                    for(int i=0; i<3; i++)
+                        v[x].xyz[i] = M[3*i+0]*p.x + M[3*i+1]*p.y + M[3*i+2]*p.z;
+                }
+
+            if(!mrcal_project(q_from, NULL, NULL, v, W,
+                              chunk->lensmodel_from, chunk->intrinsics_from))
+                goto done;
+
+            float* mapxy_row = &chunk->mapxy[2*y*W];
+            for(int x=0; x<W; x++)
+            {
+                mapxy_row[2*x + 0] = (float)q_from[x].x;
+                mapxy_row[2*x + 1] = (float)q_from[x].y;
+            }
+        }
+    }
+    chunk->result = true;
+
+ done:
+    free(q);
+    return NULL;
+}
+
+// Computes a reprojection map between two models. See the docs in mrcal.h
+bool mrcal_image_transformation_map( // out
+                                     float* mapxy,
+
+                                     // in
+                                     mrcal_lensmodel_t lensmodel_from,
+                                     const double* intrinsics_from,
+                                     mrcal_lensmodel_t lensmodel_to,
+                                     const double* intrinsics_to,
+                                     int W_to, int H_to,
+                                     const double* M_from_to,
+                                     int Nthreads)
+{
+    if( lensmodel_to.type == MRCAL_LENSMODEL_CAHVORE )
+    {
+        MSG("mrcal_image_transformation_map() can't unproject with MRCAL_LENSMODEL_CAHVORE");
+        return false;
+    }
+    if(W_to <= 0 || H_to <= 0)
+    {
+        MSG("The target imager must have a positive size. Got %dx%d", W_to, H_to);
+        return false;
+    }
+
+    mrcal_projection_precomputed_t precomputed_to;
+    _mrcal_precompute_lensmodel_data(&precomputed_to, lensmodel_to);
+
+    const int Ntiles = (H_to + TRANSFORMATION_MAP_ROWS_PER_TILE-1) / TRANSFORMATION_MAP_ROWS_PER_TILE;
+    if(Nthreads > Ntiles) Nthreads = Ntiles;
+    if(Nthreads < 1)      Nthreads = 1;
+
+    // Chunk 0 is done in this thread. If I can't create a thread for some
+    // chunk, I do that chunk in this thread also
+    transformation_map_chunk_t chunks     [Nthreads];
+    pthread_t                  threads    [Nthreads];
+    bool                       have_thread[Nthreads];
+    for(int ichunk=0; ichunk<Nthreads; ichunk++)
+        chunks[ichunk] = (transformation_map_chunk_t)
+            { .mapxy           = mapxy,
+              .W               = W_to,
+              .H               = H_to,
+              .lensmodel_from  = lensmodel_from,
+              .intrinsics_from = intrinsics_from,
+              .lensmodel_to    = lensmodel_to,
+              .intrinsics_to   = intrinsics_to,
+              .precomputed_to  = &precomputed_to,
+              .M_from_to       = M_from_to,
+              .itile0          = ichunk,
+              .itile_stride    = Nthreads };
+    for(int ichunk=1; ichunk<Nthreads; ichunk++)
+        have_thread[ichunk] =
+            0 == pthread_create(&threads[ichunk], NULL,
+                                &transformation_map_chunk, &chunks[ichunk]);
+    transformation_map_chunk(&chunks[0]);
+    bool result = chunks[0].result;
+    for(int ichunk=1; ichunk<Nthreads; ichunk++)
+    {
+        if(have_thread[ichunk])
+            pthread_join(threads[ichunk], NULL);
+        else
+            transformation_map_chunk(&chunks[ichunk]);
+        result = result && chunks[ichunk].result;
+    }
+    return result;
+}
+
+// The image-remapping kernels. The same code is compiled for each pixel type
+// and each SIMD width we support, like the batch-projection kernels above.
+// remap_nlanes() picks the SIMD width at runtime
+#define REMAP_NLANES 1
+#define REMAP_KERNEL  remap_kernel_UINT8_1
+#define REMAP_PIXEL_T uint8_t
+#define REMAP_PIXEL_MAX UINT8_MAX
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_PIXEL_MAX
+#define REMAP_KERNEL  remap_kernel_UINT16_1
+#define REMAP_PIXEL_T uint16_t
+#define REMAP_PIXEL_MAX UINT16_MAX
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_PIXEL_MAX
+#define REMAP_KERNEL  remap_kernel_FLOAT_1
+#define REMAP_PIXEL_T float
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_NLANES
+
+#if defined PROJECT_BATCH_HAVE_X86_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define REMAP_NLANES 8
+#define REMAP_KERNEL  remap_kernel_UINT8_8
+#define REMAP_PIXEL_T uint8_t
+#define REMAP_PIXEL_MAX UINT8_MAX
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_PIXEL_MAX
+#define REMAP_KERNEL  remap_kernel_UINT16_8
+#define REMAP_PIXEL_T uint16_t
+#define REMAP_PIXEL_MAX UINT16_MAX
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_PIXEL_MAX
+#define REMAP_KERNEL  remap_kernel_FLOAT_8
+#define REMAP_PIXEL_T float
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_NLANES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define REMAP_NLANES 16
+#define REMAP_KERNEL  remap_kernel_UINT8_16
+#define REMAP_PIXEL_T uint8_t
+#define REMAP_PIXEL_MAX UINT8_MAX
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_PIXEL_MAX
+#define REMAP_KERNEL  remap_kernel_UINT16_16
+#define REMAP_PIXEL_T uint16_t
+#define REMAP_PIXEL_MAX UINT16_MAX
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_PIXEL_MAX
+#define REMAP_KERNEL  remap_kernel_FLOAT_16
+#define REMAP_PIXEL_T float
+#include "mrcal_remap_kernel.h"
+#undef REMAP_KERNEL
+#undef REMAP_PIXEL_T
+#undef REMAP_NLANES
+#pragma GCC pop_options
+
+#endif
+
+typedef void (remap_kernel_t)(void*,
+                              const int32_t*, const int32_t*,
+                              const float*, const float*,
+                              int,
+                              const void*, int, int, int,
+                              bool);
+
+// The widest remapping kernel this CPU can run
+static int remap_nlanes(void)
+{
+    switch(project_batch_nlanes())
+    {
+    case 8:  return 16;
+    case 4:  return 8;
+    default: return 1;
+    }
+}
+
+// Pixel coordinates that are further than this off the image produce 0. I
+// clamp to this, so that everything fits into an int32_t
+#define REMAP_COORD_MAX 1e6f
+
+void mrcal_transformation_map_compact( // out
+                                       int16_t*  mapxy_int,
+                                       uint16_t* mapxy_frac,
+
+                                       // in
+                                       const float* mapxy,
+                                       int N)
+{
+    const int   Nfrac = 1 << MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS;
+    const float scale = (float)Nfrac;
+    for(int i=0; i<N; i++)
+    {
+        const float x = mapxy[2*i + 0] * scale;
+        const float y = mapxy[2*i + 1] * scale;
+        if(!(float_is_finite(x) && float_is_finite(y) &&
+             x >= (float)INT16_MIN*scale && x < ((float)INT16_MAX+1.f)*scale - 0.5f &&
+             y >= (float)INT16_MIN*scale && y < ((float)INT16_MAX+1.f)*scale - 0.5f))
+        {
+            mapxy_int[2*i + 0] = INT16_MIN;
+            mapxy_int[2*i + 1] = INT16_MIN;
+            mapxy_frac[i]      = 0;
+            continue;
+        }
+
+        const int32_t ix = (int32_t)lrintf(x);
+        const int32_t iy = (int32_t)lrintf(y);
+        // >> on negative numbers is an arithmetic shift in gcc, so this
+        // rounds down
+        mapxy_int[2*i + 0] = (int16_t)(ix >> MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS);
+        mapxy_int[2*i + 1] = (int16_t)(iy >> MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS);
+        mapxy_frac[i] = (uint16_t)( ((iy & (Nfrac-1)) << MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS) |
+                                     (ix & (Nfrac-1)) );
+    }
+}
+
+typedef struct
+{
+    void*           out;
+    const void*     image;
+    int             W, H, Nchannels;
+    int             pixel_size;
+    int             W_out;
+    int             y0, y1;
+    const float*    mapxy;
+    const int16_t*  mapxy_int;
+    const uint16_t* mapxy_frac;
+    bool            bicubic;
+    remap_kernel_t* kernel;
+    remap_kernel_t* kernel_scalar;
+    int             Nlanes;
+    bool            result;
+} remap_chunk_t;
+
+// Remaps rows [y0,y1) of the output. Usable as a pthread entry point. Each row
+// is done in two passes: the map is decoded into integer pixels and fractional
+// offsets, and then the kernel interpolates. The bulk of each row goes through
+// the SIMD kernel, and the leftovers through the scalar one
+static void* remap_chunk(void* _chunk)
+{
+    remap_chunk_t* chunk = (remap_chunk_t*)_chunk;
+    const int W_out = chunk->W_out;
+
+    chunk->result = false;
+
+    int32_t* x0 = malloc(W_out*(2*sizeof(int32_t) + 2*sizeof(float)));
+    if(x0 == NULL)
+    {
+        MSG("Couldn't allocate the scratch buffers for a row of %d pixels", W_out);
+        return NULL;
+    }
+    int32_t* y0 = &x0[W_out];
+    float*   tx = (float*)&y0[W_out];
+    float*   ty = &tx[W_out];
+
+    const int Nbulk = W_out - W_out%chunk->Nlanes;
+
+    for(int y=chunk->y0; y<chunk->y1; y++)
+    {
+        if(chunk->mapxy != NULL)
+        {
+            const float* m = &chunk->mapxy[2*(long)y*W_out];
+            for(int x=0; x<W_out; x++)
+            {
+                float mx = m[2*x + 0];
+                float my = m[2*x + 1];
+                if(!(float_is_finite(mx) && float_is_finite(my)))
+                    mx = my = -REMAP_COORD_MAX;
+                else
+                {
+                    if(mx < -REMAP_COORD_MAX) mx = -REMAP_COORD_MAX;
+                    if(mx >  REMAP_COORD_MAX) mx =  REMAP_COORD_MAX;
+                    if(my < -REMAP_COORD_MAX) my = -REMAP_COORD_MAX;
+                    if(my >  REMAP_COORD_MAX) my =  REMAP_COORD_MAX;
+                }
+                // floor(). floorf() is a library call without SSE4.1, and I
+                // know these fit into an int32_t
+                int32_t ix = (int32_t)mx; if((float)ix > mx) ix--;
+                int32_t iy = (int32_t)my; if((float)iy > my) iy--;
+                x0[x] = ix;
+                y0[x] = iy;
+                tx[x] = mx - (float)ix;
+                ty[x] = my - (float)iy;
+            }
+        }
+        else
+        {
+            const int16_t*  mi = &chunk->mapxy_int [2*(long)y*W_out];
+            const uint16_t* mf = &chunk->mapxy_frac[  (long)y*W_out];
+            const int       Nfrac = 1 << MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS;
+            const float     scale = 1.f / (float)Nfrac;
+            for(int x=0; x<W_out; x++)
+            {
+                x0[x] = mi[2*x + 0];
+                y0[x] = mi[2*x + 1];
+                tx[x] = (float)( mf[x]                                              & (Nfrac-1)) * scale;
+                ty[x] = (float)((mf[x] >> MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS) & (Nfrac-1)) * scale;
+            }
+        }
+
+        uint8_t* out_row =
+            &((uint8_t*)chunk->out)[(long)y*W_out*chunk->Nchannels*chunk->pixel_size];
+        chunk->kernel(out_row,
+                      x0, y0, tx, ty, Nbulk,
+                      chunk->image, chunk->W, chunk->H, chunk->Nchannels,
+                      chunk->bicubic);
+        if(Nbulk < W_out)
+            chunk->kernel_scalar(&out_row[(long)Nbulk*chunk->Nchannels*chunk->pixel_size],
+                                 &x0[Nbulk], &y0[Nbulk], &tx[Nbulk], &ty[Nbulk], W_out - Nbulk,
+                                 chunk->image, chunk->W, chunk->H, chunk->Nchannels,
+                                 chunk->bicubic);
+    }
+    chunk->result = true;
+
+    free(x0);
+    return NULL;
+}
+
+// NOT A PART OF THE EXTERNAL API. This is exported for the tests only, to be
+// able to exercise each kernel explicitly. See the docs in mrcal_internal.h
+bool _mrcal_transform_image_internal( // out
+                                     void* out,
+
+                                     // in
+                                     const void* image,
+                                     int W, int H, int Nchannels,
+                                     mrcal_image_type_t type,
+                                     int W_out, int H_out,
+                                     const float*    mapxy,
+                                     const int16_t*  mapxy_int,
+                                     const uint16_t* mapxy_frac,
+                                     bool bicubic,
+                                     int Nthreads,
+                                     int Nlanes)
+{
+    if( (mapxy != NULL) == (mapxy_int != NULL || mapxy_frac != NULL) ||
+        (mapxy == NULL && (mapxy_int == NULL || mapxy_frac == NULL)) )
+    {
+        MSG("Exactly one of mapxy or (mapxy_int,mapxy_frac) must be given");
+        return false;
+    }
+    if(W <= 0 || H <= 0 || Nchannels <= 0 || W_out <= 0 || H_out <= 0)
+    {
+        MSG("The image dimensions must be positive. Got input %dx%dx%d and output %dx%d",
+            W, H, Nchannels, W_out, H_out);
+        return false;
+    }
+
+    if(Nlanes <= 0)
+        Nlanes = remap_nlanes();
+
+    remap_kernel_t* kernel        = NULL;
+    remap_kernel_t* kernel_scalar = NULL;
+    int             pixel_size    = 0;
+    switch(type)
+    {
+#if defined PROJECT_BATCH_HAVE_X86_SIMD
+#define REMAP_CASE(name, ctype)                                         \
+    case MRCAL_IMAGE_ ## name:                                          \
+        pixel_size    = sizeof(ctype);                                  \
+        kernel_scalar = &remap_kernel_ ## name ## _1;                   \
+        switch(Nlanes)                                                  \
+        {                                                               \
+        case 1:  kernel = &remap_kernel_ ## name ## _1;  break;         \
+        case 8:                                                         \
+            if(!(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))) \
+                return false;                                           \
+            kernel = &remap_kernel_ ## name ## _8;                      \
+            break;                                                      \
+        case 16:                                                        \
+            if(!__builtin_cpu_supports("avx512f"))                      \
+                return false;                                           \
+            kernel = &remap_kernel_ ## name ## _16;                     \
+            break;                                                      \
+        default: return false;                                          \
+        }                                                               \
+        break;
+#else
+#define REMAP_CASE(name, ctype)                                         \
+    case MRCAL_IMAGE_ ## name:                                          \
+        pixel_size    = sizeof(ctype);                                  \
+        kernel_scalar = &remap_kernel_ ## name ## _1;                   \
+        if(Nlanes != 1) return false;                                   \
+        kernel = &remap_kernel_ ## name ## _1;                          \
+        break;
+#endif
+        MRCAL_IMAGE_TYPE_LIST(REMAP_CASE)
+#undef REMAP_CASE
+    default:
+        MSG("Unknown image type %d", (int)type);
+        return false;
+    }
+
+    if(Nthreads > H_out) Nthreads = H_out;
+    if(Nthreads < 1)     Nthreads = 1;
+
+    // Each thread gets a contiguous block of output rows. Chunk 0 is done in
+    // this thread. If I can't create a thread for some chunk, I do that chunk
+    // in this thread also
+    remap_chunk_t chunks     [Nthreads];
+    pthread_t     threads    [Nthreads];
+    bool          have_thread[Nthreads];
+    for(int ichunk=0; ichunk<Nthreads; ichunk++)
+        chunks[ichunk] = (remap_chunk_t)
+            { .out           = out,
+              .image         = image,
+              .W             = W,
+              .H             = H,
+              .Nchannels     = Nchannels,
+              .pixel_size    = pixel_size,
+              .W_out         = W_out,
+              .y0            = (int)((long)H_out *  ichunk    / Nthreads),
+              .y1            = (int)((long)H_out * (ichunk+1) / Nthreads),
+              .mapxy         = mapxy,
+              .mapxy_int     = mapxy_int,
+              .mapxy_frac    = mapxy_frac,
+              .bicubic       = bicubic,
+              .kernel        = kernel,
+              .kernel_scalar = kernel_scalar,
+              .Nlanes        = Nlanes };
+    for(int ichunk=1; ichunk<Nthreads; ichunk++)
+        have_thread[ichunk] =
+            0 == pthread_create(&threads[ichunk], NULL,
+                                &remap_chunk, &chunks[ichunk]);
+    remap_chunk(&chunks[0]);
+    bool result = chunks[0].result;
+    for(int ichunk=1; ichunk<Nthreads; ichunk++)
+    {
+        if(have_thread[ichunk])
+            pthread_join(threads[ichunk], NULL);
+        else
+            remap_chunk(&chunks[ichunk]);
+        result = result && chunks[ichunk].result;
+    }
+    return result;
+}
+
+// Transforms an image using a transformation map. See the docs in mrcal.h
+bool mrcal_transform_image( // out
+                            void* out,
+
+                            // in
+                            const void* image,
+                            int W, int H, int Nchannels,
+                            mrcal_image_type_t type,
+                            int W_out, int H_out,
+                            const float*    mapxy,
+                            const int16_t*  mapxy_int,
+                            const uint16_t* mapxy_frac,
+                            bool bicubic,
+                            int Nthreads)
+{
+    return _mrcal_transform_image_internal(out, image, W, H, Nchannels, type,
+                                           W_out, H_out,
+                                           mapxy, mapxy_int, mapxy_frac,
+                                           bicubic, Nthreads, 0);
+}
+
+// Unprojection solves project(unproject_stereographic(u)) = q for u, the
+// constant-fxy-cxy 2D stereographic projection of the observation vector. This
+// function evaluates the residual x = project(unproject_stereographic(u)) - q
+// and its 2x2 gradient J = dx/du
+static void unproject_residual( // out
+                                double* x,
+                                double* J,
+
+                                // in
+                                const double* u,
+                                const mrcal_point2_t* q,
+                                mrcal_lensmodel_t lensmodel,
+                                // core, distortions concatenated
+                                const double* intrinsics,
+                                const mrcal_projection_precomputed_t* precomputed)
+{
+    double fx = intrinsics[0];
+    double fy = intrinsics[1];
+    double cx = intrinsics[2];
+    double cy = intrinsics[3];
+
+    // I unproject u stereographically, and project it using the actual model
+    project_function_t* project = project_function(lensmodel);
+    mrcal_point2_t dv_du[3];
+    mrcal_pose_t frame = {};
+    mrcal_unproject_stereographic( &frame.t, dv_du,
+                                   (const mrcal_point2_t*)u, 1,
+                                   fx,fy,cx,cy );
+
+    mrcal_point3_t dq_dtframe[2];
+    mrcal_point2_t q_hypothesis;
+    project( &q_hypothesis,
+             NULL,NULL,NULL,NULL,NULL,
+             NULL, NULL, NULL, dq_dtframe,
+             NULL,
+
+             // in
+             intrinsics,
+             NULL,
+             &frame,
+             NULL, NULL,
+             NULL, NULL,
+             true,
+             lensmodel, precomputed,
+             0,0);
+    x[0] = q_hypothesis.x - q->x;
+    x[1] = q_hypothesis.y - q->y;
+    J[0*2 + 0] =
+        dq_dtframe[0].x*dv_du[0].x +
+        dq_dtframe[0].y*dv_du[1].x +
+        dq_dtframe[0].z*dv_du[2].x;
+    J[0*2 + 1] =
+        dq_dtframe[0].x*dv_du[0].y +
+        dq_dtframe[0].y*dv_du[1].y +
+        dq_dtframe[0].z*dv_du[2].y;
+    J[1*2 + 0] =
+        dq_dtframe[1].x*dv_du[0].x +
+        dq_dtframe[1].y*dv_du[1].x +
+        dq_dtframe[1].z*dv_du[2].x;
+    J[1*2 + 1] =
+        dq_dtframe[1].x*dv_du[0].y +
+        dq_dtframe[1].y*dv_du[1].y +
+        dq_dtframe[1].z*dv_du[2].y;
+}
+
+// Computes the 2x2 Newton step du = -inv(J) x. Returns false if J is singular
+static bool unproject_newton_step(// out
+                                  double* du,
+                                  // in
+                                  const double* x,
+                                  const double* J)
+{
+    double det = J[0]*J[3] - J[1]*J[2];
+    if(fabs(det) < 1e-12 * (J[0]*J[0] + J[1]*J[1] + J[2]*J[2] + J[3]*J[3]))
+        return false;
+    du[0] = -( J[3]*x[0] - J[1]*x[1]) / det;
+    du[1] = -(-J[2]*x[0] + J[0]*x[1]) / det;
+    return true;
+}
+
+// Tries to unproject one point with a few iterations of an undamped Newton's
+// method, starting at u. On success, u contains the solution, J contains the
+// gradient at the solution, and true is returned. If we don't converge quickly,
+// false is returned, and the caller should use the slower, more robust solver
+static bool unproject_newton( // in,out
+                              double* u,
+                              // out
+                              double* J,
+
+                              // in
+                              const mrcal_point2_t* q,
+                              mrcal_lensmodel_t lensmodel,
+                              // core, distortions concatenated
+                              const double* intrinsics,
+                              const mrcal_projection_precomputed_t* precomputed)
+{
+    // Newton's method converges quadratically near the solution, so this is
+    // plenty if the seed is any good
+    const int    Niterations_max = 10;
+    // Converged if we're within this many pixels of q
+    const double threshold_pixels = 1e-6;
+
+    double norm2x_prev = 1e300;
+    for(int i=0; i<Niterations_max; i++)
+    {
+        double x[2];
+        unproject_residual(x, J, u, q, lensmodel, intrinsics, precomputed);
+
+        double norm2x = x[0]*x[0] + x[1]*x[1];
+        if(!isfinite(norm2x) || norm2x > norm2x_prev)
+            // Diverging
+            return false;
+        norm2x_prev = norm2x;
+
+        double du[2];
+        if(!unproject_newton_step(du, x, J))
+            return false;
+        u[0] += du[0];
+        u[1] += du[1];
+
+        // Converged. The step I just took squared the error yet again, so
+        // it's well below the threshold now
+        if(norm2x < threshold_pixels*threshold_pixels)
+            return true;
+    }
+    return false;
 }
 
 // NOT A PART OF THE EXTERNAL API. This is exported for the mrcal python wrapper
@@ -2559,6 +4153,17 @@ bool _mrcal_unproject_internal( // out
     double cx = intrinsics[2];
     double cy = intrinsics[3];
 
+    // If the previous point was solved with Newton's method and it is within
+    // this many pixels of this point, I seed this point from the previous
+    // solution. When unprojecting a grid of pixels (a whole imager, say) this
+    // makes the seeds very good, and Newton's method converges in an iteration
+    // or two
+    const double neighbor_seed_max_distance_pixels = 16.;
+
+    bool   have_prev = false;
+    double u_prev[2] = {}; // init to pacify compiler warning
+    double J_prev[4] = {};
+
     // I optimize in the space of the stereographic projection. This is a 2D
     // space with a direct mapping to/from observation vectors with a single
     // singularity directly behind the camera. The allows me to run an
@@ -2570,114 +4175,116 @@ bool _mrcal_unproject_internal( // out
                 double*         J,
                 void*           cookie __attribute__((unused)))
         {
-            // u is the constant-fxy-cxy 2D stereographic
-            // projection of the hypothesis v. I unproject it stereographically,
-            // and project it using the actual model
-            mrcal_point2_t dv_du[3];
-            mrcal_pose_t frame = {};
-            mrcal_unproject_stereographic( &frame.t, dv_du,
-                                           (mrcal_point2_t*)u, 1,
-                                           fx,fy,cx,cy );
-
-            mrcal_point3_t dq_dtframe[2];
-            mrcal_point2_t q_hypothesis;
-            project( &q_hypothesis,
-                     NULL,NULL,NULL,NULL,NULL,
-                     NULL, NULL, NULL, dq_dtframe,
-                     NULL,
-
-                     // in
-                     intrinsics,
-                     NULL,
-                     &frame,
-                     NULL,
-                     true,
-                     lensmodel, precomputed,
-                     0.0, 0,0);
-            x[0] = q_hypothesis.x - q[i].x;
-            x[1] = q_hypothesis.y - q[i].y;
-            J[0*2 + 0] =
-                dq_dtframe[0].x*dv_du[0].x +
-                dq_dtframe[0].y*dv_du[1].x +
-                dq_dtframe[0].z*dv_du[2].x;
-            J[0*2 + 1] =
-                dq_dtframe[0].x*dv_du[0].y +
-                dq_dtframe[0].y*dv_du[1].y +
-                dq_dtframe[0].z*dv_du[2].y;
-            J[1*2 + 0] =
-                dq_dtframe[1].x*dv_du[0].x +
-                dq_dtframe[1].y*dv_du[1].x +
-                dq_dtframe[1].z*dv_du[2].x;
-            J[1*2 + 1] =
-                dq_dtframe[1].x*dv_du[0].y +
-                dq_dtframe[1].y*dv_du[1].y +
-                dq_dtframe[1].z*dv_du[2].y;
+            unproject_residual(x, J, u, &q[i],
+                               lensmodel, intrinsics, precomputed);
         }
 
-
-        // WARNING: This should go away. For some reason it makes unproject() converge better, and it makes the tests pass. But it's not even right!
+        void seed_default(void)
+        {
+            // WARNING: This should go away. For some reason it makes unproject() converge better, and it makes the tests pass. But it's not even right!
 #if 0
-        out->xyz[0] = (q[i].x-cx)/fx;
-        out->xyz[1] = (q[i].y-cy)/fy;
+            out->xyz[0] = (q[i].x-cx)/fx;
+            out->xyz[1] = (q[i].y-cy)/fy;
 #else
-        // Seed from a perfect stereographic projection, pushed towards the
-        // center a bit. Normally I'd set out[] to q[i], but for some models
-        // (OPENCV8 for instance) this pushes us into a place where stuff
-        // doesn't converge anymore. This produces a more stable solution, and
-        // my tests pass
-        out->xyz[0] = (q[i].x-cx)*0.7 + cx;
-        out->xyz[1] = (q[i].y-cy)*0.7 + cy;
-
-        // something like this makes more sense, but it doesn't work! The tests still fail
-        // out->xyz[0] = (q[i].x-cx)/fx * 0.7;
-        // out->xyz[1] = (q[i].y-cy)/fy * 0.7;
+            // Seed from a perfect stereographic projection, pushed towards the
+            // center a bit. Normally I'd set out[] to q[i], but for some models
+            // (OPENCV8 for instance) this pushes us into a place where stuff
+            // doesn't converge anymore. This produces a more stable solution, and
+            // my tests pass
+            out->xyz[0] = (q[i].x-cx)*0.7 + cx;
+            out->xyz[1] = (q[i].y-cy)*0.7 + cy;
+
+            // something like this makes more sense, but it doesn't work! The tests still fail
+            // out->xyz[0] = (q[i].x-cx)/fx * 0.7;
+            // out->xyz[1] = (q[i].y-cy)/fy * 0.7;
 #endif
+        }
 
-
-
-
-
-        dogleg_parameters2_t dogleg_parameters;
-        dogleg_getDefaultParameters(&dogleg_parameters);
-        dogleg_parameters.dogleg_debug = 0;
-        double norm2x =
-            dogleg_optimize_dense2(out->xyz, 2, 2, cb, NULL,
-                                   &dogleg_parameters,
-                                   NULL);
-        //This needs to be precise; if it isn't, I barf. Shouldn't happen
-        //very often
-
-        static bool already_complained = false;
-        if(norm2x/2.0 > 1e-4)
+        // The fast path: Newton's method, seeded from the previous point if
+        // it's close, or from the default seed otherwise
+        bool solved = false;
+        double J[4];
+        if(have_prev)
         {
-            if(!already_complained)
+            double dq[2] = { q[i].x - q[i-1].x,
+                             q[i].y - q[i-1].y };
+            double du[2];
+            if(dq[0]*dq[0] + dq[1]*dq[1] <
+               neighbor_seed_max_distance_pixels*neighbor_seed_max_distance_pixels &&
+               unproject_newton_step(du, (const double[]){-dq[0], -dq[1]}, J_prev))
             {
-                // MSG("WARNING: I wasn't able to precisely compute some points. norm2x=%f. Returning nan for those. Will complain just once",
-                //     norm2x);
-                already_complained = true;
+                // First-order prediction from the previous solution:
+                // u = u_prev + inv(J_prev) (q - q_prev)
+                out->xyz[0] = u_prev[0] + du[0];
+                out->xyz[1] = u_prev[1] + du[1];
+                solved = unproject_newton(out->xyz, J, &q[i],
+                                          lensmodel, intrinsics, precomputed);
             }
-            double nan = strtod("NAN", NULL);
-            out->xyz[0] = nan;
-            out->xyz[1] = nan;
+        }
+        if(!solved)
+        {
+            seed_default();
+            solved = unproject_newton(out->xyz, J, &q[i],
+                                      lensmodel, intrinsics, precomputed);
+        }
+
+        have_prev = solved;
+        if(solved)
+        {
+            u_prev[0] = out->xyz[0];
+            u_prev[1] = out->xyz[1];
+            memcpy(J_prev, J, sizeof(J_prev));
         }
         else
         {
-            // out[0,1] is the stereographic representation of the observation
-            // vector using idealized fx,fy,cx,cy. This is already the right
-            // thing if we're reporting in 2d. Otherwise I need to unproject
-
-            // This is the normal no-error path
-            mrcal_unproject_stereographic((mrcal_point3_t*)out, NULL,
-                                          (mrcal_point2_t*)out, 1,
-                                          fx,fy,cx,cy);
-            if(!model_supports_projection_behind_camera(lensmodel) && out->xyz[2] < 0.0)
+            // The slow path. Newton's method didn't converge quickly, so I fall
+            // back to a full trust-region solve
+            seed_default();
+
+            dogleg_parameters2_t dogleg_parameters;
+            dogleg_getDefaultParameters(&dogleg_parameters);
+            dogleg_parameters.dogleg_debug = 0;
+            double norm2x =
+                dogleg_optimize_dense2(out->xyz, 2, 2, cb, NULL,
+                                       &dogleg_parameters,
+                                       NULL);
+            //This needs to be precise; if it isn't, I barf. Shouldn't happen
+            //very often
+
+            static bool already_complained = false;
+            if(norm2x/2.0 > 1e-4)
             {
-                out->xyz[0] *= -1.0;
-                out->xyz[1] *= -1.0;
-                out->xyz[2] *= -1.0;
+                if(!already_complained)
+                {
+                    // MSG("WARNING: I wasn't able to precisely compute some points. norm2x=%f. Returning nan for those. Will complain just once",
+                    //     norm2x);
+                    already_complained = true;
+                }
+                double nan = strtod("NAN", NULL);
+                out->xyz[0] = nan;
+                out->xyz[1] = nan;
+
+                // Advance to the next point
+                out++;
+                continue;
             }
         }
 
+        // out[0,1] is the stereographic representation of the observation
+        // vector using idealized fx,fy,cx,cy. This is already the right
+        // thing if we're reporting in 2d. Otherwise I need to unproject
+
+        // This is the normal no-error path
+        mrcal_unproject_stereographic((mrcal_point3_t*)out, NULL,
+                                      (mrcal_point2_t*)out, 1,
+                                      fx,fy,cx,cy);
+        if(!model_supports_projection_behind_camera(lensmodel) && out->xyz[2] < 0.0)
+        {
+            out->xyz[0] *= -1.0;
+            out->xyz[1] *= -1.0;
+            out->xyz[2] *= -1.0;
+        }
+
         // Advance to the next point. Error or not
         out++;
     }
@@ -3321,26 +4928,141 @@ bool mrcal_corresponding_icam_extrinsics(// out
     return true;
 }
 
-// Doing this myself instead of hooking into the logic in libdogleg for now.
-// Bring back the fancy libdogleg logic once everything stabilizes
-static
-bool markOutliers(// output, input
+// The robust loss functions. Each scalar reprojection error x contributes
+// rho(x^2) to the cost. libdogleg minimizes norm2(x), so I report each
+// measurement as psi(x) = sign(x) sqrt(rho(x^2)) instead: norm2() of those is
+// the cost I want. The jacobian row is scaled by dpsi/dx. This is exact, and
+// doesn't touch the sparsity pattern
+//
+// k is the loss scale, in pixels
+static void apply_loss(// in,out
+                       double* x,
+                       // in,out. The jacobian row. May be NULL
+                       double* J, int NJ,
+
+                       // in
+                       mrcal_loss_t loss, double k)
+{
+    const double xabs = fabs(*x);
+    double psiabs, dpsi_dx;
 
-                  // the weight stored in each mrcal_point3_t.z indicates outlierness
-                  // on entry AND on exit. Outliers have weight < 0.0
-                  mrcal_point3_t* observations_board_pool,
+    switch(loss)
+    {
+    case MRCAL_LOSS_HUBER:
+        if(xabs <= k)
+            return;
+        psiabs  = sqrt(2.*k*xabs - k*k);
+        dpsi_dx = k / psiabs;
+        break;
+
+    case MRCAL_LOSS_CAUCHY:
+        if(xabs < 1e-8*k)
+            // psi(x) = x + O(x^3)
+            return;
+        psiabs  = k * sqrt(log1p(xabs*xabs/(k*k)));
+        dpsi_dx = xabs / ((1. + xabs*xabs/(k*k)) * psiabs);
+        break;
 
-                  // output
-                  int* Noutliers,
+    default:
+        return;
+    }
 
-                  // input
-                  const mrcal_observation_board_t* observations_board,
-                  int Nobservations_board,
-                  int calibration_object_width_n,
-                  int calibration_object_height_n,
+    *x = copysign(psiabs, *x);
+    if(J != NULL)
+        for(int i=0; i<NJ; i++)
+            J[i] *= dpsi_dx;
+}
 
-                  const double* x_measurements,
-                  double observed_pixel_uncertainty,
+// The inverse of apply_loss(): returns the raw reprojection error x from
+// psi(x)
+static double unapply_loss(double psi,
+                           mrcal_loss_t loss, double k)
+{
+    const double psiabs = fabs(psi);
+    switch(loss)
+    {
+    case MRCAL_LOSS_HUBER:
+        if(psiabs <= k)
+            return psi;
+        return copysign((psiabs*psiabs + k*k) / (2.*k), psi);
+
+    case MRCAL_LOSS_CAUCHY:
+        return copysign(k * sqrt(expm1(psiabs*psiabs/(k*k))), psi);
+
+    default:
+        return psi;
+    }
+}
+
+// The solver sees the reprojection errors with the loss applied. This converts
+// them back to pixels in the measurement vector x, in place. The range
+// penalties and the regularization are never robustified, so they're left
+// alone. Returns the new norm2(x)
+static double unapply_loss_measurements(// in,out
+                                        double* x,
+
+                                        // in
+                                        int Nmeasurements,
+                                        int Nobservations_board,
+                                        int Nobservations_point,
+                                        int calibration_object_width_n,
+                                        int calibration_object_height_n,
+                                        mrcal_loss_t loss, double k)
+{
+    const int imeasurement_boards =
+        mrcal_measurement_index_boards(0,
+                                       Nobservations_board,
+                                       Nobservations_point,
+                                       calibration_object_width_n,
+                                       calibration_object_height_n);
+    const int Nmeasurements_boards =
+        mrcal_num_measurements_boards(Nobservations_board,
+                                      calibration_object_width_n,
+                                      calibration_object_height_n);
+    for(int i=0; i<Nmeasurements_boards; i++)
+        x[imeasurement_boards + i] = unapply_loss(x[imeasurement_boards + i], loss, k);
+
+    // Each point observation has x, y, then the range penalty
+    const int imeasurement_points =
+        mrcal_measurement_index_points(0,
+                                       Nobservations_board,
+                                       Nobservations_point,
+                                       calibration_object_width_n,
+                                       calibration_object_height_n);
+    for(int i=0; i<Nobservations_point; i++)
+        for(int i_xy=0; i_xy<2; i_xy++)
+            x[imeasurement_points + 3*i + i_xy] =
+                unapply_loss(x[imeasurement_points + 3*i + i_xy], loss, k);
+
+    double norm2 = 0.0;
+    for(int i=0; i<Nmeasurements; i++)
+        norm2 += x[i]*x[i];
+    return norm2;
+}
+
+// Doing this myself instead of hooking into the logic in libdogleg for now.
+// Bring back the fancy libdogleg logic once everything stabilizes
+static
+bool markOutliers(// output, input
+
+                  // the weight stored in each mrcal_point3_t.z indicates outlierness
+                  // on entry AND on exit. Outliers have weight < 0.0
+                  mrcal_point3_t* observations_board_pool,
+
+                  // output
+                  int* Noutliers,
+
+                  // input
+                  const mrcal_observation_board_t* observations_board,
+                  int Nobservations_board,
+                  int calibration_object_width_n,
+                  int calibration_object_height_n,
+
+                  // The measurements, with the loss applied. I look at
+                  // the raw reprojection errors
+                  const double* x_measurements,
+                  mrcal_loss_t loss, double loss_scale,
+                  double observed_pixel_uncertainty,
                   bool verbose)
 {
     // I define an outlier as a feature that's > k stdevs past the mean. I make
@@ -3410,8 +5132,8 @@ bool markOutliers(// output, input
             continue;
         }
 
-        double dx = x_measurements[2*i_feature + 0];
-        double dy = x_measurements[2*i_feature + 1];
+        double dx = unapply_loss(x_measurements[2*i_feature + 0], loss, loss_scale);
+        double dy = unapply_loss(x_measurements[2*i_feature + 1], loss, loss_scale);
 
         var += *weight * (dx*dx + dy*dy);
         sum_weight += *weight;
@@ -3427,8 +5149,8 @@ bool markOutliers(// output, input
         if(*weight < 0.0)
           continue;
 
-        double dx = x_measurements[2*i_feature + 0];
-        double dy = x_measurements[2*i_feature + 1];
+        double dx = unapply_loss(x_measurements[2*i_feature + 0], loss, loss_scale);
+        double dy = unapply_loss(x_measurements[2*i_feature + 1], loss, loss_scale);
         if(dx*dx > k1*k1*var ||
            dy*dy > k1*k1*var )
         {
@@ -3455,8 +5177,8 @@ bool markOutliers(// output, input
         if(*weight < 0)
           continue;
 
-        double dx = x_measurements[2*i_feature + 0];
-        double dy = x_measurements[2*i_feature + 1];
+        double dx = unapply_loss(x_measurements[2*i_feature + 0], loss, loss_scale);
+        double dy = unapply_loss(x_measurements[2*i_feature + 1], loss, loss_scale);
         if(dx*dx > k0*k0*var ||
            dy*dy > k0*k0*var )
         {
@@ -3475,6 +5197,280 @@ bool markOutliers(// output, input
 #undef LOOP_FEATURE_END
 }
 
+// A contiguous subset of the board and point observations, evaluated by one
+// thread in optimizer_callback(). The measurement and jacobian offsets are
+// computed with the same per-observation counts _mrcal_num_j_nonzero() uses, so
+// each thread writes its own disjoint slice of x and Jt
+typedef struct
+{
+    // Observations [i_observation_board0,i_observation_board1) and
+    // [i_observation_point0,i_observation_point1)
+    int i_observation_board0, i_observation_board1;
+    int i_observation_point0, i_observation_point1;
+
+    // Where in x and Jt the board, point observations start and end
+    int iMeasurement_board0; int64_t iJacobian_board0;
+    int iMeasurement_board1; int64_t iJacobian_board1;
+    int iMeasurement_point0; int64_t iJacobian_point0;
+    int iMeasurement_point1; int64_t iJacobian_point1;
+} observation_chunk_t;
+
+// How many chunks the observations are split into, given the requested number
+// of threads. Always at least 1
+static int num_observation_chunks(int Nthreads,
+                                  int Nobservations_board,
+                                  int Nobservations_point)
+{
+    // No point in having more threads than observations
+    int Nobservations_max = Nobservations_board > Nobservations_point ?
+        Nobservations_board : Nobservations_point;
+    if(Nthreads > Nobservations_max) Nthreads = Nobservations_max;
+    if(Nthreads < 1)                 Nthreads = 1;
+    return Nthreads;
+}
+
+// Splits the observations into Nchunks chunks, as returned by
+// num_observation_chunks()
+static void
+compute_observation_chunks(// out
+                           observation_chunk_t* chunks,
+
+                           // in
+                           int Nchunks,
+                           int Nobservations_board,
+                           int Nobservations_point,
+                           int calibration_object_width_n,
+                           int calibration_object_height_n,
+                           int Npoints, int Npoints_fixed,
+                           const mrcal_observation_board_t* observations_board,
+                           const mrcal_observation_point_t* observations_point,
+                           mrcal_problem_selections_t problem_selections,
+                           mrcal_lensmodel_t lensmodel)
+{
+    if(calibration_object_width_n  < 0) calibration_object_width_n  = 0;
+    if(calibration_object_height_n < 0) calibration_object_height_n = 0;
+
+    const int Nintrinsics_per_measurement =
+        num_intrinsics_optimization_params_per_measurement(problem_selections,
+                                                           lensmodel);
+    const int Nmeasurements_boards =
+        mrcal_num_measurements_boards(Nobservations_board,
+                                      calibration_object_width_n,
+                                      calibration_object_height_n);
+
+    // All the board observations come before all the point observations, so I
+    // make two passes
+    int64_t iJacobian = 0;
+    for(int ichunk=0; ichunk<Nchunks; ichunk++)
+    {
+        observation_chunk_t* chunk = &chunks[ichunk];
+
+        chunk->i_observation_board0 = (int)((long)Nobservations_board* ichunk   /Nchunks);
+        chunk->i_observation_board1 = (int)((long)Nobservations_board*(ichunk+1)/Nchunks);
+
+        chunk->iMeasurement_board0 =
+            mrcal_measurement_index_boards(chunk->i_observation_board0,
+                                           Nobservations_board, Nobservations_point,
+                                           calibration_object_width_n,
+                                           calibration_object_height_n);
+        chunk->iMeasurement_board1 =
+            mrcal_measurement_index_boards(chunk->i_observation_board1,
+                                           Nobservations_board, Nobservations_point,
+                                           calibration_object_width_n,
+                                           calibration_object_height_n);
+        chunk->iJacobian_board0 = iJacobian;
+        for(int i=chunk->i_observation_board0; i<chunk->i_observation_board1; i++)
+            iJacobian += num_j_nonzero_observation_board(&observations_board[i],
+                                                         calibration_object_width_n,
+                                                         calibration_object_height_n,
+                                                         problem_selections,
+                                                         Nintrinsics_per_measurement);
+        chunk->iJacobian_board1 = iJacobian;
+    }
+    for(int ichunk=0; ichunk<Nchunks; ichunk++)
+    {
+        observation_chunk_t* chunk = &chunks[ichunk];
+
+        chunk->i_observation_point0 = (int)((long)Nobservations_point* ichunk   /Nchunks);
+        chunk->i_observation_point1 = (int)((long)Nobservations_point*(ichunk+1)/Nchunks);
+
+        // Each point observation produces 3 measurements: x, y, range
+        chunk->iMeasurement_point0 = Nmeasurements_boards + 3*chunk->i_observation_point0;
+        chunk->iMeasurement_point1 = Nmeasurements_boards + 3*chunk->i_observation_point1;
+        chunk->iJacobian_point0 = iJacobian;
+        for(int i=chunk->i_observation_point0; i<chunk->i_observation_point1; i++)
+            iJacobian += num_j_nonzero_observation_point(&observations_point[i],
+                                                         Npoints, Npoints_fixed,
+                                                         problem_selections,
+                                                         Nintrinsics_per_measurement);
+        chunk->iJacobian_point1 = iJacobian;
+    }
+}
+
+// The user-facing workspace is just a block of memory that is grown as needed.
+// workspace_layout() carves it up for a particular problem
+struct mrcal_workspace_t
+{
+    void*  buffer;
+    size_t size;
+};
+
+mrcal_workspace_t* mrcal_workspace_new(void)
+{
+    mrcal_workspace_t* workspace = calloc(1, sizeof(mrcal_workspace_t));
+    if(workspace == NULL)
+        MSG("Couldn't allocate the workspace");
+    return workspace;
+}
+
+void mrcal_workspace_free(mrcal_workspace_t* workspace)
+{
+    if(workspace == NULL)
+        return;
+    free(workspace->buffer);
+    free(workspace);
+}
+
+// The scratch buffers used by a solve, all pointing into a mrcal_workspace_t
+typedef struct
+{
+    observation_chunk_t* observation_chunks; // Nobservation_chunks of these
+    double*              packed_state;       // Nstate of these
+    double*              intrinsics_all;     // Ncameras_intrinsics*Nintrinsics of these
+    mrcal_pose_t*        camera_rt;          // Ncameras_extrinsics of these
+    mrcal_pose_t*        frames_rt;          // Nframes of these
+
+    // R_from_r() of camera_rt and frames_rt. Ncameras_extrinsics and Nframes
+    // of these
+    rotation_precomputed_t* camera_R;
+    rotation_precomputed_t* frame_R;
+
+    // The calibration object geometry, from calibration_object_points().
+    // Npoints_board of each
+    mrcal_point3_t*      calobject_ref;
+    mrcal_point2_t*      dcalobject_ref_dwarp;
+
+    // The projection gradients of a whole board observation, or of one point
+    // observation. Each observation chunk gets its own pool, so the threads
+    // don't step on each other. These are
+    // Nobservation_chunks*Ndq_dintrinsics_pool_double and
+    // Nobservation_chunks*Ndq_dintrinsics_pool_int long
+    double*              dq_dintrinsics_pool_double;
+    int*                 dq_dintrinsics_pool_int;
+    int                  Ndq_dintrinsics_pool_double, Ndq_dintrinsics_pool_int;
+
+    // The measurements at the optimum, if the solver doesn't keep its own.
+    // Nmeasurements_solver of these; may be NULL
+    double*              x_solver;
+} workspace_layout_t;
+
+// Makes sure the workspace is large enough for the given problem, and fills in
+// the layout. Returns false on error
+static bool workspace_layout(// out
+                             workspace_layout_t* layout,
+
+                             // in,out
+                             mrcal_workspace_t* workspace,
+
+                             // in
+                             int Nobservation_chunks, int Nstate,
+                             int Ncameras_intrinsics, int Ncameras_extrinsics,
+                             int Nframes,
+                             int Nintrinsics,
+                             int calibration_object_width_n,
+                             int calibration_object_height_n,
+                             int Nmeasurements_solver)
+{
+    const int Npoints_board =
+        (calibration_object_width_n  > 0 ? calibration_object_width_n  : 0) *
+        (calibration_object_height_n > 0 ? calibration_object_height_n : 0);
+    // The point observations need a pool for a single point
+    const int Npoints_pool  = Npoints_board > 0 ? Npoints_board : 1;
+    layout->Ndq_dintrinsics_pool_double = Npoints_pool*2*(1+Nintrinsics);
+    layout->Ndq_dintrinsics_pool_int    = Npoints_pool;
+
+    // Each buffer starts at a 16-byte boundary
+    size_t size = 0;
+    size_t reserve(size_t Nbytes)
+    {
+        size_t offset = size;
+        size += (Nbytes + 15) & ~(size_t)15;
+        return offset;
+    }
+    const size_t offset_observation_chunks =
+        reserve(Nobservation_chunks * sizeof(observation_chunk_t));
+    const size_t offset_packed_state =
+        reserve(Nstate * sizeof(double));
+    const size_t offset_intrinsics_all =
+        reserve(Ncameras_intrinsics*Nintrinsics * sizeof(double));
+    const size_t offset_camera_rt =
+        reserve(Ncameras_extrinsics * sizeof(mrcal_pose_t));
+    const size_t offset_frames_rt =
+        reserve(Nframes * sizeof(mrcal_pose_t));
+    const size_t offset_camera_R =
+        reserve(Ncameras_extrinsics * sizeof(rotation_precomputed_t));
+    const size_t offset_frame_R =
+        reserve(Nframes * sizeof(rotation_precomputed_t));
+    const size_t offset_calobject_ref =
+        reserve(Npoints_board * sizeof(mrcal_point3_t));
+    const size_t offset_dcalobject_ref_dwarp =
+        reserve(Npoints_board * sizeof(mrcal_point2_t));
+    const size_t offset_dq_dintrinsics_pool_double =
+        reserve((size_t)Nobservation_chunks*layout->Ndq_dintrinsics_pool_double * sizeof(double));
+    const size_t offset_dq_dintrinsics_pool_int =
+        reserve((size_t)Nobservation_chunks*layout->Ndq_dintrinsics_pool_int    * sizeof(int));
+    const size_t offset_x_solver =
+        reserve(Nmeasurements_solver * sizeof(double));
+
+    if(size > workspace->size)
+    {
+        // I don't need the old contents, so I don't realloc()
+        free(workspace->buffer);
+        workspace->buffer = malloc(size);
+        if(workspace->buffer == NULL)
+        {
+            MSG("Couldn't allocate a workspace of %zu bytes", size);
+            workspace->size = 0;
+            return false;
+        }
+        workspace->size = size;
+    }
+
+    char* buffer = (char*)workspace->buffer;
+    layout->observation_chunks         = (observation_chunk_t*)&buffer[offset_observation_chunks];
+    layout->packed_state               = (double*)             &buffer[offset_packed_state];
+    layout->intrinsics_all             = (double*)             &buffer[offset_intrinsics_all];
+    layout->camera_rt                  = (mrcal_pose_t*)       &buffer[offset_camera_rt];
+    layout->frames_rt                  = (mrcal_pose_t*)       &buffer[offset_frames_rt];
+    layout->camera_R                   = (rotation_precomputed_t*)&buffer[offset_camera_R];
+    layout->frame_R                    = (rotation_precomputed_t*)&buffer[offset_frame_R];
+    layout->calobject_ref              = (mrcal_point3_t*)     &buffer[offset_calobject_ref];
+    layout->dcalobject_ref_dwarp       = (mrcal_point2_t*)     &buffer[offset_dcalobject_ref_dwarp];
+    layout->dq_dintrinsics_pool_double = (double*)             &buffer[offset_dq_dintrinsics_pool_double];
+    layout->dq_dintrinsics_pool_int    = (int*)                &buffer[offset_dq_dintrinsics_pool_int];
+    layout->x_solver                   = Nmeasurements_solver > 0 ?
+                                         (double*)             &buffer[offset_x_solver] : NULL;
+    return true;
+}
+
+// The sparsity pattern of the Jacobian depends only on the problem definition:
+// not on the state, and not on the outliers (their gradients are stored as
+// explicit 0). The solvers keep the same Jacobian buffers for the whole
+// solve, so the pattern needs to be written into each buffer only once. Later
+// callbacks write only the values. This keeps track of the buffers that have
+// the pattern already.
+//
+// This is active only while a solve is running: the buffers are owned by the
+// solver, and a new solve may allocate new ones at the same addresses
+#define JACOBIAN_STRUCTURE_CACHE_SIZE 4
+typedef struct
+{
+    bool        active;
+    int         N;
+    const void* Jrowptr[JACOBIAN_STRUCTURE_CACHE_SIZE];
+    const void* Jcolidx[JACOBIAN_STRUCTURE_CACHE_SIZE];
+} jacobian_structure_cache_t;
+
 typedef struct
 {
     // these are all UNPACKED
@@ -3508,35 +5504,119 @@ typedef struct
     int calibration_object_width_n;
     int calibration_object_height_n;
 
-    const int Nmeasurements, N_j_nonzero, Nintrinsics;
+    int     Nmeasurements, Nintrinsics;
+    int64_t N_j_nonzero;
+
+    // The board and point observations are split into Nobservation_chunks
+    // chunks, each one evaluated by a separate thread. Nobservation_chunks == 1
+    // means that everything is evaluated serially
+    const observation_chunk_t* observation_chunks;
+    int Nobservation_chunks;
+
+    // Scratch buffers. Nothing is allocated in the callback itself
+    workspace_layout_t workspace;
     const char* reportFitMsg;
+
+    // The Jacobians that already contain the sparsity pattern. May be NULL:
+    // the pattern is then written on every call
+    jacobian_structure_cache_t* Jt_structure_cache;
 } callback_context_t;
 
-static
-void optimizer_callback(// input state
-                       const double*   packed_state,
+// Returns true if the sparsity pattern must be written into this Jt. Records
+// Jt as having it
+static bool jacobian_structure_claim(jacobian_structure_cache_t* cache,
+                                     const cholmod_sparse* Jt,
+                                     int Nmeasurements, int64_t N_j_nonzero)
+{
+    if(cache == NULL || !cache->active)
+        return true;
 
-                       // output measurements
-                       double*         x,
+    for(int i=0; i<cache->N; i++)
+        if(cache->Jrowptr[i] == Jt->p &&
+           cache->Jcolidx[i] == Jt->i)
+        {
+            // A cheap sanity check: the pattern I wrote ends here
+            const int64_t end =
+                Jt->itype == CHOLMOD_LONG ?
+                ((const int64_t*)Jt->p)[Nmeasurements] :
+                ((const int*    )Jt->p)[Nmeasurements];
+            if(end == N_j_nonzero)
+                return false;
+            return true;
+        }
 
-                       // Jacobian
-                       cholmod_sparse* Jt,
+    // Too many buffers to keep track of. I just write the pattern every time
+    // into the ones I don't know about
+    if(cache->N < JACOBIAN_STRUCTURE_CACHE_SIZE)
+    {
+        cache->Jrowptr[cache->N] = Jt->p;
+        cache->Jcolidx[cache->N] = Jt->i;
+        cache->N++;
+    }
+    return true;
+}
 
-                       const callback_context_t* ctx)
+static void jacobian_structure_reset(jacobian_structure_cache_t* cache,
+                                     bool active)
 {
-    double norm2_error = 0.0;
+    cache->N      = 0;
+    cache->active = active;
+}
+
+// The jacobian uses 32-bit (CHOLMOD_INT) or 64-bit (CHOLMOD_LONG) indices. The
+// sparsity pattern is written through whichever of Jrowptr,Jcolidx (32-bit) or
+// Jrowptr_l,Jcolidx_l (64-bit) is non-NULL. If all of these are NULL, Jt already
+// has the pattern, and only the values are written
+typedef struct
+{
+    int*     Jrowptr;
+    int*     Jcolidx;
+    int64_t* Jrowptr_l;
+    int64_t* Jcolidx_l;
+} jacobian_structure_pointers_t;
+
+static jacobian_structure_pointers_t
+jacobian_structure_pointers(cholmod_sparse* Jt, bool write_structure)
+{
+    jacobian_structure_pointers_t ptrs = {};
+    if(Jt == NULL || !write_structure)
+        return ptrs;
+    if(Jt->itype == CHOLMOD_LONG)
+    {
+        ptrs.Jrowptr_l = (int64_t*)Jt->p;
+        ptrs.Jcolidx_l = (int64_t*)Jt->i;
+    }
+    else
+    {
+        ptrs.Jrowptr   = (int*)Jt->p;
+        ptrs.Jcolidx   = (int*)Jt->i;
+    }
+    return ptrs;
+}
 
-    int    iJacobian          = 0;
-    int    iMeasurement       = 0;
+// Starts a new row (measurement) in the jacobian
+#define STORE_JACOBIAN_ROWSTART(irow)                           \
+    do                                                          \
+    {                                                           \
+        if     (Jstructure.Jrowptr)                             \
+            Jstructure.Jrowptr  [irow] = (int)iJacobian;        \
+        else if(Jstructure.Jrowptr_l)                           \
+            Jstructure.Jrowptr_l[irow] = iJacobian;             \
+    } while(0)
+#define STORE_JACOBIAN_COLIDX(k, col)                           \
+    do                                                          \
+    {                                                           \
+        if     (Jstructure.Jcolidx)                             \
+            Jstructure.Jcolidx  [k] = col;                      \
+        else if(Jstructure.Jcolidx_l)                           \
+            Jstructure.Jcolidx_l[k] = col;                      \
+    } while(0)
 
-    int*    Jrowptr = Jt ? (int*)   Jt->p : NULL;
-    int*    Jcolidx = Jt ? (int*)   Jt->i : NULL;
-    double* Jval    = Jt ? (double*)Jt->x : NULL;
 #define STORE_JACOBIAN(col, g)                  \
     do                                          \
     {                                           \
         if(Jt) {                                \
-            Jcolidx[ iJacobian ] = col;         \
+            STORE_JACOBIAN_COLIDX(iJacobian, col); \
             Jval   [ iJacobian ] = g;           \
         }                                       \
         iJacobian++;                            \
@@ -3545,9 +5625,9 @@ void optimizer_callback(// input state
     do                                          \
     {                                           \
         if(Jt) {                                \
-            Jcolidx[ iJacobian+0 ] = col0+0;    \
+            STORE_JACOBIAN_COLIDX(iJacobian+0, col0+0); \
+            STORE_JACOBIAN_COLIDX(iJacobian+1, col0+1); \
             Jval   [ iJacobian+0 ] = g0;        \
-            Jcolidx[ iJacobian+1 ] = col0+1;    \
             Jval   [ iJacobian+1 ] = g1;        \
         }                                       \
         iJacobian += 2;                         \
@@ -3556,101 +5636,124 @@ void optimizer_callback(// input state
     do                                              \
     {                                               \
         if(Jt) {                                    \
-            Jcolidx[ iJacobian+0 ] = col0+0;        \
+            STORE_JACOBIAN_COLIDX(iJacobian+0, col0+0); \
+            STORE_JACOBIAN_COLIDX(iJacobian+1, col0+1); \
+            STORE_JACOBIAN_COLIDX(iJacobian+2, col0+2); \
             Jval   [ iJacobian+0 ] = g0;            \
-            Jcolidx[ iJacobian+1 ] = col0+1;        \
             Jval   [ iJacobian+1 ] = g1;            \
-            Jcolidx[ iJacobian+2 ] = col0+2;        \
             Jval   [ iJacobian+2 ] = g2;            \
         }                                           \
         iJacobian += 3;                             \
     } while(0)
 
 
-    int Ncore = modelHasCore_fxfycxcy(ctx->lensmodel) ? 4 : 0;
-    int Ncore_state = (modelHasCore_fxfycxcy(ctx->lensmodel) &&
-                       ctx->problem_selections.do_optimize_intrinsics_core) ? 4 : 0;
+// Everything optimizer_callback() computes once per call, and then shares
+// read-only with the threads that evaluate the observations
+typedef struct
+{
+    const callback_context_t* ctx;
+    const double*             packed_state;
+
+    // output
+    double*                   x;
+    cholmod_sparse*           Jt;
+    // If false, Jt already has the sparsity pattern, and I write only the
+    // values
+    bool                      write_Jt_structure;
+
+    // These are all UNPACKED
+    const double*             intrinsics_all; // Ncameras_intrinsics*Nintrinsics of these
+    const mrcal_pose_t*       camera_rt;      // Ncameras_extrinsics of these
+    const mrcal_pose_t*       frames_rt;      // Nframes of these
+
+    // R_from_r() of camera_rt and frames_rt, computed once per callback, and
+    // shared by all the observations of each camera and frame
+    const rotation_precomputed_t* camera_R;   // Ncameras_extrinsics of these
+    const rotation_precomputed_t* frame_R;    // Nframes of these
+
+    // The calibration object geometry, with the warp applied. The same for
+    // all the observations in this callback. Npoints_board of each
+    const mrcal_point3_t*     calobject_ref;
+    const mrcal_point2_t*     dcalobject_ref_dwarp;
+
+    int                       i_var_calobject_warp;
+    int                       Ncore, Ncore_state;
+} callback_evaluation_t;
 
-    // If I'm locking down some parameters, then the state vector contains a
-    // subset of my data. I reconstitute the intrinsics and extrinsics here.
-    // I do the frame poses later. This is a good way to do it if I have few
-    // cameras. With many cameras (this will be slow)
+typedef struct
+{
+    const callback_evaluation_t* evaluation;
+    const observation_chunk_t*   chunk;
+
+    // This chunk's slice of the workspace
+    double*                      dq_dintrinsics_pool_double;
+    int*                         dq_dintrinsics_pool_int;
+
+    // out
+    double                       norm2_error;
+} observation_chunk_work_t;
+
+// Evaluates the board and point observations in one chunk. This writes into a
+// slice of x and Jt that no other chunk touches, so the chunks may be evaluated
+// in parallel. The serial path evaluates all the observations as a single
+// chunk. Usable as a pthread entry point
+static void* evaluate_observation_chunk(void* _work)
+{
+    observation_chunk_work_t*    work  = (observation_chunk_work_t*)_work;
+    const callback_evaluation_t* e     = work->evaluation;
+    const observation_chunk_t*   chunk = work->chunk;
+    const callback_context_t*    ctx   = e->ctx;
+
+    const double*   packed_state = e->packed_state;
+    double*         x            = e->x;
+    cholmod_sparse* Jt           = e->Jt;
+
+    const jacobian_structure_pointers_t Jstructure =
+        jacobian_structure_pointers(Jt, e->write_Jt_structure);
+    double* Jval = Jt ? (double*)Jt->x : NULL;
+
+    // All the observations use the same lens model
+    project_function_t* project = project_function(ctx->lensmodel);
+
+    const double (*intrinsics_all)[ctx->Nintrinsics] =
+        (const double (*)[ctx->Nintrinsics])e->intrinsics_all;
+    const mrcal_pose_t*  camera_rt            = e->camera_rt;
+    const mrcal_pose_t*  frames_rt            = e->frames_rt;
+    const int            i_var_calobject_warp = e->i_var_calobject_warp;
+    const int            Ncore                = e->Ncore;
+    const int            Ncore_state          = e->Ncore_state;
+
+    // The loss applies to the reprojection errors only
+    const mrcal_loss_t   loss       = ctx->problem_constants != NULL ? ctx->problem_constants->loss       : MRCAL_LOSS_SQUARED;
+    const double         loss_scale = ctx->problem_constants != NULL ? ctx->problem_constants->loss_scale : 0.0;
 
-    // WARNING: sparsify this. This is potentially a BIG thing on the stack
-    double intrinsics_all[ctx->Ncameras_intrinsics][ctx->Nintrinsics];
-    mrcal_pose_t camera_rt[ctx->Ncameras_extrinsics];
+    double norm2_error = 0.0;
 
-    mrcal_point2_t calobject_warp_local = {};
-    const int i_var_calobject_warp =
-        mrcal_state_index_calobject_warp(ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
-                                         ctx->Nframes,
-                                         ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
-                                         ctx->problem_selections, ctx->lensmodel);
-    if(ctx->problem_selections.do_optimize_calobject_warp)
-        unpack_solver_state_calobject_warp(&calobject_warp_local, &packed_state[i_var_calobject_warp]);
-    else if(ctx->calobject_warp != NULL)
-        calobject_warp_local = *ctx->calobject_warp;
+    int64_t iJacobian          = chunk->iJacobian_board0;
+    int     iMeasurement       = chunk->iMeasurement_board0;
 
-    for(int icam_intrinsics=0;
-        icam_intrinsics<ctx->Ncameras_intrinsics;
-        icam_intrinsics++)
+    void check_chunk_layout(const char* what,
+                            int iMeasurement_expected, int64_t iJacobian_expected)
     {
-        // Construct the FULL intrinsics vector, based on either the
-        // optimization vector or the inputs, depending on what we're optimizing
-        double* intrinsics_here  = &intrinsics_all[icam_intrinsics][0];
-        double* distortions_here = &intrinsics_all[icam_intrinsics][Ncore];
-
-        int i_var_intrinsics =
-            mrcal_state_index_intrinsics(icam_intrinsics,
-                                         ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
-                                         ctx->Nframes,
-                                         ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
-                                         ctx->problem_selections, ctx->lensmodel);
-        if(Ncore)
+        if( ctx->reportFitMsg )
+            return;
+        if(iMeasurement != iMeasurement_expected)
         {
-            if( ctx->problem_selections.do_optimize_intrinsics_core )
-            {
-                intrinsics_here[0] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_FOCAL_LENGTH;
-                intrinsics_here[1] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_FOCAL_LENGTH;
-                intrinsics_here[2] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_CENTER_PIXEL;
-                intrinsics_here[3] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_CENTER_PIXEL;
-            }
-            else
-                memcpy( intrinsics_here,
-                        &ctx->intrinsics[ctx->Nintrinsics*icam_intrinsics],
-                        Ncore*sizeof(double) );
+            MSG("Assertion (iMeasurement == iMeasurement_expected) failed after the %s observations: (%d != %d)",
+                what, iMeasurement, iMeasurement_expected);
+            assert(0);
         }
-        if( ctx->problem_selections.do_optimize_intrinsics_distortions )
+        if(iJacobian    != iJacobian_expected   )
         {
-            for(int i = 0; i<ctx->Nintrinsics-Ncore; i++)
-                distortions_here[i] = packed_state[i_var_intrinsics++] * SCALE_DISTORTION;
+            MSG("Assertion (iJacobian    == iJacobian_expected   ) failed after the %s observations: (%lld != %lld)",
+                what, (long long)iJacobian, (long long)iJacobian_expected);
+            assert(0);
         }
-        else
-            memcpy( distortions_here,
-                    &ctx->intrinsics[ctx->Nintrinsics*icam_intrinsics + Ncore],
-                    (ctx->Nintrinsics-Ncore)*sizeof(double) );
-    }
-    for(int icam_extrinsics=0;
-        icam_extrinsics<ctx->Ncameras_extrinsics;
-        icam_extrinsics++)
-    {
-        if( icam_extrinsics < 0 ) continue;
-
-        const int i_var_camera_rt =
-            mrcal_state_index_extrinsics(icam_extrinsics,
-                                         ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
-                                         ctx->Nframes,
-                                         ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
-                                         ctx->problem_selections, ctx->lensmodel);
-        if(ctx->problem_selections.do_optimize_extrinsics)
-            unpack_solver_state_extrinsics_one(&camera_rt[icam_extrinsics], &packed_state[i_var_camera_rt]);
-        else
-            memcpy(&camera_rt[icam_extrinsics], &ctx->extrinsics_fromref[icam_extrinsics], sizeof(mrcal_pose_t));
     }
-
-    int i_feature = 0;
-    for(int i_observation_board = 0;
-        i_observation_board < ctx->Nobservations_board;
+    int i_feature = chunk->i_observation_board0 *
+        ctx->calibration_object_width_n*ctx->calibration_object_height_n;
+    for(int i_observation_board = chunk->i_observation_board0;
+        i_observation_board < chunk->i_observation_board1;
         i_observation_board++)
     {
         const mrcal_observation_board_t* observation = &ctx->observations_board[i_observation_board];
@@ -3668,11 +5771,6 @@ void optimizer_callback(// input state
                                      ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
                                      ctx->problem_selections, ctx->lensmodel);
 
-        mrcal_pose_t frame_rt;
-        if(ctx->problem_selections.do_optimize_frames)
-            unpack_solver_state_framert_one(&frame_rt, &packed_state[i_var_frame_rt]);
-        else
-            memcpy(&frame_rt, &ctx->frames_toref[iframe], sizeof(mrcal_pose_t));
 
         const int i_var_intrinsics =
             mrcal_state_index_intrinsics(icam_intrinsics,
@@ -3705,8 +5803,11 @@ void optimizer_callback(// input state
         // cy. So x depends on fx and NOT on fy, and similarly for y. Similar
         // for cx,cy, except we know the gradient value beforehand. I support
         // this case explicitly here. I store dx/dfx and dy/dfy; no cross terms
-        double dq_dintrinsics_pool_double[ctx->calibration_object_width_n*ctx->calibration_object_height_n*2*(1+ctx->Nintrinsics)];
-        int    dq_dintrinsics_pool_int   [ctx->calibration_object_width_n*ctx->calibration_object_height_n];
+        //
+        // The pools are big for models with many parameters, so they live in
+        // the workspace, not on the stack
+        double* dq_dintrinsics_pool_double = work->dq_dintrinsics_pool_double;
+        int*    dq_dintrinsics_pool_int    = work->dq_dintrinsics_pool_int;
         double* dq_dfxy = NULL;
         double* dq_dintrinsics_nocore = NULL;
         gradient_sparse_meta_t gradient_sparse_meta = {};
@@ -3734,11 +5835,12 @@ void optimizer_callback(// input state
 
                 // input
                 intrinsics_all[icam_intrinsics],
-                &camera_rt[icam_extrinsics], &frame_rt,
-                ctx->calobject_warp == NULL ? NULL : &calobject_warp_local,
+                &camera_rt[icam_extrinsics], &frames_rt[iframe],
+                e->calobject_ref, e->dcalobject_ref_dwarp,
+                icam_extrinsics < 0 ? NULL : &e->camera_R[icam_extrinsics],
+                &e->frame_R[iframe],
                 icam_extrinsics < 0,
                 ctx->lensmodel, &ctx->precomputed,
-                ctx->calibration_object_spacing,
                 ctx->calibration_object_width_n,
                 ctx->calibration_object_height_n);
 
@@ -3765,9 +5867,9 @@ void optimizer_callback(// input state
                         continue;
                     }
 
-                    if(Jt) Jrowptr[iMeasurement] = iJacobian;
+                    const int64_t iJacobian_row = iJacobian;
+                    STORE_JACOBIAN_ROWSTART(iMeasurement);
                     x[iMeasurement] = err;
-                    norm2_error += err*err;
 
                     if( ctx->problem_selections.do_optimize_intrinsics_core )
                     {
@@ -3863,6 +5965,12 @@ void optimizer_callback(// input state
                                          dq_dcalobject_warp[i_pt][i_xy].y * weight * SCALE_CALOBJECT_WARP);
                     }
 
+                    if(loss != MRCAL_LOSS_SQUARED)
+                        apply_loss(&x[iMeasurement],
+                                   Jt ? &Jval[iJacobian_row] : NULL, (int)(iJacobian - iJacobian_row),
+                                   loss, loss_scale);
+                    norm2_error += x[iMeasurement]*x[iMeasurement];
+
                     iMeasurement++;
                 }
             }
@@ -3890,7 +5998,7 @@ void optimizer_callback(// input state
                         continue;
                     }
 
-                    if(Jt) Jrowptr[iMeasurement] = iJacobian;
+                    STORE_JACOBIAN_ROWSTART(iMeasurement);
                     x[iMeasurement] = err;
                     norm2_error += err*err;
 
@@ -3948,11 +6056,16 @@ void optimizer_callback(// input state
                 splined_intrinsics_grad_irun++;
         }
     }
+    check_chunk_layout("board",
+                       chunk->iMeasurement_board1, chunk->iJacobian_board1);
+
+    iJacobian    = chunk->iJacobian_point0;
+    iMeasurement = chunk->iMeasurement_point0;
 
     // Handle all the point observations. This is VERY similar to the
     // board-observation loop above. Please consolidate
-    for(int i_observation_point = 0;
-        i_observation_point < ctx->Nobservations_point;
+    for(int i_observation_point = chunk->i_observation_point0;
+        i_observation_point < chunk->i_observation_point1;
         i_observation_point++)
     {
         const mrcal_observation_point_t* observation = &ctx->observations_point[i_observation_point];
@@ -3995,7 +6108,7 @@ void optimizer_callback(// input state
             // gradient and store them
             for( int i_xy=0; i_xy<2; i_xy++ )
             {
-                if(Jt) Jrowptr[iMeasurement] = iJacobian;
+                STORE_JACOBIAN_ROWSTART(iMeasurement);
                 x[iMeasurement] = 0;
 
                 if( ctx->problem_selections.do_optimize_intrinsics_core )
@@ -4039,7 +6152,7 @@ void optimizer_callback(// input state
                 iMeasurement++;
             }
 
-            if(Jt) Jrowptr[iMeasurement] = iJacobian;
+            STORE_JACOBIAN_ROWSTART(iMeasurement);
             x[iMeasurement] = 0;
             if(icam_extrinsics >= 0 && ctx->problem_selections.do_optimize_extrinsics )
             {
@@ -4080,9 +6193,9 @@ void optimizer_callback(// input state
             point_ref = ctx->points[i_point];
 
 
-        // WARNING: "compute size(dq_dintrinsics_pool_double) correctly and maybe bounds-check"
-        double dq_dintrinsics_pool_double[2*(1+ctx->Nintrinsics)];
-        int    dq_dintrinsics_pool_int   [1];
+        // This chunk's pool always has room for at least one point
+        double* dq_dintrinsics_pool_double          = work->dq_dintrinsics_pool_double;
+        int*    dq_dintrinsics_pool_int             = work->dq_dintrinsics_pool_int;
         double* dq_dfxy                             = NULL;
         double* dq_dintrinsics_nocore               = NULL;
         gradient_sparse_meta_t gradient_sparse_meta = {};
@@ -4120,11 +6233,13 @@ void optimizer_callback(// input state
                 // points 3 back. The fake "r" here will not be
                 // referenced
                 (mrcal_pose_t*)(&point_ref.xyz[-3]),
-                NULL,
+                NULL, NULL,
 
+                icam_extrinsics < 0 ? NULL : &e->camera_R[icam_extrinsics],
+                NULL,
                 icam_extrinsics < 0,
                 ctx->lensmodel, &ctx->precomputed,
-                0,0,0);
+                0,0);
 #pragma GCC diagnostic pop
 
         // I have my two measurements (dx, dy). I propagate their
@@ -4133,9 +6248,9 @@ void optimizer_callback(// input state
         {
             const double err = (q_hypothesis.xy[i_xy] - qx_qy_w__observed->xyz[i_xy])*weight;
 
-            if(Jt) Jrowptr[iMeasurement] = iJacobian;
+            const int64_t iJacobian_row = iJacobian;
+            STORE_JACOBIAN_ROWSTART(iMeasurement);
             x[iMeasurement] = err;
-            norm2_error += err*err;
 
             if( ctx->problem_selections.do_optimize_intrinsics_core )
             {
@@ -4216,6 +6331,12 @@ void optimizer_callback(// input state
                                  dq_dpoint[i_xy].xyz[2] *
                                  weight * SCALE_POSITION_POINT);
 
+            if(loss != MRCAL_LOSS_SQUARED)
+                apply_loss(&x[iMeasurement],
+                           Jt ? &Jval[iJacobian_row] : NULL, (int)(iJacobian - iJacobian_row),
+                           loss, loss_scale);
+            norm2_error += x[iMeasurement]*x[iMeasurement];
+
             iMeasurement++;
         }
 
@@ -4266,7 +6387,7 @@ void optimizer_callback(// input state
                 dpenalty_ddistsq *= -1.;
             }
 
-            if(Jt) Jrowptr[iMeasurement] = iJacobian;
+            STORE_JACOBIAN_ROWSTART(iMeasurement);
             x[iMeasurement] = penalty;
             norm2_error += penalty*penalty;
 
@@ -4283,14 +6404,10 @@ void optimizer_callback(// input state
         }
         else
         {
-            // I need to transform the point. I already computed
-            // this stuff in project()...
-            double Rc[3*3];
-            double d_Rc_rc[9*3];
-
-            mrcal_R_from_r(Rc,
-                           d_Rc_rc,
-                           camera_rt[icam_extrinsics].r.xyz);
+            // I need to transform the point. The rotation was computed once
+            // for this callback
+            const double* Rc      = e->camera_R[icam_extrinsics].R;
+            const double* d_Rc_rc = e->camera_R[icam_extrinsics].d_R_r;
 
             mrcal_point3_t pcam;
             mul_vec3_gen33t_vout(point_ref.xyz, Rc, pcam.xyz);
@@ -4310,7 +6427,7 @@ void optimizer_callback(// input state
                 dpenalty_ddistsq *= -1.;
             }
 
-            if(Jt) Jrowptr[iMeasurement] = iJacobian;
+            STORE_JACOBIAN_ROWSTART(iMeasurement);
             x[iMeasurement] = penalty;
             norm2_error += penalty*penalty;
 
@@ -4359,41 +6476,244 @@ void optimizer_callback(// input state
             iMeasurement++;
         }
     }
+    check_chunk_layout("point",
+                       chunk->iMeasurement_point1, chunk->iJacobian_point1);
 
+    work->norm2_error = norm2_error;
+    return NULL;
+}
 
-    // regularization terms for the intrinsics. I favor smaller distortion
-    // parameters
-    if(ctx->problem_selections.do_apply_regularization &&
-       modelHasCore_fxfycxcy(ctx->lensmodel) &&
-       ( ctx->problem_selections.do_optimize_intrinsics_distortions ||
-         ctx->problem_selections.do_optimize_intrinsics_core
-         ))
-    {
-        // I want the total regularization cost to be low relative to the
-        // other contributions to the cost. And I want each set of
-        // regularization terms to weigh roughly the same. Let's say I want
-        // regularization to account for ~ .5% of the other error
-        // contributions:
-        //
-        //   Nmeasurements_rest*normal_pixel_error_sq * 0.005/2. =
-        //   Nmeasurements_regularization_distortion *normal_regularization_distortion_error_sq  =
-        //   Nmeasurements_regularization_centerpixel*normal_regularization_centerpixel_error_sq =
-        //
-        //   normal_regularization_distortion_error_sq  = (scale*normal_centerpixel_offset)^2
-        //   normal_regularization_centerpixel_error_sq = (scale*normal_distortion_value  )^2
-        //
-        // Regularization introduces a bias to the solution. The
-        // test-projection-uncertainty test measures it, and barfs if it is too
-        // high. The constants should be adjusted if that test fails.
-        const bool dump_regularizaton_details = false;
-
-        int    Nmeasurements_regularization_distortion  = ctx->Ncameras_intrinsics*(ctx->Nintrinsics-Ncore);
-        int    Nmeasurements_regularization_centerpixel = ctx->Ncameras_intrinsics*2;
+static
+void optimizer_callback(// input state
+                       const double*   packed_state,
 
-        int    Nmeasurements_nonregularization =
-            ctx->Nmeasurements -
-            Nmeasurements_regularization_distortion -
-            Nmeasurements_regularization_centerpixel;
+                       // output measurements
+                       double*         x,
+
+                       // Jacobian
+                       cholmod_sparse* Jt,
+
+                       const callback_context_t* ctx)
+{
+    double norm2_error = 0.0;
+
+    const bool write_Jt_structure =
+        Jt != NULL && jacobian_structure_claim(ctx->Jt_structure_cache, Jt,
+                                               ctx->Nmeasurements, ctx->N_j_nonzero);
+
+    const jacobian_structure_pointers_t Jstructure =
+        jacobian_structure_pointers(Jt, write_Jt_structure);
+    double* Jval = Jt ? (double*)Jt->x : NULL;
+
+    int Ncore = modelHasCore_fxfycxcy(ctx->lensmodel) ? 4 : 0;
+    int Ncore_state = (modelHasCore_fxfycxcy(ctx->lensmodel) &&
+                       ctx->problem_selections.do_optimize_intrinsics_core) ? 4 : 0;
+
+    // If I'm locking down some parameters, then the state vector contains a
+    // subset of my data. I reconstitute the intrinsics and extrinsics here.
+    // I do the frame poses later. This is a good way to do it if I have few
+    // cameras. With many cameras (this will be slow)
+
+    double (*intrinsics_all)[ctx->Nintrinsics] =
+        (double (*)[ctx->Nintrinsics])ctx->workspace.intrinsics_all;
+    mrcal_pose_t* camera_rt = ctx->workspace.camera_rt;
+    mrcal_pose_t* frames_rt = ctx->workspace.frames_rt;
+
+    mrcal_point2_t calobject_warp_local = {};
+    const int i_var_calobject_warp =
+        mrcal_state_index_calobject_warp(ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
+                                         ctx->Nframes,
+                                         ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
+                                         ctx->problem_selections, ctx->lensmodel);
+    if(ctx->problem_selections.do_optimize_calobject_warp)
+        unpack_solver_state_calobject_warp(&calobject_warp_local, &packed_state[i_var_calobject_warp]);
+    else if(ctx->calobject_warp != NULL)
+        calobject_warp_local = *ctx->calobject_warp;
+
+    if(ctx->Nobservations_board > 0)
+        calibration_object_points(ctx->workspace.calobject_ref,
+                                  ctx->workspace.dcalobject_ref_dwarp,
+                                  ctx->calobject_warp == NULL ? NULL : &calobject_warp_local,
+                                  ctx->calibration_object_spacing,
+                                  ctx->calibration_object_width_n,
+                                  ctx->calibration_object_height_n);
+
+    for(int icam_intrinsics=0;
+        icam_intrinsics<ctx->Ncameras_intrinsics;
+        icam_intrinsics++)
+    {
+        // Construct the FULL intrinsics vector, based on either the
+        // optimization vector or the inputs, depending on what we're optimizing
+        double* intrinsics_here  = &intrinsics_all[icam_intrinsics][0];
+        double* distortions_here = &intrinsics_all[icam_intrinsics][Ncore];
+
+        int i_var_intrinsics =
+            mrcal_state_index_intrinsics(icam_intrinsics,
+                                         ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
+                                         ctx->Nframes,
+                                         ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
+                                         ctx->problem_selections, ctx->lensmodel);
+        if(Ncore)
+        {
+            if( ctx->problem_selections.do_optimize_intrinsics_core )
+            {
+                intrinsics_here[0] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_FOCAL_LENGTH;
+                intrinsics_here[1] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_FOCAL_LENGTH;
+                intrinsics_here[2] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_CENTER_PIXEL;
+                intrinsics_here[3] = packed_state[i_var_intrinsics++] * SCALE_INTRINSICS_CENTER_PIXEL;
+            }
+            else
+                memcpy( intrinsics_here,
+                        &ctx->intrinsics[ctx->Nintrinsics*icam_intrinsics],
+                        Ncore*sizeof(double) );
+        }
+        if( ctx->problem_selections.do_optimize_intrinsics_distortions )
+        {
+            for(int i = 0; i<ctx->Nintrinsics-Ncore; i++)
+                distortions_here[i] = packed_state[i_var_intrinsics++] * SCALE_DISTORTION;
+        }
+        else
+            memcpy( distortions_here,
+                    &ctx->intrinsics[ctx->Nintrinsics*icam_intrinsics + Ncore],
+                    (ctx->Nintrinsics-Ncore)*sizeof(double) );
+    }
+    for(int icam_extrinsics=0;
+        icam_extrinsics<ctx->Ncameras_extrinsics;
+        icam_extrinsics++)
+    {
+        if( icam_extrinsics < 0 ) continue;
+
+        const int i_var_camera_rt =
+            mrcal_state_index_extrinsics(icam_extrinsics,
+                                         ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
+                                         ctx->Nframes,
+                                         ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
+                                         ctx->problem_selections, ctx->lensmodel);
+        if(ctx->problem_selections.do_optimize_extrinsics)
+            unpack_solver_state_extrinsics_one(&camera_rt[icam_extrinsics], &packed_state[i_var_camera_rt]);
+        else
+            memcpy(&camera_rt[icam_extrinsics], &ctx->extrinsics_fromref[icam_extrinsics], sizeof(mrcal_pose_t));
+
+        mrcal_R_from_r(ctx->workspace.camera_R[icam_extrinsics].R,
+                       ctx->workspace.camera_R[icam_extrinsics].d_R_r,
+                       camera_rt[icam_extrinsics].r.xyz);
+    }
+    // The frames are used by the board observations only
+    if(ctx->Nobservations_board > 0)
+        for(int iframe=0; iframe<ctx->Nframes; iframe++)
+        {
+            if(ctx->problem_selections.do_optimize_frames)
+            {
+                const int i_var_frame_rt =
+                    mrcal_state_index_frames(iframe,
+                                             ctx->Ncameras_intrinsics, ctx->Ncameras_extrinsics,
+                                             ctx->Nframes,
+                                             ctx->Npoints, ctx->Npoints_fixed, ctx->Nobservations_board,
+                                             ctx->problem_selections, ctx->lensmodel);
+                unpack_solver_state_framert_one(&frames_rt[iframe], &packed_state[i_var_frame_rt]);
+            }
+            else
+                memcpy(&frames_rt[iframe], &ctx->frames_toref[iframe], sizeof(mrcal_pose_t));
+
+            mrcal_R_from_r(ctx->workspace.frame_R[iframe].R,
+                           ctx->workspace.frame_R[iframe].d_R_r,
+                           frames_rt[iframe].r.xyz);
+        }
+
+    const callback_evaluation_t evaluation =
+        { .ctx                  = ctx,
+          .packed_state         = packed_state,
+          .x                    = x,
+          .Jt                   = Jt,
+          .write_Jt_structure   = write_Jt_structure,
+          .intrinsics_all       = &intrinsics_all[0][0],
+          .camera_rt            = camera_rt,
+          .frames_rt            = frames_rt,
+          .camera_R             = ctx->workspace.camera_R,
+          .frame_R              = ctx->workspace.frame_R,
+          .calobject_ref        = ctx->workspace.calobject_ref,
+          .dcalobject_ref_dwarp = ctx->workspace.dcalobject_ref_dwarp,
+          .i_var_calobject_warp = i_var_calobject_warp,
+          .Ncore                = Ncore,
+          .Ncore_state          = Ncore_state };
+
+    const int Nchunks = ctx->Nobservation_chunks;
+    observation_chunk_work_t work[Nchunks];
+    for(int ichunk=0; ichunk<Nchunks; ichunk++)
+        work[ichunk] = (observation_chunk_work_t)
+            { .evaluation                 = &evaluation,
+              .chunk                      = &ctx->observation_chunks[ichunk],
+              .dq_dintrinsics_pool_double = &ctx->workspace.dq_dintrinsics_pool_double[ichunk*ctx->workspace.Ndq_dintrinsics_pool_double],
+              .dq_dintrinsics_pool_int    = &ctx->workspace.dq_dintrinsics_pool_int   [ichunk*ctx->workspace.Ndq_dintrinsics_pool_int] };
+
+    if(Nchunks == 1 || ctx->reportFitMsg)
+    {
+        // Serial evaluation. The reportFitMsg diagnostics are written in order
+        for(int ichunk=0; ichunk<Nchunks; ichunk++)
+            evaluate_observation_chunk(&work[ichunk]);
+    }
+    else
+    {
+        // Chunk 0 is evaluated in this thread. If I can't create a thread for
+        // some chunk, I evaluate that chunk in this thread also
+        pthread_t threads    [Nchunks];
+        bool      have_thread[Nchunks];
+        for(int ichunk=1; ichunk<Nchunks; ichunk++)
+            have_thread[ichunk] =
+                0 == pthread_create(&threads[ichunk], NULL,
+                                    &evaluate_observation_chunk, &work[ichunk]);
+        evaluate_observation_chunk(&work[0]);
+        for(int ichunk=1; ichunk<Nchunks; ichunk++)
+        {
+            if(have_thread[ichunk])
+                pthread_join(threads[ichunk], NULL);
+            else
+                evaluate_observation_chunk(&work[ichunk]);
+        }
+    }
+
+    // Accumulated in a fixed order, so the result doesn't depend on the
+    // threading
+    for(int ichunk=0; ichunk<Nchunks; ichunk++)
+        norm2_error += work[ichunk].norm2_error;
+
+    // The regularization terms come after all the observations
+    int     iMeasurement = ctx->observation_chunks[Nchunks-1].iMeasurement_point1;
+    int64_t iJacobian    = ctx->observation_chunks[Nchunks-1].iJacobian_point1;
+
+    // regularization terms for the intrinsics. I favor smaller distortion
+    // parameters
+    if(ctx->problem_selections.do_apply_regularization &&
+       modelHasCore_fxfycxcy(ctx->lensmodel) &&
+       ( ctx->problem_selections.do_optimize_intrinsics_distortions ||
+         ctx->problem_selections.do_optimize_intrinsics_core
+         ))
+    {
+        // I want the total regularization cost to be low relative to the
+        // other contributions to the cost. And I want each set of
+        // regularization terms to weigh roughly the same. Let's say I want
+        // regularization to account for ~ .5% of the other error
+        // contributions:
+        //
+        //   Nmeasurements_rest*normal_pixel_error_sq * 0.005/2. =
+        //   Nmeasurements_regularization_distortion *normal_regularization_distortion_error_sq  =
+        //   Nmeasurements_regularization_centerpixel*normal_regularization_centerpixel_error_sq =
+        //
+        //   normal_regularization_distortion_error_sq  = (scale*normal_centerpixel_offset)^2
+        //   normal_regularization_centerpixel_error_sq = (scale*normal_distortion_value  )^2
+        //
+        // Regularization introduces a bias to the solution. The
+        // test-projection-uncertainty test measures it, and barfs if it is too
+        // high. The constants should be adjusted if that test fails.
+        const bool dump_regularizaton_details = false;
+
+        int    Nmeasurements_regularization_distortion  = ctx->Ncameras_intrinsics*(ctx->Nintrinsics-Ncore);
+        int    Nmeasurements_regularization_centerpixel = ctx->Ncameras_intrinsics*2;
+
+        int    Nmeasurements_nonregularization =
+            ctx->Nmeasurements -
+            Nmeasurements_regularization_distortion -
+            Nmeasurements_regularization_centerpixel;
 
         double normal_pixel_error = 1.0;
         double expected_total_pixel_error_sq =
@@ -4451,7 +6771,7 @@ void optimizer_callback(// input state
             {
                 for(int j=0; j<ctx->Nintrinsics-Ncore; j++)
                 {
-                    if(Jt) Jrowptr[iMeasurement] = iJacobian;
+                    STORE_JACOBIAN_ROWSTART(iMeasurement);
 
                     // This maybe should live elsewhere, but I put it here
                     // for now. Various distortion coefficients have
@@ -4510,7 +6830,7 @@ void optimizer_callback(// input state
                     (intrinsics_all[icam_intrinsics][2] - cx_target);
                 x[iMeasurement]  = err;
                 norm2_error     += err*err;
-                if(Jt) Jrowptr[iMeasurement] = iJacobian;
+                STORE_JACOBIAN_ROWSTART(iMeasurement);
                 STORE_JACOBIAN( i_var_intrinsics + 2,
                                 scale_regularization_centerpixel * SCALE_INTRINSICS_CENTER_PIXEL );
                 iMeasurement++;
@@ -4521,7 +6841,7 @@ void optimizer_callback(// input state
                     (intrinsics_all[icam_intrinsics][3] - cy_target);
                 x[iMeasurement]  = err;
                 norm2_error     += err*err;
-                if(Jt) Jrowptr[iMeasurement] = iJacobian;
+                STORE_JACOBIAN_ROWSTART(iMeasurement);
                 STORE_JACOBIAN( i_var_intrinsics + 3,
                                 scale_regularization_centerpixel * SCALE_INTRINSICS_CENTER_PIXEL );
                 iMeasurement++;
@@ -4535,7 +6855,7 @@ void optimizer_callback(// input state
     // required to indicate the end of the jacobian matrix
     if( !ctx->reportFitMsg )
     {
-        if(Jt) Jrowptr[iMeasurement] = iJacobian;
+        STORE_JACOBIAN_ROWSTART(iMeasurement);
         if(iMeasurement != ctx->Nmeasurements)
         {
             MSG("Assertion (iMeasurement == ctx->Nmeasurements) failed: (%d != %d)",
@@ -4544,8 +6864,8 @@ void optimizer_callback(// input state
         }
         if(iJacobian    != ctx->N_j_nonzero  )
         {
-            MSG("Assertion (iJacobian    == ctx->N_j_nonzero  ) failed: (%d != %d)",
-                iJacobian, ctx->N_j_nonzero);
+            MSG("Assertion (iJacobian    == ctx->N_j_nonzero  ) failed: (%lld != %lld)",
+                (long long)iJacobian, (long long)ctx->N_j_nonzero);
             assert(0);
         }
 
@@ -4553,6 +6873,41 @@ void optimizer_callback(// input state
     }
 }
 
+// Checks the solver and loss settings. Used by mrcal_optimizer_callback() and
+// mrcal_problem_new(). NULL problem_constants means "use the defaults", which
+// are always valid
+static bool validate_problem_constants(const mrcal_problem_constants_t* problem_constants)
+{
+    if(problem_constants == NULL)
+        return true;
+
+    if(problem_constants->solver != MRCAL_SOLVER_CHOLMOD &&
+       problem_constants->solver != MRCAL_SOLVER_SCHUR   &&
+       problem_constants->solver != MRCAL_SOLVER_PCG     &&
+       problem_constants->solver != MRCAL_SOLVER_CHOLMOD_LM)
+    {
+        MSG("ERROR: unknown solver %d", (int)problem_constants->solver);
+        return false;
+    }
+    if(problem_constants->loss != MRCAL_LOSS_SQUARED &&
+       problem_constants->loss != MRCAL_LOSS_HUBER   &&
+       problem_constants->loss != MRCAL_LOSS_CAUCHY)
+    {
+        MSG("ERROR: unknown loss %d", (int)problem_constants->loss);
+        return false;
+    }
+    // The robust losses are meaningless with k <= 0: Huber takes the sqrt of a
+    // negative number, and Cauchy flips the sign of the gradient
+    if(problem_constants->loss != MRCAL_LOSS_SQUARED &&
+       !(problem_constants->loss_scale > 0.0))
+    {
+        MSG("ERROR: a robust loss needs loss_scale > 0. Got %f",
+            problem_constants->loss_scale);
+        return false;
+    }
+    return true;
+}
+
 bool mrcal_optimizer_callback(// out
 
                              // These output pointers may NOT be NULL, unlike
@@ -4562,13 +6917,13 @@ bool mrcal_optimizer_callback(// out
                              double* p_packed,
                              // used only to confirm that the user passed-in the buffer they
                              // should have passed-in. The size must match exactly
-                             int buffer_size_p_packed,
+                             size_t buffer_size_p_packed,
 
                              // Shape (Nmeasurements,)
                              double* x,
                              // used only to confirm that the user passed-in the buffer they
                              // should have passed-in. The size must match exactly
-                             int buffer_size_x,
+                             size_t buffer_size_x,
 
                              // output Jacobian. May be NULL if we don't need
                              // it. This is the unitless Jacobian, used by the
@@ -4615,9 +6970,17 @@ bool mrcal_optimizer_callback(// out
                              double calibration_object_spacing,
                              int calibration_object_width_n,
                              int calibration_object_height_n,
-                             bool verbose)
+                             bool verbose,
+
+                             mrcal_workspace_t* workspace)
 {
     bool result = false;
+    mrcal_workspace_t workspace_local = {};
+    if(workspace == NULL)
+        workspace = &workspace_local;
+
+    if(!validate_problem_constants(problem_constants))
+        goto done;
 
     if(!modelHasCore_fxfycxcy(lensmodel))
         problem_selections.do_optimize_intrinsics_core = false;
@@ -4644,10 +7007,10 @@ bool mrcal_optimizer_callback(// out
                                         Npoints, Npoints_fixed, Nobservations_board,
                                         problem_selections,
                                         lensmodel);
-    if( buffer_size_p_packed != Nstate*(int)sizeof(double) )
+    if( buffer_size_p_packed != (size_t)Nstate*sizeof(double) )
     {
-        MSG("The buffer passed to fill-in p_packed has the wrong size. Needed exactly %d bytes, but got %d bytes",
-            Nstate*(int)sizeof(double),buffer_size_p_packed);
+        MSG("The buffer passed to fill-in p_packed has the wrong size. Needed exactly %zu bytes, but got %zu bytes",
+            (size_t)Nstate*sizeof(double),buffer_size_p_packed);
         goto done;
     }
 
@@ -4660,23 +7023,31 @@ bool mrcal_optimizer_callback(// out
                                                Npoints, Npoints_fixed,
                                                problem_selections,
                                                lensmodel);
-    int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
-    int N_j_nonzero = _mrcal_num_j_nonzero(Nobservations_board,
-                                           Nobservations_point,
-                                           calibration_object_width_n,
-                                           calibration_object_height_n,
-                                           Ncameras_intrinsics, Ncameras_extrinsics,
-                                           Nframes,
-                                           Npoints, Npoints_fixed,
-                                           observations_board,
-                                           observations_point,
-                                           problem_selections,
-                                           lensmodel);
+    int     Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
+    int64_t N_j_nonzero = _mrcal_num_j_nonzero(Nobservations_board,
+                                               Nobservations_point,
+                                               calibration_object_width_n,
+                                               calibration_object_height_n,
+                                               Ncameras_intrinsics, Ncameras_extrinsics,
+                                               Nframes,
+                                               Npoints, Npoints_fixed,
+                                               observations_board,
+                                               observations_point,
+                                               problem_selections,
+                                               lensmodel);
 
-    if( buffer_size_x != Nmeasurements*(int)sizeof(double) )
+    if( buffer_size_x != (size_t)Nmeasurements*sizeof(double) )
     {
-        MSG("The buffer passed to fill-in x has the wrong size. Needed exactly %d bytes, but got %d bytes",
-            Nmeasurements*(int)sizeof(double),buffer_size_x);
+        MSG("The buffer passed to fill-in x has the wrong size. Needed exactly %zu bytes, but got %zu bytes",
+            (size_t)Nmeasurements*sizeof(double),buffer_size_x);
+        goto done;
+    }
+    if( Jt != NULL &&
+        Jt->itype != CHOLMOD_LONG &&
+        N_j_nonzero > INT_MAX )
+    {
+        MSG("The jacobian has %lld non-zero entries. That's too many for 32-bit indices: Jt must use CHOLMOD_LONG",
+            (long long)N_j_nonzero);
         goto done;
     }
 
@@ -4684,6 +7055,32 @@ bool mrcal_optimizer_callback(// out
         Nobservations_board *
         calibration_object_width_n*calibration_object_height_n;
 
+    const int Nobservation_chunks =
+        num_observation_chunks(problem_constants != NULL ? problem_constants->Nthreads : 1,
+                               Nobservations_board,
+                               Nobservations_point);
+    workspace_layout_t layout;
+    if(!workspace_layout(&layout, workspace,
+                         Nobservation_chunks, Nstate,
+                         Ncameras_intrinsics, Ncameras_extrinsics,
+                         Nframes,
+                         Nintrinsics,
+                         calibration_object_width_n,
+                         calibration_object_height_n,
+                         0))
+        goto done;
+    compute_observation_chunks(layout.observation_chunks,
+                               Nobservation_chunks,
+                               Nobservations_board,
+                               Nobservations_point,
+                               calibration_object_width_n,
+                               calibration_object_height_n,
+                               Npoints, Npoints_fixed,
+                               observations_board,
+                               observations_point,
+                               problem_selections,
+                               lensmodel);
+
     const callback_context_t ctx = {
         .intrinsics                 = intrinsics,
         .extrinsics_fromref         = extrinsics_fromref,
@@ -4710,7 +7107,10 @@ bool mrcal_optimizer_callback(// out
         .calibration_object_height_n= calibration_object_height_n > 0 ? calibration_object_height_n : 0,
         .Nmeasurements              = Nmeasurements,
         .N_j_nonzero                = N_j_nonzero,
-        .Nintrinsics                = Nintrinsics};
+        .Nintrinsics                = Nintrinsics,
+        .observation_chunks         = layout.observation_chunks,
+        .Nobservation_chunks        = Nobservation_chunks,
+        .workspace                  = layout};
     _mrcal_precompute_lensmodel_data((mrcal_projection_precomputed_t*)&ctx.precomputed, lensmodel);
 
     pack_solver_state(p_packed,
@@ -4728,80 +7128,90 @@ bool mrcal_optimizer_callback(// out
     result = true;
 
 done:
+    free(workspace_local.buffer);
     return result;
 }
 
-mrcal_stats_t
-mrcal_optimize( // out
-                // Each one of these output pointers may be NULL
-
-                // Shape (Nstate,)
-                double* p_packed_final,
-                // used only to confirm that the user passed-in the buffer they
-                // should have passed-in. The size must match exactly
-                int buffer_size_p_packed_final,
-
-                // Shape (Nmeasurements,)
-                double* x_final,
-                // used only to confirm that the user passed-in the buffer they
-                // should have passed-in. The size must match exactly
-                int buffer_size_x_final,
-
-                // out, in
+// Monotonic wall-clock time, in seconds. Used to time the solver rounds
+static double get_time_sec(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
 
-                // These are a seed on input, solution on output
+// Everything mrcal_problem_optimize() needs to solve a problem repeatedly. The
+// user's buffers are referenced, not copied
+struct mrcal_problem_t
+{
+    callback_context_t        ctx;
+    mrcal_problem_constants_t problem_constants;
+    dogleg_parameters2_t      dogleg_parameters;
+    int                       Nstate;
+
+    // These are the seed on input and the solution on output
+    double*                   intrinsics;
+    mrcal_pose_t*             extrinsics_fromref;
+    mrcal_pose_t*             frames_toref;
+    mrcal_point3_t*           points;
+    mrcal_point2_t*           calobject_warp;
+
+    // New outliers are written here
+    mrcal_point3_t*           observations_board_pool;
+    double                    observed_pixel_uncertainty;
+
+    // If the user didn't give us a workspace, we own this one
+    mrcal_workspace_t*        workspace;
+    bool                      own_workspace;
+
+    jacobian_structure_cache_t Jt_structure_cache;
+
+    // The structure of the problem that the solvers in solver.c derive from
+    // the sparsity pattern of the jacobian. That's the same in all the
+    // outlier-rejection rounds, and in all the solves, so I build it once
+    solver_structure_t*       solver_structure;
+};
+
+mrcal_problem_t*
+mrcal_problem_new( // out, in
+
+                   // These are a seed on input, solution on output
+                   double*             intrinsics,
+                   mrcal_pose_t*       extrinsics_fromref,
+                   mrcal_pose_t*       frames_toref,
+                   mrcal_point3_t*     points,
+                   mrcal_point2_t*     calobject_warp,
 
-                // intrinsics is a concatenation of the intrinsics core and the
-                // distortion params. The specific distortion parameters may
-                // vary, depending on lensmodel, so this is a variable-length
-                // structure
-                double*             intrinsics,         // Ncameras_intrinsics * NlensParams
-                mrcal_pose_t*       extrinsics_fromref, // Ncameras_extrinsics of these. Transform FROM the reference frame
-                mrcal_pose_t*       frames_toref,       // Nframes of these.    Transform TO the reference frame
-                mrcal_point3_t*     points,             // Npoints of these.    In the reference frame
-                mrcal_point2_t*     calobject_warp,     // 1 of these. May be NULL if !problem_selections.do_optimize_calobject_warp
+                   // in
+                   int Ncameras_intrinsics, int Ncameras_extrinsics, int Nframes,
+                   int Npoints, int Npoints_fixed,
 
-                // in
-                int Ncameras_intrinsics, int Ncameras_extrinsics, int Nframes,
-                int Npoints, int Npoints_fixed, // at the end of points[]
+                   const mrcal_observation_board_t* observations_board,
+                   const mrcal_observation_point_t* observations_point,
+                   int Nobservations_board,
+                   int Nobservations_point,
 
-                const mrcal_observation_board_t* observations_board,
-                const mrcal_observation_point_t* observations_point,
-                int Nobservations_board,
-                int Nobservations_point,
+                   mrcal_point3_t* observations_board_pool,
 
-                // All the board pixel observations, in order.
-                // .x, .y are the pixel observations
-                // .z is the weight of the observation. Most of the weights are
-                // expected to be 1.0, which implies that the noise on the
-                // observation has standard deviation of
-                // observed_pixel_uncertainty. observed_pixel_uncertainty scales
-                // inversely with the weight.
-                //
-                // z<0 indicates that this is an outlier. This is respected on
-                // input (even if !do_apply_outlier_rejection). New outliers are
-                // marked with z<0 on output, so this isn't const
-                mrcal_point3_t* observations_board_pool,
-
-                mrcal_lensmodel_t lensmodel,
-                double observed_pixel_uncertainty,
-                const int* imagersizes, // Ncameras_intrinsics*2 of these
-                mrcal_problem_selections_t       problem_selections,
-                const mrcal_problem_constants_t* problem_constants,
+                   mrcal_lensmodel_t lensmodel,
+                   double observed_pixel_uncertainty,
+                   const int* imagersizes,
+                   mrcal_problem_selections_t       problem_selections,
+                   const mrcal_problem_constants_t* problem_constants,
 
-                double calibration_object_spacing,
-                int calibration_object_width_n,
-                int calibration_object_height_n,
-                bool verbose,
+                   double calibration_object_spacing,
+                   int calibration_object_width_n,
+                   int calibration_object_height_n,
+                   bool verbose,
 
-                bool check_gradient)
+                   mrcal_workspace_t* workspace)
 {
     if( Nobservations_board > 0 )
     {
         if( problem_selections.do_optimize_calobject_warp && calobject_warp == NULL )
         {
             MSG("ERROR: We're optimizing the calibration object warp, so a buffer with a seed MUST be passed in.");
-            return (mrcal_stats_t){.rms_reproj_error__pixels = -1.0};
+            return NULL;
         }
     }
     else
@@ -4819,27 +7229,36 @@ mrcal_optimize( // out
         MSG("Warning: Not optimizing any of our variables");
     }
 
-    dogleg_parameters2_t dogleg_parameters;
-    dogleg_getDefaultParameters(&dogleg_parameters);
-    dogleg_parameters.dogleg_debug = verbose ? DOGLEG_DEBUG_VNLOG : 0;
+    if(!validate_problem_constants(problem_constants))
+        return NULL;
+
+    mrcal_problem_t* problem = calloc(1, sizeof(mrcal_problem_t));
+    if(problem == NULL)
+    {
+        MSG("Couldn't allocate the problem");
+        return NULL;
+    }
+
+    dogleg_parameters2_t* dogleg_parameters = &problem->dogleg_parameters;
+    dogleg_getDefaultParameters(dogleg_parameters);
+    dogleg_parameters->dogleg_debug = verbose ? DOGLEG_DEBUG_VNLOG : 0;
 
     // These were derived empirically, seeking high accuracy, fast convergence
     // and without serious concern for performance. I looked only at a single
     // frame. Tweak them please
-    dogleg_parameters.Jt_x_threshold = 0;
-    dogleg_parameters.update_threshold = 1e-6;
-    dogleg_parameters.trustregion_threshold = 0;
-    dogleg_parameters.max_iterations = 300;
-    // dogleg_parameters.trustregion_decrease_factor    = 0.1;
-    // dogleg_parameters.trustregion_decrease_threshold = 0.15;
-    // dogleg_parameters.trustregion_increase_factor    = 4.0
-    // dogleg_parameters.trustregion_increase_threshold = 0.75;
-
-    const int Npoints_fromBoards =
-        Nobservations_board *
-        calibration_object_width_n*calibration_object_height_n;
-
-    callback_context_t ctx = {
+    dogleg_parameters->Jt_x_threshold = 0;
+    dogleg_parameters->update_threshold = 1e-6;
+    dogleg_parameters->trustregion_threshold = 0;
+    dogleg_parameters->max_iterations = 300;
+    // dogleg_parameters->trustregion_decrease_factor    = 0.1;
+    // dogleg_parameters->trustregion_decrease_threshold = 0.15;
+    // dogleg_parameters->trustregion_increase_factor    = 4.0
+    // dogleg_parameters->trustregion_increase_threshold = 0.75;
+
+    if(problem_constants != NULL)
+        problem->problem_constants = *problem_constants;
+
+    problem->ctx = (callback_context_t){
         .intrinsics                 = intrinsics,
         .extrinsics_fromref         = extrinsics_fromref,
         .frames_toref               = frames_toref,
@@ -4859,7 +7278,8 @@ mrcal_optimize( // out
         .lensmodel                  = lensmodel,
         .imagersizes                = imagersizes,
         .problem_selections            = problem_selections,
-        .problem_constants          = problem_constants,
+        .problem_constants          = problem_constants != NULL ? &problem->problem_constants : NULL,
+        .Jt_structure_cache         = &problem->Jt_structure_cache,
         .calibration_object_spacing = calibration_object_spacing,
         .calibration_object_width_n = calibration_object_width_n  > 0 ? calibration_object_width_n  : 0,
         .calibration_object_height_n= calibration_object_height_n > 0 ? calibration_object_height_n : 0,
@@ -4884,47 +7304,193 @@ mrcal_optimize( // out
                                                            problem_selections,
                                                            lensmodel),
         .Nintrinsics                = mrcal_lensmodel_num_params(lensmodel)};
-    _mrcal_precompute_lensmodel_data((mrcal_projection_precomputed_t*)&ctx.precomputed, lensmodel);
+    callback_context_t* ctx = &problem->ctx;
+    _mrcal_precompute_lensmodel_data((mrcal_projection_precomputed_t*)&ctx->precomputed, lensmodel);
+
+    problem->Nstate = mrcal_num_states(Ncameras_intrinsics, Ncameras_extrinsics,
+                                       Nframes,
+                                       Npoints, Npoints_fixed, Nobservations_board,
+                                       problem_selections,
+                                       lensmodel);
+
+    problem->intrinsics                 = intrinsics;
+    problem->extrinsics_fromref         = extrinsics_fromref;
+    problem->frames_toref               = frames_toref;
+    problem->points                     = points;
+    problem->calobject_warp             = calobject_warp;
+    problem->observations_board_pool    = observations_board_pool;
+    problem->observed_pixel_uncertainty = observed_pixel_uncertainty;
+
+    if(workspace == NULL)
+    {
+        workspace = mrcal_workspace_new();
+        if(workspace == NULL)
+        {
+            free(problem);
+            return NULL;
+        }
+        problem->own_workspace = true;
+    }
+    problem->workspace = workspace;
+
+    const int Nobservation_chunks =
+        num_observation_chunks(problem_constants != NULL ? problem_constants->Nthreads : 1,
+                               Nobservations_board,
+                               Nobservations_point);
+    if(!workspace_layout(&ctx->workspace, workspace,
+                         Nobservation_chunks, problem->Nstate,
+                         Ncameras_intrinsics, Ncameras_extrinsics,
+                         Nframes,
+                         ctx->Nintrinsics,
+                         calibration_object_width_n,
+                         calibration_object_height_n,
+                         // libdogleg keeps its own x. The other solvers
+                         // write it here
+                         problem->problem_constants.solver != MRCAL_SOLVER_CHOLMOD ?
+                         ctx->Nmeasurements : 0))
+    {
+        mrcal_problem_free(problem);
+        return NULL;
+    }
+    compute_observation_chunks(ctx->workspace.observation_chunks,
+                               Nobservation_chunks,
+                               Nobservations_board,
+                               Nobservations_point,
+                               calibration_object_width_n,
+                               calibration_object_height_n,
+                               Npoints, Npoints_fixed,
+                               observations_board,
+                               observations_point,
+                               problem_selections,
+                               lensmodel);
+    ctx->observation_chunks  = ctx->workspace.observation_chunks;
+    ctx->Nobservation_chunks = Nobservation_chunks;
 
-    const int Nstate = mrcal_num_states(Ncameras_intrinsics, Ncameras_extrinsics,
-                                        Nframes,
-                                        Npoints, Npoints_fixed, Nobservations_board,
-                                        problem_selections,
-                                        lensmodel);
+    if(verbose)
+        MSG("## Nmeasurements=%d, Nstate=%d", ctx->Nmeasurements, problem->Nstate);
+    if(ctx->Nmeasurements <= problem->Nstate)
+    {
+        MSG("WARNING: problem isn't overdetermined: Nmeasurements=%d, Nstate=%d. Solver may not converge, and if it does, the results aren't reliable. Add more constraints and/or regularization",
+            ctx->Nmeasurements, problem->Nstate);
+    }
+
+    return problem;
+}
+
+void mrcal_problem_free(mrcal_problem_t* problem)
+{
+    if(problem == NULL)
+        return;
+    if(problem->own_workspace)
+        mrcal_workspace_free(problem->workspace);
+    _mrcal_solver_structure_free(problem->solver_structure);
+    free(problem);
+}
 
+mrcal_stats_t
+mrcal_problem_optimize( // out
+                        // Each one of these output pointers may be NULL
+
+                        // Shape (Nstate,)
+                        double* p_packed_final,
+                        // used only to confirm that the user passed-in the buffer they
+                        // should have passed-in. The size must match exactly
+                        size_t buffer_size_p_packed_final,
+
+                        // Shape (Nmeasurements,)
+                        double* x_final,
+                        // used only to confirm that the user passed-in the buffer they
+                        // should have passed-in. The size must match exactly
+                        size_t buffer_size_x_final,
+
+                        // in,out
+                        mrcal_problem_t* problem,
+
+                        // in
+                        bool check_gradient)
+{
+    callback_context_t* ctx    = &problem->ctx;
+    const int           Nstate = problem->Nstate;
+
+    // The problem definition, in the form the rest of this function expects
+    const int                        Ncameras_intrinsics         = ctx->Ncameras_intrinsics;
+    const int                        Ncameras_extrinsics         = ctx->Ncameras_extrinsics;
+    const int                        Nframes                     = ctx->Nframes;
+    const int                        Npoints                     = ctx->Npoints;
+    const int                        Npoints_fixed               = ctx->Npoints_fixed;
+    const int                        Nobservations_board         = ctx->Nobservations_board;
+    const int                        calibration_object_width_n  = ctx->calibration_object_width_n;
+    const int                        calibration_object_height_n = ctx->calibration_object_height_n;
+    const bool                       verbose                     = ctx->verbose;
+    const mrcal_lensmodel_t          lensmodel                   = ctx->lensmodel;
+    const mrcal_problem_selections_t problem_selections          = ctx->problem_selections;
+    const mrcal_observation_board_t* observations_board          = ctx->observations_board;
+    mrcal_point3_t*                  observations_board_pool     = problem->observations_board_pool;
+
+    // libdogleg uses 32-bit indices. The other solvers work with any size
+    if( ctx->N_j_nonzero > INT_MAX &&
+        (problem->problem_constants.solver == MRCAL_SOLVER_CHOLMOD ||
+         check_gradient) )
+    {
+        MSG("The jacobian has %lld non-zero entries. That's too many for libdogleg, which uses 32-bit indices. Use MRCAL_SOLVER_SCHUR, MRCAL_SOLVER_PCG or MRCAL_SOLVER_CHOLMOD_LM",
+            (long long)ctx->N_j_nonzero);
+        return (mrcal_stats_t){.rms_reproj_error__pixels = -1.0};
+    }
     if( p_packed_final != NULL &&
-        buffer_size_p_packed_final != Nstate*(int)sizeof(double) )
+        buffer_size_p_packed_final != (size_t)Nstate*sizeof(double) )
     {
-        MSG("The buffer passed to fill-in p_packed_final has the wrong size. Needed exactly %d bytes, but got %d bytes",
-            Nstate*(int)sizeof(double),buffer_size_p_packed_final);
+        MSG("The buffer passed to fill-in p_packed_final has the wrong size. Needed exactly %zu bytes, but got %zu bytes",
+            (size_t)Nstate*sizeof(double),buffer_size_p_packed_final);
         return (mrcal_stats_t){.rms_reproj_error__pixels = -1.0};
     }
     if( x_final != NULL &&
-        buffer_size_x_final != ctx.Nmeasurements*(int)sizeof(double) )
+        buffer_size_x_final != (size_t)ctx->Nmeasurements*sizeof(double) )
     {
-        MSG("The buffer passed to fill-in x_final has the wrong size. Needed exactly %d bytes, but got %d bytes",
-            ctx.Nmeasurements*(int)sizeof(double),buffer_size_x_final);
+        MSG("The buffer passed to fill-in x_final has the wrong size. Needed exactly %zu bytes, but got %zu bytes",
+            (size_t)ctx->Nmeasurements*sizeof(double),buffer_size_x_final);
         return (mrcal_stats_t){.rms_reproj_error__pixels = -1.0};
     }
 
+    const int Npoints_fromBoards =
+        Nobservations_board *
+        calibration_object_width_n*calibration_object_height_n;
 
     dogleg_solverContext_t* solver_context = NULL;
 
-    if(verbose)
-        MSG("## Nmeasurements=%d, Nstate=%d", ctx.Nmeasurements, Nstate);
-    if(ctx.Nmeasurements <= Nstate)
-    {
-        MSG("WARNING: problem isn't overdetermined: Nmeasurements=%d, Nstate=%d. Solver may not converge, and if it does, the results aren't reliable. Add more constraints and/or regularization",
-            ctx.Nmeasurements, Nstate);
-    }
-
-    double packed_state[Nstate];
+    // The measurements at the current solution. libdogleg keeps these in its
+    // context. The other solvers write them into the workspace
+    double* x_solver = NULL;
+
+    // The layout of the state vector, for the solvers that aren't libdogleg
+#define STATE_INDEX(what) mrcal_state_index_ ## what(0,                               \
+                                                   Ncameras_intrinsics, Ncameras_extrinsics, \
+                                                   Nframes,                                  \
+                                                   Npoints, Npoints_fixed, Nobservations_board, \
+                                                   problem_selections, lensmodel)
+    const solver_blocks_t solver_blocks =
+        { .Ncameras_intrinsics   = Ncameras_intrinsics,
+          .Nintrinsics_state     = mrcal_num_intrinsics_optimization_params(problem_selections, lensmodel),
+          .istate_extrinsics     = STATE_INDEX(extrinsics),
+          .Ncameras_extrinsics   = mrcal_num_states_extrinsics(Ncameras_extrinsics, problem_selections) / 6,
+          .istate_frames         = STATE_INDEX(frames),
+          .Nframes               = mrcal_num_states_frames(Nframes, problem_selections) / 6,
+          .istate_points         = STATE_INDEX(points),
+          .Npoints               = mrcal_num_states_points(Npoints, Npoints_fixed, problem_selections) / 3,
+          .istate_calobject_warp = mrcal_state_index_calobject_warp(Ncameras_intrinsics, Ncameras_extrinsics,
+                                                                    Nframes,
+                                                                    Npoints, Npoints_fixed, Nobservations_board,
+                                                                    problem_selections, lensmodel),
+          .Ncalobject_warp       = mrcal_num_states_calobject_warp(problem_selections, Nobservations_board) };
+#undef STATE_INDEX
+
+    // Each solve starts from whatever is in the seed buffers now
+    double* packed_state = ctx->workspace.packed_state;
     pack_solver_state(packed_state,
-                      lensmodel, intrinsics,
-                      extrinsics_fromref,
-                      frames_toref,
-                      points,
-                      calobject_warp,
+                      lensmodel, problem->intrinsics,
+                      problem->extrinsics_fromref,
+                      problem->frames_toref,
+                      problem->points,
+                      problem->calobject_warp,
                       problem_selections,
                       Ncameras_intrinsics, Ncameras_extrinsics,
                       Nframes, Npoints-Npoints_fixed, Nstate);
@@ -4946,23 +7512,66 @@ mrcal_optimize( // out
 
         if(verbose)
         {
-            ctx.reportFitMsg = "Before";
-            //        optimizer_callback(packed_state, NULL, NULL, &ctx);
+            ctx->reportFitMsg = "Before";
+            //        optimizer_callback(packed_state, NULL, NULL, ctx);
         }
-        ctx.reportFitMsg = NULL;
+        ctx->reportFitMsg = NULL;
 
 
         double outliernessScale = -1.0;
         do
         {
-            norm2_error = dogleg_optimize2(packed_state,
-                                           Nstate, ctx.Nmeasurements, ctx.N_j_nonzero,
-                                           (dogleg_callback_t*)&optimizer_callback, &ctx,
-                                           &dogleg_parameters,
-                                           &solver_context);
+            // Each outlier-rejection round starts from the previous optimum in
+            // packed_state. The new outliers only change weights, so the
+            // problem structure is the same: the solvers in solver.c reuse
+            // problem->solver_structure. The previous libdogleg
+            // context was needed only to find the outliers, so I release it
+            // now. Otherwise every round would leak one
+            if(solver_context != NULL)
+                dogleg_freeContext(&solver_context);
+
+            // The solver allocates its Jacobian buffers at the start of the
+            // solve, and keeps them until the end. So in this solve I write
+            // the sparsity pattern into each buffer only once
+            jacobian_structure_reset(&problem->Jt_structure_cache, true);
+
+            const double time_round_start = get_time_sec();
+            if(problem->problem_constants.solver != MRCAL_SOLVER_CHOLMOD)
+            {
+                x_solver    = ctx->workspace.x_solver;
+                norm2_error = _mrcal_optimize_sparse(packed_state, x_solver,
+                                                     Nstate, ctx->Nmeasurements, ctx->N_j_nonzero,
+                                                     (dogleg_callback_t*)&optimizer_callback, ctx,
+                                                     &problem->dogleg_parameters,
+                                                     &solver_blocks,
+                                                     problem->problem_constants.solver,
+                                                     verbose,
+                                                     &problem->solver_structure);
+            }
+            else
+            {
+                norm2_error = dogleg_optimize2(packed_state,
+                                               Nstate, ctx->Nmeasurements, ctx->N_j_nonzero,
+                                               (dogleg_callback_t*)&optimizer_callback, ctx,
+                                               &problem->dogleg_parameters,
+                                               &solver_context);
+                if(solver_context != NULL)
+                    x_solver = solver_context->beforeStep->x;
+            }
+            const double time_round = get_time_sec() - time_round_start;
+
+            jacobian_structure_reset(&problem->Jt_structure_cache, false);
+
+            if(stats.Nsolver_rounds == 0)
+                stats.solve_time_first_round__s   = time_round;
+            else
+                stats.solve_time_later_rounds__s += time_round;
+            stats.Nsolver_rounds++;
+            if(verbose)
+                MSG("Solver round %d took %.3fs", stats.Nsolver_rounds, time_round);
 
             if(norm2_error < 0)
-                // libdogleg barfed. I quit out
+                // The solver barfed. I quit out
                 goto done;
 
 #if 0
@@ -4984,17 +7593,22 @@ mrcal_optimize( // out
                               Nobservations_board,
                               calibration_object_width_n,
                               calibration_object_height_n,
-                              solver_context->beforeStep->x,
-                              observed_pixel_uncertainty,
+                              x_solver,
+                              problem->problem_constants.loss,
+                              problem->problem_constants.loss_scale,
+                              problem->observed_pixel_uncertainty,
                               verbose) &&
+                 // A robust loss already keeps the outliers from pulling
+                 // the solution, so I mark them, but I don't re-solve
+                 problem->problem_constants.loss == MRCAL_LOSS_SQUARED &&
                  ({MSG("Threw out some outliers (have a total of %d now); going again", stats.Noutliers); true;}));
 
         // Done. I have the final state. I spit it back out
-        unpack_solver_state( intrinsics,         // Ncameras_intrinsics of these
-                             extrinsics_fromref, // Ncameras_extrinsics of these
-                             frames_toref,       // Nframes of these
-                             points,             // Npoints of these
-                             calobject_warp,
+        unpack_solver_state( problem->intrinsics,         // Ncameras_intrinsics of these
+                             problem->extrinsics_fromref, // Ncameras_extrinsics of these
+                             problem->frames_toref,       // Nframes of these
+                             problem->points,             // Npoints of these
+                             problem->calobject_warp,
                              packed_state,
                              lensmodel,
                              problem_selections,
@@ -5012,8 +7626,8 @@ mrcal_optimize( // out
                                   solver_context->beforeStep, solver_context);
 #endif
 
-            ctx.reportFitMsg = "After";
-            //        optimizer_callback(packed_state, NULL, NULL, &ctx);
+            ctx->reportFitMsg = "After";
+            //        optimizer_callback(packed_state, NULL, NULL, ctx);
             if(problem_selections.do_apply_regularization)
             {
                 double norm2_err_regularization = 0;
@@ -5024,7 +7638,7 @@ mrcal_optimize( // out
 
                 for(int i=0; i<Nmeasurements_regularization; i++)
                 {
-                    double x = solver_context->beforeStep->x[ctx.Nmeasurements-1 - i];
+                    double x = x_solver[ctx->Nmeasurements-1 - i];
                     norm2_err_regularization += x*x;
                 }
 
@@ -5036,7 +7650,7 @@ mrcal_optimize( // out
                 //
                 // for(int i=0; i<Nmeasurements_regularization; i++)
                 // {
-                //     double x = solver_context->beforeStep->x[ctx.Nmeasurements - Nmeasurements_regularization + i];
+                //     double x = solver_context->beforeStep->x[ctx->Nmeasurements - Nmeasurements_regularization + i];
                 //     MSG("regularization %d: %f (squared: %f)", i, x, x*x);
                 // }
                 MSG("norm2_error: %f",               norm2_error);
@@ -5044,21 +7658,35 @@ mrcal_optimize( // out
                 MSG("regularization cost ratio: %g", ratio_regularization_cost);
             }
         }
+
+        // The reported measurements and the RMS error are in pixels, not in
+        // the robustified units the solver worked with
+        if(problem->problem_constants.loss != MRCAL_LOSS_SQUARED &&
+           x_solver != NULL)
+            norm2_error =
+                unapply_loss_measurements(x_solver,
+                                          ctx->Nmeasurements,
+                                          Nobservations_board,
+                                          ctx->Nobservations_point,
+                                          calibration_object_width_n,
+                                          calibration_object_height_n,
+                                          problem->problem_constants.loss,
+                                          problem->problem_constants.loss_scale);
     }
     else
         for(int ivar=0; ivar<Nstate; ivar++)
             dogleg_testGradient(ivar, packed_state,
-                                Nstate, ctx.Nmeasurements, ctx.N_j_nonzero,
-                                (dogleg_callback_t*)&optimizer_callback, &ctx);
+                                Nstate, ctx->Nmeasurements, ctx->N_j_nonzero,
+                                (dogleg_callback_t*)&optimizer_callback, ctx);
 
     stats.rms_reproj_error__pixels =
         // /2 because I have separate x and y measurements
-        sqrt(norm2_error / ((double)ctx.Nmeasurements / 2.0));
+        sqrt(norm2_error / ((double)ctx->Nmeasurements / 2.0));
 
     if(p_packed_final)
-        memcpy(p_packed_final, solver_context->beforeStep->p, Nstate*sizeof(double));
-    if(x_final)
-        memcpy(x_final, solver_context->beforeStep->x, ctx.Nmeasurements*sizeof(double));
+        memcpy(p_packed_final, packed_state, Nstate*sizeof(double));
+    if(x_final && x_solver != NULL)
+        memcpy(x_final, x_solver, ctx->Nmeasurements*sizeof(double));
 
  done:
     if(solver_context != NULL)
@@ -5066,3 +7694,409 @@ mrcal_optimize( // out
 
     return stats;
 }
+
+mrcal_stats_t
+mrcal_optimize( // out
+                // Each one of these output pointers may be NULL
+
+                // Shape (Nstate,)
+                double* p_packed_final,
+                // used only to confirm that the user passed-in the buffer they
+                // should have passed-in. The size must match exactly
+                size_t buffer_size_p_packed_final,
+
+                // Shape (Nmeasurements,)
+                double* x_final,
+                // used only to confirm that the user passed-in the buffer they
+                // should have passed-in. The size must match exactly
+                size_t buffer_size_x_final,
+
+                // out, in
+
+                // These are a seed on input, solution on output
+
+                // intrinsics is a concatenation of the intrinsics core and the
+                // distortion params. The specific distortion parameters may
+                // vary, depending on lensmodel, so this is a variable-length
+                // structure
+                double*             intrinsics,         // Ncameras_intrinsics * NlensParams
+                mrcal_pose_t*       extrinsics_fromref, // Ncameras_extrinsics of these. Transform FROM the reference frame
+                mrcal_pose_t*       frames_toref,       // Nframes of these.    Transform TO the reference frame
+                mrcal_point3_t*     points,             // Npoints of these.    In the reference frame
+                mrcal_point2_t*     calobject_warp,     // 1 of these. May be NULL if !problem_selections.do_optimize_calobject_warp
+
+                // in
+                int Ncameras_intrinsics, int Ncameras_extrinsics, int Nframes,
+                int Npoints, int Npoints_fixed, // at the end of points[]
+
+                const mrcal_observation_board_t* observations_board,
+                const mrcal_observation_point_t* observations_point,
+                int Nobservations_board,
+                int Nobservations_point,
+
+                // All the board pixel observations, in order.
+                // .x, .y are the pixel observations
+                // .z is the weight of the observation. Most of the weights are
+                // expected to be 1.0, which implies that the noise on the
+                // observation has standard deviation of
+                // observed_pixel_uncertainty. observed_pixel_uncertainty scales
+                // inversely with the weight.
+                //
+                // z<0 indicates that this is an outlier. This is respected on
+                // input (even if !do_apply_outlier_rejection). New outliers are
+                // marked with z<0 on output, so this isn't const
+                mrcal_point3_t* observations_board_pool,
+
+                mrcal_lensmodel_t lensmodel,
+                double observed_pixel_uncertainty,
+                const int* imagersizes, // Ncameras_intrinsics*2 of these
+                mrcal_problem_selections_t       problem_selections,
+                const mrcal_problem_constants_t* problem_constants,
+
+                double calibration_object_spacing,
+                int calibration_object_width_n,
+                int calibration_object_height_n,
+                bool verbose,
+
+                bool check_gradient,
+
+                mrcal_workspace_t* workspace)
+{
+    mrcal_problem_t* problem =
+        mrcal_problem_new( intrinsics,
+                           extrinsics_fromref,
+                           frames_toref,
+                           points,
+                           calobject_warp,
+                           Ncameras_intrinsics, Ncameras_extrinsics, Nframes,
+                           Npoints, Npoints_fixed,
+                           observations_board,
+                           observations_point,
+                           Nobservations_board,
+                           Nobservations_point,
+                           observations_board_pool,
+                           lensmodel,
+                           observed_pixel_uncertainty,
+                           imagersizes,
+                           problem_selections,
+                           problem_constants,
+                           calibration_object_spacing,
+                           calibration_object_width_n,
+                           calibration_object_height_n,
+                           verbose,
+                           workspace);
+    if(problem == NULL)
+        return (mrcal_stats_t){.rms_reproj_error__pixels = -1.0};
+
+    mrcal_stats_t stats =
+        mrcal_problem_optimize(p_packed_final, buffer_size_p_packed_final,
+                               x_final,        buffer_size_x_final,
+                               problem,
+                               check_gradient);
+    mrcal_problem_free(problem);
+    return stats;
+}
+
+
+static bool cameramodel_binary_dtype_itemsize(int* itemsize,
+                                              const char* dtype)
+{
+    // numpy-style: byte order, kind, size in bytes. The byte order is '<'
+    // (little-endian) or '|' (not applicable)
+    if(!(dtype[0] == '<' || dtype[0] == '|'))
+        return false;
+    if(strchr("fiub", dtype[1]) == NULL)
+        return false;
+    char* end;
+    long n = strtol(&dtype[2], &end, 10);
+    if(*end != '\0' || !(n == 1 || n == 2 || n == 4 || n == 8))
+        return false;
+    *itemsize = (int)n;
+    return true;
+}
+
+static bool cameramodel_binary_section_is(const mrcal_cameramodel_binary_section_t* section,
+                                          const char* dtype,
+                                          int Ndims)
+{
+    return
+        0 == strcmp(section->dtype, dtype) &&
+        (int)section->Ndims == Ndims;
+}
+
+bool mrcal_cameramodel_binary_parse( // out
+                                     mrcal_cameramodel_binary_t* model,
+
+                                     // in
+                                     const void* buffer,
+                                     size_t size)
+{
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    MSG("Binary camera models are little-endian, and only little-endian hosts are supported");
+    return false;
+#endif
+
+    *model = (mrcal_cameramodel_binary_t){.buffer = buffer,
+                                          .size   = size};
+
+    if( (uintptr_t)buffer % MRCAL_CAMERAMODEL_BINARY_ALIGNMENT != 0 )
+    {
+        MSG("The buffer containing a binary camera model must be aligned to %d bytes",
+            MRCAL_CAMERAMODEL_BINARY_ALIGNMENT);
+        return false;
+    }
+
+    const mrcal_cameramodel_binary_header_t* header = buffer;
+    if( size < sizeof(*header) ||
+        0 != memcmp(header->magic, MRCAL_CAMERAMODEL_BINARY_MAGIC, sizeof(header->magic)) )
+    {
+        MSG("This isn't a binary camera model");
+        return false;
+    }
+    if( header->version > MRCAL_CAMERAMODEL_BINARY_VERSION )
+    {
+        MSG("The binary camera model has version %u, but I only know about versions <= %d",
+            header->version, MRCAL_CAMERAMODEL_BINARY_VERSION);
+        return false;
+    }
+    if( header->size > size ||
+        header->Nsections > (header->size - sizeof(*header)) / sizeof(mrcal_cameramodel_binary_section_t) )
+    {
+        MSG("The binary camera model is truncated");
+        return false;
+    }
+
+    model->Nsections = (int)header->Nsections;
+    model->sections  = (const mrcal_cameramodel_binary_section_t*)&header[1];
+
+    // Validate all the sections, so that the users of the model can trust the
+    // sizes and offsets
+    for(int i=0; i<model->Nsections; i++)
+    {
+        const mrcal_cameramodel_binary_section_t* section = &model->sections[i];
+
+        if( memchr(section->name,  '\0', sizeof(section->name))  == NULL ||
+            memchr(section->dtype, '\0', sizeof(section->dtype)) == NULL )
+        {
+            MSG("Binary camera model section %d has an invalid name or dtype", i);
+            return false;
+        }
+        if( section->Ndims > MRCAL_CAMERAMODEL_BINARY_MAX_DIMS )
+        {
+            MSG("Binary camera model section '%s' has %u dimensions; at most %d are supported",
+                section->name, section->Ndims, MRCAL_CAMERAMODEL_BINARY_MAX_DIMS);
+            return false;
+        }
+        if( section->offset % MRCAL_CAMERAMODEL_BINARY_ALIGNMENT != 0 ||
+            section->offset > header->size ||
+            section->size   > header->size - section->offset )
+        {
+            MSG("Binary camera model section '%s' has an invalid offset or size",
+                section->name);
+            return false;
+        }
+
+        if( 0 == strcmp(section->dtype, "none") )
+        {
+            if(section->size != 0)
+            {
+                MSG("Binary camera model section '%s' is None, but has data",
+                    section->name);
+                return false;
+            }
+            continue;
+        }
+        if( 0 == strcmp(section->dtype, "str") )
+        {
+            const char* s = (const char*)buffer + section->offset;
+            if( !(section->Ndims == 1 &&
+                  section->shape[0] == section->size &&
+                  section->size > 0 &&
+                  s[section->size-1] == '\0') )
+            {
+                MSG("Binary camera model section '%s' isn't a valid string",
+                    section->name);
+                return false;
+            }
+            continue;
+        }
+
+        int itemsize;
+        if(!cameramodel_binary_dtype_itemsize(&itemsize, section->dtype))
+        {
+            MSG("Binary camera model section '%s' has an unknown dtype '%s'",
+                section->name, section->dtype);
+            return false;
+        }
+        uint64_t N = 1;
+        for(unsigned int j=0; j<section->Ndims; j++)
+        {
+            if(section->shape[j] != 0 && N > UINT64_MAX / section->shape[j])
+            {
+                N = UINT64_MAX;
+                break;
+            }
+            N *= section->shape[j];
+        }
+        if( N > section->size || N*(uint64_t)itemsize != section->size )
+        {
+            MSG("Binary camera model section '%s' has a size that doesn't match its shape",
+                section->name);
+            return false;
+        }
+    }
+
+    // The core of the model
+    const mrcal_cameramodel_binary_section_t* section;
+    const void* data;
+
+    data = mrcal_cameramodel_binary_find(&section, model, "lensmodel");
+    if(data == NULL || 0 != strcmp(section->dtype, "str"))
+    {
+        MSG("The binary camera model doesn't have a valid 'lensmodel'");
+        return false;
+    }
+    model->lensmodel = mrcal_lensmodel_from_name((const char*)data);
+    if( !mrcal_lensmodel_type_is_valid(model->lensmodel.type) )
+    {
+        MSG("The binary camera model has an unknown lensmodel '%s'", (const char*)data);
+        return false;
+    }
+
+    model->intrinsics = mrcal_cameramodel_binary_find(&section, model, "intrinsics");
+    if(model->intrinsics == NULL ||
+       !cameramodel_binary_section_is(section, "<f8", 1) ||
+       (int)section->shape[0] != mrcal_lensmodel_num_params(model->lensmodel))
+    {
+        MSG("The binary camera model doesn't have valid 'intrinsics'");
+        return false;
+    }
+    model->Nintrinsics = (int)section->shape[0];
+
+    model->rt_cam_ref = mrcal_cameramodel_binary_find(&section, model, "extrinsics");
+    if(model->rt_cam_ref == NULL ||
+       !cameramodel_binary_section_is(section, "<f8", 1) ||
+       section->shape[0] != 6)
+    {
+        MSG("The binary camera model doesn't have valid 'extrinsics'");
+        return false;
+    }
+
+    const int32_t* imagersize = mrcal_cameramodel_binary_find(&section, model, "imagersize");
+    if(imagersize == NULL ||
+       !cameramodel_binary_section_is(section, "<i4", 1) ||
+       section->shape[0] != 2 ||
+       imagersize[0] <= 0 || imagersize[1] <= 0)
+    {
+        MSG("The binary camera model doesn't have a valid 'imagersize'");
+        return false;
+    }
+    model->imagersize[0] = imagersize[0];
+    model->imagersize[1] = imagersize[1];
+
+    // The optional pieces
+    model->valid_intrinsics_region =
+        mrcal_cameramodel_binary_find(&section, model, "valid_intrinsics_region");
+    if(model->valid_intrinsics_region != NULL)
+    {
+        if(!cameramodel_binary_section_is(section, "<f8", 2) ||
+           section->shape[1] != 2 ||
+           section->shape[0] > INT32_MAX)
+        {
+            MSG("The binary camera model has an invalid 'valid_intrinsics_region'");
+            return false;
+        }
+        model->Nvalid_intrinsics_region = (int)section->shape[0];
+    }
+
+    model->icam_intrinsics = -1;
+    const int32_t* icam_intrinsics =
+        mrcal_cameramodel_binary_find(&section, model, "icam_intrinsics");
+    if(icam_intrinsics != NULL)
+    {
+        if(!cameramodel_binary_section_is(section, "<i4", 0) ||
+           *icam_intrinsics < 0)
+        {
+            MSG("The binary camera model has an invalid 'icam_intrinsics'");
+            return false;
+        }
+        model->icam_intrinsics = *icam_intrinsics;
+    }
+
+    return true;
+}
+
+bool mrcal_cameramodel_binary_map( // out
+                                   mrcal_cameramodel_binary_t* model,
+
+                                   // in
+                                   const char* filename)
+{
+    *model = (mrcal_cameramodel_binary_t){};
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        MSG("Couldn't open '%s': %s", filename, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if(0 != fstat(fd, &st))
+    {
+        MSG("Couldn't stat '%s': %s", filename, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if(st.st_size <= 0)
+    {
+        MSG("'%s' is empty", filename);
+        close(fd);
+        return false;
+    }
+
+    // mmap() returns page-aligned memory, so the alignment requirement is met
+    void* buffer = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(buffer == MAP_FAILED)
+    {
+        MSG("Couldn't mmap '%s': %s", filename, strerror(errno));
+        return false;
+    }
+
+    if(!mrcal_cameramodel_binary_parse(model, buffer, (size_t)st.st_size))
+    {
+        MSG("Couldn't parse '%s'", filename);
+        munmap(buffer, (size_t)st.st_size);
+        *model = (mrcal_cameramodel_binary_t){};
+        return false;
+    }
+
+    model->mapped = true;
+    return true;
+}
+
+void mrcal_cameramodel_binary_unmap(mrcal_cameramodel_binary_t* model)
+{
+    if(model->mapped)
+        munmap((void*)model->buffer, model->size);
+    *model = (mrcal_cameramodel_binary_t){};
+}
+
+const void*
+mrcal_cameramodel_binary_find( // out
+                               const mrcal_cameramodel_binary_section_t** section,
+
+                               // in
+                               const mrcal_cameramodel_binary_t* model,
+                               const char* name)
+{
+    for(int i=0; i<model->Nsections; i++)
+        if(0 == strcmp(model->sections[i].name, name))
+        {
+            if(section != NULL)
+                *section = &model->sections[i];
+            return (const char*)model->buffer + model->sections[i].offset;
+        }
+    return NULL;
+}
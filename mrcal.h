@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include "basic_geometry.h"
 #include "poseutils.h"
@@ -267,6 +268,35 @@ bool mrcal_project( // out
                    const double* intrinsics);
 
 
+// Project many camera-coordinate-system points using a pinhole or OpenCV model
+//
+// This computes the same thing as mrcal_project(), but the input points are
+// given in a structure-of-arrays layout: the point i is (px[i], py[i], pz[i]).
+// Several points are projected at a time in SIMD registers: with AVX-512 or
+// AVX2 if the CPU supports them (this is checked at runtime), or with scalar
+// code otherwise. Useful for applications that project many points with the
+// same intrinsics.
+//
+// The outputs q, dq_dp, dq_dintrinsics are laid out exactly as in
+// mrcal_project(). The gradient outputs may be NULL.
+//
+// Only MRCAL_LENSMODEL_PINHOLE and MRCAL_LENSMODEL_OPENCV... are supported.
+// Returns false for any other model
+bool mrcal_project_batch( // out
+                         mrcal_point2_t* q,
+                         mrcal_point3_t* dq_dp,
+                         double*         dq_dintrinsics,
+
+                         // in
+                         const double* px,
+                         const double* py,
+                         const double* pz,
+                         int N,
+                         mrcal_lensmodel_t lensmodel,
+                         // core, distortions concatenated
+                         const double* intrinsics);
+
+
 // Unproject the given pixel coordinates
 //
 // Compute an "unprojection", a mapping of pixel coordinates to the camera
@@ -277,8 +307,12 @@ bool mrcal_project( // out
 // not normalized, and may have any length.
 
 // This is the "reverse" direction, so an iterative nonlinear optimization is
-// performed internally to compute this result. This is much slower than
-// mrcal_project(). For OpenCV models specifically, OpenCV has
+// performed internally to compute this result: a few Newton iterations per
+// point, falling back to a full trust-region solve if those don't converge.
+// When the given q are close to each other (a grid of pixels, for instance),
+// each point is seeded from the solution of the previous one, which makes the
+// solves fast. This is still slower than mrcal_project(). For OpenCV models
+// specifically, OpenCV has
 // cvUndistortPoints() (and cv2.undistortPoints()), but these are unreliable:
 // https://github.com/opencv/opencv/issues/8811
 //
@@ -294,6 +328,160 @@ bool mrcal_unproject( // out
                      const double* intrinsics);
 
 
+// Unproject the given pixel coordinates using several threads
+//
+// Identical to mrcal_unproject(), but the N points are split into Nthreads
+// contiguous chunks, which are unprojected in parallel. Useful for unprojecting
+// whole imagers. Nthreads <= 1 does everything in the calling thread, exactly
+// like mrcal_unproject()
+//
+// This function does NOT support CAHVORE
+bool mrcal_unproject_threaded( // out
+                              mrcal_point3_t* v,
+
+                              // in
+                              const mrcal_point2_t* q,
+                              int N,
+                              mrcal_lensmodel_t lensmodel,
+                              // core, distortions concatenated
+                              const double* intrinsics,
+                              int Nthreads);
+
+
+// Interpolate a lookup table of observation vectors
+//
+// mrcal_unproject() runs an iterative solve for each point. If we unproject
+// many points with the same model, it's much faster to unproject a regular grid
+// of pixels once, and to interpolate that grid afterwards. This function does
+// the interpolation. The Python mrcal.unprojection_lut class builds the grid,
+// validates the interpolation error, and reads/writes it to disk.
+//
+// The grid is a (gridn_height,gridn_width) array of observation vectors, stored
+// row-first. Grid point (ix,iy) is the unprojection of the pixel
+// (ix*grid_spacing_x, iy*grid_spacing_y). If bicubic, we use Catmull-Rom
+// interpolation, with the grid extrapolated quadratically past its edges.
+// Otherwise we interpolate bilinearly. Points outside the grid extrapolate the
+// edge cells.
+//
+// The output vectors are not normalized. Non-finite q, and q in the cells that
+// use grid points that don't unproject (NaN), produce NaN
+void mrcal_unprojection_lut_interpolate( // out
+                                        mrcal_point3_t* v,
+
+                                        // in
+                                        const mrcal_point2_t* q,
+                                        int N,
+                                        const mrcal_point3_t* grid,
+                                        int gridn_width, int gridn_height,
+                                        double grid_spacing_x,
+                                        double grid_spacing_y,
+                                        bool bicubic);
+
+
+// Compute a reprojection map between two models
+//
+// This is the internals of mrcal.image_transformation_map() in Python. For
+// each pixel (x,y) of an image made by model_to, we compute the pixel in the
+// image made by model_from that observes the same point. The result is stored
+// in mapxy, a row-first (H_to,W_to,2) array of 32-bit floats: the format
+// cv2.remap() expects. We unproject each pixel with model_to, map the
+// observation vector to the model_from coordinate system with
+//
+//   v_from = M_from_to v_to
+//
+// and project it with model_from. M_from_to is a row-first (3,3) matrix. It
+// can be a rotation or a plane-induced homography. If NULL, the identity is
+// used.
+//
+// The map is computed in tiles of rows that are split among Nthreads threads.
+// Each row is processed in row-sized buffers; nothing image-sized is allocated
+// apart from mapxy itself. Pixels that can't be unprojected map to nan.
+//
+// model_to can't be MRCAL_LENSMODEL_CAHVORE; we can't unproject it here
+bool mrcal_image_transformation_map( // out
+                                     float* mapxy,
+
+                                     // in
+                                     mrcal_lensmodel_t lensmodel_from,
+                                     const double* intrinsics_from,
+                                     mrcal_lensmodel_t lensmodel_to,
+                                     const double* intrinsics_to,
+                                     int W_to, int H_to,
+                                     const double* M_from_to,
+                                     int Nthreads);
+
+
+// The pixel types mrcal_transform_image() can work with. This is an "X macro":
+// each entry is (name, C type)
+#define MRCAL_IMAGE_TYPE_LIST(_)                \
+    _(UINT8,  uint8_t)                          \
+    _(UINT16, uint16_t)                         \
+    _(FLOAT,  float)
+#define _LIST_WITH_COMMA(name,ctype) MRCAL_IMAGE_ ## name,
+typedef enum
+    { MRCAL_IMAGE_TYPE_LIST( _LIST_WITH_COMMA ) } mrcal_image_type_t;
+#undef _LIST_WITH_COMMA
+
+// The compact transformation maps store each coordinate in fixed point: the
+// integer part in an int16_t, and this many fractional bits of x and y packed
+// into a uint16_t. This is the layout cv2.convertMaps() produces for
+// CV_16SC2 maps
+#define MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS 5
+
+// Convert a transformation map to its compact form
+//
+// mapxy is an array of N (x,y) pixel coordinates, as produced by
+// mrcal_image_transformation_map(). We write the integer parts of each
+// coordinate to mapxy_int (N (x,y) pairs), and the fractional parts to
+// mapxy_frac: (yfrac << MRCAL_TRANSFORMATION_MAP_FRACTIONAL_BITS) | xfrac. The
+// compact map uses 6 bytes per pixel instead of 8, and is what
+// mrcal_transform_image() reads fastest. Coordinates that are nan or that don't
+// fit into an int16_t map to (-32768,-32768): far outside any image
+void mrcal_transformation_map_compact( // out
+                                       int16_t*  mapxy_int,
+                                       uint16_t* mapxy_frac,
+
+                                       // in
+                                       const float* mapxy,
+                                       int N);
+
+// Transform an image using a transformation map
+//
+// This is the internals of mrcal.transform_image() in Python. It does what
+// cv2.remap() does, with a constant 0 border. Output pixel (x,y) is the source
+// image interpolated at the coordinates in the map at (x,y). Exactly one of
+// these must be given:
+//
+// - mapxy: a row-first (H_out,W_out,2) array of floats, as produced by
+//   mrcal_image_transformation_map()
+//
+// - (mapxy_int, mapxy_frac): the compact map produced by
+//   mrcal_transformation_map_compact(). mapxy_int has shape (H_out,W_out,2) and
+//   mapxy_frac has shape (H_out,W_out)
+//
+// The other map pointers must be NULL. The image is a dense row-first
+// (H,W,Nchannels) array of the given type; the output is a dense
+// (H_out,W_out,Nchannels) array of the same type. If bicubic we use OpenCV's
+// INTER_CUBIC kernel. Otherwise we interpolate bilinearly. Integer pixels are
+// rounded and saturated. Source pixels outside the image read as 0.
+//
+// The rows are split among Nthreads threads. The interpolation uses the widest
+// SIMD kernel the CPU supports
+bool mrcal_transform_image( // out
+                            void* out,
+
+                            // in
+                            const void* image,
+                            int W, int H, int Nchannels,
+                            mrcal_image_type_t type,
+                            int W_out, int H_out,
+                            const float*    mapxy,
+                            const int16_t*  mapxy_int,
+                            const uint16_t* mapxy_frac,
+                            bool bicubic,
+                            int Nthreads);
+
+
 // Project the given camera-coordinate-system points using a stereographic model
 //
 // Compute a "projection", a mapping of points defined in the camera coordinate
@@ -433,6 +621,58 @@ typedef struct
 
 } mrcal_problem_selections_t;
 
+// The linear solvers available to mrcal_optimize()
+//
+// - MRCAL_SOLVER_CHOLMOD: libdogleg's trust-region optimizer, factoring the
+//   full sparse JtJ with CHOLMOD. The default. libdogleg analyzes the sparsity
+//   pattern anew in each solve
+//
+// - MRCAL_SOLVER_SCHUR: Levenberg-Marquardt. The frame poses and discrete
+//   points are eliminated from each linear system, leaving a reduced system
+//   containing only the camera parameters. Faster than CHOLMOD when there are
+//   many frames or points and few cameras. The reduced system is dense, so
+//   this is only for lens models with few parameters: splined models are
+//   rejected
+//
+// - MRCAL_SOLVER_PCG: Levenberg-Marquardt. Each linear system is solved with
+//   preconditioned conjugate gradients, using only Jt (J v) products. JtJ is
+//   never formed, so the memory use grows linearly with the number of
+//   observations. For problems too large to factor
+//
+// - MRCAL_SOLVER_CHOLMOD_LM: Levenberg-Marquardt, factoring the full sparse JtJ
+//   with CHOLMOD, like MRCAL_SOLVER_CHOLMOD. But the symbolic analysis of the
+//   sparsity pattern is done only once per problem, not in each
+//   outlier-rejection round, or in each mrcal_problem_optimize() call
+typedef enum
+    { MRCAL_SOLVER_CHOLMOD = 0,
+      MRCAL_SOLVER_SCHUR,
+      MRCAL_SOLVER_PCG,
+      MRCAL_SOLVER_CHOLMOD_LM } mrcal_solver_t;
+
+// The loss functions applied to the reprojection errors in mrcal_optimize()
+//
+// Each scalar reprojection error x (in pixels) contributes rho(x^2) to the
+// optimized cost. k is mrcal_problem_constants_t.loss_scale
+//
+// - MRCAL_LOSS_SQUARED: rho(s) = s. Plain least-squares. The default
+//
+// - MRCAL_LOSS_HUBER: rho(s) = s if s <= k^2, 2k sqrt(s) - k^2 otherwise.
+//   Quadratic near the optimum, linear for errors past k
+//
+// - MRCAL_LOSS_CAUCHY: rho(s) = k^2 log(1 + s/k^2). Large errors have a
+//   vanishing effect on the solution
+//
+// The robust losses make the solution insensitive to outliers, so the outlier
+// rejection (if requested) runs once, after a single solve. The regularization
+// and range penalties always use MRCAL_LOSS_SQUARED. The loss is applied inside
+// the solver only: the measurements returned by mrcal_optimize() and the
+// reported RMS error are in pixels. mrcal_optimizer_callback() reports the
+// measurements and the jacobian the solver sees, with the loss applied
+typedef enum
+    { MRCAL_LOSS_SQUARED = 0,
+      MRCAL_LOSS_HUBER,
+      MRCAL_LOSS_CAUCHY } mrcal_loss_t;
+
 // Constants used in a mrcal optimization. This is similar to
 // mrcal_problem_selections_t, but contains numerical values rather than just
 // bits
@@ -448,6 +688,20 @@ typedef struct
     // camera. Any observation of a point abive this range will be penalized to
     // encourage the optimizer to move the point closer to the camera
     double  point_max_range;
+
+    // How many threads to use to evaluate the optimization callback. The board
+    // and point observations are split between the threads. <= 1 means that
+    // everything is evaluated serially. The results are bit-identical
+    // regardless of this setting
+    int     Nthreads;
+
+    // Which solver to use. The default (0) is MRCAL_SOLVER_CHOLMOD
+    mrcal_solver_t solver;
+
+    // The loss function applied to the reprojection errors, and its scale, in
+    // pixels. The default (0) is MRCAL_LOSS_SQUARED, which ignores loss_scale
+    mrcal_loss_t loss;
+    double       loss_scale;
 } mrcal_problem_constants_t;
 
 
@@ -542,7 +796,17 @@ bool mrcal_corresponding_icam_extrinsics(// out
     /* How many pixel observations were thrown out as outliers. Each pixel */ \
     /* observation produces two measurements. Note that this INCLUDES any */ \
     /* outliers that were passed-in at the start */                     \
-    _(int,            Noutliers,                  PyInt_FromLong)
+    _(int,            Noutliers,                  PyInt_FromLong)       \
+                                                                        \
+    /* How many times the solver ran: once, plus once for each outlier- */ \
+    /* rejection round that found new outliers. Each round starts from */ \
+    /* the optimum of the previous one */                               \
+    _(int,            Nsolver_rounds,             PyInt_FromLong)       \
+                                                                        \
+    /* Wall-clock time spent in the first solver round, and in all the */ \
+    /* later (outlier-rejection) rounds together. In seconds */          \
+    _(double,         solve_time_first_round__s,  PyFloat_FromDouble)   \
+    _(double,         solve_time_later_rounds__s, PyFloat_FromDouble)
 #define MRCAL_STATS_ITEM_DEFINE(type, name, pyconverter) type name;
 typedef struct
 {
@@ -550,10 +814,36 @@ typedef struct
 } mrcal_stats_t;
 
 
+// Scratch memory for mrcal_optimize() and mrcal_optimizer_callback()
+//
+// The optimizer needs working buffers whose size depends on the problem: the
+// unpacked intrinsics and extrinsics, the packed state vector, the per-thread
+// projection gradients, etc. These are too big to live on the stack for large
+// problems (splined models with many knots, big camera rigs), so they're kept
+// in a mrcal_workspace_t. This is allocated once by mrcal_workspace_new(), and
+// passed to each solve. The buffers are grown as needed, and are never shrunk,
+// so repeated solves of similarly-sized problems allocate nothing. The
+// workspace is released with mrcal_workspace_free().
+//
+// A workspace may be used by only one solve at a time. Passing workspace=NULL
+// to mrcal_optimize() or mrcal_optimizer_callback() is allowed: a temporary
+// workspace is then allocated and released inside that call
+typedef struct mrcal_workspace_t mrcal_workspace_t;
+
+// Returns NULL on error
+mrcal_workspace_t* mrcal_workspace_new(void);
+void               mrcal_workspace_free(mrcal_workspace_t* workspace);
+
+
 // Solve the given optimization problem
 //
 // This is the entry point to the mrcal optimization routine. The argument list
 // is commented.
+//
+// The numbers of state variables and of measurements are ints (see
+// mrcal_num_states() and mrcal_num_measurements()), so each is limited to
+// INT_MAX. The buffer sizes are size_t, and the number of non-zero jacobian
+// entries is an int64_t, so those have no such limit
 mrcal_stats_t
 mrcal_optimize( // out
                 // Each one of these output pointers may be NULL
@@ -561,13 +851,13 @@ mrcal_optimize( // out
                 double* p_packed,
                 // used only to confirm that the user passed-in the buffer they
                 // should have passed-in. The size must match exactly
-                int buffer_size_p_packed,
+                size_t buffer_size_p_packed,
 
                 // Shape (Nmeasurements,)
                 double* x,
                 // used only to confirm that the user passed-in the buffer they
                 // should have passed-in. The size must match exactly
-                int buffer_size_x,
+                size_t buffer_size_x,
 
                 // out, in
 
@@ -618,7 +908,103 @@ mrcal_optimize( // out
                 int calibration_object_height_n,
                 bool verbose,
 
-                bool check_gradient);
+                bool check_gradient,
+
+                // Scratch memory. May be NULL. See mrcal_workspace_new()
+                mrcal_workspace_t* workspace);
+
+
+// A persistent optimization problem
+//
+// mrcal_optimize() sets up the problem (the problem layout, the sparsity
+// pattern of the Jacobian, the scratch buffers), solves it, and throws
+// everything away. Applications that solve the same problem repeatedly (from a
+// different seed, or with different observation weights) can set it up once
+// with mrcal_problem_new(), solve it any number of times with
+// mrcal_problem_optimize(), and release it with mrcal_problem_free().
+//
+// What is kept between the solves depends on the solver. The problem layout
+// and the scratch buffers are always kept. The MRCAL_SOLVER_SCHUR,
+// MRCAL_SOLVER_PCG and MRCAL_SOLVER_CHOLMOD_LM solvers also keep the structure
+// they derive from the sparsity pattern (for MRCAL_SOLVER_CHOLMOD_LM, the
+// CHOLMOD symbolic analysis). The default MRCAL_SOLVER_CHOLMOD does not:
+// libdogleg redoes its analysis in each solve
+//
+// The arguments to mrcal_problem_new() are the same as those to
+// mrcal_optimize(). The buffers are referenced, NOT copied, so they must
+// remain valid until mrcal_problem_free(). Each mrcal_problem_optimize() call
+// reads the seed from intrinsics, extrinsics_fromref, frames_toref, points,
+// calobject_warp and writes the solution back into them, like mrcal_optimize()
+// does. The observations may be re-weighted between calls by modifying the .z
+// values in observations_board_pool; everything else must stay as it was
+//
+// This is a C-only interface. The problem references the caller's buffers, so
+// a Python wrapper would need an object that holds all the input arrays, and
+// stops the caller from replacing or resizing them. mrcal.optimize() converts
+// and validates its arguments anew in each call, and that costs more than the
+// setup a persistent problem would save
+typedef struct mrcal_problem_t mrcal_problem_t;
+
+// Returns NULL on error
+mrcal_problem_t*
+mrcal_problem_new( // out, in
+                   double*             intrinsics,         // Ncameras_intrinsics * NlensParams
+                   mrcal_pose_t*       extrinsics_fromref, // Ncameras_extrinsics of these. Transform FROM the reference frame
+                   mrcal_pose_t*       frames_toref,       // Nframes of these.    Transform TO the reference frame
+                   mrcal_point3_t*     points,             // Npoints of these.    In the reference frame
+                   mrcal_point2_t*     calobject_warp,     // 1 of these. May be NULL if !problem_selections.do_optimize_calobject_warp
+
+                   // in
+                   int Ncameras_intrinsics, int Ncameras_extrinsics, int Nframes,
+                   int Npoints, int Npoints_fixed, // at the end of points[]
+
+                   const mrcal_observation_board_t* observations_board,
+                   const mrcal_observation_point_t* observations_point,
+                   int Nobservations_board,
+                   int Nobservations_point,
+
+                   mrcal_point3_t* observations_board_pool,
+
+                   mrcal_lensmodel_t lensmodel,
+                   double observed_pixel_uncertainty,
+                   const int* imagersizes, // Ncameras_intrinsics*2 of these
+                   mrcal_problem_selections_t       problem_selections,
+                   const mrcal_problem_constants_t* problem_constants,
+                   double calibration_object_spacing,
+                   int calibration_object_width_n,
+                   int calibration_object_height_n,
+                   bool verbose,
+
+                   // Scratch memory. May be NULL, in which case the problem
+                   // allocates its own. If non-NULL, it must outlive the
+                   // problem, and may not be used by anything else while the
+                   // problem exists
+                   mrcal_workspace_t* workspace);
+
+void mrcal_problem_free(mrcal_problem_t* problem);
+
+// Solve a problem created by mrcal_problem_new(). The outputs and the returned
+// statistics are the same as those of mrcal_optimize()
+mrcal_stats_t
+mrcal_problem_optimize( // out
+                        // Each one of these output pointers may be NULL
+                        // Shape (Nstate,)
+                        double* p_packed,
+                        // used only to confirm that the user passed-in the buffer they
+                        // should have passed-in. The size must match exactly
+                        size_t buffer_size_p_packed,
+
+                        // Shape (Nmeasurements,)
+                        double* x,
+                        // used only to confirm that the user passed-in the buffer they
+                        // should have passed-in. The size must match exactly
+                        size_t buffer_size_x,
+
+                        // in,out
+                        mrcal_problem_t* problem,
+
+                        // in
+                        bool check_gradient);
 
 
 // This is cholmod_sparse. I don't want to include the full header that defines
@@ -643,13 +1029,13 @@ bool mrcal_optimizer_callback(// out
                              double* p_packed,
                              // used only to confirm that the user passed-in the buffer they
                              // should have passed-in. The size must match exactly
-                             int buffer_size_p_packed,
+                             size_t buffer_size_p_packed,
 
                              // Shape (Nmeasurements,)
                              double* x,
                              // used only to confirm that the user passed-in the buffer they
                              // should have passed-in. The size must match exactly
-                             int buffer_size_x,
+                             size_t buffer_size_x,
 
                              // output Jacobian. May be NULL if we don't need
                              // it. This is the unitless Jacobian, used by the
@@ -699,7 +1085,190 @@ bool mrcal_optimizer_callback(// out
                              double calibration_object_spacing,
                              int calibration_object_width_n,
                              int calibration_object_height_n,
-                             bool verbose);
+                             bool verbose,
+
+                             // Scratch memory. May be NULL. See
+                             // mrcal_workspace_new()
+                             mrcal_workspace_t* workspace);
+
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////// Camera models
+////////////////////////////////////////////////////////////////////////////////
+
+// Camera models are normally stored in the text .cameramodel format: a Python
+// dict that's easy for humans to read and edit. mrcal also supports a binary
+// format. This stores the same data, but as aligned arrays that can be used
+// directly from a memory-mapped file, with no parsing or copying. This is the
+// format to use when many models must be loaded quickly, or when the models
+// contain large optimization_inputs.
+//
+// A binary model is
+//
+// - A header: mrcal_cameramodel_binary_header_t
+// - A table of Nsections section descriptors: mrcal_cameramodel_binary_section_t
+// - The data of each section, starting at the given offset from the start of the
+//   file. Each offset is a multiple of MRCAL_CAMERAMODEL_BINARY_ALIGNMENT
+//
+// Everything is stored little-endian. Each section is an array, described by a
+// name, a numpy-style dtype string ("<f8", "<i4", "|b1", ...) and a shape. Two
+// dtypes are special:
+//
+// - "str": a NUL-terminated UTF-8 string. The shape is (size,), including the
+//   NUL
+// - "none": a Python None. The section has no data
+//
+// A model contains these sections:
+//
+// - "lensmodel":  str. Required
+// - "intrinsics": <f8, shape (Nintrinsics,). Required
+// - "extrinsics": <f8, shape (6,): rt_cam_ref. Required
+// - "imagersize": <i4, shape (2,). Required
+// - "valid_intrinsics_region": <f8, shape (N,2). Optional
+// - "icam_intrinsics": <i4, shape (). Present if the optimization inputs are
+// - "optimization_inputs/KEY": each element of the optimization_inputs dict.
+//   Optional
+// - "projection_uncertainty_precomputed/rt_cam_ref": <f8, shape (6,). Optional
+// - "projection_uncertainty_precomputed/Var_ief": <f8, shape (N*(N+1)/2,): the
+//   upper triangle of the (N,N) covariance, row by row. N = Nintrinsics+12.
+//   Present if and only if the rt_cam_ref section is. See
+//   mrcal.precompute_projection_uncertainty() in Python
+#define MRCAL_CAMERAMODEL_BINARY_MAGIC     "MRCALBIN"
+#define MRCAL_CAMERAMODEL_BINARY_VERSION   1
+#define MRCAL_CAMERAMODEL_BINARY_ALIGNMENT 64
+#define MRCAL_CAMERAMODEL_BINARY_MAX_DIMS  4
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t Nsections;
+    // The size of the whole file, in bytes
+    uint64_t size;
+    uint8_t  _reserved[MRCAL_CAMERAMODEL_BINARY_ALIGNMENT - 24];
+} mrcal_cameramodel_binary_header_t;
+
+typedef struct
+{
+    // NUL-terminated
+    char     name[64];
+    // NUL-terminated numpy-style dtype string, or "str" or "none"
+    char     dtype[8];
+    uint32_t Ndims;
+    uint32_t _reserved;
+    uint64_t shape[MRCAL_CAMERAMODEL_BINARY_MAX_DIMS];
+    // Where the data is, from the start of the file, and how many bytes it has
+    uint64_t offset;
+    uint64_t size;
+} mrcal_cameramodel_binary_section_t;
+
+// A binary model, parsed. All the pointers point into the buffer holding the
+// model; nothing is copied
+typedef struct
+{
+    mrcal_lensmodel_t lensmodel;
+    int               Nintrinsics;
+    const double*     intrinsics;
+    const double*     rt_cam_ref;
+    int32_t           imagersize[2];
+
+    // NULL if the model doesn't have a valid-intrinsics region. A region with
+    // Nvalid_intrinsics_region == 0 means "valid nowhere"
+    const double*     valid_intrinsics_region;
+    int               Nvalid_intrinsics_region;
+
+    // <0 if the model doesn't have optimization_inputs
+    int               icam_intrinsics;
+
+    int                                       Nsections;
+    const mrcal_cameramodel_binary_section_t* sections;
+
+    // The buffer containing the model. If we mmap-ed it ourselves,
+    // mrcal_cameramodel_binary_unmap() releases it
+    const void* buffer;
+    size_t      size;
+    bool        mapped;
+} mrcal_cameramodel_binary_t;
+
+// Parse a binary model in a buffer
+//
+// The buffer must be aligned to MRCAL_CAMERAMODEL_BINARY_ALIGNMENT, and must
+// exist for as long as the model is used. Returns false if the buffer doesn't
+// contain a valid model
+bool mrcal_cameramodel_binary_parse( // out
+                                     mrcal_cameramodel_binary_t* model,
+
+                                     // in
+                                     const void* buffer,
+                                     size_t size);
+
+// Memory-map a binary model file, and parse it
+//
+// The file is mapped read-only. When the model is no longer needed, call
+// mrcal_cameramodel_binary_unmap(). Returns false on error
+bool mrcal_cameramodel_binary_map( // out
+                                   mrcal_cameramodel_binary_t* model,
+
+                                   // in
+                                   const char* filename);
+
+// Release a model mapped by mrcal_cameramodel_binary_map(). Does nothing to a
+// model that came from mrcal_cameramodel_binary_parse()
+void mrcal_cameramodel_binary_unmap(mrcal_cameramodel_binary_t* model);
+
+// Find a section in a binary model, by name
+//
+// Returns a pointer to the data, and reports the section descriptor in
+// *section, if section != NULL. Returns NULL if no such section exists. For
+// instance, to get the observations of the chessboards in the optimization
+// inputs:
+//
+//   const mrcal_cameramodel_binary_section_t* section;
+//   const double* observations_board =
+//     mrcal_cameramodel_binary_find(&model,
+//                                   "optimization_inputs/observations_board",
+//                                   &section);
+const void*
+mrcal_cameramodel_binary_find( // out
+                               const mrcal_cameramodel_binary_section_t** section,
+
+                               // in
+                               const mrcal_cameramodel_binary_t* model,
+                               const char* name);
+
+
+// A camera model, as read by mrcal_read_cameramodel_file() or
+// mrcal_read_cameramodel_string(). This contains the parts of the model needed
+// to project and unproject. The intrinsics array has
+// mrcal_lensmodel_num_params(lensmodel) elements, and is allocated together
+// with the rest of the structure
+typedef struct
+{
+    double            rt_cam_ref[6];
+    unsigned int      imagersize[2];
+    mrcal_lensmodel_t lensmodel;
+    double            intrinsics[0];
+} mrcal_cameramodel_t;
+
+// Read a camera model from a file
+//
+// The file may be a text .cameramodel file or a binary one. The text parser
+// understands the Python-dict syntax that mrcal writes, and skips the fields
+// that mrcal_cameramodel_t doesn't contain, so the optimization_inputs cost
+// very little. Nothing is allocated other than the returned model. Returns NULL
+// on error. The model must be freed with mrcal_free_cameramodel()
+mrcal_cameramodel_t* mrcal_read_cameramodel_file  (const char* filename);
+
+// Read a camera model from a string
+//
+// Same as mrcal_read_cameramodel_file(), but the model is given in memory. If
+// len <= 0, the string is NUL-terminated. A binary model must be aligned to
+// MRCAL_CAMERAMODEL_BINARY_ALIGNMENT
+mrcal_cameramodel_t* mrcal_read_cameramodel_string(const char* string, int len);
+
+// Free a model returned by mrcal_read_cameramodel_file() or
+// mrcal_read_cameramodel_string(), and set the pointer to NULL
+void mrcal_free_cameramodel(mrcal_cameramodel_t** cameramodel);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -31,6 +31,7 @@ import warnings
 import io
 import copy
 import base64
+import mmap
 
 import mrcal
 
@@ -148,6 +149,23 @@ class CameramodelParseException(Exception):
     pass
 
 
+def _validateProjectionUncertaintyPrecomputed(precomputed, lensmodel):
+    r'''Raises an exception if the given precomputed uncertainty is invalid
+
+The given dict has the packed representation: 'Var_ief' contains the upper
+triangle of the symmetric covariance matrix'''
+
+    if not isinstance(precomputed, dict) or \
+       set(precomputed.keys()) != set(('rt_cam_ref', 'Var_ief')):
+        raise Exception("The precomputed projection uncertainty must be a dict with keys 'rt_cam_ref' and 'Var_ief'")
+
+    Nz = mrcal.lensmodel_num_params(lensmodel) + 12
+    if np.asarray(precomputed['rt_cam_ref']).shape != (6,):
+        raise Exception("The precomputed projection uncertainty must have rt_cam_ref of shape (6,)")
+    if np.asarray(precomputed['Var_ief']).shape != (Nz*(Nz+1)//2,):
+        raise Exception(f"The precomputed projection uncertainty for lensmodel {lensmodel} must have {Nz*(Nz+1)//2} elements in the packed Var_ief")
+
+
 def _serialize_optimization_inputs(optimization_inputs):
     r'''Convert a optimization_inputs dict to an ascii string
 
@@ -290,6 +308,149 @@ that function for details
     return optimization_inputs
 
 
+# The binary .cameramodel format. This is described in detail in mrcal.h, next
+# to mrcal_cameramodel_binary_parse(). Briefly: a header, a table of section
+# descriptors, and the section data. Each section is an aligned array, so it can
+# be used in-place from a memory-mapped file
+_cameramodel_binary_magic     = b'MRCALBIN'
+_cameramodel_binary_version   = 1
+_cameramodel_binary_alignment = 64
+_cameramodel_binary_header_dtype = \
+    np.dtype([ ('magic',     'S8'),
+               ('version',   '<u4'),
+               ('Nsections', '<u4'),
+               ('size',      '<u8'),
+               ('_reserved', 'V40') ])
+_cameramodel_binary_section_dtype = \
+    np.dtype([ ('name',      'S64'),
+               ('dtype',     'S8'),
+               ('Ndims',     '<u4'),
+               ('_reserved', '<u4'),
+               ('shape',     '<u8', (4,)),
+               ('offset',    '<u8'),
+               ('size',      '<u8') ])
+
+
+def _binary_section(name, v):
+    r'''Convert a value to a (name, dtype, shape, bytes) binary-model section
+
+This is an internal function.
+
+    '''
+
+    if v is None:
+        return (name, 'none', (), b'')
+    if isinstance(v, str):
+        b = v.encode() + b'\0'
+        return (name, 'str', (len(b),), b)
+
+    v = np.asarray(v)
+    if v.dtype.kind not in 'fiub' or v.ndim > 4:
+        raise Exception(f"Can't store '{name}' in a binary cameramodel: it has dtype {v.dtype} and shape {v.shape}")
+    v = np.array(v, dtype = v.dtype.newbyteorder('<'), order = 'C')
+    return (name, v.dtype.str, v.shape, v.tobytes())
+
+
+def _write_binary_cameramodel(f, sections):
+    r'''Write a binary camera model to an open binary file
+
+This is an internal function.
+
+sections is a list of (name, dtype, shape, bytes) tuples
+
+    '''
+
+    def aligned(n):
+        a = _cameramodel_binary_alignment
+        return (n + a-1) // a * a
+
+    table = np.zeros((len(sections),), dtype = _cameramodel_binary_section_dtype)
+    offset = aligned(_cameramodel_binary_header_dtype.itemsize +
+                     table.nbytes)
+    for i,(name,dtype,shape,data) in enumerate(sections):
+        if len(name.encode()) >= _cameramodel_binary_section_dtype['name'].itemsize:
+            raise Exception(f"Binary cameramodel section name '{name}' is too long")
+        table['name'  ][i]             = name.encode()
+        table['dtype' ][i]             = dtype.encode()
+        table['Ndims' ][i]             = len(shape)
+        table['shape' ][i,:len(shape)] = shape
+        table['offset'][i]             = offset
+        table['size'  ][i]             = len(data)
+        offset = aligned(offset + len(data))
+
+    header = np.zeros((), dtype = _cameramodel_binary_header_dtype)
+    header['magic']     = _cameramodel_binary_magic
+    header['version']   = _cameramodel_binary_version
+    header['Nsections'] = len(sections)
+    header['size']      = offset
+
+    f.write(header.tobytes())
+    f.write(table.tobytes())
+    written = header.nbytes + table.nbytes
+    for i,(name,dtype,shape,data) in enumerate(sections):
+        f.write(b'\0' * (int(table[i]['offset']) - written))
+        f.write(data)
+        written = int(table[i]['offset']) + len(data)
+    f.write(b'\0' * (offset - written))
+
+
+def _read_binary_cameramodel(buffer):
+    r'''Parse a binary camera model in a buffer
+
+This is an internal function.
+
+Returns a dict mapping each section name to its value. The arrays are views
+into the buffer: nothing is copied. Scalars are converted to Python objects,
+like _deserialize_optimization_inputs() does
+
+    '''
+
+    if len(buffer) < _cameramodel_binary_header_dtype.itemsize:
+        raise CameramodelParseException("Binary cameramodel is truncated")
+    header = np.frombuffer(buffer, dtype = _cameramodel_binary_header_dtype, count = 1)[0]
+    if header['magic'] != _cameramodel_binary_magic:
+        raise CameramodelParseException("This isn't a binary cameramodel")
+    if header['version'] > _cameramodel_binary_version:
+        raise CameramodelParseException(f"Binary cameramodel has version {header['version']}, but I only know about versions <= {_cameramodel_binary_version}")
+    Nsections = int(header['Nsections'])
+    if int(header['size']) > len(buffer) or \
+       _cameramodel_binary_header_dtype.itemsize + \
+       Nsections*_cameramodel_binary_section_dtype.itemsize > int(header['size']):
+        raise CameramodelParseException("Binary cameramodel is truncated")
+
+    table = np.frombuffer(buffer,
+                          dtype  = _cameramodel_binary_section_dtype,
+                          count  = Nsections,
+                          offset = _cameramodel_binary_header_dtype.itemsize)
+    sections = dict()
+    for s in table:
+        name   = s['name'].decode()
+        dtype  = s['dtype'].decode()
+        shape  = tuple(int(x) for x in s['shape'][:s['Ndims']])
+        offset = int(s['offset'])
+        size   = int(s['size'])
+        if offset + size > int(header['size']):
+            raise CameramodelParseException(f"Binary cameramodel section '{name}' is truncated")
+
+        if dtype == 'none':
+            v = None
+        elif dtype == 'str':
+            v = bytes(buffer[offset:offset+size]).rstrip(b'\0').decode()
+        else:
+            dtype = np.dtype(dtype)
+            count = int(np.prod(shape, dtype=int))
+            if count * dtype.itemsize != size:
+                raise CameramodelParseException(f"Binary cameramodel section '{name}' has a size that doesn't match its shape")
+            v = np.frombuffer(buffer,
+                              dtype  = dtype,
+                              count  = count,
+                              offset = offset).reshape(shape)
+            if v.shape == ():
+                v = v.item()
+        sections[name] = v
+    return sections
+
+
 class cameramodel(object):
     r'''A class that describes the lens parameters and geometry of a single camera
 
@@ -402,6 +563,13 @@ A sample valid .cameramodel file:
       'imagersize': [3840,2160]
     }
 
+Models may also be stored in a binary format, by calling write(binary=True).
+This holds the same data as aligned arrays, which are used in-place from a
+memory-mapped file when read. Reading a binary model involves no parsing, so
+this is much faster when many models are loaded, or when the models contain
+large optimization_inputs. The constructor recognizes both formats. The layout
+is described in mrcal.h.
+
     '''
 
     def _write(self, f, note=None):
@@ -447,7 +615,8 @@ A sample valid .cameramodel file:
             f.write(("    'icam_intrinsics': {:d},\n").format(self._icam_intrinsics))
         f.write("\n")
 
-        if self._optimization_inputs_string is not None:
+        optimization_inputs_string = self._optimization_inputs_as_string()
+        if optimization_inputs_string is not None:
             f.write(r"""    # The optimization inputs contain all the data used to compute this model.
     # This contains ALL the observations for ALL the cameras in the solve. The uses of
     # this are to be able to compute projection uncertainties, to visualize the
@@ -460,11 +629,133 @@ A sample valid .cameramodel file:
     # elsewhere, the original solve can still be used to represent the camera-relative
     # projection uncertainties
 """)
-            f.write(f"    'optimization_inputs': {self._optimization_inputs_string},\n\n")
+            f.write(f"    'optimization_inputs': {optimization_inputs_string},\n\n")
+
+        if self._projection_uncertainty_precomputed is not None:
+            f.write(r"""    # The covariance of the intrinsics, extrinsics and frames, precomputed from the
+    # optimization inputs by mrcal.precompute_projection_uncertainty(). This is
+    # used to quickly compute projection uncertainties. Stored like the
+    # optimization inputs
+""")
+            f.write("    'projection_uncertainty_precomputed': {},\n\n". \
+                    format(_serialize_optimization_inputs(self._projection_uncertainty_precomputed)))
 
         f.write("}\n")
 
 
+    def _write_binary(self, f, note=None):
+        r'''Writes out this camera model to an open binary file'''
+
+        _validateIntrinsics(self._imagersize,
+                            self._intrinsics)
+        _validateValidIntrinsicsRegion(self._valid_intrinsics_region)
+        _validateExtrinsics(self._extrinsics)
+
+        sections = [ _binary_section('lensmodel',  self._intrinsics[0]),
+                     _binary_section('intrinsics', np.asarray(self._intrinsics[1], dtype=float)),
+                     _binary_section('extrinsics', np.asarray(self._extrinsics,    dtype=float)),
+                     _binary_section('imagersize', np.asarray(self._imagersize,    dtype=np.int32)) ]
+        if note is not None:
+            sections.append( _binary_section('note', note) )
+        if self._valid_intrinsics_region is not None:
+            sections.append( _binary_section('valid_intrinsics_region',
+                                             np.asarray(self._valid_intrinsics_region, dtype=float).reshape(-1,2)) )
+
+        optimization_inputs = self._optimization_inputs_as_dict()
+        if optimization_inputs is not None:
+            sections.append( _binary_section('icam_intrinsics',
+                                             np.int32(self._icam_intrinsics)) )
+            for k,v in optimization_inputs.items():
+                sections.append( _binary_section('optimization_inputs/' + k, v) )
+
+        if self._projection_uncertainty_precomputed is not None:
+            for k,v in self._projection_uncertainty_precomputed.items():
+                sections.append( _binary_section('projection_uncertainty_precomputed/' + k, v) )
+
+        _write_binary_cameramodel(f, sections)
+
+
+    def _optimization_inputs_as_string(self):
+        r'''Returns the serialized optimization inputs, or None'''
+        if self._optimization_inputs_string is None and \
+           self._optimization_inputs_binary is not None:
+            self._optimization_inputs_string = \
+                _serialize_optimization_inputs(self._optimization_inputs_binary)
+        return self._optimization_inputs_string
+
+
+    def _optimization_inputs_as_dict(self):
+        r'''Returns the optimization inputs dict, or None
+
+The arrays in the dict are shared with this object, and may be read-only views
+into a memory-mapped binary model. The caller must not modify them'''
+        if self._optimization_inputs_binary is not None:
+            return self._optimization_inputs_binary
+        if self._optimization_inputs_string is not None:
+            return _deserialize_optimization_inputs(self._optimization_inputs_string)
+        return None
+
+
+    def _read_binary_into_self(self, buffer):
+        r'''Reads in a binary model from a buffer
+
+The buffer is a bytes object or a memory-mapped file. The arrays in this object
+are views into the buffer: nothing is copied'''
+
+        sections = _read_binary_cameramodel(buffer)
+
+        keys_required = set(('lensmodel',
+                             'intrinsics',
+                             'extrinsics',
+                             'imagersize'))
+        if not keys_required <= set(sections.keys()):
+            raise CameramodelParseException("Binary model must have at least these sections: '{}'. Instead I got '{}'". \
+                                            format(keys_required, set(sections.keys())))
+
+        intrinsics = (sections['lensmodel'], sections['intrinsics'])
+        _validateIntrinsics(sections['imagersize'],
+                            intrinsics)
+
+        valid_intrinsics_region = sections.get('valid_intrinsics_region')
+        try:
+            _validateValidIntrinsicsRegion(valid_intrinsics_region)
+        except Exception as e:
+            warnings.warn("Invalid valid_intrinsics region; skipping: '{}'".format(e))
+            valid_intrinsics_region = None
+
+        _validateExtrinsics(sections['extrinsics'])
+
+        self._intrinsics                 = intrinsics
+        self._valid_intrinsics_region    = mrcal.close_contour(valid_intrinsics_region)
+        self._extrinsics                 = sections['extrinsics']
+        self._imagersize                 = sections['imagersize']
+        self._optimization_inputs_string = None
+
+        prefix = 'optimization_inputs/'
+        optimization_inputs = dict( (k[len(prefix):], v) \
+                                    for k,v in sections.items() \
+                                    if k.startswith(prefix) )
+        if len(optimization_inputs):
+            if not isinstance(sections.get('icam_intrinsics'), int) or \
+               sections['icam_intrinsics'] < 0:
+                raise CameramodelParseException("'optimization_inputs' are given, but a valid 'icam_intrinsics' is NOT given")
+            self._optimization_inputs_binary = optimization_inputs
+            self._icam_intrinsics            = sections['icam_intrinsics']
+        else:
+            self._optimization_inputs_binary = None
+            self._icam_intrinsics            = None
+
+        prefix = 'projection_uncertainty_precomputed/'
+        precomputed = dict( (k[len(prefix):], v) \
+                            for k,v in sections.items() \
+                            if k.startswith(prefix) )
+        if len(precomputed):
+            _validateProjectionUncertaintyPrecomputed(precomputed, intrinsics[0])
+            self._projection_uncertainty_precomputed = precomputed
+        else:
+            self._projection_uncertainty_precomputed = None
+
+
     def _read_into_self(self, f):
         r'''Reads in a model from an open file, or the model given as a string
 
@@ -482,6 +773,12 @@ A sample valid .cameramodel file:
             s    = f
             name = None
 
+        if isinstance(s, (bytes, bytearray)):
+            if s.startswith(_cameramodel_binary_magic):
+                self._read_binary_into_self(s)
+                return
+            s = s.decode()
+
         try:
             model = ast.literal_eval(s)
         except:
@@ -546,6 +843,7 @@ A sample valid .cameramodel file:
                 raise CameramodelParseException("'optimization_inputs' is given, but it's not a byte string. type(optimization_inputs)={}". \
                                                 format(type(model['optimization_inputs'])))
             self._optimization_inputs_string           = model['optimization_inputs']
+            self._optimization_inputs_binary           = None
 
             if 'icam_intrinsics' not in model:
                 raise CameramodelParseException("'optimization_inputs' is given, but icam_intrinsics NOT given")
@@ -556,8 +854,18 @@ A sample valid .cameramodel file:
             self._icam_intrinsics = model['icam_intrinsics']
         else:
             self._optimization_inputs_string          = None
+            self._optimization_inputs_binary          = None
             self._icam_intrinsics = None
 
+        if 'projection_uncertainty_precomputed' in model:
+            if not isinstance(model['projection_uncertainty_precomputed'], bytes):
+                raise CameramodelParseException("'projection_uncertainty_precomputed' is given, but it's not a byte string")
+            precomputed = _deserialize_optimization_inputs(model['projection_uncertainty_precomputed'])
+            _validateProjectionUncertaintyPrecomputed(precomputed, intrinsics[0])
+            self._projection_uncertainty_precomputed = precomputed
+        else:
+            self._projection_uncertainty_precomputed = None
+
     def __init__(self,
 
                  file_or_model           = None,
@@ -707,7 +1015,11 @@ ARGUMENTS
                 self._intrinsics                 = copy.deepcopy(file_or_model._intrinsics)
                 self._valid_intrinsics_region    = copy.deepcopy(mrcal.close_contour(file_or_model._valid_intrinsics_region))
                 self._optimization_inputs_string = copy.deepcopy(file_or_model._optimization_inputs_string)
+                # The arrays in here are never modified, so I share them
+                self._optimization_inputs_binary = copy.copy(file_or_model._optimization_inputs_binary)
                 self._icam_intrinsics            = copy.deepcopy(file_or_model._icam_intrinsics)
+                self._projection_uncertainty_precomputed = \
+                    copy.deepcopy(file_or_model._projection_uncertainty_precomputed)
                 return
 
             if type(file_or_model) is str:
@@ -726,8 +1038,7 @@ ARGUMENTS
                     return
 
                 # Some readable file. Read it!
-                def tryread(f):
-                    modelstring = f.read()
+                def tryread(modelstring):
                     try:
                         self._read_into_self(modelstring)
                     except CameramodelParseException:
@@ -737,10 +1048,23 @@ ARGUMENTS
                         model.write(modelfile)
                         self._read_into_self(modelfile.getvalue())
                 if file_or_model == '-':
-                    tryread(sys.stdin)
-                else:
-                    with open(file_or_model, 'r') as openedfile:
-                        tryread(openedfile)
+                    modelbytes = sys.stdin.buffer.read()
+                    if modelbytes.startswith(_cameramodel_binary_magic):
+                        self._read_binary_into_self(modelbytes)
+                    else:
+                        tryread(modelbytes.decode())
+                    return
+
+                with open(file_or_model, 'rb') as openedfile:
+                    if openedfile.read(len(_cameramodel_binary_magic)) == \
+                       _cameramodel_binary_magic:
+                        # A binary model. I map it, and use the data
+                        # in-place. The arrays keep the mapping alive
+                        self._read_binary_into_self(mmap.mmap(openedfile.fileno(), 0,
+                                                              access = mmap.ACCESS_READ))
+                        return
+                with open(file_or_model, 'r') as openedfile:
+                    tryread(openedfile.read())
                 return
 
             self._read_into_self(file_or_model)
@@ -828,7 +1152,7 @@ ARGUMENTS
             ')'
 
 
-    def write(self, f, note=None, cahvor=False):
+    def write(self, f, note=None, cahvor=False, binary=False):
         r'''Write out this camera model to disk
 
 SYNOPSIS
@@ -839,6 +1163,14 @@ We write the contents of the given mrcal.cameramodel object to the given
 filename or a given pre-opened file. If the filename is 'xxx.cahvor' or if
 cahvor: we use the legacy cahvor file format for output
 
+If binary: we use the binary cameramodel format. This stores the same data as
+the usual text format, but as aligned arrays. Reading a binary model maps the
+file into memory, and uses the data in-place, without parsing or copying. This
+is much faster for models that contain large optimization_inputs. The binary
+format can be read from C as well, with mrcal_cameramodel_binary_map(). The
+mrcal.cameramodel constructor recognizes either format. Convert a binary model
+back to text with mrcal-to-cameramodel to edit it
+
 ARGUMENTS
 
 - f: a string for the filename or an opened Python 'file' object to use
@@ -850,6 +1182,11 @@ ARGUMENTS
 - cahvor: an optional boolean, defaulting to False. If True: we write out the
   data using the legacy .cahvor file format
 
+- binary: an optional boolean, defaulting to False. If True or if the filename
+  is 'xxx.cameramodelb': we write out the data using the binary cameramodel
+  format. If writing to a pre-opened file, it must have been opened in binary
+  mode
+
 RETURNED VALUES
 
 None
@@ -860,6 +1197,17 @@ None
             cahvor.write(f, self, note)
             return
 
+        if type(f) is str and re.match(".*\.cameramodelb$", f):
+            binary = True
+
+        if binary:
+            if type(f) is str:
+                with open(f, 'wb') as openedfile:
+                    self._write_binary( openedfile, note )
+            else:
+                self._write_binary( f, note )
+            return
+
         if type(f) is str:
             if re.match(".*\.cahvor$", f):
                 from . import cahvor
@@ -922,7 +1270,8 @@ the arguments.
   - (optionally) icam_intrinsics
 
   Changing any of these 4 parameters automatically invalidates the others, and
-  it only makes sense to set them in unison.
+  it only makes sense to set them in unison. The setter also clears the
+  precomputed projection uncertainty, if any.
 
 The getters return a copy of the data, and the setters make a copy of the input:
 so it's impossible for the caller or callee to modify each other's data.
@@ -977,6 +1326,8 @@ tuple where
         self._imagersize = copy.deepcopy(imagersize)
         self._intrinsics = copy.deepcopy(intrinsics)
 
+        self._optimization_inputs_binary         = None
+        self._projection_uncertainty_precomputed = None
         if optimization_inputs is not None:
             self._optimization_inputs_string = \
                 _serialize_optimization_inputs(optimization_inputs)
@@ -1305,14 +1656,85 @@ RETURNED VALUE
 The optimization_inputs dict, or None if one isn't stored in this model.
         '''
 
-        if self._optimization_inputs_string is None:
+        if self._optimization_inputs_binary is not None:
+            # The arrays are views into the model file. I return copies
+            x = dict( (k, v.copy() if isinstance(v, np.ndarray) else v) \
+                      for k,v in self._optimization_inputs_binary.items() )
+        elif self._optimization_inputs_string is not None:
+            x = _deserialize_optimization_inputs(self._optimization_inputs_string)
+        else:
             return None
-        x = _deserialize_optimization_inputs(self._optimization_inputs_string)
         if x['extrinsics_rt_fromref'] is None:
             x['extrinsics_rt_fromref'] = np.zeros((0,6), dtype=float)
         return x
 
 
+    def projection_uncertainty_precomputed(self, precomputed=None):
+        r'''Get or set the precomputed projection-uncertainty covariance
+
+SYNOPSIS
+
+    # setter
+    model.projection_uncertainty_precomputed( \
+        mrcal.precompute_projection_uncertainty(model) )
+
+    # getter
+    precomputed = model.projection_uncertainty_precomputed()
+
+mrcal.projection_uncertainty() can use a covariance precomputed by
+mrcal.precompute_projection_uncertainty() instead of the optimization_inputs.
+This is much faster, and doesn't require the optimization_inputs to be present.
+This function stores or retrieves that covariance. It is written to the model
+file, and read back from it. It is a small square matrix of size
+Nintrinsics+12, of which only the upper triangle is stored.
+
+Setting the intrinsics with intrinsics() invalidates the precomputed
+covariance, like it invalidates the optimization_inputs.
+
+if precomputed is None: this is a getter; otherwise a setter.
+
+The getters return a copy of the data, and the setters make a copy of the input:
+so it's impossible for the caller or callee to modify each other's data.
+
+ARGUMENTS
+
+- precomputed: if we're setting: the dict returned by
+  mrcal.precompute_projection_uncertainty(). If we're getting: None
+
+RETURNED VALUE
+
+If this is a getter (no arguments given), returns the dict as returned by
+mrcal.precompute_projection_uncertainty(), or None if this model doesn't contain
+a precomputed covariance
+
+        '''
+        Nz = mrcal.lensmodel_num_params(self._intrinsics[0]) + 12
+        iupper = np.triu_indices(Nz)
+
+        if precomputed is None:
+            # getter
+            if self._projection_uncertainty_precomputed is None:
+                return None
+            Var_ief = np.zeros((Nz,Nz), dtype=float)
+            Var_ief[iupper] = self._projection_uncertainty_precomputed['Var_ief']
+            Var_ief.T[iupper] = self._projection_uncertainty_precomputed['Var_ief']
+            return dict( rt_cam_ref = np.array(self._projection_uncertainty_precomputed['rt_cam_ref'],
+                                               dtype=float),
+                         Var_ief    = Var_ief )
+
+        # setter
+        Var_ief = np.asarray(precomputed.get('Var_ief'), dtype=float)
+        if Var_ief.shape != (Nz,Nz):
+            raise Exception(f"Var_ief must have shape ({Nz},{Nz}) for lensmodel {self._intrinsics[0]}. Got {Var_ief.shape}")
+        packed = dict( rt_cam_ref = np.array(precomputed.get('rt_cam_ref'), dtype=float),
+                       Var_ief    = Var_ief[iupper] )
+
+        # raises exception on error
+        _validateProjectionUncertaintyPrecomputed(packed, self._intrinsics[0])
+        self._projection_uncertainty_precomputed = packed
+        return True
+
+
     def icam_intrinsics(self):
         r'''Get the camera index indentifying this camera at optimization time
 
@@ -10,6 +10,7 @@ mrcal.image_transforms.fff() or mrcal.fff(). The latter is preferred.
 import numpy as np
 import numpysane as nps
 import sys
+import os
 import re
 import cv2
 import mrcal
@@ -268,7 +269,8 @@ def image_transformation_map(model_from, model_to,
 
                              use_rotation = False,
                              plane_n      = None,
-                             plane_d      = None):
+                             plane_d      = None,
+                             Nthreads     = None):
 
     r'''Compute a reprojection map between two models
 
@@ -372,12 +374,15 @@ ARGUMENTS
   use_rotation should be True. if given, we use the full intrinsics and
   extrinsics of both camera models
 
+- Nthreads: optional integer, defaulting to the number of CPUs. The map is
+  computed in C by this many threads
+
 RETURNED VALUE
 
 A numpy array of shape (Nheight,Nwidth,2) where Nheight and Nwidth represent the
 imager dimensions of model_to. This array contains 32-bit floats, as required by
-cv2.remap() (the function providing the internals of mrcal.transform_image()).
-This array can be passed to mrcal.transform_image()
+cv2.remap(). This array can be passed to mrcal.transform_image(), or converted
+to a compact form with mrcal.transformation_map_compact() first
 
     '''
 
@@ -434,27 +439,10 @@ This array can be passed to mrcal.transform_image()
                                                         cv2.CV_32FC1)],
                          axis = -1)
 
-    W_from,H_from = model_from.imagersize()
-    W_to,  H_to   = model_to.  imagersize()
-
-    # shape: (Nheight,Nwidth,2). Contains (x,y) rows
-    grid = np.ascontiguousarray(nps.mv(nps.cat(*np.meshgrid(np.arange(W_to),
-                                                            np.arange(H_to))),
-                                       0,-1),
-                                dtype = float)
-    if lensmodel_to == "LENSMODEL_PINHOLE":
-        # Faster path for the unproject. Nice, simple closed-form solution
-        fxy_to = intrinsics_data_to[0:2]
-        cxy_to = intrinsics_data_to[2:4]
-        v = np.zeros( (grid.shape[0], grid.shape[1], 3), dtype=float)
-        v[..., :2] = (grid-cxy_to)/fxy_to
-        v[...,  2] = 1
-    elif lensmodel_to == "LENSMODEL_STEREOGRAPHIC":
-        # Faster path for the unproject. Nice, simple closed-form solution
-        v = mrcal.unproject_stereographic(grid, *intrinsics_data_to[:4])
-    else:
-        v = mrcal.unproject(grid, lensmodel_to, intrinsics_data_to)
+    W_to,H_to = model_to.imagersize()
 
+    # The map is v_from = matmult(M_from_to, v_to)
+    M_from_to = None
     if plane_n is not None:
 
         R_to_from = Rt_to_from[:3,:]
@@ -464,22 +452,94 @@ This array can be passed to mrcal.transform_image()
         # "Motion and structure from motion in a piecewise planar environment"
         # by Olivier Faugeras, F. Lustman.
         A_to_from = plane_d * R_to_from + nps.outer(t_to_from, plane_n)
-        A_from_to = np.linalg.inv(A_to_from)
-        v = nps.matmult( v, nps.transpose(A_from_to) )
+        M_from_to = np.linalg.inv(A_to_from)
 
     else:
         if Rt_to_from is not None:
             R_to_from = Rt_to_from[:3,:]
             if np.trace(R_to_from) < 3. - 1e-12:
                 # rotation isn't identity. apply
-                v = nps.matmult(v, R_to_from)
+                M_from_to = nps.transpose(R_to_from)
+
+    if lensmodel_to != "LENSMODEL_CAHVORE":
+        # The usual path. The map is computed in C, one row at a time, without
+        # any image-sized temporaries
+        if Nthreads is None:
+            Nthreads = os.cpu_count() or 1
+        return mrcal._mrcal._image_transformation_map(lensmodel_from,
+                                                      np.ascontiguousarray(intrinsics_data_from, dtype=float),
+                                                      lensmodel_to,
+                                                      np.ascontiguousarray(intrinsics_data_to,   dtype=float),
+                                                      int(W_to), int(H_to),
+                                                      M_from_to = None if M_from_to is None else \
+                                                        np.ascontiguousarray(M_from_to, dtype=float),
+                                                      Nthreads  = Nthreads)
+
+    # The C code can't unproject CAHVORE, so I do that in numpy
+
+    # shape: (Nheight,Nwidth,2). Contains (x,y) rows
+    grid = np.ascontiguousarray(nps.mv(nps.cat(*np.meshgrid(np.arange(W_to),
+                                                            np.arange(H_to))),
+                                       0,-1),
+                                dtype = float)
+    v = mrcal.unproject(grid, lensmodel_to, intrinsics_data_to)
+    if M_from_to is not None:
+        v = nps.matmult( v, nps.transpose(M_from_to) )
 
     mapxy = mrcal.project( v, lensmodel_from, intrinsics_data_from )
 
     return mapxy.astype(np.float32)
 
 
-def transform_image(image, mapxy):
+def transformation_map_compact(mapxy):
+    r'''Converts a transformation map to a compact fixed-point form
+
+SYNOPSIS
+
+    mapxy = mrcal.image_transformation_map(model_orig, model_pinhole)
+
+    mapxy_compact = mrcal.transformation_map_compact(mapxy)
+
+    for image in images:
+        image_undistorted = mrcal.transform_image(image, mapxy_compact)
+
+A transformation map from mrcal.image_transformation_map() stores each source
+pixel coordinate as a pair of 32-bit floats. This function converts it to a
+fixed-point representation: an integer pixel in an int16 pair, and the
+fractional offsets in x and y in a uint16, in 1/32-pixel steps. This takes 6
+bytes per pixel instead of 8, and the pixel lookups are already split, so it's
+cheaper to use when the same map is applied to many images.
+mrcal.transform_image() accepts either form.
+
+This is the same layout that cv2.convertMaps() produces with
+dstmap1type=cv2.CV_16SC2, so the result can be passed to cv2.remap() as well.
+Coordinates that are nan or far off the image are converted to -32768, which
+mrcal.transform_image() maps to a black pixel.
+
+ARGUMENTS
+
+- mapxy: a numpy array of shape (Nheight,Nwidth,2) and dtype np.float32, as
+  returned by mrcal.image_transformation_map()
+
+RETURNED VALUE
+
+A tuple (mapxy_int, mapxy_frac):
+
+- mapxy_int: a numpy array of shape (Nheight,Nwidth,2) and dtype np.int16
+  containing the integer part of each coordinate
+
+- mapxy_frac: a numpy array of shape (Nheight,Nwidth) and dtype np.uint16
+  containing the fractional parts: (yfrac << 5) | xfrac
+
+    '''
+
+    return mrcal._mrcal._transformation_map_compact(np.ascontiguousarray(mapxy,
+                                                                         dtype=np.float32))
+
+
+def transform_image(image, mapxy,
+                    interpolation = 'bilinear',
+                    Nthreads      = None):
     r'''Transforms a given image using a given map
 
 SYNOPSIS
@@ -502,25 +562,69 @@ model to the image of the same scene using a different model, we can produce a
 suitable transformation map with mrcal.image_transformation_map(). An example of
 this common usage appears above in the synopsis.
 
-At this time this function is a thin wrapper around cv2.remap()
+Images containing uint8, uint16 or float32 pixels, with any number of channels,
+are transformed in C by mrcal: the rows of the output are split among Nthreads
+threads, and the interpolation is vectorized with the widest SIMD instructions
+the CPU supports. Other images are passed to cv2.remap(). Pixels that map to a
+point off the source image are black, like cv2.remap() with
+borderMode=cv2.BORDER_CONSTANT.
+
+If the same map is applied to many images, it can be converted to a compact
+fixed-point form with mrcal.transformation_map_compact() first. That form is
+smaller, and is cheaper to read.
 
 ARGUMENTS
 
-- image: a numpy array containing an image we're transforming
+- image: a numpy array containing an image we're transforming. The shape is
+  (H,W) or (H,W,Nchannels)
 
-- mapxy: a numpy array of shape (Nheight,Nwidth,2) where Nheight and Nwidth
-  represent the dimensions of the target image. This array is expected to have
-  dtype=np.float32, since the internals of this function are provided by
-  cv2.remap()
+- mapxy: the transformation map. Either a numpy array of shape
+  (Nheight,Nwidth,2) and dtype np.float32, as returned by
+  mrcal.image_transformation_map(), or a tuple (mapxy_int,mapxy_frac), as
+  returned by mrcal.transformation_map_compact(). Nheight and Nwidth represent
+  the dimensions of the target image
+
+- interpolation: optional string, defaulting to 'bilinear'. May be 'bilinear'
+  or 'bicubic'. The bicubic kernel is the one cv2.INTER_CUBIC uses
+
+- Nthreads: optional integer, defaulting to the number of CPUs. How many
+  threads to use to transform the image
 
 RETURNED VALUE
 
-A numpy array of shape (..., Nheight, Nwidth) containing the transformed image.
+A numpy array of shape (Nheight,Nwidth,...) containing the transformed image.
 
     '''
 
-    # necessary to avoid opencv crashing
     if not isinstance(image, np.ndarray): raise Exception("'image' must be a numpy array")
-    if not isinstance(mapxy, np.ndarray): raise Exception("'mapxy' must be a numpy array")
-    return cv2.remap(image, mapxy, None,
-                     cv2.INTER_LINEAR)
+
+    if   interpolation == 'bilinear': bicubic = False
+    elif interpolation == 'bicubic':  bicubic = True
+    else:
+        raise Exception(f"interpolation must be 'bilinear' or 'bicubic'. Got '{interpolation}'")
+
+    if isinstance(mapxy, tuple):
+        if len(mapxy) != 2 or \
+           not all(isinstance(m, np.ndarray) for m in mapxy):
+            raise Exception("A compact 'mapxy' must be a tuple (mapxy_int,mapxy_frac) of numpy arrays")
+        map1,map2 = mapxy
+        maps = dict(mapxy_int  = map1,
+                    mapxy_frac = map2)
+    elif isinstance(mapxy, np.ndarray):
+        map1,map2 = mapxy,None
+        maps = dict(mapxy = mapxy)
+    else:
+        raise Exception("'mapxy' must be a numpy array or a tuple (mapxy_int,mapxy_frac)")
+
+    if image.dtype in (np.uint8, np.uint16, np.float32) and \
+       image.ndim in (2,3):
+        if Nthreads is None:
+            Nthreads = os.cpu_count() or 1
+        return mrcal._mrcal._transform_image(np.ascontiguousarray(image),
+                                             bicubic  = bicubic,
+                                             Nthreads = Nthreads,
+                                             **maps)
+
+    # Some other pixel type. opencv handles it
+    return cv2.remap(image, map1, map2,
+                     cv2.INTER_CUBIC if bicubic else cv2.INTER_LINEAR)
@@ -442,7 +442,14 @@ broadcasting
     return np.sqrt((a+c)/2 + np.sqrt( (a-c)*(a-c)/4 + b*b))
 
 
+# The projection uncertainty is computed for chunks of points at a time, to
+# bound the memory used: the gradients of each chunk and the solves use
+# O(Npoints_chunk*Nstate) memory. This is the approximate upper bound, in bytes
+_projection_uncertainty_max_bytes = 256*1024*1024
+
+
 def _projection_uncertainty_make_output( factorization, Jpacked, dq_dpief_packed,
+                                         dq_dpief_packed_blocks,
                                          Nmeasurements_observations,
                                          observed_pixel_uncertainty, what ):
     r'''Helper for projection uncertainty functions
@@ -458,7 +465,12 @@ def _projection_uncertainty_make_output( factorization, Jpacked, dq_dpief_packed
 
     The given dq_dpief_packed uses the packed, unitless state p*, so it already
     includes the multiplication by D in the expressions below. It's sparse, but
-    stored densely, so it already includes the multiplication by S
+    stored densely, so it already includes the multiplication by S. This has
+    shape (N,2,Nstate), for a chunk of N points
+
+    dq_dpief_packed_blocks are the nonzero parts of dq_dpief_packed: a list of
+    (istate0, dq_dpief_packed[..., istate0:istate0+n]) tuples. These are used
+    where the sparsity can be exploited
 
     The uncertainty computation in
     http://mrcal.secretsauce.net/uncertainty.html concludes that
@@ -500,7 +512,8 @@ def _projection_uncertainty_make_output( factorization, Jpacked, dq_dpief_packed
       1. solve( J*tJ*, D St dq/dp[ief]t)
          The result has shape (Nstate,2)
 
-      2. pre-multiply by dq/dp[ief] S D
+      2. pre-multiply by dq/dp[ief] S D. Only the nonzero blocks of
+         dq/dp[ief] S D contribute
 
       3. multiply by observed_pixel_uncertainty^2
 
@@ -520,7 +533,7 @@ def _projection_uncertainty_make_output( factorization, Jpacked, dq_dpief_packed
 
     '''
 
-    # shape (2,Nstate)
+    # shape (N,2,Nstate)
     A = factorization.solve_xt_JtJ_bt( dq_dpief_packed )
     if Nmeasurements_observations is not None:
         # I have regularization. Use the more complicated expression
@@ -531,8 +544,14 @@ def _projection_uncertainty_make_output( factorization, Jpacked, dq_dpief_packed
         Var_dq = mrcal._mrcal_npsp._A_Jt_J_At(A, Jpacked.indptr, Jpacked.indices, Jpacked.data,
                                                      Nleading_rows_J = Nmeasurements_observations)
     else:
-        # No regularization. Use the simplified expression
-        Var_dq = nps.matmult(dq_dpief_packed, nps.transpose(A))
+        # No regularization. Use the simplified expression. dq_dpief_packed is
+        # mostly 0, so I only multiply the nonzero blocks
+        Var_dq = 0
+        for istate0,dq_dpief_packed_block in dq_dpief_packed_blocks:
+            n = dq_dpief_packed_block.shape[-1]
+            Var_dq = Var_dq + \
+                nps.matmult(dq_dpief_packed_block,
+                            nps.transpose(A[..., istate0:istate0+n]))
 
     if what == 'covariance':           return Var_dq * observed_pixel_uncertainty*observed_pixel_uncertainty
     if what == 'worstdirection-stdev': return worst_direction_stdev(Var_dq) * observed_pixel_uncertainty
@@ -540,7 +559,7 @@ def _projection_uncertainty_make_output( factorization, Jpacked, dq_dpief_packed
     else: raise Exception("Shouldn't have gotten here. There's a bug")
 
 
-def _projection_uncertainty( p_cam,
+def _projection_uncertainty( p_cam, atinfinity,
                              lensmodel, intrinsics_data,
                              extrinsics_rt_fromref, frames_rt_toref,
                              factorization, Jpacked, optimization_inputs,
@@ -554,12 +573,88 @@ def _projection_uncertainty( p_cam,
     See docs for _projection_uncertainty_make_output() and
     projection_uncertainty()
 
-    This function does all the work when observing points with a finite range
+    dq/dp[ief] is very sparse: only the intrinsics of this camera, its
+    extrinsics and the frames have an effect. The other cameras, the calibration
+    object warp and the discrete points don't. So I compute just the nonzero
+    blocks of dq/dp[ief] (in _dq_dpief_blocks...()), and I process the points in
+    chunks, to bound the memory needed for the dense dq/dp[ief] passed to the
+    solver. Full-imager uncertainty maps are thus computable with a large Nstate
 
     '''
 
     Nstate = Jpacked.shape[-1]
-    dq_dpief = np.zeros(p_cam.shape[:-1] + (2,Nstate), dtype=float)
+
+    # dq_dpief is in the denominator, so I pack it by calling unpack_state()
+    # on it, which multiplies each state variable by its scale. I compute the
+    # scale for each state variable once, and apply it to each block
+    scale_unpack = np.ones((Nstate,), dtype=float)
+    mrcal.unpack_state(scale_unpack, **optimization_inputs)
+
+    p_cam = np.array(p_cam, dtype=float)
+    shape_leading = p_cam.shape[:-1]
+    # shape (Npoints,3)
+    p_cam = p_cam.reshape(-1,3)
+    Npoints = len(p_cam)
+
+    # Each point in a chunk needs a dense (2,Nstate) dq_dpief, the solution of
+    # the same size, and the intermediate gradients, which are dominated by the
+    # frames blocks, and are about as large. So I budget 8*Nstate doubles per
+    # point
+    Npoints_chunk = _projection_uncertainty_max_bytes // (8 * 8*Nstate)
+    Npoints_chunk = max(1, min(Npoints, Npoints_chunk))
+
+    # The blocks land in the same columns for each chunk, so they overwrite the
+    # previous chunk's data in this buffer, and the rest stays 0
+    dq_dpief_packed = np.zeros((Npoints_chunk,2,Nstate), dtype=float)
+
+    if what == 'covariance': out = np.zeros((Npoints,2,2), dtype=float)
+    else:                    out = np.zeros((Npoints,),    dtype=float)
+
+    dq_dpief_blocks_function = \
+        _dq_dpief_blocks_rotationonly if atinfinity else _dq_dpief_blocks
+    for i0 in range(0, Npoints, Npoints_chunk):
+        i1 = min(i0 + Npoints_chunk, Npoints)
+
+        dq_dpief_packed_blocks = \
+            dq_dpief_blocks_function(p_cam[i0:i1],
+                                     lensmodel, intrinsics_data,
+                                     extrinsics_rt_fromref, frames_rt_toref,
+                                     istate_intrinsics, istate_extrinsics, istate_frames,
+                                     slice_optimized_intrinsics)
+        for istate0,dq_dpief_packed_block in dq_dpief_packed_blocks:
+            n = dq_dpief_packed_block.shape[-1]
+            dq_dpief_packed_block *= scale_unpack[istate0:istate0+n]
+            dq_dpief_packed[:i1-i0, :, istate0:istate0+n] = dq_dpief_packed_block
+
+        out[i0:i1] = \
+            _projection_uncertainty_make_output( factorization, Jpacked,
+                                                 dq_dpief_packed[:i1-i0],
+                                                 dq_dpief_packed_blocks,
+                                                 Nmeasurements_observations,
+                                                 observed_pixel_uncertainty,
+                                                 what)
+
+    return out.reshape(shape_leading + out.shape[1:])
+
+
+def _dq_dpief_blocks( p_cam,
+                      lensmodel, intrinsics_data,
+                      extrinsics_rt_fromref, frames_rt_toref,
+                      istate_intrinsics, istate_extrinsics, istate_frames,
+                      slice_optimized_intrinsics):
+    r'''Helper for projection_uncertainty()
+
+    See docs for _projection_uncertainty_make_output() and
+    projection_uncertainty()
+
+    This function computes the nonzero blocks of dq_dpief when observing points
+    with a finite range. p_cam has shape (N,3). Returns a list of (istate0,
+    dq_dpief[..., istate0:istate0+n]) tuples, each block with shape (N,2,n).
+    These use the unpacked state
+
+    '''
+
+    dq_dpief_blocks = []
 
     if frames_rt_toref is not None:
         Nframes = len(frames_rt_toref)
@@ -603,57 +698,44 @@ def _projection_uncertainty( p_cam,
                        get_gradients = True)
 
     if istate_intrinsics is not None:
-        dq_dintrinsics_optimized = dq_dintrinsics[..., slice_optimized_intrinsics]
-        Nintrinsics = dq_dintrinsics_optimized.shape[-1]
-        dq_dpief[..., istate_intrinsics:istate_intrinsics+Nintrinsics] = \
-            dq_dintrinsics_optimized
+        dq_dpief_blocks.append( (istate_intrinsics,
+                                 np.array(dq_dintrinsics[..., slice_optimized_intrinsics])) )
 
     if extrinsics_rt_fromref is not None:
         _, dpcam_drt, dpcam_dpref = \
             mrcal.transform_point_rt(extrinsics_rt_fromref, p_ref,
                                      get_gradients = True)
 
-        dq_dpief[..., istate_extrinsics:istate_extrinsics+6] = \
-            nps.matmult(dq_dpcam, dpcam_drt)
+        dq_dpief_blocks.append( (istate_extrinsics,
+                                 nps.matmult(dq_dpcam, dpcam_drt)) )
 
         if frames_rt_toref is not None:
-            dq_dpief[..., istate_frames:istate_frames+Nframes*6] = \
-                nps.matmult(dq_dpcam, dpcam_dpref, dpref_dframes)
+            dq_dpief_blocks.append( (istate_frames,
+                                     nps.matmult(dq_dpcam, dpcam_dpref, dpref_dframes)) )
     else:
         if frames_rt_toref is not None:
-            dq_dpief[..., istate_frames:istate_frames+Nframes*6] = \
-                nps.matmult(dq_dpcam, dpref_dframes)
+            dq_dpief_blocks.append( (istate_frames,
+                                     nps.matmult(dq_dpcam, dpref_dframes)) )
 
-    # Make dq_dpief use the packed state. I call "unpack_state" because the
-    # state is in the denominator
-    mrcal.unpack_state(dq_dpief, **optimization_inputs)
-    return \
-        _projection_uncertainty_make_output( factorization, Jpacked,
-                                             dq_dpief, Nmeasurements_observations,
-                                             observed_pixel_uncertainty,
-                                             what)
-
-
-def _projection_uncertainty_rotationonly( p_cam,
-                                          lensmodel, intrinsics_data,
-                                          extrinsics_rt_fromref, frames_rt_toref,
-                                          factorization, Jpacked, optimization_inputs,
-                                          istate_intrinsics, istate_extrinsics, istate_frames,
-                                          slice_optimized_intrinsics,
-                                          Nmeasurements_observations,
-                                          observed_pixel_uncertainty,
-                                          what):
+    return dq_dpief_blocks
+
+
+def _dq_dpief_blocks_rotationonly( p_cam,
+                                   lensmodel, intrinsics_data,
+                                   extrinsics_rt_fromref, frames_rt_toref,
+                                   istate_intrinsics, istate_extrinsics, istate_frames,
+                                   slice_optimized_intrinsics):
     r'''Helper for projection_uncertainty()
 
     See docs for _projection_uncertainty_make_output() and
     projection_uncertainty()
 
-    This function does all the work when observing points at infinity
+    This function computes the nonzero blocks of dq_dpief when observing points
+    at infinity. Same interface as _dq_dpief_blocks()
 
     '''
 
-    Nstate = Jpacked.shape[-1]
-    dq_dpief = np.zeros(p_cam.shape[:-1] + (2,Nstate), dtype=float)
+    dq_dpief_blocks = []
 
     if frames_rt_toref is not None:
         Nframes = len(frames_rt_toref)
@@ -691,41 +773,321 @@ def _projection_uncertainty_rotationonly( p_cam,
                        get_gradients = True)
 
     if istate_intrinsics is not None:
-        dq_dintrinsics_optimized = dq_dintrinsics[..., slice_optimized_intrinsics]
-        Nintrinsics = dq_dintrinsics_optimized.shape[-1]
-        dq_dpief[..., istate_intrinsics:istate_intrinsics+Nintrinsics] = \
-            dq_dintrinsics_optimized
+        dq_dpief_blocks.append( (istate_intrinsics,
+                                 np.array(dq_dintrinsics[..., slice_optimized_intrinsics])) )
 
     if extrinsics_rt_fromref is not None:
         _, dpcam_dr, dpcam_dpref = \
             mrcal.rotate_point_r(extrinsics_rt_fromref[...,:3], p_ref,
                                  get_gradients = True)
-        dq_dpief[..., istate_extrinsics:istate_extrinsics+3] = \
-            nps.matmult(dq_dpcam, dpcam_dr)
+        dq_dpief_blocks.append( (istate_extrinsics,
+                                 nps.matmult(dq_dpcam, dpcam_dr)) )
 
-        if frames_rt_toref is not None:
+        dq_dpref = nps.matmult(dq_dpcam, dpcam_dpref)
+    else:
+        dq_dpref = dq_dpcam
+
+    if frames_rt_toref is not None:
+        # The translations of the frames have no effect. I still return a
+        # contiguous block for all the frames, with 0 for the translations
+        # shape (..., 2,Nframes,6)
+        dq_dframes = np.zeros(p_cam.shape[:-1] + (2,Nframes,6), dtype=float)
+        # dprefallframes_dframesr has shape (..., Nframes,3,3)
+        dq_dframes[..., :3] = \
+            nps.mv( nps.matmult(nps.dummy(dq_dpref,-3),
+                                dprefallframes_dframesr), -3, -2) / Nframes
+        dq_dpief_blocks.append( (istate_frames,
+                                 nps.clump(dq_dframes, n=-2)) )
+
+    return dq_dpief_blocks
 
-            dq_dpref = nps.matmult(dq_dpcam, dpcam_dpref)
 
-            # dprefallframes_dframesr has shape (..., Nframes,3,3)
-            for i in range(Nframes):
-                dq_dpief[..., istate_frames+6*i:istate_frames+6*i+3] = \
-                    nps.matmult(dq_dpref, dprefallframes_dframesr[...,i,:,:]) / Nframes
+def _projection_uncertainty_setup(model):
+    r'''Helper for projection_uncertainty() and precompute_projection_uncertainty()
+
+    Computes the factorization and the state indices from the
+    optimization_inputs in the model. Returns a tuple of the arguments of
+    _projection_uncertainty() that follow atinfinity and precede what
+
+    '''
+
+    lensmodel = model.intrinsics()[0]
+
+    optimization_inputs = model.optimization_inputs()
+    if optimization_inputs is None:
+        raise Exception("optimization_inputs are unavailable in this model. Uncertainty cannot be computed")
+
+    loss = optimization_inputs.get('loss')
+    if loss is not None and loss != 'squared':
+        raise Exception(f"Cannot compute the uncertainty of a solve that used the '{loss}' loss. The uncertainty propagation assumes a plain least-squares solve")
+
+    if not optimization_inputs.get('do_optimize_extrinsics'):
+        raise Exception("Computing uncertainty if !do_optimize_extrinsics not supported currently. This is possible, but not implemented. _projection_uncertainty...() would need a path for fixed extrinsics like they already do for fixed frames")
+
+    Jpacked,factorization = \
+        mrcal.optimizer_callback( **optimization_inputs )[2:]
+
+    if factorization is None:
+        raise Exception("Cannot compute the uncertainty: factorization computation failed")
+
+    # The intrinsics,extrinsics,frames MUST come from the solve when
+    # evaluating the uncertainties. The user is allowed to update the
+    # extrinsics in the model after the solve, as long as I use the
+    # solve-time ones for the uncertainty computation. Updating the
+    # intrinsics invalidates the uncertainty stuff so I COULD grab those
+    # from the model. But for good hygiene I get them from the solve as
+    # well
+
+    # which calibration-time camera we're looking at
+    icam_intrinsics = model.icam_intrinsics()
+    icam_extrinsics = mrcal.corresponding_icam_extrinsics(icam_intrinsics, **optimization_inputs)
+
+    intrinsics_data   = optimization_inputs['intrinsics'][icam_intrinsics]
+
+    if not optimization_inputs.get('do_optimize_intrinsics_core') and \
+       not optimization_inputs.get('do_optimize_intrinsics_distortions'):
+        istate_intrinsics          = None
+        slice_optimized_intrinsics = None
     else:
-        if frames_rt_toref is not None:
-            # dprefallframes_dframesr has shape (..., Nframes,3,3)
-            for i in range(Nframes):
-                dq_dpief[..., istate_frames+6*i:istate_frames+6*i+3] = \
-                    nps.matmult(dq_dpcam, dprefallframes_dframesr[...,i,:,:]) / Nframes
-
-    # Make dq_dpief use the packed state. I call "unpack_state" because the
-    # state is in the denominator
-    mrcal.unpack_state(dq_dpief, **optimization_inputs)
+        istate_intrinsics = mrcal.state_index_intrinsics(icam_intrinsics, **optimization_inputs)
+
+        i0,i1 = None,None # everything by default
+
+        has_core     = mrcal.lensmodel_metadata(lensmodel)['has_core']
+        Ncore        = 4 if has_core else 0
+        Ndistortions = mrcal.lensmodel_num_params(lensmodel) - Ncore
+
+        if not optimization_inputs.get('do_optimize_intrinsics_core'):
+            i0 = Ncore
+        if not optimization_inputs.get('do_optimize_intrinsics_distortions'):
+            i1 = -Ndistortions
+
+        slice_optimized_intrinsics  = slice(i0,i1)
+
+    try:
+        istate_frames = mrcal.state_index_frames(0, **optimization_inputs)
+    except:
+        istate_frames = None
+
+    if icam_extrinsics < 0:
+        extrinsics_rt_fromref = None
+        istate_extrinsics     = None
+    else:
+        extrinsics_rt_fromref = optimization_inputs['extrinsics_rt_fromref'][icam_extrinsics]
+        istate_extrinsics     = mrcal.state_index_extrinsics (icam_extrinsics, **optimization_inputs)
+
+    frames_rt_toref = None
+    if optimization_inputs.get('do_optimize_frames'):
+        frames_rt_toref = optimization_inputs.get('frames_rt_toref')
+
+
+    Nmeasurements_observations = mrcal.num_measurements_boards(**optimization_inputs)
+    if Nmeasurements_observations == mrcal.num_measurements(**optimization_inputs):
+        # Note the special-case where I'm using all the observations
+        Nmeasurements_observations = None
+
+    observed_pixel_uncertainty = optimization_inputs['observed_pixel_uncertainty']
+
     return \
-        _projection_uncertainty_make_output( factorization, Jpacked,
-                                             dq_dpief, Nmeasurements_observations,
-                                             observed_pixel_uncertainty,
-                                             what)
+        (lensmodel, intrinsics_data,
+         extrinsics_rt_fromref, frames_rt_toref,
+         factorization, Jpacked, optimization_inputs,
+         istate_intrinsics, istate_extrinsics, istate_frames,
+         slice_optimized_intrinsics,
+         Nmeasurements_observations,
+         observed_pixel_uncertainty)
+
+
+def _skew_symmetric(v):
+    r'''Returns the cross-product matrices of an array of 3-vectors
+
+    Given v of shape (...,3), returns an array of shape (...,3,3) such that
+    matmult(_skew_symmetric(v), x) = cross(v,x)
+
+    '''
+    v = np.asarray(v)
+    m = np.zeros(v.shape + (3,), dtype=float)
+    m[..., 0,1] = -v[...,2]
+    m[..., 0,2] =  v[...,1]
+    m[..., 1,0] =  v[...,2]
+    m[..., 1,2] = -v[...,0]
+    m[..., 2,0] = -v[...,1]
+    m[..., 2,1] =  v[...,0]
+    return m
+
+
+def _rotation_left_jacobian(r):
+    r'''Returns the left jacobian of the rotation given by a Rodrigues vector
+
+    Given r of shape (...,3), returns Jl of shape (...,3,3) such that a
+    perturbation dr of r rotates a point by matmult(Jl,dr) in the ROTATED
+    coordinate system:
+
+      rotate_point_r(r+dr, x) ~ rotate_point_r(matmult(Jl,dr), rotate_point_r(r,x))
+
+    So d(rotate_point_r(r,x))/dr = -matmult(skew(rotate_point_r(r,x)), Jl)
+
+    '''
+    r  = np.asarray(r, dtype=float)
+    th = nps.mag(r)
+    K  = _skew_symmetric(r)
+    KK = nps.matmult(K,K)
+
+    # Taylor series for small angles
+    small = th < 1e-6
+    th_safe = np.where(small, 1., th)
+    a = np.where(small, 1./2., (1. - np.cos(th_safe)) / (th_safe*th_safe))
+    b = np.where(small, 1./6., (th_safe - np.sin(th_safe)) / (th_safe*th_safe*th_safe))
+    return np.eye(3) + a[...,np.newaxis,np.newaxis]*K + b[...,np.newaxis,np.newaxis]*KK
+
+
+def _projection_uncertainty_Var_ief( lensmodel, intrinsics_data,
+                                     extrinsics_rt_fromref, frames_rt_toref,
+                                     factorization, Jpacked, optimization_inputs,
+                                     istate_intrinsics, istate_extrinsics, istate_frames,
+                                     slice_optimized_intrinsics,
+                                     Nmeasurements_observations,
+                                     observed_pixel_uncertainty):
+    r'''Helper for precompute_projection_uncertainty()
+
+    Computes the covariance of the intrinsics, extrinsics and the frames, in a
+    form that is independent of the query points. The arguments are those
+    returned by _projection_uncertainty_setup()
+
+    dq/dp_f depends on all the frames, but only through the mean reference-point
+    perturbation. For frame i, p_ref = R_i p_frame_i + t_i, and
+
+      dp_ref/dr_i = -skew(p_ref - t_i) Jl_i
+      dp_ref/dt_i = I
+
+    where Jl_i is the left jacobian of r_i. Averaging over all the frames:
+
+      dp_ref = mean_i( dp_ref/dr_i dr_i + dt_i )
+             = -skew(p_ref) u + v
+      u      = mean_i( Jl_i dr_i )
+      v      = mean_i( skew(t_i) Jl_i dr_i + dt_i )
+
+    So dq/dp_f dp_f = dq/dp_ref [-skew(p_ref) I] [u;v]. The 6-vector w = [u;v]
+    is a linear function of the frames, independent of p_ref. I thus compute
+    Var(z) for z = [p_i; p_e; w]: an (Nintrinsics+12, Nintrinsics+12) matrix.
+    z = C p, so
+
+      Var(z) = C Var(p) Ct = C D Var(p*) D Ct
+
+    with Var(p*) as described in _projection_uncertainty_make_output(). The
+    intrinsics or extrinsics that aren't optimized have 0 covariance. If the
+    frames aren't optimized, w has 0 covariance. At infinity, the translations
+    of p_e and v are ignored.
+
+    This needs Nintrinsics+12 solves, as opposed to the dense inversion of
+    JtJ
+
+    '''
+
+    Nstate      = Jpacked.shape[-1]
+    Nintrinsics = mrcal.lensmodel_num_params(lensmodel)
+
+    # shape (Nz,Nstate)
+    C = np.zeros((Nintrinsics+12, Nstate), dtype=float)
+    if istate_intrinsics is not None:
+        i = np.arange(Nintrinsics)[slice_optimized_intrinsics]
+        C[i, istate_intrinsics + np.arange(len(i))] = 1.
+    if extrinsics_rt_fromref is not None:
+        C[Nintrinsics:Nintrinsics+6, istate_extrinsics:istate_extrinsics+6] = np.eye(6)
+    if frames_rt_toref is not None:
+        Nframes = len(frames_rt_toref)
+
+        # shape (Nframes,3,3)
+        Jl = _rotation_left_jacobian(frames_rt_toref[:,:3])
+
+        # shape (6,Nframes,6)
+        dw_dframes = np.zeros((6,Nframes,6), dtype=float)
+        dw_dframes[:3,:,:3] = nps.mv(Jl, 0, -2)
+        dw_dframes[3:,:,:3] = nps.mv(nps.matmult(_skew_symmetric(frames_rt_toref[:,3:]),
+                                                 Jl), 0, -2)
+        dw_dframes[3:,:,3:] = nps.dummy(np.eye(3), -2)
+        C[Nintrinsics+6:, istate_frames:istate_frames+6*Nframes] = \
+            nps.clump(dw_dframes, n=-2) / Nframes
+
+    # Make C use the packed state. I call "unpack_state" because the state is in
+    # the denominator
+    mrcal.unpack_state(C, **optimization_inputs)
+
+    # shape (Nz,Nstate)
+    A = factorization.solve_xt_JtJ_bt( C )
+    if Nmeasurements_observations is not None:
+        # I have regularization. Use the more complicated expression: Var_ief =
+        # A Jt J At. J At is dense, with shape (Nmeasurements_observations,Nz).
+        # With lots of observations and a splined model, this is far too big to
+        # store at once, so I accumulate over chunks of rows of J, bounded by
+        # _projection_uncertainty_max_bytes
+        Nz          = len(A)
+        Nrows_chunk = max(1, _projection_uncertainty_max_bytes // (8*Nz))
+        Var_ief     = np.zeros((Nz,Nz), dtype=float)
+        for i0 in range(0, Nmeasurements_observations, Nrows_chunk):
+            i1 = min(i0 + Nrows_chunk, Nmeasurements_observations)
+            # shape (i1-i0,Nz)
+            JAt = Jpacked[i0:i1].dot(nps.transpose(A))
+            Var_ief += nps.matmult(nps.transpose(JAt), JAt)
+    else:
+        Var_ief = nps.matmult(C, nps.transpose(A))
+
+    return Var_ief * observed_pixel_uncertainty*observed_pixel_uncertainty
+
+
+def _projection_uncertainty_from_precomputed( p_cam, atinfinity,
+                                              lensmodel, intrinsics_data,
+                                              rt_cam_ref, Var_ief,
+                                              what ):
+    r'''Helper for projection_uncertainty()
+
+    Computes the projection uncertainty from the covariance precomputed by
+    precompute_projection_uncertainty(). See the docs for
+    _projection_uncertainty_Var_ief() for the meaning of Var_ief. No solves are
+    needed here: the gradients are computed for each point, and applied to
+    Var_ief
+
+    '''
+
+    if not atinfinity:
+        p_ref = \
+            mrcal.transform_point_rt( mrcal.invert_rt(rt_cam_ref),
+                                      p_cam )
+        _, dpcam_drt, dpcam_dpref = \
+            mrcal.transform_point_rt(rt_cam_ref, p_ref,
+                                     get_gradients = True)
+        # dp_ref = -skew(p_ref) u + v
+        dpref_dw = nps.glue(-_skew_symmetric(p_ref),
+                            np.zeros(p_ref.shape + (3,)) + np.eye(3),
+                            axis = -1)
+    else:
+        # I ignore all the translations
+        p_ref = \
+            mrcal.rotate_point_r( -rt_cam_ref[..., :3], p_cam )
+        _, dpcam_dr, dpcam_dpref = \
+            mrcal.rotate_point_r(rt_cam_ref[...,:3], p_ref,
+                                 get_gradients = True)
+        dpcam_drt = nps.glue(dpcam_dr, np.zeros(dpcam_dr.shape),
+                             axis = -1)
+        dpref_dw = nps.glue(-_skew_symmetric(p_ref), np.zeros(p_ref.shape + (3,)),
+                            axis = -1)
+
+    _, dq_dpcam, dq_dintrinsics = \
+        mrcal.project( p_cam, lensmodel, intrinsics_data,
+                       get_gradients = True)
+
+    # shape (..., 2,Nintrinsics+12)
+    dq_dz = nps.glue( dq_dintrinsics,
+                      nps.matmult(dq_dpcam, dpcam_drt),
+                      nps.matmult(dq_dpcam, dpcam_dpref, dpref_dw),
+                      axis = -1)
+
+    Var_dq = nps.matmult(dq_dz, Var_ief, nps.transpose(dq_dz))
+
+    if what == 'covariance':           return Var_dq
+    if what == 'worstdirection-stdev': return worst_direction_stdev(Var_dq)
+    if what == 'rms-stdev':            return np.sqrt(nps.trace(Var_dq)/2.)
+    else: raise Exception("Shouldn't have gotten here. There's a bug")
 
 
 def projection_uncertainty( p_cam, model,
@@ -781,6 +1143,10 @@ test-projection-uncertainty.py
 The uncertainties can be visualized with the mrcal-show-projection-uncertainty
 tool.
 
+If the model contains precomputed covariances (see
+mrcal.precompute_projection_uncertainty()), those are used instead of the
+optimization_inputs. This is MUCH faster, and needs no optimization_inputs.
+
 ARGUMENTS
 
 This function accepts an array of camera-referenced points p_cam and some
@@ -914,103 +1280,81 @@ else:                    we return an array of shape (...)
         raise Exception(f"'what' kwarg must be in {what_known}, but got '{what}'")
 
 
-    lensmodel = model.intrinsics()[0]
+    # If the model has the covariances precomputed, I use them. No
+    # optimization_inputs or factorizations are needed in that case
+    precomputed = model.projection_uncertainty_precomputed()
+    if precomputed is not None:
+        return \
+            _projection_uncertainty_from_precomputed(p_cam, atinfinity,
+                                                     *model.intrinsics(),
+                                                     precomputed['rt_cam_ref'],
+                                                     precomputed['Var_ief'],
+                                                     what)
 
-    optimization_inputs = model.optimization_inputs()
-    if optimization_inputs is None:
-        raise Exception("optimization_inputs are unavailable in this model. Uncertainty cannot be computed")
+    return \
+        _projection_uncertainty(p_cam, atinfinity,
+                                *_projection_uncertainty_setup(model),
+                                what)
 
-    if not optimization_inputs.get('do_optimize_extrinsics'):
-        raise Exception("Computing uncertainty if !do_optimize_extrinsics not supported currently. This is possible, but not implemented. _projection_uncertainty...() would need a path for fixed extrinsics like they already do for fixed frames")
 
-    Jpacked,factorization = \
-        mrcal.optimizer_callback( **optimization_inputs )[2:]
 
-    if factorization is None:
-        raise Exception("Cannot compute the uncertainty: factorization computation failed")
+def precompute_projection_uncertainty(model):
+    r'''Precompute the covariances needed to evaluate the projection uncertainty
 
-    # The intrinsics,extrinsics,frames MUST come from the solve when
-    # evaluating the uncertainties. The user is allowed to update the
-    # extrinsics in the model after the solve, as long as I use the
-    # solve-time ones for the uncertainty computation. Updating the
-    # intrinsics invalidates the uncertainty stuff so I COULD grab those
-    # from the model. But for good hygiene I get them from the solve as
-    # well
-
-    # which calibration-time camera we're looking at
-    icam_intrinsics = model.icam_intrinsics()
-    icam_extrinsics = mrcal.corresponding_icam_extrinsics(icam_intrinsics, **optimization_inputs)
+SYNOPSIS
 
-    intrinsics_data   = optimization_inputs['intrinsics'][icam_intrinsics]
+    model = mrcal.cameramodel("xxx.cameramodel")
 
-    if not optimization_inputs.get('do_optimize_intrinsics_core') and \
-       not optimization_inputs.get('do_optimize_intrinsics_distortions'):
-        istate_intrinsics          = None
-        slice_optimized_intrinsics = None
-    else:
-        istate_intrinsics = mrcal.state_index_intrinsics(icam_intrinsics, **optimization_inputs)
+    model.projection_uncertainty_precomputed( \
+        mrcal.precompute_projection_uncertainty(model) )
+    model.write("xxx-precomputed.cameramodel")
 
-        i0,i1 = None,None # everything by default
+    ...
 
-        has_core     = mrcal.lensmodel_metadata(lensmodel)['has_core']
-        Ncore        = 4 if has_core else 0
-        Ndistortions = mrcal.lensmodel_num_params(lensmodel) - Ncore
+    # Later, perhaps in a different process. This doesn't touch the
+    # optimization_inputs, and doesn't need to solve anything
+    model = mrcal.cameramodel("xxx-precomputed.cameramodel")
+    print(mrcal.projection_uncertainty(pcam,
+                                       model = model,
+                                       what  = 'worstdirection-stdev'))
 
-        if not optimization_inputs.get('do_optimize_intrinsics_core'):
-            i0 = Ncore
-        if not optimization_inputs.get('do_optimize_intrinsics_distortions'):
-            i1 = -Ndistortions
+mrcal.projection_uncertainty() normally evaluates the optimizer callback from
+the optimization_inputs stored in the model, and factorizes JtJ. Then it solves
+a large linear system for each query. This is slow. This function does that work
+once, and returns the covariance of the intrinsics, extrinsics and frames in a
+compact form: a square matrix of size Nintrinsics+12, regardless of how many
+frames or cameras were in the solve. mrcal.projection_uncertainty() uses this
+covariance instead of the optimization_inputs if the model contains it. Store it
+in the model with model.projection_uncertainty_precomputed(). The covariance
+applies to the intrinsics and the calibration-time extrinsics; like the
+optimization_inputs, it is invalidated if the intrinsics are changed, but not if
+the extrinsics are changed.
+
+The two methods produce the same results. The derivation is in the docs for
+the internal _projection_uncertainty_Var_ief() function.
 
-        slice_optimized_intrinsics  = slice(i0,i1)
+ARGUMENTS
 
-    try:
-        istate_frames = mrcal.state_index_frames(0, **optimization_inputs)
-    except:
-        istate_frames = None
+- model: a mrcal.cameramodel object containing the optimization_inputs
 
-    if icam_extrinsics < 0:
-        extrinsics_rt_fromref = None
-        istate_extrinsics     = None
-    else:
-        extrinsics_rt_fromref = optimization_inputs['extrinsics_rt_fromref'][icam_extrinsics]
-        istate_extrinsics     = mrcal.state_index_extrinsics (icam_extrinsics, **optimization_inputs)
+RETURNED VALUE
 
-    frames_rt_toref = None
-    if optimization_inputs.get('do_optimize_frames'):
-        frames_rt_toref = optimization_inputs.get('frames_rt_toref')
+A dict with keys:
 
+- 'rt_cam_ref': the calibration-time extrinsics, a numpy array of shape (6,)
 
-    Nmeasurements_observations = mrcal.num_measurements_boards(**optimization_inputs)
-    if Nmeasurements_observations == mrcal.num_measurements(**optimization_inputs):
-        # Note the special-case where I'm using all the observations
-        Nmeasurements_observations = None
+- 'Var_ief': the covariance of the intrinsics, extrinsics and the mean frame
+  perturbation, a numpy array of shape (Nintrinsics+12,Nintrinsics+12). This
+  includes the observed_pixel_uncertainty
 
-    observed_pixel_uncertainty = optimization_inputs['observed_pixel_uncertainty']
+    '''
 
-    # Two distinct paths here that are very similar, but different-enough to not
-    # share any code. If atinfinity, I ignore all translations
-    if not atinfinity:
-        return \
-            _projection_uncertainty(p_cam,
-                                    lensmodel, intrinsics_data,
-                                    extrinsics_rt_fromref, frames_rt_toref,
-                                    factorization, Jpacked, optimization_inputs,
-                                    istate_intrinsics, istate_extrinsics, istate_frames,
-                                    slice_optimized_intrinsics,
-                                    Nmeasurements_observations,
-                                    observed_pixel_uncertainty,
-                                    what)
-    else:
-        return \
-            _projection_uncertainty_rotationonly(p_cam,
-                                                 lensmodel, intrinsics_data,
-                                                 extrinsics_rt_fromref, frames_rt_toref,
-                                                 factorization, Jpacked, optimization_inputs,
-                                                 istate_intrinsics, istate_extrinsics, istate_frames,
-                                                 slice_optimized_intrinsics,
-                                                 Nmeasurements_observations,
-                                                 observed_pixel_uncertainty,
-                                                 what)
+    setup = _projection_uncertainty_setup(model)
+    extrinsics_rt_fromref = setup[2]
+    if extrinsics_rt_fromref is None:
+        extrinsics_rt_fromref = np.zeros((6,), dtype=float)
+    return dict( rt_cam_ref = np.array(extrinsics_rt_fromref, dtype=float),
+                 Var_ief    = _projection_uncertainty_Var_ief(*setup) )
 
 
 def projection_diff(models,
@@ -689,6 +689,11 @@ gradients, pass get_gradients=True. Logic:
 This function supports broadcasting fully, so we can rotate lots of points at
 the same time and/or apply lots of different rotations at the same time
 
+If get_gradients is False and we're given a single rotation and many points, all
+the points are rotated in a single C call. This is much faster than looping
+over the points, and is the common case of moving a whole point cloud into a
+different coordinate system
+
 ARGUMENTS
 
 - r: array of shape (3,). The Rodrigues vector that defines the rotation. This is
@@ -732,6 +737,9 @@ A tuple (u=r(x),du/dr,du/dx):
 
     """
     if not get_gradients:
+        if np.ndim(r) == 1 and np.ndim(x) >= 2:
+            # One rotation, many points. Rotate them all in one C call
+            return _poseutils._rotate_point_r_batch(r,x, out=out, inverted=inverted)
         return _poseutils._rotate_point_r(r,x, out=out, inverted=inverted)
     return _poseutils._rotate_point_r_withgrad(r,x, out=out, inverted=inverted)
 
@@ -777,6 +785,11 @@ gradients, pass get_gradients=True. Logic:
 This function supports broadcasting fully, so we can rotate lots of points at
 the same time and/or apply lots of different rotations at the same time
 
+If get_gradients is False and we're given a single rotation and many points, all
+the points are rotated in a single C call. This is much faster than looping
+over the points, and is the common case of moving a whole point cloud into a
+different coordinate system
+
 ARGUMENTS
 
 - R: array of shape (3,3). This matrix defines the rotation. It is assumed that
@@ -817,6 +830,9 @@ the gradients (u=R(x),du/dR,du/dx):
     """
 
     if not get_gradients:
+        if np.ndim(R) == 2 and np.ndim(x) >= 2:
+            # One rotation, many points. Rotate them all in one C call
+            return _poseutils._rotate_point_R_batch(R,x, out=out)
         return _poseutils._rotate_point_R(R,x, out=out)
     return _poseutils._rotate_point_R_withgrad(R,x, out=out)
 
@@ -867,6 +883,11 @@ gradients, pass get_gradients=True. Logic:
 This function supports broadcasting fully, so we can transform lots of points at
 the same time and/or apply lots of different transformations at the same time
 
+If get_gradients is False and we're given a single transformation and many points, all
+the points are transformed in a single C call. This is much faster than looping
+over the points, and is the common case of moving a whole point cloud into a
+different coordinate system
+
 ARGUMENTS
 
 - rt: array of shape (6,). This vector defines the transformation. rt[:3] is a
@@ -910,6 +931,9 @@ gradients (u=rt(x),du/drt,du/dx):
     """
 
     if not get_gradients:
+        if np.ndim(rt) == 1 and np.ndim(x) >= 2:
+            # One transformation, many points. Transform them all in one C call
+            return _poseutils._transform_point_rt_batch(rt,x, out=out, inverted=inverted)
         return _poseutils._transform_point_rt(rt,x, out=out, inverted=inverted)
     return _poseutils._transform_point_rt_withgrad(rt,x, out=out, inverted=inverted)
 
@@ -959,6 +983,11 @@ gradients, pass get_gradients=True. Logic:
 This function supports broadcasting fully, so we can transform lots of points at
 the same time and/or apply lots of different transformations at the same time
 
+If get_gradients is False and we're given a single transformation and many points, all
+the points are transformed in a single C call. This is much faster than looping
+over the points, and is the common case of moving a whole point cloud into a
+different coordinate system
+
 ARGUMENTS
 
 - Rt: array of shape (4,3). This matrix defines the transformation. Rt[:3,:] is
@@ -1000,6 +1029,9 @@ gradients (u=Rt(x),du/dRt,du/dx):
     """
 
     if not get_gradients:
+        if np.ndim(Rt) == 2 and np.ndim(x) >= 2:
+            # One transformation, many points. Transform them all in one C call
+            return _poseutils._transform_point_Rt_batch(Rt,x, out=out)
         return _poseutils._transform_point_Rt(Rt,x, out=out)
     return _poseutils._transform_point_Rt_withgrad(Rt,x, out=out)
 
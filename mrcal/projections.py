@@ -226,3 +226,280 @@ by default. To get normalized vectors, pass normalize=True
         v /= nps.dummy(nps.mag(v), -1)
     return v
 
+
+
+class unprojection_lut(object):
+    r'''A precomputed lookup table to quickly unproject pixels with a given model
+
+SYNOPSIS
+
+    model = mrcal.cameramodel('left.cameramodel')
+
+    # Built once. Read from the given file if it has a table for this model;
+    # computed and written to that file otherwise
+    lut = mrcal.unprojection_lut(model,
+                                 file          = 'left.unprojection-lut.npz',
+                                 max_error_rad = 1e-6)
+
+    # Many times. Much faster than mrcal.unproject()
+    v = lut.unproject(q, normalize = True)
+
+mrcal.unproject() runs an iterative solve for each pixel. If we unproject many
+pixels with the same model (to compute stereo rectification maps or image
+transformation maps, for instance) it's much faster to unproject a grid of
+pixels once, and to interpolate this grid afterwards. That's what this class
+does.
+
+The table is a regular grid of normalized observation vectors spanning the
+imager: the corners of the imager are on the grid. The grid is refined until the
+interpolation error is at most max_error_rad everywhere on the imager. The
+interpolation error is measured as the angle between the interpolated and the
+true observation vectors. To confirm the bound we compare against
+mrcal.unproject() on a finer grid that subdivides each cell: at the midpoints of
+the cells and of their edges with bilinear interpolation, and at the
+quarter-points with bicubic interpolation. This is where the interpolation error
+peaks. The true peaks can be a few % higher than the sampled ones, so the
+measured error is padded by 10%. The error that we achieved is returned by the
+max_error_rad() method. The error bound applies inside the imager only. Queries
+outside of it extrapolate the edge cells.
+
+Some models can't unproject all of the imager: the corners of some wide-angle
+models, for instance. The table returns nan for those pixels, and for the pixels
+in the grid cells next to them. The error bound applies to the rest of the
+imager, and we print a warning saying how much of it returns nan.
+
+The table can be written to disk with the write() method, and read back by
+passing file=... to the constructor. The file stores the lens model, the
+intrinsics and the imager size. We use this to make sure a table read from disk
+matches the model we're asking for, so a stale table is never used silently.
+
+    '''
+
+    def __init__(self,
+                 model           = None,
+                 file            = None,
+                 max_error_rad   = 1e-6,
+                 interpolation   = 'bicubic',
+                 gridn_width_max = 4097):
+        r'''Build a lookup table or read it from disk
+
+SYNOPSIS
+
+    # compute the table
+    lut = mrcal.unprojection_lut(model)
+
+    # read the table from disk
+    lut = mrcal.unprojection_lut(file = 'left.unprojection-lut.npz')
+
+    # read the table from disk if it has what we need. Otherwise compute it, and
+    # write it to disk
+    lut = mrcal.unprojection_lut(model,
+                                 file = 'left.unprojection-lut.npz')
+
+ARGUMENTS
+
+- model: the mrcal.cameramodel we're unprojecting with. If omitted, we read the
+  table from 'file'
+
+- file: the filename of the table on disk. If model is None, we read the table
+  from this file. If model is given, we read the table from this file if it
+  exists and if it was computed from the same model, with the same
+  interpolation, and with an error bound at least as tight as max_error_rad.
+  Otherwise we compute the table, and write it to this file
+
+- max_error_rad: optional error bound, in radians. The interpolated observation
+  vectors will be at most this far from the true ones. Defaults to 1e-6
+
+- interpolation: optional string, one of 'bicubic' (the default) or 'bilinear'.
+  Bicubic interpolation needs far fewer grid points to achieve the same error
+
+- gridn_width_max: optional limit on the width of the grid. If the error bound
+  can't be met with this many grid points horizontally, we throw an exception
+
+        '''
+
+        if interpolation != 'bicubic' and interpolation != 'bilinear':
+            raise Exception(f"interpolation must be 'bicubic' or 'bilinear'. Got '{interpolation}'")
+
+        if model is None:
+            if file is None:
+                raise Exception("At least one of (model,file) must be given")
+            self._read(file)
+            return
+
+        if file is not None:
+            try:
+                self._read(file)
+                if self._matches(model, max_error_rad, interpolation):
+                    return
+            except FileNotFoundError:
+                pass
+
+        self._compute(model, max_error_rad, interpolation, gridn_width_max)
+        if file is not None:
+            self.write(file)
+
+
+    def _compute(self, model, max_error_rad, interpolation, gridn_width_max):
+
+        lensmodel,intrinsics_data = model.intrinsics()
+        W,H                       = model.imagersize()
+
+        self._lensmodel       = lensmodel
+        self._intrinsics_data = np.array(intrinsics_data, dtype=float)
+        self._imagersize      = np.array((W,H), dtype=np.int32)
+        self._interpolation   = interpolation
+
+        Nsubdivisions = 4 if interpolation == 'bicubic' else 2
+
+        # I start coarse, and halve the grid spacing until the error bound is
+        # met. The old grid points are a subset of the new ones
+        gridn_width = 17
+        while True:
+            gridn_height = max(2, int(round((H-1)/(W-1)*(gridn_width-1))) + 1)
+
+            self._v = \
+                mrcal.unproject(mrcal.sample_imager(gridn_width, gridn_height, W, H),
+                                lensmodel, intrinsics_data,
+                                normalize = True)
+            self._precompute_interpolation()
+
+            # I compare against mrcal.unproject() on a grid that subdivides
+            # each cell: at the midpoints with bilinear interpolation, and at
+            # the quarter-points with bicubic interpolation. This is where the
+            # interpolation error peaks
+            t = np.arange(Nsubdivisions) / Nsubdivisions
+            x = np.linspace(0, W-1, gridn_width)
+            y = np.linspace(0, H-1, gridn_height)
+            x = np.append( (nps.dummy(x[:-1], -1) + t*self._dxy[0]).ravel(), W-1 )
+            y = np.append( (nps.dummy(y[:-1], -1) + t*self._dxy[1]).ravel(), H-1 )
+            q_check = np.ascontiguousarray(nps.mv(nps.cat(*np.meshgrid(x, y)), 0,-1))
+            v_true = mrcal.unproject(q_check,
+                                     lensmodel, intrinsics_data,
+                                     normalize = True)
+            v_interp = self.unproject(q_check, normalize = True)
+
+            # Some pixels don't unproject (the corners of the imager with some
+            # wide-angle models, for instance). Those produce nan, and so does
+            # the table in the cells next to them. I measure the error only
+            # where both are finite
+            valid_true   = np.all(np.isfinite(v_true),   axis=-1)
+            valid_interp = np.all(np.isfinite(v_interp), axis=-1)
+            valid        = valid_true * valid_interp
+            if not np.any(valid):
+                raise Exception("None of the imager unprojects: can't build a lookup table")
+
+            # angle between the vectors. The cross-product is well-behaved for
+            # small angles
+            err = np.arcsin( np.clip(nps.mag(np.cross(v_true  [valid],
+                                                      v_interp[valid])), 0, 1) )
+
+            # The check points are near the peaks, but not exactly on them. The
+            # true peaks are a few % higher, so I pad the measured error
+            self._max_error_rad = 1.1 * float(np.max(err))
+            if self._max_error_rad <= max_error_rad:
+                if not np.all(valid):
+                    sys.stderr.write(f"WARNING: unprojection_lut: {np.count_nonzero(~valid_true)} of the {valid.size} checked pixels don't unproject. The table returns nan for those, and for the pixels next to them: {np.count_nonzero(~valid)} checked pixels in all. The error bound applies to the rest of the imager\n")
+                return
+
+            if gridn_width >= gridn_width_max:
+                raise Exception(f"Couldn't meet the error bound of {max_error_rad} rad with a grid {gridn_width} points wide: the achieved error is {self._max_error_rad} rad. Increase gridn_width_max or relax max_error_rad")
+
+            gridn_width = min(2*gridn_width - 1, gridn_width_max)
+
+
+    def _precompute_interpolation(self):
+        gridn_height,gridn_width = self._v.shape[:2]
+        W,H = self._imagersize
+        self._dxy = np.array(( (W-1) / (gridn_width -1),
+                               (H-1) / (gridn_height-1) ))
+
+
+    def _matches(self, model, max_error_rad, interpolation):
+        lensmodel,intrinsics_data = model.intrinsics()
+        return \
+            self._lensmodel     == lensmodel                                 and \
+            self._interpolation == interpolation                             and \
+            self._max_error_rad <= max_error_rad                             and \
+            np.array_equal(self._imagersize, np.array(model.imagersize()))  and \
+            self._intrinsics_data.shape == intrinsics_data.shape            and \
+            np.array_equal(self._intrinsics_data, intrinsics_data)
+
+
+    def _read(self, file):
+        with np.load(file, allow_pickle = False) as d:
+            self._lensmodel       = str(d['lensmodel'])
+            self._intrinsics_data = d['intrinsics_data']
+            self._imagersize      = d['imagersize']
+            self._interpolation   = str(d['interpolation'])
+            self._max_error_rad   = float(d['max_error_rad'])
+            self._v               = d['v']
+        self._precompute_interpolation()
+
+
+    def write(self, file):
+        r'''Write out this lookup table to disk
+
+SYNOPSIS
+
+    lut.write('left.unprojection-lut.npz')
+
+The table can be read back with mrcal.unprojection_lut(file = ...)
+
+ARGUMENTS
+
+- file: a string for the filename or an opened Python 'file' object to use
+
+RETURNED VALUES
+
+None
+
+        '''
+        np.savez(file,
+                 lensmodel       = np.array(self._lensmodel),
+                 intrinsics_data = self._intrinsics_data,
+                 imagersize      = self._imagersize,
+                 interpolation   = np.array(self._interpolation),
+                 max_error_rad   = np.array(self._max_error_rad),
+                 v               = self._v)
+
+
+    def max_error_rad(self):
+        r'''Returns the interpolation error bound of this table, in radians'''
+        return self._max_error_rad
+
+
+    def unproject(self, q, normalize = False):
+        r'''Unprojects pixel coordinates to observation vectors using the table
+
+SYNOPSIS
+
+    v = lut.unproject( # (...,2) array of pixel observations
+                       q )
+
+This is a drop-in replacement for mrcal.unproject(q, *model.intrinsics()).
+The result differs from mrcal.unproject() by at most max_error_rad() radians
+inside the imager.
+
+ARGUMENTS
+
+- q: array of dims (...,2); the pixel coordinates we're unprojecting
+
+- normalize: optional boolean defaults to False. If True: normalize the output
+  vectors
+
+RETURNED VALUE
+
+The unprojected observation vector of shape (..., 3). These are close to
+unit-length, but aren't normalized exactly by default. To get normalized
+vectors, pass normalize=True
+
+        '''
+
+        v = mrcal._mrcal_npsp._unprojection_lut_interpolate(q, self._v,
+                                                             grid_spacing_x = self._dxy[0],
+                                                             grid_spacing_y = self._dxy[1],
+                                                             bicubic        = self._interpolation == 'bicubic')
+        if normalize:
+            v /= nps.dummy(nps.mag(v), -1)
+        return v
@@ -44,6 +44,66 @@ void _mrcal_project_internal_opencv( // outputs
                                     int N,
                                     const double* intrinsics,
                                     int Nintrinsics);
+// Nlanes selects the batch kernel: 1 (scalar), 4 (AVX2), 8 (AVX-512), or <= 0
+// for the best one this CPU supports. Returns false if the requested kernel
+// isn't available. Point i is at (px[i*stride], py[i*stride], pz[i*stride])
+bool _mrcal_project_batch_internal( // out
+                                   mrcal_point2_t* q,
+                                   mrcal_point3_t* dq_dp,          // may be NULL
+                                   double*         dq_dintrinsics, // may be NULL
+
+                                   // in
+                                   const double* px,
+                                   const double* py,
+                                   const double* pz,
+                                   int stride,
+                                   int N,
+                                   const double* intrinsics,
+                                   int Nintrinsics,
+                                   int Nlanes);
+// Projects N points with a LENSMODEL_SPLINED_STEREOGRAPHIC model. Computes the
+// same thing as _mrcal_project_internal(), but all the points at once, binned by
+// spline cell. The intrinsics gradients are returned sparsely, in the layout the
+// internal project() function uses:
+//
+// - dq_dfxy[i] is dq/dfxy for point i. dq/dcxy is the identity
+// - ivar0[i] is the first intrinsics variable affected by the spline
+// - grad_ABCDx_ABCDy[i*2*L + ...] holds ABCDx[L], ABCDy[L] for point i, where
+//   L = order+1 is the run length
+//
+// dqxy/dintrinsics[ivar0 + 2*Nx*iy + 2*ix + i_xy] = ABCDx[ix]*ABCDy[iy]*fxy[i_xy]
+//
+// Any of the gradient outputs may be NULL
+bool _mrcal_project_splined_batch( // out
+                                  mrcal_point2_t* q,
+                                  mrcal_point3_t* dq_dp,            // (N,2)
+                                  mrcal_point2_t* dq_dfxy,          // (N)
+                                  int*            ivar0,            // (N)
+                                  double*         grad_ABCDx_ABCDy, // (N,2*L)
+
+                                  // in
+                                  const mrcal_point3_t* p,
+                                  int N,
+                                  const mrcal_LENSMODEL_SPLINED_STEREOGRAPHIC__config_t* config,
+                                  const double* intrinsics,
+                                  const mrcal_LENSMODEL_SPLINED_STEREOGRAPHIC__precomputed_t* precomputed);
+// mrcal_transform_image(), with an explicit choice of the interpolation
+// kernel. Nlanes: 1 (scalar), 8 (AVX2), 16 (AVX-512), or <= 0 for the best one
+// this CPU supports. Returns false if the requested kernel isn't available
+bool _mrcal_transform_image_internal( // out
+                                     void* out,
+
+                                     // in
+                                     const void* image,
+                                     int W, int H, int Nchannels,
+                                     mrcal_image_type_t type,
+                                     int W_out, int H_out,
+                                     const float*    mapxy,
+                                     const int16_t*  mapxy_int,
+                                     const uint16_t* mapxy_frac,
+                                     bool bicubic,
+                                     int Nthreads,
+                                     int Nlanes);
 bool _mrcal_project_internal_cahvore( // out
                                      mrcal_point2_t* out,
 
@@ -89,15 +149,16 @@ bool _mrcal_unproject_internal( // out
                                const double* intrinsics,
                                const mrcal_projection_precomputed_t* precomputed);
 
-// Report the number of non-zero entries in the optimization jacobian
-int _mrcal_num_j_nonzero(int Nobservations_board,
-                         int Nobservations_point,
-                         int calibration_object_width_n,
-                         int calibration_object_height_n,
-                         int Ncameras_intrinsics, int Ncameras_extrinsics,
-                         int Nframes,
-                         int Npoints, int Npoints_fixed,
-                         const mrcal_observation_board_t* observations_board,
-                         const mrcal_observation_point_t* observations_point,
-                         mrcal_problem_selections_t problem_selections,
-                         mrcal_lensmodel_t lensmodel);
+// Report the number of non-zero entries in the optimization jacobian. This can
+// exceed the range of an int for big problems
+int64_t _mrcal_num_j_nonzero(int Nobservations_board,
+                             int Nobservations_point,
+                             int calibration_object_width_n,
+                             int calibration_object_height_n,
+                             int Ncameras_intrinsics, int Ncameras_extrinsics,
+                             int Nframes,
+                             int Npoints, int Npoints_fixed,
+                             const mrcal_observation_board_t* observations_board,
+                             const mrcal_observation_point_t* observations_point,
+                             mrcal_problem_selections_t problem_selections,
+                             mrcal_lensmodel_t lensmodel);
@@ -0,0 +1,165 @@
+// The batch projection kernel for the pinhole and OpenCV models. This is NOT a
+// normal header: mrcal.c includes it several times, once for each SIMD width,
+// each time with different compiler target options. Before including, define
+//
+//   PROJECT_BATCH_KERNEL: the name of the function to define
+//   PROJECT_BATCH_NLANES: how many points to process at a time
+//
+// The math is identical to _mrcal_project_internal_opencv(), except that each
+// variable holds PROJECT_BATCH_NLANES points in a GCC vector. The compiler maps
+// these onto whatever SIMD registers the target has. The defined function
+// processes N points; N must be a multiple of PROJECT_BATCH_NLANES
+
+static void PROJECT_BATCH_KERNEL( // out
+                                  mrcal_point2_t* restrict q,
+                                  // (N,2) mrcal_point3_t. May be NULL
+                                  mrcal_point3_t* restrict dq_dp,
+                                  // (N,2,Nintrinsics), dense. May be NULL
+                                  double*         restrict dq_dintrinsics,
+
+                                  // in
+                                  // Point i is at (px[i*stride], py[i*stride], pz[i*stride])
+                                  const double* px,
+                                  const double* py,
+                                  const double* pz,
+                                  int stride,
+                                  int N,
+                                  const double* intrinsics,
+                                  int Nintrinsics)
+{
+    typedef double vec_t __attribute__((vector_size(PROJECT_BATCH_NLANES*sizeof(double))));
+    const int NL = PROJECT_BATCH_NLANES;
+
+    const double fx = intrinsics[0];
+    const double fy = intrinsics[1];
+    const double cx = intrinsics[2];
+    const double cy = intrinsics[3];
+
+    double k[12] = {};
+    for(int i=0; i<Nintrinsics-4; i++)
+        k[i] = intrinsics[i+4];
+
+    for(int i0 = 0; i0 < N; i0 += NL)
+    {
+        vec_t x, y, z_recip;
+        if(stride == 1)
+        {
+            vec_t z;
+            memcpy(&x, &px[i0], sizeof(x));
+            memcpy(&y, &py[i0], sizeof(y));
+            memcpy(&z, &pz[i0], sizeof(z));
+            z_recip = 1./z;
+        }
+        else
+            for(int l=0; l<NL; l++)
+            {
+                z_recip[l] = 1./pz[(i0+l)*stride];
+                x      [l] = px[(i0+l)*stride];
+                y      [l] = py[(i0+l)*stride];
+            }
+        x *= z_recip;
+        y *= z_recip;
+
+        vec_t r2      = x*x + y*y;
+        vec_t r4      = r2*r2;
+        vec_t r6      = r4*r2;
+        vec_t a1      = 2*x*y;
+        vec_t a2      = r2 + 2*x*x;
+        vec_t a3      = r2 + 2*y*y;
+        vec_t cdist   = 1 + k[0]*r2 + k[1]*r4 + k[4]*r6;
+        vec_t icdist2 = 1./(1 + k[5]*r2 + k[6]*r4 + k[7]*r6);
+        vec_t xd      = x*cdist*icdist2 + k[2]*a1 + k[3]*a2 + k[8]*r2+k[9]*r4;
+        vec_t yd      = y*cdist*icdist2 + k[2]*a3 + k[3]*a1 + k[10]*r2+k[11]*r4;
+
+        vec_t qx = xd*fx + cx;
+        vec_t qy = yd*fy + cy;
+        for(int l=0; l<NL; l++)
+        {
+            q[i0+l].x = qx[l];
+            q[i0+l].y = qy[l];
+        }
+
+        if( dq_dp )
+        {
+            const vec_t zero = {};
+            vec_t dx_dp[] = { z_recip, zero,    -x*z_recip };
+            vec_t dy_dp[] = { zero,    z_recip, -y*z_recip };
+            for( int j = 0; j < 3; j++ )
+            {
+                vec_t dr2_dp = 2*x*dx_dp[j] + 2*y*dy_dp[j];
+                vec_t dcdist_dp = k[0]*dr2_dp + 2*k[1]*r2*dr2_dp + 3*k[4]*r4*dr2_dp;
+                vec_t dicdist2_dp = -icdist2*icdist2*(k[5]*dr2_dp + 2*k[6]*r2*dr2_dp + 3*k[7]*r4*dr2_dp);
+                vec_t da1_dp = 2*(x*dy_dp[j] + y*dx_dp[j]);
+                vec_t dmx_dp = (dx_dp[j]*cdist*icdist2 + x*dcdist_dp*icdist2 + x*cdist*dicdist2_dp +
+                                k[2]*da1_dp + k[3]*(dr2_dp + 4*x*dx_dp[j]) + k[8]*dr2_dp + 2*r2*k[9]*dr2_dp);
+                vec_t dmy_dp = (dy_dp[j]*cdist*icdist2 + y*dcdist_dp*icdist2 + y*cdist*dicdist2_dp +
+                                k[2]*(dr2_dp + 4*y*dy_dp[j]) + k[3]*da1_dp + k[10]*dr2_dp + 2*r2*k[11]*dr2_dp);
+                for(int l=0; l<NL; l++)
+                {
+                    dq_dp[(i0+l)*2 + 0].xyz[j] = fx*dmx_dp[l];
+                    dq_dp[(i0+l)*2 + 1].xyz[j] = fy*dmy_dp[l];
+                }
+            }
+        }
+
+        if( dq_dintrinsics )
+        {
+            // Writes column ivar of the x and y gradient rows of each point
+#define STORE_DQ_DINTRINSICS(ivar, gx, gy)                              \
+            do {                                                        \
+                const vec_t _gx = (gx), _gy = (gy);                     \
+                for(int l=0; l<NL; l++)                                 \
+                {                                                       \
+                    dq_dintrinsics[(2*(i0+l) + 0)*Nintrinsics + (ivar)] = _gx[l]; \
+                    dq_dintrinsics[(2*(i0+l) + 1)*Nintrinsics + (ivar)] = _gy[l]; \
+                }                                                       \
+            } while(0)
+
+            const vec_t zero = {};
+            const vec_t one  = zero + 1.;
+
+            // The core: fx, fy, cx, cy
+            STORE_DQ_DINTRINSICS(0, xd,   zero);
+            STORE_DQ_DINTRINSICS(1, zero, yd  );
+            STORE_DQ_DINTRINSICS(2, one,  zero);
+            STORE_DQ_DINTRINSICS(3, zero, one );
+
+            if( Nintrinsics-4 > 0 )
+            {
+                STORE_DQ_DINTRINSICS(4+0, fx*x*icdist2*r2, fy*y*icdist2*r2);
+                STORE_DQ_DINTRINSICS(4+1, fx*x*icdist2*r4, fy*y*icdist2*r4);
+
+                if( Nintrinsics-4 > 2 )
+                {
+                    STORE_DQ_DINTRINSICS(4+2, fx*a1, fy*a3);
+                    STORE_DQ_DINTRINSICS(4+3, fx*a2, fy*a1);
+                    if( Nintrinsics-4 > 4 )
+                    {
+                        STORE_DQ_DINTRINSICS(4+4, fx*x*icdist2*r6, fy*y*icdist2*r6);
+
+                        if( Nintrinsics-4 > 5 )
+                        {
+                            STORE_DQ_DINTRINSICS(4+5,
+                                                 fx*x*cdist*(-icdist2)*icdist2*r2,
+                                                 fy*y*cdist*(-icdist2)*icdist2*r2);
+                            STORE_DQ_DINTRINSICS(4+6,
+                                                 fx*x*cdist*(-icdist2)*icdist2*r4,
+                                                 fy*y*cdist*(-icdist2)*icdist2*r4);
+                            STORE_DQ_DINTRINSICS(4+7,
+                                                 fx*x*cdist*(-icdist2)*icdist2*r6,
+                                                 fy*y*cdist*(-icdist2)*icdist2*r6);
+                            if( Nintrinsics-4 > 8 )
+                            {
+                                STORE_DQ_DINTRINSICS(4+8,  fx*r2, zero ); //s1
+                                STORE_DQ_DINTRINSICS(4+9,  fx*r4, zero ); //s2
+                                STORE_DQ_DINTRINSICS(4+10, zero,  fy*r2); //s3
+                                STORE_DQ_DINTRINSICS(4+11, zero,  fy*r4); //s4
+                            }
+                        }
+                    }
+                }
+            }
+#undef STORE_DQ_DINTRINSICS
+        }
+    }
+}
@@ -0,0 +1,167 @@
+// The image-remapping kernel. This is NOT a normal header: mrcal.c includes it
+// several times, once for each pixel type and SIMD width, each time with
+// different compiler target options. Before including, define
+//
+//   REMAP_KERNEL:  the name of the function to define
+//   REMAP_PIXEL_T: the pixel type: uint8_t, uint16_t or float
+//   REMAP_NLANES:  how many output pixels to process at a time
+//   REMAP_PIXEL_MAX: the largest pixel value, for integer pixels only. The
+//                    results are rounded and saturated to [0,REMAP_PIXEL_MAX].
+//                    Leave undefined for floating-point pixels
+//
+// The interpolation weights and the blending are computed for REMAP_NLANES
+// pixels at a time, each variable holding REMAP_NLANES pixels in a GCC vector.
+// The compiler maps these onto whatever SIMD registers the target has. The
+// source taps are gathered lane-by-lane. The defined function produces N output
+// pixels; N must be a multiple of REMAP_NLANES
+//
+// All the kernels have the same prototype, so the pixel type is void here. The
+// caller picks the kernel that matches the image.
+//
+// The caller has already split each source coordinate into an integer pixel
+// (x0,y0) and a fractional offset (tx,ty) in [0,1). Bilinear interpolation uses
+// the taps at x0 + {0,1}, bicubic interpolation uses x0 + {-1,0,1,2}; same in
+// y. Taps outside the image read as 0
+
+#define _REMAP_CAT(a,b)  a ## b
+#define _REMAP_CAT2(a,b) _REMAP_CAT(a,b)
+#define REMAP_KERNEL_NTAPS _REMAP_CAT2(REMAP_KERNEL, _ntaps)
+
+// The body of the kernel. Ntaps is 2 (bilinear) or 4 (bicubic). This is always
+// inlined with a constant Ntaps, so that the tap loops are unrolled
+static inline __attribute__((always_inline))
+void REMAP_KERNEL_NTAPS( // out
+                          // (N,Nchannels) of REMAP_PIXEL_T
+                          void* restrict _out,
+
+                          // in
+                          const int32_t* x0,
+                          const int32_t* y0,
+                          const float*   tx,
+                          const float*   ty,
+                          int N,
+                          // (H,W,Nchannels) of REMAP_PIXEL_T
+                          const void* restrict _image,
+                          int W, int H, int Nchannels,
+                          const int Ntaps)
+{
+    REMAP_PIXEL_T*       out   = (REMAP_PIXEL_T*)      _out;
+    const REMAP_PIXEL_T* image = (const REMAP_PIXEL_T*)_image;
+
+    typedef float   vec_t  __attribute__((vector_size(REMAP_NLANES*sizeof(float))));
+    typedef int32_t ivec_t __attribute__((vector_size(REMAP_NLANES*sizeof(int32_t))));
+    const int NL = REMAP_NLANES;
+
+    // OpenCV's INTER_CUBIC kernel. The bicubic results match cv2.remap()
+    const float A = -0.75f;
+
+    const bool bicubic = Ntaps == 4;
+    const int  tap_min = bicubic ? -1 : 0;
+
+    for(int i0 = 0; i0 < N; i0 += NL)
+    {
+        ivec_t x, y;
+        vec_t  fx, fy;
+        memcpy(&x,  &x0[i0], sizeof(x));
+        memcpy(&y,  &y0[i0], sizeof(y));
+        memcpy(&fx, &tx[i0], sizeof(fx));
+        memcpy(&fy, &ty[i0], sizeof(fy));
+
+        vec_t wx[4], wy[4];
+        if(bicubic)
+        {
+            vec_t t = fx;
+            for(int k=0; k<2; k++)
+            {
+                vec_t* w  = k==0 ? wx : wy;
+                vec_t  t1 = t + 1.f;
+                vec_t  s  = 1.f - t;
+                w[0] = ((A*t1 - 5.f*A)*t1 + 8.f*A)*t1 - 4.f*A;
+                w[1] = ((A+2.f)*t - (A+3.f))*t*t + 1.f;
+                w[2] = ((A+2.f)*s - (A+3.f))*s*s + 1.f;
+                w[3] = 1.f - w[0] - w[1] - w[2];
+                t = fy;
+            }
+        }
+        else
+        {
+            wx[0] = 1.f - fx; wx[1] = fx;
+            wy[0] = 1.f - fy; wy[1] = fy;
+        }
+
+        // The first tap of each lane. If every tap of every lane is inside the
+        // image, I gather without bounds checks. Otherwise each tap is checked
+        const ivec_t xmin = x + tap_min;
+        const ivec_t ymin = y + tap_min;
+        const ivec_t inside =
+            (xmin >= 0) & (xmin + Ntaps-1 < W) &
+            (ymin >= 0) & (ymin + Ntaps-1 < H);
+        bool all_inside = true;
+        for(int l=0; l<NL; l++)
+            all_inside = all_inside && inside[l];
+
+        long base[NL];
+        for(int l=0; l<NL; l++)
+            base[l] = ((long)ymin[l]*W + xmin[l])*Nchannels;
+
+        for(int c=0; c<Nchannels; c++)
+        {
+            vec_t acc = {};
+            for(int j=0; j<Ntaps; j++)
+            {
+                vec_t row = {};
+                for(int i=0; i<Ntaps; i++)
+                {
+                    const long offset = ((long)j*W + i)*Nchannels + c;
+                    vec_t v;
+                    if(all_inside)
+                        for(int l=0; l<NL; l++)
+                            v[l] = (float)image[base[l] + offset];
+                    else
+                        for(int l=0; l<NL; l++)
+                        {
+                            const int xx = xmin[l] + i;
+                            const int yy = ymin[l] + j;
+                            v[l] =
+                                (xx >= 0 && xx < W && yy >= 0 && yy < H) ?
+                                (float)image[base[l] + offset] : 0.f;
+                        }
+                    row += wx[i]*v;
+                }
+                acc += wy[j]*row;
+            }
+
+            for(int l=0; l<NL; l++)
+            {
+                REMAP_PIXEL_T* p = &out[(long)(i0+l)*Nchannels + c];
+#if defined REMAP_PIXEL_MAX
+                const float a = acc[l] + 0.5f;
+                *p = a <= 0.f ? 0 : (a >= (float)REMAP_PIXEL_MAX ? REMAP_PIXEL_MAX : (REMAP_PIXEL_T)a);
+#else
+                *p = (REMAP_PIXEL_T)acc[l];
+#endif
+            }
+        }
+    }
+}
+
+static void REMAP_KERNEL( // out
+                          void* restrict out,
+
+                          // in
+                          const int32_t* x0,
+                          const int32_t* y0,
+                          const float*   tx,
+                          const float*   ty,
+                          int N,
+                          const void* restrict image,
+                          int W, int H, int Nchannels,
+                          bool bicubic)
+{
+    if(bicubic)
+        REMAP_KERNEL_NTAPS(out, x0, y0, tx, ty, N, image, W, H, Nchannels, 4);
+    else
+        REMAP_KERNEL_NTAPS(out, x0, y0, tx, ty, N, image, W, H, Nchannels, 2);
+}
+
+#undef REMAP_KERNEL_NTAPS
@@ -373,6 +373,119 @@ the docs for that function for details.
 '''},
 )
 
+# The _..._batch functions apply one rotation or transformation to a whole
+# (N,3) array of points in one C call, instead of one call per point. The python
+# wrappers in poseutils.py use these when given a single pose and many points
+m.function( "_rotate_point_R_batch",
+            """Rotate many points using one rotation matrix
+
+This is an internal function. You probably want mrcal.rotate_point_R(). See the
+docs for that function for details.
+""",
+            args_input       = ('R', 'x'),
+            prototype_input  = ((3,3), ('N',3)),
+            prototype_output = ('N',3),
+
+            Ccode_slice_eval = \
+                {np.float64:
+                 r'''
+    mrcal_rotate_point_R_batch_full( (double*)data_slice__output,
+                                     strides_slice__output[0],
+                                     strides_slice__output[1],
+                                     (const double*)data_slice__R,
+                                     strides_slice__R[0],
+                                     strides_slice__R[1],
+                                     (const double*)data_slice__x,
+                                     strides_slice__x[0],
+                                     strides_slice__x[1],
+                                     dims_slice__x[0] );
+    return true;
+'''},
+)
+
+m.function( "_rotate_point_r_batch",
+            """Rotate many points using one Rodrigues vector
+
+This is an internal function. You probably want mrcal.rotate_point_r(). See the
+docs for that function for details.
+""",
+            args_input       = ('r', 'x'),
+            prototype_input  = ((3,), ('N',3)),
+            prototype_output = ('N',3),
+            extra_args = (("int", "inverted", "false", "p"),),
+
+            Ccode_slice_eval = \
+                {np.float64:
+                 r'''
+    mrcal_rotate_point_r_batch_full( (double*)data_slice__output,
+                                     strides_slice__output[0],
+                                     strides_slice__output[1],
+                                     (const double*)data_slice__r,
+                                     strides_slice__r[0],
+                                     (const double*)data_slice__x,
+                                     strides_slice__x[0],
+                                     strides_slice__x[1],
+                                     dims_slice__x[0],
+                                     *inverted );
+    return true;
+'''},
+)
+
+m.function( "_transform_point_Rt_batch",
+            """Transform many points using one Rt transformation
+
+This is an internal function. You probably want mrcal.transform_point_Rt(). See
+the docs for that function for details.
+""",
+            args_input       = ('Rt', 'x'),
+            prototype_input  = ((4,3), ('N',3)),
+            prototype_output = ('N',3),
+
+            Ccode_slice_eval = \
+                {np.float64:
+                 r'''
+    mrcal_transform_point_Rt_batch_full( (double*)data_slice__output,
+                                         strides_slice__output[0],
+                                         strides_slice__output[1],
+                                         (const double*)data_slice__Rt,
+                                         strides_slice__Rt[0],
+                                         strides_slice__Rt[1],
+                                         (const double*)data_slice__x,
+                                         strides_slice__x[0],
+                                         strides_slice__x[1],
+                                         dims_slice__x[0] );
+    return true;
+'''},
+)
+
+m.function( "_transform_point_rt_batch",
+            """Transform many points using one rt transformation
+
+This is an internal function. You probably want mrcal.transform_point_rt(). See
+the docs for that function for details.
+""",
+            args_input       = ('rt', 'x'),
+            prototype_input  = ((6,), ('N',3)),
+            prototype_output = ('N',3),
+            extra_args = (("int", "inverted", "false", "p"),),
+
+            Ccode_slice_eval = \
+                {np.float64:
+                 r'''
+    mrcal_transform_point_rt_batch_full( (double*)data_slice__output,
+                                         strides_slice__output[0],
+                                         strides_slice__output[1],
+                                         (const double*)data_slice__rt,
+                                         strides_slice__rt[0],
+                                         (const double*)data_slice__x,
+                                         strides_slice__x[0],
+                                         strides_slice__x[1],
+                                         dims_slice__x[0],
+                                         *inverted );
+    return true;
+'''},
+)
+
 m.function( "_r_from_R",
             """Compute a Rodrigues vector from a rotation matrix
 
@@ -283,6 +283,250 @@ void mrcal_transform_point_Rt_full( // output
         mrcal_identity_R_full(&P3(J_Rt,0,3,0), J_Rt_stride0, J_Rt_stride2);
 }
 
+// The core of all the mrcal_..._batch_full() functions: x_out = R x_in + t for
+// N points. R is a contiguous (3,3) array and t is a contiguous (3,) array
+//
+// Each variable holds POSEUTILS_BATCH_NLANES points in a GCC vector; the
+// compiler maps these onto whatever SIMD registers the target has. This is
+// memory-bound, and shuffling the interleaved (x,y,z) points into and out of
+// the lanes isn't free: 2 lanes was faster than 1 or 4. All the lanes are
+// loaded before any are stored, so x_out may be the same array as x_in. I
+// advance the pointers instead of computing i*stride to not overflow the int
+// strides with huge N
+#define POSEUTILS_BATCH_NLANES 2
+static inline __attribute__((always_inline))
+void _transform_point_batch(// output
+                            double* x_out,
+                            int x_out_stride0,
+                            int x_out_stride1,
+                            // input
+                            const double* R,
+                            const double* t,
+                            const double* x_in,
+                            int x_in_stride0,
+                            int x_in_stride1,
+                            int N)
+{
+    typedef double vec_t __attribute__((vector_size(POSEUTILS_BATCH_NLANES*sizeof(double))));
+    const int NL = POSEUTILS_BATCH_NLANES;
+
+    char*       out = (char*)x_out;
+    const char* in  = (const char*)x_in;
+
+    int i = 0;
+    for(; i+NL <= N; i += NL)
+    {
+        vec_t x,y,z;
+        for(int l=0; l<NL; l++)
+        {
+            const char* p = in + l*x_in_stride0;
+            x[l] = _P1(p, x_in_stride1, 0);
+            y[l] = _P1(p, x_in_stride1, 1);
+            z[l] = _P1(p, x_in_stride1, 2);
+        }
+
+        vec_t x0 = R[0]*x + R[1]*y + R[2]*z + t[0];
+        vec_t x1 = R[3]*x + R[4]*y + R[5]*z + t[1];
+        vec_t x2 = R[6]*x + R[7]*y + R[8]*z + t[2];
+
+        for(int l=0; l<NL; l++)
+        {
+            char* p = out + l*x_out_stride0;
+            _P1(p, x_out_stride1, 0) = x0[l];
+            _P1(p, x_out_stride1, 1) = x1[l];
+            _P1(p, x_out_stride1, 2) = x2[l];
+        }
+
+        in  += NL*x_in_stride0;
+        out += NL*x_out_stride0;
+    }
+
+    // leftovers
+    for(; i<N; i++)
+    {
+        const double x = _P1(in, x_in_stride1, 0);
+        const double y = _P1(in, x_in_stride1, 1);
+        const double z = _P1(in, x_in_stride1, 2);
+        _P1(out, x_out_stride1, 0) = R[0]*x + R[1]*y + R[2]*z + t[0];
+        _P1(out, x_out_stride1, 1) = R[3]*x + R[4]*y + R[5]*z + t[1];
+        _P1(out, x_out_stride1, 2) = R[6]*x + R[7]*y + R[8]*z + t[2];
+
+        in  += x_in_stride0;
+        out += x_out_stride0;
+    }
+}
+static void transform_point_batch(// output
+                                  double* x_out,
+                                  int x_out_stride0,
+                                  int x_out_stride1,
+                                  // input
+                                  const double* R,
+                                  const double* t,
+                                  const double* x_in,
+                                  int x_in_stride0,
+                                  int x_in_stride1,
+                                  int N)
+{
+    // Dense arrays are the overwhelmingly common case. I give the compiler
+    // constant strides for those, so that it can vectorize the loads and stores
+    if(x_out_stride0 == 3*sizeof(double) && x_out_stride1 == sizeof(double) &&
+       x_in_stride0  == 3*sizeof(double) && x_in_stride1  == sizeof(double))
+        _transform_point_batch(x_out, 3*sizeof(double), sizeof(double),
+                               R, t,
+                               x_in,  3*sizeof(double), sizeof(double),
+                               N);
+    else
+        _transform_point_batch(x_out, x_out_stride0, x_out_stride1,
+                               R, t,
+                               x_in,  x_in_stride0,  x_in_stride1,
+                               N);
+}
+
+// Sets R <- R^T, t <- -R^T t. Both are contiguous
+static void invert_Rt_contiguous(double* R, double* t)
+{
+    for(int i=0; i<3; i++)
+        for(int j=i+1; j<3; j++)
+        {
+            double tmp = R[3*i+j];
+            R[3*i+j]   = R[3*j+i];
+            R[3*j+i]   = tmp;
+        }
+    const double t0[3] = {t[0], t[1], t[2]};
+    for(int i=0; i<3; i++)
+        t[i] = -(R[3*i+0]*t0[0] + R[3*i+1]*t0[1] + R[3*i+2]*t0[2]);
+}
+
+void mrcal_rotate_point_R_batch_full( // output
+                                     double* x_out,      // (N,3) array
+                                     int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                     int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                     // input
+                                     const double* R,    // (3,3) array
+                                     int R_stride0,      // in bytes. <= 0 means "contiguous"
+                                     int R_stride1,      // in bytes. <= 0 means "contiguous"
+                                     const double* x_in, // (N,3) array
+                                     int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                     int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                     int N )
+{
+    init_stride_2D(x_out, N,3);
+    init_stride_2D(R,     3,3);
+    init_stride_2D(x_in,  N,3);
+
+    double R_contiguous[9];
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            R_contiguous[3*i+j] = P2(R,i,j);
+    const double t[3] = {};
+
+    transform_point_batch(x_out, x_out_stride0, x_out_stride1,
+                          R_contiguous, t,
+                          x_in, x_in_stride0, x_in_stride1,
+                          N);
+}
+
+void mrcal_rotate_point_r_batch_full( // output
+                                     double* x_out,      // (N,3) array
+                                     int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                     int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                     // input
+                                     const double* r,    // (3,) array
+                                     int r_stride0,      // in bytes. <= 0 means "contiguous"
+                                     const double* x_in, // (N,3) array
+                                     int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                     int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                     int N,
+
+                                     bool inverted )
+{
+    init_stride_2D(x_out, N,3);
+    init_stride_2D(x_in,  N,3);
+
+    double R[9];
+    double t[3] = {};
+    mrcal_R_from_r_full(R, 0,0,
+                        NULL,0,0,0,
+                        r, r_stride0);
+    if(inverted)
+        invert_Rt_contiguous(R, t);
+
+    transform_point_batch(x_out, x_out_stride0, x_out_stride1,
+                          R, t,
+                          x_in, x_in_stride0, x_in_stride1,
+                          N);
+}
+
+void mrcal_transform_point_Rt_batch_full( // output
+                                         double* x_out,      // (N,3) array
+                                         int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                         int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                         // input
+                                         const double* Rt,   // (4,3) array
+                                         int Rt_stride0,     // in bytes. <= 0 means "contiguous"
+                                         int Rt_stride1,     // in bytes. <= 0 means "contiguous"
+                                         const double* x_in, // (N,3) array
+                                         int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                         int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                         int N )
+{
+    init_stride_2D(x_out, N,3);
+    init_stride_2D(Rt,    4,3);
+    init_stride_2D(x_in,  N,3);
+
+    double R[9];
+    double t[3];
+    for(int i=0; i<3; i++)
+    {
+        for(int j=0; j<3; j++)
+            R[3*i+j] = P2(Rt,i,j);
+        t[i] = P2(Rt,3,i);
+    }
+
+    transform_point_batch(x_out, x_out_stride0, x_out_stride1,
+                          R, t,
+                          x_in, x_in_stride0, x_in_stride1,
+                          N);
+}
+
+void mrcal_transform_point_rt_batch_full( // output
+                                         double* x_out,      // (N,3) array
+                                         int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                         int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                         // input
+                                         const double* rt,   // (6,) array
+                                         int rt_stride0,     // in bytes. <= 0 means "contiguous"
+                                         const double* x_in, // (N,3) array
+                                         int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                         int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                         int N,
+
+                                         bool inverted )
+{
+    init_stride_2D(x_out, N,3);
+    init_stride_1D(rt,    6);
+    init_stride_2D(x_in,  N,3);
+
+    double R[9];
+    double t[3];
+    mrcal_R_from_r_full(R, 0,0,
+                        NULL,0,0,0,
+                        rt, rt_stride0);
+    for(int i=0; i<3; i++)
+        t[i] = P1(rt,i+3);
+    if(inverted)
+        invert_Rt_contiguous(R, t);
+
+    transform_point_batch(x_out, x_out_stride0, x_out_stride1,
+                          R, t,
+                          x_in, x_in_stride0, x_in_stride1,
+                          N);
+}
+
 // The implementation of mrcal_R_from_r is based on opencv.
 // The sources have been heavily modified, but the opencv logic remains.
 //
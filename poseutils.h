@@ -188,6 +188,82 @@ void mrcal_transform_point_rt_full( // output
                                                        // the input rt
                                    );
 
+// Batch versions of the above: apply ONE rotation or transformation to N points
+// in an (N,3) array x_in. This is the common case of moving a whole point cloud
+// into a different coordinate system. The rotation matrix is computed once, and
+// the points are processed several at a time, using SIMD. These do not report
+// gradients: use the per-point functions above if those are needed
+//
+// The results are returned in an (N,3) array x_out. This may be the same array
+// as x_in, to transform the points in-place
+#define mrcal_rotate_point_R_batch(x_out,R,x_in,N) mrcal_rotate_point_R_batch_full(x_out,0,0,R,0,0,x_in,0,0,N)
+void mrcal_rotate_point_R_batch_full( // output
+                                     double* x_out,      // (N,3) array
+                                     int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                     int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                     // input
+                                     const double* R,    // (3,3) array
+                                     int R_stride0,      // in bytes. <= 0 means "contiguous"
+                                     int R_stride1,      // in bytes. <= 0 means "contiguous"
+                                     const double* x_in, // (N,3) array
+                                     int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                     int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                     int N );
+
+#define mrcal_rotate_point_r_batch(x_out,r,x_in,N) mrcal_rotate_point_r_batch_full(x_out,0,0,r,0,x_in,0,0,N,false)
+void mrcal_rotate_point_r_batch_full( // output
+                                     double* x_out,      // (N,3) array
+                                     int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                     int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                     // input
+                                     const double* r,    // (3,) array
+                                     int r_stride0,      // in bytes. <= 0 means "contiguous"
+                                     const double* x_in, // (N,3) array
+                                     int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                     int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                     int N,
+
+                                     bool inverted       // if true, I apply a
+                                                         // rotation in the opposite
+                                                         // direction
+                                     );
+
+#define mrcal_transform_point_Rt_batch(x_out,Rt,x_in,N) mrcal_transform_point_Rt_batch_full(x_out,0,0,Rt,0,0,x_in,0,0,N)
+void mrcal_transform_point_Rt_batch_full( // output
+                                         double* x_out,      // (N,3) array
+                                         int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                         int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                         // input
+                                         const double* Rt,   // (4,3) array
+                                         int Rt_stride0,     // in bytes. <= 0 means "contiguous"
+                                         int Rt_stride1,     // in bytes. <= 0 means "contiguous"
+                                         const double* x_in, // (N,3) array
+                                         int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                         int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                         int N );
+
+#define mrcal_transform_point_rt_batch(x_out,rt,x_in,N) mrcal_transform_point_rt_batch_full(x_out,0,0,rt,0,x_in,0,0,N,false)
+void mrcal_transform_point_rt_batch_full( // output
+                                         double* x_out,      // (N,3) array
+                                         int x_out_stride0,  // in bytes. <= 0 means "contiguous"
+                                         int x_out_stride1,  // in bytes. <= 0 means "contiguous"
+
+                                         // input
+                                         const double* rt,   // (6,) array
+                                         int rt_stride0,     // in bytes. <= 0 means "contiguous"
+                                         const double* x_in, // (N,3) array
+                                         int x_in_stride0,   // in bytes. <= 0 means "contiguous"
+                                         int x_in_stride1,   // in bytes. <= 0 means "contiguous"
+                                         int N,
+
+                                         bool inverted       // if true, I apply the
+                                                             // transformation in the
+                                                             // opposite direction
+                                         );
+
 // Convert a rotation matrix in a (3,3) array to a rodrigues vector in a (3,)
 // array
 //
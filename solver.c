@@ -0,0 +1,1403 @@
+// Sparse Levenberg-Marquardt solvers that exploit the structure of the mrcal
+// optimization problems. libdogleg factors the full JtJ with CHOLMOD. Here we
+// have two alternatives, and a CHOLMOD solver of our own:
+//
+// - The frame poses and discrete points are eliminated first: their part of JtJ
+//   is block-diagonal, so this is cheap, and the remaining system contains only
+//   the camera parameters
+//
+// - Preconditioned conjugate gradients. JtJ is never formed: we only need the
+//   products Jt (J v), so the memory use grows linearly with the number of
+//   observations
+//
+// - The full JtJ is factored with CHOLMOD, like libdogleg does. But the
+//   symbolic analysis of the sparsity pattern is done only once per problem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "solver.h"
+
+#define MSG(fmt, ...) fprintf(stderr, "%s(%d): " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+// The PCG preconditioner blocks are at most this large. Bigger blocks (the
+// intrinsics of splined models) are split into chunks of this size, so that the
+// memory use stays linear in the number of state variables
+#define PCG_BLOCK_SIZE_MAX  32
+// PCG stops when norm(residual) < PCG_TOLERANCE*norm(rhs), or after
+// PCG_ITERATIONS_MAX iterations
+#define PCG_TOLERANCE       1e-10
+#define PCG_ITERATIONS_MAX  1000
+// The Schur-complement solver factors its reduced system of the camera
+// variables densely. The memory use is O(Ncamera^2) and the factorization is
+// O(Ncamera^3) in each iteration. This is fine for the lens models with few
+// parameters, but not for splined models with thousands of intrinsics per
+// camera. Bigger reduced systems are rejected: use the CHOLMOD or PCG solvers
+// for those
+#define SCHUR_NCAMERA_MAX   2000
+
+// In-place Cholesky factorization of a dense, symmetric NxN matrix. The lower
+// triangle of A is overwritten with L, where A = L Lt. The upper triangle is
+// not touched. Returns false if the matrix isn't positive-definite
+static bool cholesky(double* A, int N)
+{
+    for(int j=0; j<N; j++)
+    {
+        double s = A[j*N + j];
+        for(int k=0; k<j; k++)
+            s -= A[j*N + k]*A[j*N + k];
+        if(!(s > 0.0))
+            return false;
+        const double Ljj = sqrt(s);
+        A[j*N + j] = Ljj;
+
+        for(int i=j+1; i<N; i++)
+        {
+            double t = A[i*N + j];
+            for(int k=0; k<j; k++)
+                t -= A[i*N + k]*A[j*N + k];
+            A[i*N + j] = t / Ljj;
+        }
+    }
+    return true;
+}
+
+// Solves L Lt x = b in-place, using the factorization from cholesky()
+static void cholesky_solve(double* b, const double* L, int N)
+{
+    for(int i=0; i<N; i++)
+    {
+        double t = b[i];
+        for(int k=0; k<i; k++)
+            t -= L[i*N + k]*b[k];
+        b[i] = t / L[i*N + i];
+    }
+    for(int i=N-1; i>=0; i--)
+    {
+        double t = b[i];
+        for(int k=i+1; k<N; k++)
+            t -= L[k*N + i]*b[k];
+        b[i] = t / L[i*N + i];
+    }
+}
+
+static double dot(const double* a, const double* b, int N)
+{
+    double s = 0.0;
+    for(int i=0; i<N; i++)
+        s += a[i]*b[i];
+    return s;
+}
+
+// Jt is a cholmod_sparse in the layout the optimizer callback produces: the
+// rows of J are in the columns of Jt
+//
+// The callback emits a scalar CSR matrix, but J is really made of small dense
+// blocks: each row is a few runs of consecutive state variables (6 for a pose,
+// 3 for a point, all the distortions of a camera, ...). The sparsity pattern is
+// fixed for a given problem, so I find the runs once, and then work on the
+// dense runs instead of on the scalar column indices. A run never straddles a
+// boundary between solver blocks, so each run contributes to exactly one block
+// of JtJ in each row
+// Jt uses 32-bit (CHOLMOD_INT) or 64-bit (CHOLMOD_LONG) indices. These read
+// either. They're used only in the one-time passes over the sparsity pattern
+static int64_t Jt_rowptr(const cholmod_sparse* Jt, int irow)
+{
+    return Jt->itype == CHOLMOD_LONG ?
+        ((const int64_t*)Jt->p)[irow] :
+        ((const int*    )Jt->p)[irow];
+}
+static int Jt_colidx(const cholmod_sparse* Jt, int64_t k)
+{
+    return Jt->itype == CHOLMOD_LONG ?
+        (int)((const int64_t*)Jt->i)[k] :
+        ((const int*)Jt->i)[k];
+}
+
+typedef struct
+{
+    int64_t  Nruns;
+
+    // The runs of row irow are [row_run0[irow], row_run0[irow+1])
+    int64_t* row_run0;
+    // The first state variable of each run, where its values are in Jt->x, and
+    // its length
+    int*     run_icol;
+    int64_t* run_ival;
+    int*     run_N;
+} jacobian_runs_t;
+
+static void jacobian_runs_free(jacobian_runs_t* r)
+{
+    free(r->row_run0);
+    free(r->run_icol);
+    free(r->run_ival);
+    free(r->run_N);
+}
+
+// Finds the runs in the sparsity pattern of Jt. A new run starts wherever the
+// columns aren't consecutive, or where iblock_state[] changes. iblock_state may
+// be NULL
+static bool jacobian_runs_init(jacobian_runs_t* r,
+                               const cholmod_sparse* Jt,
+                               const int* iblock_state)
+{
+    const int Nmeasurements = (int)Jt->ncol;
+
+    *r = (jacobian_runs_t){};
+
+    bool run_starts_at(int64_t k, int64_t k0)
+    {
+        if(k == k0)
+            return true;
+        const int icol      = Jt_colidx(Jt, k);
+        const int icol_prev = Jt_colidx(Jt, k-1);
+        return
+            icol != icol_prev + 1 ||
+            (iblock_state != NULL &&
+             iblock_state[icol] != iblock_state[icol_prev]);
+    }
+
+    int64_t Nruns = 0;
+    for(int irow=0; irow<Nmeasurements; irow++)
+    {
+        const int64_t k0 = Jt_rowptr(Jt, irow);
+        const int64_t k1 = Jt_rowptr(Jt, irow+1);
+        for(int64_t k=k0; k<k1; k++)
+            if(run_starts_at(k, k0))
+                Nruns++;
+    }
+
+    r->Nruns    = Nruns;
+    r->row_run0 = malloc((Nmeasurements+1)  * sizeof(int64_t));
+    r->run_icol = malloc((Nruns > 0 ? Nruns : 1) * sizeof(int));
+    r->run_ival = malloc((Nruns > 0 ? Nruns : 1) * sizeof(int64_t));
+    r->run_N    = malloc((Nruns > 0 ? Nruns : 1) * sizeof(int));
+    if(r->row_run0 == NULL || r->run_icol == NULL ||
+       r->run_ival == NULL || r->run_N    == NULL)
+    {
+        MSG("Couldn't allocate the jacobian runs");
+        return false;
+    }
+
+    int64_t irun = 0;
+    for(int irow=0; irow<Nmeasurements; irow++)
+    {
+        const int64_t k0 = Jt_rowptr(Jt, irow);
+        const int64_t k1 = Jt_rowptr(Jt, irow+1);
+
+        r->row_run0[irow] = irun;
+        for(int64_t k=k0; k<k1; k++)
+        {
+            if(run_starts_at(k, k0))
+            {
+                r->run_icol[irun] = Jt_colidx(Jt, k);
+                r->run_ival[irun] = k;
+                r->run_N   [irun] = 0;
+                irun++;
+            }
+            r->run_N[irun-1]++;
+        }
+    }
+    r->row_run0[Nmeasurements] = irun;
+    return true;
+}
+
+// The dense kernels used on the runs
+
+// out += a v
+static void axpy(double* restrict out, double a, const double* restrict v, int N)
+{
+    for(int i=0; i<N; i++)
+        out[i] += a*v[i];
+}
+
+// A[i*stride + j] += u[i] v[j]
+static void accumulate_outer(double* restrict A, int stride,
+                             const double* restrict u, int Nu,
+                             const double* restrict v, int Nv)
+{
+    for(int i=0; i<Nu; i++)
+        axpy(&A[i*stride], u[i], v, Nv);
+}
+
+// out = Jt x
+static void compute_Jt_x(double* out,
+                         const cholmod_sparse* Jt, const jacobian_runs_t* runs,
+                         const double* x)
+{
+    const double* Jval = (const double*)Jt->x;
+
+    memset(out, 0, Jt->nrow*sizeof(double));
+    for(int irow=0; irow<(int)Jt->ncol; irow++)
+        for(int64_t irun=runs->row_run0[irow]; irun<runs->row_run0[irow+1]; irun++)
+            axpy(&out[runs->run_icol[irun]], x[irow],
+                 &Jval[runs->run_ival[irun]], runs->run_N[irun]);
+}
+
+// out = (JtJ + lambda I) v, without forming JtJ. Returns norm2(J v)
+static double compute_JtJ_v(double* out,
+                            const cholmod_sparse* Jt, const jacobian_runs_t* runs,
+                            const double* v,
+                            double lambda)
+{
+    const double* Jval = (const double*)Jt->x;
+
+    double norm2_Jv = 0.0;
+    if(out != NULL)
+        for(int i=0; i<(int)Jt->nrow; i++)
+            out[i] = lambda*v[i];
+    for(int irow=0; irow<(int)Jt->ncol; irow++)
+    {
+        const int64_t irun0 = runs->row_run0[irow];
+        const int64_t irun1 = runs->row_run0[irow+1];
+
+        double Jv = 0.0;
+        for(int64_t irun=irun0; irun<irun1; irun++)
+            Jv += dot(&Jval[runs->run_ival[irun]],
+                      &v[runs->run_icol[irun]],
+                      runs->run_N[irun]);
+        norm2_Jv += Jv*Jv;
+        if(out != NULL)
+            for(int64_t irun=irun0; irun<irun1; irun++)
+                axpy(&out[runs->run_icol[irun]], Jv,
+                     &Jval[runs->run_ival[irun]], runs->run_N[irun]);
+    }
+    return norm2_Jv;
+}
+
+
+
+
+// Each linear solver is initialized from the first jacobian: the sparsity
+// pattern of the jacobian is fixed for a given problem (libdogleg assumes this
+// too: it analyzes the pattern once). Then it is linearized at each new
+// operating point, and asked to solve (JtJ + lambda I) delta = -g, possibly
+// several times with different lambda. g = Jt x is computed by the caller
+
+
+// The Schur-complement solver. The "blocks" here are the eliminated variables:
+// the frames and the points. Everything else is a "camera" variable
+typedef struct
+{
+    int Nstate, Ncamera, Nblocks, NW;
+    const solver_blocks_t* blocks;
+
+    // The state variables that are not eliminated are the "camera" variables.
+    // They're indexed compactly, in the same order as in the state vector.
+    // istate_camera[] maps a state index to a camera index (or -1).
+    // iblock_state[] maps a state index to an eliminated block (or -1)
+    int* istate_camera;
+    int* iblock_state;
+
+    // Which block each measurement depends on (or -1). And the measurements
+    // for each block, in a CSR layout: block_rows[block_row0[iblock]...]
+    int* row_block;
+    int* block_row0;
+    int* block_rows;
+
+    // The camera variables coupled to each block, in a CSR layout:
+    // block_cols[block_col0[iblock]...]. icol_local[] is scratch, used to find
+    // the position of a camera variable in a block's list
+    int* block_col0;
+    int* block_cols;
+    int* icol_local;
+
+    // W_b = Jcamera_t Jblock is stored densely for each block, over only the
+    // camera variables the block is coupled to: (Ncols_b, Nb). V_b = Jblock_t
+    // Jblock is (Nb,Nb), stored with a stride of 6, and so is its factorization.
+    // U = Jcamera_t Jcamera and the reduced system S are dense
+    double* W;
+    double* V;
+    double* Vchol;
+    double* U;
+    double* S;
+    double* Y;
+    double* rhs_camera;
+} schur_t;
+
+static int schur_block_size(const schur_t* s, int iblock)
+{
+    return iblock < s->blocks->Nframes ? 6 : 3;
+}
+static int schur_block_istate(const schur_t* s, int iblock)
+{
+    return iblock < s->blocks->Nframes ?
+        s->blocks->istate_frames + 6*iblock :
+        s->blocks->istate_points + 3*(iblock - s->blocks->Nframes);
+}
+
+static void schur_free(schur_t* s)
+{
+    free(s->istate_camera);
+    free(s->iblock_state);
+    free(s->row_block);
+    free(s->block_row0);
+    free(s->block_rows);
+    free(s->block_col0);
+    free(s->block_cols);
+    free(s->icol_local);
+    free(s->W);
+    free(s->V);
+    free(s->Vchol);
+    free(s->U);
+    free(s->S);
+    free(s->Y);
+    free(s->rhs_camera);
+}
+
+// Finds the structure of the problem: which measurements touch which block,
+// and which camera variables are coupled to each block
+static bool schur_init(schur_t* s,
+                       const cholmod_sparse* Jt,
+                       const solver_blocks_t* blocks)
+{
+    const int Nstate        = (int)Jt->nrow;
+    const int Nmeasurements = (int)Jt->ncol;
+    const int Nblocks       = blocks->Nframes + blocks->Npoints;
+
+    *s = (schur_t){ .Nstate  = Nstate,
+                    .Nblocks = Nblocks,
+                    .blocks  = blocks };
+
+    s->istate_camera = malloc(Nstate*sizeof(int));
+    s->iblock_state  = malloc(Nstate*sizeof(int));
+    if(s->istate_camera == NULL || s->iblock_state == NULL)
+    {
+        MSG("Couldn't allocate the state index maps");
+        return false;
+    }
+    for(int i=0; i<Nstate; i++)
+        s->iblock_state[i] = -1;
+    for(int iblock=0; iblock<Nblocks; iblock++)
+    {
+        const int istate0 = schur_block_istate(s, iblock);
+        const int Nb      = schur_block_size(s, iblock);
+        if(istate0 < 0 || istate0 + Nb > Nstate)
+        {
+            MSG("Block %d is out of bounds of the state vector", iblock);
+            return false;
+        }
+        for(int i=0; i<Nb; i++)
+            s->iblock_state[istate0 + i] = iblock;
+    }
+    int Ncamera = 0;
+    for(int i=0; i<Nstate; i++)
+        s->istate_camera[i] = s->iblock_state[i] < 0 ? Ncamera++ : -1;
+    s->Ncamera = Ncamera;
+    if(Ncamera > SCHUR_NCAMERA_MAX)
+    {
+        MSG("The Schur-complement solver factors the reduced system of the camera variables densely, so it supports at most %d of them. This problem has %d. Use the CHOLMOD or PCG solvers instead",
+            SCHUR_NCAMERA_MAX, Ncamera);
+        return false;
+    }
+
+    s->row_block  = malloc(Nmeasurements*sizeof(int));
+    s->block_row0 = calloc(Nblocks+1, sizeof(int));
+    s->block_col0 = calloc(Nblocks+1, sizeof(int));
+    s->icol_local = malloc((Ncamera > 0 ? Ncamera : 1)*sizeof(int));
+    if(s->row_block == NULL || s->block_row0 == NULL || s->block_col0 == NULL || s->icol_local == NULL)
+    {
+        MSG("Couldn't allocate the problem structure");
+        return false;
+    }
+
+    for(int irow=0; irow<Nmeasurements; irow++)
+    {
+        s->row_block[irow] = -1;
+        for(int64_t k=Jt_rowptr(Jt,irow); k<Jt_rowptr(Jt,irow+1); k++)
+        {
+            const int iblock = s->iblock_state[Jt_colidx(Jt,k)];
+            if(iblock < 0)
+                continue;
+            if(s->row_block[irow] >= 0 && s->row_block[irow] != iblock)
+            {
+                MSG("Measurement %d depends on blocks %d and %d. The Schur-complement solver needs each measurement to depend on at most one frame or point",
+                    irow, s->row_block[irow], iblock);
+                return false;
+            }
+            s->row_block[irow] = iblock;
+        }
+        if(s->row_block[irow] >= 0)
+            s->block_row0[s->row_block[irow]+1]++;
+    }
+    for(int iblock=0; iblock<Nblocks; iblock++)
+        s->block_row0[iblock+1] += s->block_row0[iblock];
+
+    s->block_rows = malloc((s->block_row0[Nblocks] > 0 ? s->block_row0[Nblocks] : 1)*sizeof(int));
+    if(s->block_rows == NULL)
+    {
+        MSG("Couldn't allocate the problem structure");
+        return false;
+    }
+    // block_col0[] is used as scratch here; it's recomputed below
+    for(int irow=0; irow<Nmeasurements; irow++)
+        if(s->row_block[irow] >= 0)
+        {
+            const int iblock = s->row_block[irow];
+            s->block_rows[s->block_row0[iblock] + s->block_col0[iblock]++] = irow;
+        }
+
+    // The camera variables coupled to each block. Two passes: the first one
+    // counts, the second one fills in. icol_local[] marks the variables I've
+    // already seen in this block
+    for(int ipass=0; ipass<2; ipass++)
+    {
+        for(int i=0; i<Ncamera; i++)
+            s->icol_local[i] = -1;
+
+        int Ncols_total = 0;
+        for(int iblock=0; iblock<Nblocks; iblock++)
+        {
+            int Ncols = 0;
+            for(int ir=s->block_row0[iblock]; ir<s->block_row0[iblock+1]; ir++)
+            {
+                const int irow = s->block_rows[ir];
+                for(int64_t k=Jt_rowptr(Jt,irow); k<Jt_rowptr(Jt,irow+1); k++)
+                {
+                    const int icam = s->istate_camera[Jt_colidx(Jt,k)];
+                    if(icam < 0 || s->icol_local[icam] == iblock)
+                        continue;
+                    s->icol_local[icam] = iblock;
+                    if(ipass == 1)
+                        s->block_cols[Ncols_total + Ncols] = icam;
+                    Ncols++;
+                }
+            }
+            if(ipass == 0)
+                s->block_col0[iblock] = Ncols_total;
+            Ncols_total += Ncols;
+        }
+
+        if(ipass == 0)
+        {
+            s->block_col0[Nblocks] = Ncols_total;
+            s->block_cols = malloc((Ncols_total > 0 ? Ncols_total : 1)*sizeof(int));
+            if(s->block_cols == NULL)
+            {
+                MSG("Couldn't allocate the problem structure");
+                return false;
+            }
+        }
+    }
+
+    int NY = 0;
+    s->NW  = 0;
+    for(int iblock=0; iblock<Nblocks; iblock++)
+    {
+        const int Ncols = s->block_col0[iblock+1] - s->block_col0[iblock];
+        s->NW += Ncols * schur_block_size(s, iblock);
+        if(Ncols*6 > NY)
+            NY = Ncols*6;
+    }
+    const size_t NU = (size_t)Ncamera*Ncamera;
+    s->W          = malloc((s->NW > 0 ? s->NW : 1)    * sizeof(double));
+    s->V          = malloc((Nblocks > 0 ? Nblocks : 1) * 6*6 * sizeof(double));
+    s->Vchol      = malloc((Nblocks > 0 ? Nblocks : 1) * 6*6 * sizeof(double));
+    s->Y          = malloc((NY > 0 ? NY : 1)           * sizeof(double));
+    s->U          = malloc((NU > 0 ? NU : 1)           * sizeof(double));
+    s->S          = malloc((NU > 0 ? NU : 1)           * sizeof(double));
+    s->rhs_camera = malloc((Ncamera > 0 ? Ncamera : 1) * sizeof(double));
+    if(s->W == NULL || s->V == NULL || s->Vchol == NULL || s->Y == NULL ||
+       s->U == NULL || s->S == NULL || s->rhs_camera == NULL)
+    {
+        MSG("Couldn't allocate the Schur-complement buffers");
+        return false;
+    }
+    return true;
+}
+
+// Computes the pieces of JtJ: U (camera-camera), V (block-block), W
+// (camera-block). Each pair of runs in a row contributes a dense outer product.
+// The runs were split at the block boundaries, so each run is entirely in the
+// camera variables or entirely in one block
+static void schur_linearize(schur_t* s,
+                            const cholmod_sparse* Jt, const jacobian_runs_t* runs)
+{
+    const double* Jval    = (const double*)Jt->x;
+    const int     Ncamera = s->Ncamera;
+
+    memset(s->U, 0, (size_t)Ncamera*Ncamera*sizeof(double));
+    memset(s->V, 0, s->Nblocks*6*6*sizeof(double));
+    memset(s->W, 0, s->NW*sizeof(double));
+
+    // The camera-camera contribution of one row. Consecutive camera variables
+    // have consecutive camera indices, so each run is dense in U too
+    void accumulate_camera(int irow)
+    {
+        for(int64_t irun0=runs->row_run0[irow]; irun0<runs->row_run0[irow+1]; irun0++)
+        {
+            const int icam0 = s->istate_camera[runs->run_icol[irun0]];
+            if(icam0 < 0)
+                continue;
+            for(int64_t irun1=runs->row_run0[irow]; irun1<runs->row_run0[irow+1]; irun1++)
+            {
+                const int icam1 = s->istate_camera[runs->run_icol[irun1]];
+                if(icam1 < 0)
+                    continue;
+                accumulate_outer(&s->U[icam0*Ncamera + icam1], Ncamera,
+                                 &Jval[runs->run_ival[irun0]], runs->run_N[irun0],
+                                 &Jval[runs->run_ival[irun1]], runs->run_N[irun1]);
+            }
+        }
+    }
+
+    for(int irow=0; irow<(int)Jt->ncol; irow++)
+        if(s->row_block[irow] < 0)
+            accumulate_camera(irow);
+
+    int iW = 0;
+    for(int iblock=0; iblock<s->Nblocks; iblock++)
+    {
+        const int Nb      = schur_block_size(s, iblock);
+        const int istate0 = schur_block_istate(s, iblock);
+        double*   Vb      = &s->V[iblock*6*6];
+        double*   Wb      = &s->W[iW];
+
+        for(int i=s->block_col0[iblock]; i<s->block_col0[iblock+1]; i++)
+            s->icol_local[s->block_cols[i]] = i - s->block_col0[iblock];
+
+        for(int ir=s->block_row0[iblock]; ir<s->block_row0[iblock+1]; ir++)
+        {
+            const int irow = s->block_rows[ir];
+            accumulate_camera(irow);
+
+            for(int64_t irun0=runs->row_run0[irow]; irun0<runs->row_run0[irow+1]; irun0++)
+            {
+                if(s->iblock_state[runs->run_icol[irun0]] != iblock)
+                    continue;
+                const int     ie0 = runs->run_icol[irun0] - istate0;
+                const int     N0  = runs->run_N[irun0];
+                const double* J0  = &Jval[runs->run_ival[irun0]];
+
+                for(int64_t irun1=runs->row_run0[irow]; irun1<runs->row_run0[irow+1]; irun1++)
+                {
+                    const int     istate1 = runs->run_icol[irun1];
+                    const int     N1      = runs->run_N[irun1];
+                    const double* J1      = &Jval[runs->run_ival[irun1]];
+
+                    if(s->iblock_state[istate1] == iblock)
+                        accumulate_outer(&Vb[ie0*6 + istate1-istate0], 6,
+                                         J0, N0, J1, N1);
+                    else if(s->istate_camera[istate1] >= 0)
+                        // The camera variables of a run aren't necessarily
+                        // adjacent in this block's list, so I place each one
+                        for(int j=0; j<N1; j++)
+                            axpy(&Wb[s->icol_local[s->istate_camera[istate1+j]]*Nb + ie0],
+                                 J1[j], J0, N0);
+                }
+            }
+        }
+        iW += (s->block_col0[iblock+1] - s->block_col0[iblock]) * Nb;
+    }
+}
+
+// Solves (JtJ + lambda I) delta = -g, by eliminating the blocks. Returns false
+// if the system isn't positive-definite
+static bool schur_solve(schur_t* s, double* delta, const double* g, double lambda)
+{
+    const int Ncamera    = s->Ncamera;
+    double*   S          = s->S;
+    double*   Y          = s->Y;
+    double*   rhs_camera = s->rhs_camera;
+
+    for(int i=0; i<Ncamera*Ncamera; i++)
+        S[i] = s->U[i];
+    for(int i=0; i<Ncamera; i++)
+        S[i*Ncamera + i] += lambda;
+    for(int istate=0; istate<s->Nstate; istate++)
+        if(s->istate_camera[istate] >= 0)
+            rhs_camera[s->istate_camera[istate]] = -g[istate];
+
+    // S    = U + lambda I - sum( W_b (V_b + lambda I)^-1 W_bt )
+    // rhs  = -g_camera    + sum( W_b (V_b + lambda I)^-1 g_b  )
+    int iW = 0;
+    for(int iblock=0; iblock<s->Nblocks; iblock++)
+    {
+        const int     Nb      = schur_block_size(s, iblock);
+        const int     istate0 = schur_block_istate(s, iblock);
+        const int     Ncols   = s->block_col0[iblock+1] - s->block_col0[iblock];
+        const int*    cols    = &s->block_cols[s->block_col0[iblock]];
+        const double* Wb      = &s->W[iW];
+        double*       L       = &s->Vchol[iblock*6*6];
+
+        for(int i=0; i<Nb; i++)
+            for(int j=0; j<Nb; j++)
+                L[i*Nb + j] = s->V[iblock*6*6 + i*6 + j] + (i==j ? lambda : 0.0);
+        if(!cholesky(L, Nb))
+            return false;
+
+        // Y = W_b (V_b + lambda I)^-1. Each row of Y solves a small system
+        for(int i=0; i<Ncols; i++)
+        {
+            for(int e=0; e<Nb; e++)
+                Y[i*Nb + e] = Wb[i*Nb + e];
+            cholesky_solve(&Y[i*Nb], L, Nb);
+        }
+
+        for(int i=0; i<Ncols; i++)
+        {
+            double* Srow = &S[cols[i]*Ncamera];
+            for(int j=0; j<Ncols; j++)
+            {
+                double t = 0.0;
+                for(int e=0; e<Nb; e++)
+                    t += Y[i*Nb + e]*Wb[j*Nb + e];
+                Srow[cols[j]] -= t;
+            }
+            for(int e=0; e<Nb; e++)
+                rhs_camera[cols[i]] += Y[i*Nb + e]*g[istate0 + e];
+        }
+        iW += Ncols*Nb;
+    }
+
+    if(!cholesky(S, Ncamera))
+        return false;
+    cholesky_solve(rhs_camera, S, Ncamera);
+    for(int istate=0; istate<s->Nstate; istate++)
+        if(s->istate_camera[istate] >= 0)
+            delta[istate] = rhs_camera[s->istate_camera[istate]];
+
+    // Back-substitution: delta_b = (V_b + lambda I)^-1 (-g_b - W_bt delta_camera)
+    iW = 0;
+    for(int iblock=0; iblock<s->Nblocks; iblock++)
+    {
+        const int     Nb      = schur_block_size(s, iblock);
+        const int     istate0 = schur_block_istate(s, iblock);
+        const int     Ncols   = s->block_col0[iblock+1] - s->block_col0[iblock];
+        const int*    cols    = &s->block_cols[s->block_col0[iblock]];
+        const double* Wb      = &s->W[iW];
+
+        double t[6];
+        for(int e=0; e<Nb; e++)
+            t[e] = -g[istate0 + e];
+        for(int i=0; i<Ncols; i++)
+            for(int e=0; e<Nb; e++)
+                t[e] -= Wb[i*Nb + e]*rhs_camera[cols[i]];
+        cholesky_solve(t, &s->Vchol[iblock*6*6], Nb);
+        for(int e=0; e<Nb; e++)
+            delta[istate0 + e] = t[e];
+
+        iW += Ncols*Nb;
+    }
+    return true;
+}
+
+
+
+// The PCG solver. The preconditioner is block-Jacobi: the diagonal blocks of
+// JtJ + lambda I, factored. The blocks are those in solver_blocks_t, split into
+// chunks of at most PCG_BLOCK_SIZE_MAX variables. Any variables not in
+// solver_blocks_t are blocks of their own
+typedef struct
+{
+    int Nstate, Nblocks, ND;
+
+    // Block iblock covers the state variables
+    // [block_istate0[iblock], block_istate0[iblock] + block_size[iblock]). Its
+    // (size,size) diagonal block of JtJ is at D[block_offset[iblock]]
+    int* block_istate0;
+    int* block_size;
+    int* block_offset;
+    int* iblock_state;
+
+    double* D;
+    double* Dchol;
+
+    // The CG vectors
+    double* r;
+    double* z;
+    double* d;
+    double* q;
+
+    // The operating point we're linearized at. Used for the Jt (J v) products
+    const cholmod_sparse*  Jt;
+    const jacobian_runs_t* runs;
+} pcg_t;
+
+static void pcg_free(pcg_t* s)
+{
+    free(s->block_istate0);
+    free(s->block_size);
+    free(s->block_offset);
+    free(s->iblock_state);
+    free(s->D);
+    free(s->Dchol);
+    free(s->r);
+    free(s->z);
+    free(s->d);
+    free(s->q);
+}
+
+static bool pcg_init(pcg_t* s,
+                     const cholmod_sparse* Jt,
+                     const solver_blocks_t* blocks)
+{
+    const int Nstate = (int)Jt->nrow;
+    *s = (pcg_t){ .Nstate = Nstate };
+
+    // There are at most Nstate blocks
+    s->block_istate0 = malloc(Nstate*sizeof(int));
+    s->block_size    = malloc(Nstate*sizeof(int));
+    s->block_offset  = malloc(Nstate*sizeof(int));
+    s->iblock_state  = malloc(Nstate*sizeof(int));
+    s->r             = malloc(Nstate*sizeof(double));
+    s->z             = malloc(Nstate*sizeof(double));
+    s->d             = malloc(Nstate*sizeof(double));
+    s->q             = malloc(Nstate*sizeof(double));
+    if(s->block_istate0 == NULL || s->block_size == NULL ||
+       s->block_offset  == NULL || s->iblock_state == NULL ||
+       s->r == NULL || s->z == NULL || s->d == NULL || s->q == NULL)
+    {
+        MSG("Couldn't allocate the PCG buffers");
+        return false;
+    }
+
+    for(int i=0; i<Nstate; i++)
+        s->iblock_state[i] = -1;
+
+    int ND = 0;
+    bool add_block(int istate0, int N)
+    {
+        if(istate0 < 0 || istate0 + N > Nstate)
+        {
+            MSG("A block of variables is out of bounds of the state vector");
+            return false;
+        }
+        for(int i0=0; i0<N; i0 += PCG_BLOCK_SIZE_MAX)
+        {
+            const int Nchunk = N-i0 < PCG_BLOCK_SIZE_MAX ? N-i0 : PCG_BLOCK_SIZE_MAX;
+            s->block_istate0[s->Nblocks] = istate0 + i0;
+            s->block_size   [s->Nblocks] = Nchunk;
+            s->block_offset [s->Nblocks] = ND;
+            for(int i=0; i<Nchunk; i++)
+                s->iblock_state[istate0 + i0 + i] = s->Nblocks;
+            ND += Nchunk*Nchunk;
+            s->Nblocks++;
+        }
+        return true;
+    }
+
+    for(int i=0; i<blocks->Ncameras_intrinsics; i++)
+        if(!add_block(i*blocks->Nintrinsics_state, blocks->Nintrinsics_state))
+            return false;
+    for(int i=0; i<blocks->Ncameras_extrinsics; i++)
+        if(!add_block(blocks->istate_extrinsics + 6*i, 6))
+            return false;
+    for(int i=0; i<blocks->Nframes; i++)
+        if(!add_block(blocks->istate_frames + 6*i, 6))
+            return false;
+    for(int i=0; i<blocks->Npoints; i++)
+        if(!add_block(blocks->istate_points + 3*i, 3))
+            return false;
+    if(!add_block(blocks->istate_calobject_warp, blocks->Ncalobject_warp))
+        return false;
+    for(int i=0; i<Nstate; i++)
+        if(s->iblock_state[i] < 0 && !add_block(i, 1))
+            return false;
+
+    s->ND    = ND;
+    s->D     = malloc((ND > 0 ? ND : 1) * sizeof(double));
+    s->Dchol = malloc((ND > 0 ? ND : 1) * sizeof(double));
+    if(s->D == NULL || s->Dchol == NULL)
+    {
+        MSG("Couldn't allocate the PCG preconditioner");
+        return false;
+    }
+    return true;
+}
+
+// Computes the diagonal blocks of JtJ. The runs were split at the block
+// boundaries, so each run is entirely inside one preconditioner block
+static void pcg_linearize(pcg_t* s,
+                          const cholmod_sparse* Jt, const jacobian_runs_t* runs)
+{
+    const double* Jval = (const double*)Jt->x;
+
+    s->Jt   = Jt;
+    s->runs = runs;
+
+    memset(s->D, 0, s->ND*sizeof(double));
+
+    for(int irow=0; irow<(int)Jt->ncol; irow++)
+        for(int64_t irun0=runs->row_run0[irow]; irun0<runs->row_run0[irow+1]; irun0++)
+        {
+            const int iblock = s->iblock_state[runs->run_icol[irun0]];
+            const int N      = s->block_size[iblock];
+            const int i0     = runs->run_icol[irun0] - s->block_istate0[iblock];
+            double*   Db     = &s->D[s->block_offset[iblock]];
+            for(int64_t irun1=runs->row_run0[irow]; irun1<runs->row_run0[irow+1]; irun1++)
+            {
+                if(s->iblock_state[runs->run_icol[irun1]] != iblock)
+                    continue;
+                accumulate_outer(&Db[i0*N + runs->run_icol[irun1] - s->block_istate0[iblock]], N,
+                                 &Jval[runs->run_ival[irun0]], runs->run_N[irun0],
+                                 &Jval[runs->run_ival[irun1]], runs->run_N[irun1]);
+            }
+        }
+}
+
+// z = M^-1 r, using the factored preconditioner blocks
+static void pcg_precondition(const pcg_t* s, double* z, const double* r)
+{
+    memcpy(z, r, s->Nstate*sizeof(double));
+    for(int iblock=0; iblock<s->Nblocks; iblock++)
+        cholesky_solve(&z[s->block_istate0[iblock]],
+                       &s->Dchol[s->block_offset[iblock]],
+                       s->block_size[iblock]);
+}
+
+// Solves (JtJ + lambda I) delta = -g with preconditioned conjugate gradients.
+// Returns false if the system isn't positive-definite
+static bool pcg_solve(pcg_t* s, double* delta, const double* g, double lambda)
+{
+    const int Nstate = s->Nstate;
+    double* r = s->r;
+    double* z = s->z;
+    double* d = s->d;
+    double* q = s->q;
+
+    for(int iblock=0; iblock<s->Nblocks; iblock++)
+    {
+        const int N  = s->block_size[iblock];
+        double*   L  = &s->Dchol[s->block_offset[iblock]];
+        const double* Db = &s->D[s->block_offset[iblock]];
+        for(int i=0; i<N*N; i++)
+            L[i] = Db[i];
+        for(int i=0; i<N; i++)
+            L[i*N + i] += lambda;
+        if(!cholesky(L, N))
+            return false;
+    }
+
+    // I start at delta = 0, so the residual is the rhs: -g
+    for(int i=0; i<Nstate; i++)
+    {
+        delta[i] = 0.0;
+        r[i]     = -g[i];
+    }
+    const double norm2_rhs = dot(r,r,Nstate);
+    if(norm2_rhs == 0.0)
+        return true;
+
+    pcg_precondition(s, z, r);
+    memcpy(d, z, Nstate*sizeof(double));
+    double rz = dot(r,z,Nstate);
+
+    for(int i=0; i<PCG_ITERATIONS_MAX; i++)
+    {
+        compute_JtJ_v(q, s->Jt, s->runs, d, lambda);
+        const double dq = dot(d,q,Nstate);
+        if(!(dq > 0.0))
+            return false;
+
+        const double alpha = rz / dq;
+        for(int j=0; j<Nstate; j++)
+        {
+            delta[j] += alpha*d[j];
+            r[j]     -= alpha*q[j];
+        }
+        if(dot(r,r,Nstate) < PCG_TOLERANCE*PCG_TOLERANCE*norm2_rhs)
+            break;
+
+        pcg_precondition(s, z, r);
+        const double rz_new = dot(r,z,Nstate);
+        const double beta   = rz_new / rz;
+        rz = rz_new;
+        for(int j=0; j<Nstate; j++)
+            d[j] = z[j] + beta*d[j];
+    }
+    // If I ran out of iterations, delta is an approximate solution. That's
+    // fine: the Levenberg-Marquardt loop evaluates each step it takes
+    return true;
+}
+
+
+
+// The CHOLMOD solver. This factors the full sparse JtJ + lambda I, like
+// libdogleg does. But libdogleg analyzes the sparsity pattern in each call, so
+// each outlier-rejection round and each solve of a mrcal_problem_t redoes it.
+// Here the analysis (the fill-reducing ordering and the symbolic
+// factorization) lives in the solver structure: cholmod_analyze() is called
+// once per problem, and each linear solve only calls cholmod_factorize_p()
+typedef struct
+{
+    cholmod_common  common;
+    bool            started;
+    // Jt has 64-bit indices, so I use the cholmod_l_...() functions
+    bool            is_long;
+    cholmod_factor* factorization;
+
+    // The negated gradient, and the solver workspaces. cholmod_solve2()
+    // allocates Y and E on the first call, and reuses them after that
+    double*         rhs;
+    cholmod_dense*  Y;
+    cholmod_dense*  E;
+
+    // The operating point we're linearized at
+    cholmod_sparse* Jt;
+} cholmod_solver_t;
+
+static void cholmod_solver_free(cholmod_solver_t* s)
+{
+    if(s->started)
+    {
+        if(s->is_long)
+        {
+            cholmod_l_free_factor(&s->factorization, &s->common);
+            cholmod_l_free_dense (&s->Y,             &s->common);
+            cholmod_l_free_dense (&s->E,             &s->common);
+            cholmod_l_finish(&s->common);
+        }
+        else
+        {
+            cholmod_free_factor(&s->factorization, &s->common);
+            cholmod_free_dense (&s->Y,             &s->common);
+            cholmod_free_dense (&s->E,             &s->common);
+            cholmod_finish(&s->common);
+        }
+        s->started = false;
+    }
+    free(s->rhs);
+}
+
+static bool cholmod_solver_init(cholmod_solver_t* s,
+                                cholmod_sparse* Jt)
+{
+    *s = (cholmod_solver_t){ .is_long = (Jt->itype == CHOLMOD_LONG) };
+
+    s->rhs = malloc(Jt->nrow * sizeof(double));
+    if(s->rhs == NULL)
+    {
+        MSG("Couldn't allocate the CHOLMOD solver buffers");
+        return false;
+    }
+
+    if( !(s->is_long ? cholmod_l_start(&s->common) : cholmod_start(&s->common)) )
+    {
+        MSG("Error trying to cholmod_start");
+        return false;
+    }
+    s->started = true;
+
+    // I want to use LGPL parts of CHOLMOD only, so I turn off the supernodal
+    // routines, like libdogleg does
+    s->common.supernodal = 0;
+
+    // Jt is not symmetric (stype == 0), so this analyzes Jt Jt' = JtJ
+    s->factorization =
+        s->is_long ?
+        cholmod_l_analyze(Jt, &s->common) :
+        cholmod_analyze  (Jt, &s->common);
+    if(s->factorization == NULL)
+    {
+        MSG("cholmod_analyze() failed");
+        return false;
+    }
+    return true;
+}
+
+static void cholmod_solver_linearize(cholmod_solver_t* s,
+                                     cholmod_sparse* Jt)
+{
+    s->Jt = Jt;
+}
+
+// Solves (JtJ + lambda I) delta = -g. Returns false if the system isn't
+// positive-definite
+static bool cholmod_solver_solve(cholmod_solver_t* s, double* delta, const double* g, double lambda)
+{
+    const int Nstate = (int)s->Jt->nrow;
+
+    double beta[2] = {lambda, 0.};
+    if( !(s->is_long ?
+          cholmod_l_factorize_p(s->Jt, beta, NULL, 0, s->factorization, &s->common) :
+          cholmod_factorize_p  (s->Jt, beta, NULL, 0, s->factorization, &s->common)) )
+    {
+        MSG("cholmod_factorize_p() failed");
+        return false;
+    }
+    if(s->factorization->minor != s->factorization->n)
+        return false;
+
+    for(int i=0; i<Nstate; i++)
+        s->rhs[i] = -g[i];
+
+    cholmod_dense b = { .nrow  = Nstate,
+                        .ncol  = 1,
+                        .nzmax = Nstate,
+                        .d     = Nstate,
+                        .x     = s->rhs,
+                        .xtype = CHOLMOD_REAL,
+                        .dtype = CHOLMOD_DOUBLE };
+    cholmod_dense out = b;
+    out.x = delta;
+
+    cholmod_dense* X = &out;
+    if( !(s->is_long ?
+          cholmod_l_solve2(CHOLMOD_A, s->factorization, &b, NULL, &X, NULL, &s->Y, &s->E, &s->common) :
+          cholmod_solve2  (CHOLMOD_A, s->factorization, &b, NULL, &X, NULL, &s->Y, &s->E, &s->common)) )
+    {
+        MSG("cholmod_solve2() failed");
+        return false;
+    }
+    if(X != &out)
+    {
+        // CHOLMOD didn't use my buffer. This shouldn't happen, but I handle it
+        memcpy(delta, X->x, Nstate*sizeof(double));
+        if(s->is_long) cholmod_l_free_dense(&X, &s->common);
+        else           cholmod_free_dense  (&X, &s->common);
+    }
+    return true;
+}
+
+
+
+// The measurements and jacobian at one operating point
+typedef struct
+{
+    cholmod_sparse Jt;
+    double*        x;
+    double         norm2_x;
+} operating_point_t;
+
+// The jacobian uses 32-bit indices if they're big-enough, and 64-bit indices
+// otherwise
+static bool operating_point_alloc(operating_point_t* op,
+                                  int Nstate, int Nmeasurements, int64_t N_j_nonzero)
+{
+    const bool   use_long = N_j_nonzero > INT_MAX;
+    const size_t index_size = use_long ? sizeof(int64_t) : sizeof(int);
+
+    *op = (operating_point_t)
+        { .Jt = { .nrow   = Nstate,
+                  .ncol   = Nmeasurements,
+                  .nzmax  = N_j_nonzero,
+                  .p      = malloc((Nmeasurements+1)*index_size),
+                  .i      = malloc(N_j_nonzero*index_size),
+                  .x      = malloc(N_j_nonzero*sizeof(double)),
+                  .stype  = 0,
+                  .itype  = use_long ? CHOLMOD_LONG : CHOLMOD_INT,
+                  .xtype  = CHOLMOD_REAL,
+                  .dtype  = CHOLMOD_DOUBLE,
+                  .sorted = 1,
+                  .packed = 1 },
+          .x = malloc(Nmeasurements*sizeof(double)) };
+    return
+        op->Jt.p != NULL &&
+        op->Jt.i != NULL &&
+        op->Jt.x != NULL &&
+        op->x    != NULL;
+}
+
+static void operating_point_free(operating_point_t* op)
+{
+    free(op->Jt.p);
+    free(op->Jt.i);
+    free(op->Jt.x);
+    free(op->x);
+}
+
+struct solver_structure_t
+{
+    // What this structure was built for. It's reused only if these match
+    mrcal_solver_t solver;
+    int            Nstate, Nmeasurements;
+    int64_t        N_j_nonzero;
+
+    operating_point_t op[2];
+    schur_t           schur;
+    pcg_t             pcg;
+    cholmod_solver_t  cholmod;
+    jacobian_runs_t   runs;
+    double*           g;
+    double*           delta;
+    double*           p_new;
+};
+
+// Frees everything inside the structure, but not the structure itself. Freeing
+// a zeroed-out structure is allowed
+static void solver_structure_free_contents(solver_structure_t* s)
+{
+    operating_point_free(&s->op[0]);
+    operating_point_free(&s->op[1]);
+    schur_free(&s->schur);
+    pcg_free(&s->pcg);
+    cholmod_solver_free(&s->cholmod);
+    jacobian_runs_free(&s->runs);
+    free(s->g);
+    free(s->delta);
+    free(s->p_new);
+}
+
+void _mrcal_solver_structure_free(solver_structure_t* structure)
+{
+    if(structure == NULL)
+        return;
+    solver_structure_free_contents(structure);
+    free(structure);
+}
+
+double _mrcal_optimize_sparse(// in,out
+                              double* p,
+                              // out. May be NULL
+                              double* x_final,
+
+                              // in
+                              int Nstate, int Nmeasurements, int64_t N_j_nonzero,
+                              dogleg_callback_t* callback, void* cookie,
+                              const dogleg_parameters2_t* parameters,
+                              const solver_blocks_t* blocks,
+                              mrcal_solver_t solver,
+                              bool verbose,
+                              // in,out. May be NULL
+                              solver_structure_t** structure)
+{
+    if(solver != MRCAL_SOLVER_SCHUR && solver != MRCAL_SOLVER_PCG &&
+       solver != MRCAL_SOLVER_CHOLMOD_LM)
+    {
+        MSG("Unknown sparse solver %d", (int)solver);
+        return -1.0;
+    }
+
+    double result = -1.0;
+
+    // Reuse the structure from a previous call, if I can. Otherwise I build a
+    // new one. A new structure is freed at the end unless the caller keeps it.
+    // free(NULL) is allowed, and so is freeing a zeroed-out structure, so I can
+    // bail at any time
+    solver_structure_t  structure_local = {};
+    solver_structure_t* s               = &structure_local;
+    bool                reused          = false;
+    if(structure != NULL && *structure != NULL)
+    {
+        if((*structure)->solver        == solver        &&
+           (*structure)->Nstate        == Nstate        &&
+           (*structure)->Nmeasurements == Nmeasurements &&
+           (*structure)->N_j_nonzero   == N_j_nonzero)
+        {
+            s      = *structure;
+            reused = true;
+
+            // The caller's block layout is the same, but it may live somewhere
+            // else now
+            s->schur.blocks = blocks;
+        }
+        else
+        {
+            _mrcal_solver_structure_free(*structure);
+            *structure = NULL;
+        }
+    }
+
+    if(!reused)
+    {
+        // A structure the caller will keep lives on the heap from the start:
+        // the solvers keep pointers into it
+        if(structure != NULL)
+        {
+            s = malloc(sizeof(solver_structure_t));
+            if(s == NULL)
+            {
+                MSG("Couldn't allocate the solver structure");
+                return -1.0;
+            }
+        }
+        *s = (solver_structure_t){ .solver        = solver,
+                                   .Nstate        = Nstate,
+                                   .Nmeasurements = Nmeasurements,
+                                   .N_j_nonzero   = N_j_nonzero };
+        s->g     = malloc(Nstate * sizeof(double));
+        s->delta = malloc(Nstate * sizeof(double));
+        s->p_new = malloc(Nstate * sizeof(double));
+        if(s->g == NULL || s->delta == NULL || s->p_new == NULL)
+        {
+            MSG("Couldn't allocate the solver buffers");
+            goto done;
+        }
+
+        if(!operating_point_alloc(&s->op[0], Nstate, Nmeasurements, N_j_nonzero) ||
+           !operating_point_alloc(&s->op[1], Nstate, Nmeasurements, N_j_nonzero))
+        {
+            MSG("Couldn't allocate the jacobian buffers");
+            goto done;
+        }
+    }
+
+    double*            g       = s->g;
+    double*            delta   = s->delta;
+    double*            p_new   = s->p_new;
+    schur_t*           schur   = &s->schur;
+    pcg_t*             pcg     = &s->pcg;
+    cholmod_solver_t*  cholmod = &s->cholmod;
+    jacobian_runs_t*   runs    = &s->runs;
+    operating_point_t* current = &s->op[0];
+    operating_point_t* trial   = &s->op[1];
+
+    void evaluate(operating_point_t* op, const double* p)
+    {
+        callback(p, op->x, &op->Jt, cookie);
+        op->norm2_x = dot(op->x, op->x, Nmeasurements);
+    }
+    void linearize(void)
+    {
+        compute_Jt_x(g, &current->Jt, runs, current->x);
+        if     (solver == MRCAL_SOLVER_SCHUR) schur_linearize         (schur,   &current->Jt, runs);
+        else if(solver == MRCAL_SOLVER_PCG)   pcg_linearize           (pcg,     &current->Jt, runs);
+        else                                  cholmod_solver_linearize(cholmod, &current->Jt);
+    }
+    bool solve(double lambda)
+    {
+        if     (solver == MRCAL_SOLVER_SCHUR) return schur_solve         (schur,   delta, g, lambda);
+        else if(solver == MRCAL_SOLVER_PCG)   return pcg_solve           (pcg,     delta, g, lambda);
+        else                                  return cholmod_solver_solve(cholmod, delta, g, lambda);
+    }
+
+    evaluate(current, p);
+    if(!reused)
+    {
+        // The structure comes from the sparsity pattern of the first jacobian
+        if(solver == MRCAL_SOLVER_SCHUR)
+        {
+            if(!schur_init(schur, &current->Jt, blocks) ||
+               !jacobian_runs_init(runs, &current->Jt, schur->iblock_state))
+                goto done;
+        }
+        else if(solver == MRCAL_SOLVER_PCG)
+        {
+            if(!pcg_init(pcg, &current->Jt, blocks) ||
+               !jacobian_runs_init(runs, &current->Jt, pcg->iblock_state))
+                goto done;
+        }
+        else
+        {
+            if(!cholmod_solver_init(cholmod, &current->Jt) ||
+               !jacobian_runs_init(runs, &current->Jt, NULL))
+                goto done;
+        }
+    }
+    linearize();
+
+    // Levenberg-Marquardt, with the damping updates from Nielsen's "Damping
+    // Parameter in Marquardt's Method". The initial lambda is scaled by the
+    // largest diagonal element of JtJ
+    double lambda = 0.0;
+    {
+        const double* Jval    = (const double*)current->Jt.x;
+        const int64_t Nnz     = Jt_rowptr(&current->Jt, Nmeasurements);
+
+        memset(delta, 0, Nstate*sizeof(double));
+        for(int64_t k=0; k<Nnz; k++)
+            delta[Jt_colidx(&current->Jt, k)] += Jval[k]*Jval[k];
+        for(int i=0; i<Nstate; i++)
+            if(delta[i] > lambda) lambda = delta[i];
+        lambda *= 1e-3;
+        if(lambda <= 0.0)
+            lambda = 1e-3;
+    }
+    double nu = 2.0;
+
+    int iteration;
+    for(iteration=0; iteration<parameters->max_iterations; iteration++)
+    {
+        double Jt_x_infnorm = 0.0;
+        for(int i=0; i<Nstate; i++)
+            if(fabs(g[i]) > Jt_x_infnorm) Jt_x_infnorm = fabs(g[i]);
+        if(Jt_x_infnorm < parameters->Jt_x_threshold)
+        {
+            if(verbose)
+                MSG("Jt_x infnorm %g is below the threshold. Done",
+                    Jt_x_infnorm);
+            break;
+        }
+
+        if(!solve(lambda))
+        {
+            lambda *= nu;
+            nu     *= 2.0;
+            continue;
+        }
+
+        double delta_infnorm = 0.0;
+        for(int i=0; i<Nstate; i++)
+        {
+            p_new[i] = p[i] + delta[i];
+            if(fabs(delta[i]) > delta_infnorm) delta_infnorm = fabs(delta[i]);
+        }
+
+        evaluate(trial, p_new);
+
+        // The decrease predicted by the linear model: norm2(x) - norm2(x + J
+        // delta). I compute it explicitly instead of using the normal
+        // equations, so that it's right even if the PCG solution is
+        // approximate
+        const double decrease_predicted =
+            -2.0*dot(delta, g, Nstate) -
+            compute_JtJ_v(NULL, &current->Jt, runs, delta, 0.0);
+        const double decrease_actual = current->norm2_x - trial->norm2_x;
+        const double rho             = decrease_actual / decrease_predicted;
+
+        if(verbose)
+            MSG("Iteration %d: norm2 %g -> %g, lambda %g, rho %g, step infnorm %g",
+                iteration, current->norm2_x, trial->norm2_x, lambda, rho, delta_infnorm);
+
+        if(decrease_predicted > 0.0 && rho > 0.0)
+        {
+            memcpy(p, p_new, Nstate*sizeof(double));
+            operating_point_t* t = current;
+            current = trial;
+            trial   = t;
+
+            if(delta_infnorm < parameters->update_threshold)
+            {
+                if(verbose)
+                    MSG("Step infnorm %g is below the threshold. Done",
+                        delta_infnorm);
+                break;
+            }
+
+            const double r = 2.0*rho - 1.0;
+            double scale = 1.0 - r*r*r;
+            if(scale < 1.0/3.0) scale = 1.0/3.0;
+            lambda *= scale;
+            nu      = 2.0;
+            linearize();
+        }
+        else
+        {
+            lambda *= nu;
+            nu     *= 2.0;
+            if(lambda > 1e16)
+            {
+                // Can't make any more progress. This is where we converged
+                if(verbose)
+                    MSG("No more progress possible. Done");
+                break;
+            }
+        }
+    }
+    if(iteration == parameters->max_iterations)
+        MSG("WARNING: the solver hit max_iterations=%d without converging",
+            parameters->max_iterations);
+
+    if(x_final != NULL)
+        memcpy(x_final, current->x, Nmeasurements*sizeof(double));
+    result = current->norm2_x;
+
+ done:
+    if(!reused)
+    {
+        if(structure != NULL && result >= 0.0)
+            // The caller keeps this structure for the next call
+            *structure = s;
+        else
+        {
+            solver_structure_free_contents(s);
+            if(s != &structure_local)
+                free(s);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+// THESE ARE NOT A PART OF THE EXTERNAL API. The sparse solvers mrcal can use
+// instead of the libdogleg/CHOLMOD one
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <dogleg.h>
+
+#include "mrcal.h"
+
+// The layout of the state vector, in blocks of variables that are coupled
+// tightly. Each camera's intrinsics and extrinsics are a block, and so is each
+// frame, each point and the calobject_warp.
+//
+// In a calibration problem each measurement depends on at most one frame pose
+// or one discrete point, so the frames/points part of JtJ is block-diagonal.
+// The Schur-complement solver eliminates those blocks. The PCG solver uses all
+// the blocks to precondition
+typedef struct
+{
+    // The intrinsics start at 0
+    int Ncameras_intrinsics, Nintrinsics_state;
+
+    int istate_extrinsics,     Ncameras_extrinsics;
+    int istate_frames,         Nframes;
+    int istate_points,         Npoints;
+    int istate_calobject_warp, Ncalobject_warp;
+} solver_blocks_t;
+
+// The solver state that depends only on the sparsity pattern of the jacobian:
+// the block structure of the problem, the dense runs in each row of the
+// jacobian, the CHOLMOD symbolic analysis, and the buffers. The pattern is
+// fixed for a given problem (the outliers are stored as explicit 0), so
+// mrcal_problem_t keeps this across the outlier-rejection rounds, and across
+// solves. Opaque
+typedef struct solver_structure_t solver_structure_t;
+void _mrcal_solver_structure_free(solver_structure_t* structure);
+
+// Levenberg-Marquardt optimization, using a linear solver other than
+// libdogleg's:
+//
+// - MRCAL_SOLVER_SCHUR: the frames and points are eliminated from the normal
+//   equations (the Schur complement). The reduced system contains only the
+//   camera parameters, and is factored densely. So this is only for lens
+//   models with few parameters: reduced systems of more than a few thousand
+//   variables are rejected
+//
+// - MRCAL_SOLVER_PCG: preconditioned conjugate gradients, using matrix-free
+//   Jt (J v) products, and a block-Jacobi preconditioner
+//
+// - MRCAL_SOLVER_CHOLMOD_LM: the full sparse JtJ is factored with CHOLMOD. The
+//   symbolic analysis is a part of the solver structure, so it's done once
+//
+// The optimization is controlled by max_iterations, update_threshold and
+// Jt_x_threshold in the libdogleg parameters.
+//
+// p is the seed on input and the optimum on output. If x_final is non-NULL,
+// the measurements at the optimum are written there. Returns norm2(x) at the
+// optimum, or <0 on error
+//
+// structure may be NULL: the solver structure is then built and freed in this
+// call. Otherwise a non-NULL *structure from a previous call for the same
+// problem is reused, and a new one is built and returned in *structure if
+// needed. The caller frees it with _mrcal_solver_structure_free()
+//
+// The jacobian uses 64-bit indices (CHOLMOD_LONG) if N_j_nonzero doesn't fit in
+// an int, so the problem size is limited only by the available memory
+double _mrcal_optimize_sparse(// in,out
+                              double* p,
+                              // out. May be NULL
+                              double* x_final,
+
+                              // in
+                              int Nstate, int Nmeasurements, int64_t N_j_nonzero,
+                              dogleg_callback_t* callback, void* cookie,
+                              const dogleg_parameters2_t* parameters,
+                              const solver_blocks_t* blocks,
+                              mrcal_solver_t solver,
+                              bool verbose,
+                              // in,out. May be NULL
+                              solver_structure_t** structure);
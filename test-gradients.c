@@ -29,7 +29,12 @@ int main(int argc, char* argv[] )
         "  calobject-warp\n"
         "\n"
         "If no selections are given, we optimize everything. Otherwise, we start with an empty\n"
-        "mrcal_problem_selections_t, and each argument sets a bit\n";
+        "mrcal_problem_selections_t, and each argument sets a bit\n"
+        "\n"
+        "The reprojection errors use the squared loss. A robust loss may be selected with\n"
+        "one of these arguments:\n"
+        "  loss-huber\n"
+        "  loss-cauchy\n";
 
     if( argc >= 2 && argv[1][0] == '-' )
     {
@@ -38,6 +43,7 @@ int main(int argc, char* argv[] )
     }
 
     mrcal_problem_selections_t problem_selections = {};
+    mrcal_loss_t               loss               = MRCAL_LOSS_SQUARED;
 
 
     int iarg = 1;
@@ -107,6 +113,16 @@ int main(int argc, char* argv[] )
                 problem_selections.do_optimize_calobject_warp = true;
                 continue;
             }
+            if( 0 == strcmp(argv[iarg], "loss-huber" ) )
+            {
+                loss = MRCAL_LOSS_HUBER;
+                continue;
+            }
+            if( 0 == strcmp(argv[iarg], "loss-cauchy" ) )
+            {
+                loss = MRCAL_LOSS_CAUCHY;
+                continue;
+            }
 
             fprintf(stderr, "Unknown optimization variable '%s'. Giving up.\n\n", argv[iarg]);
             fprintf(stderr, usage, argv[0]);
@@ -353,7 +369,9 @@ int main(int argc, char* argv[] )
 
     mrcal_problem_constants_t problem_constants =
         { .point_min_range =  30.0,
-          .point_max_range = 180.0};
+          .point_max_range = 180.0,
+          .loss            = loss,
+          .loss_scale      = 1.0};
 
     mrcal_optimize( NULL,0, NULL,0,
                     intrinsics,
@@ -382,7 +400,8 @@ int main(int argc, char* argv[] )
                     calibration_object_height_n,
 
                     false,
-                    true);
+                    true,
+                    NULL);
 
     return 0;
 }
@@ -49,4 +49,23 @@ testutils.confirm_equal(xt, xt_ref,
                         eps       = 1e-6,
                         msg       = "solve_xt_JtJ_bt produces the correct result")
 
+# Huge problems have jacobians with 64-bit indices. The factorization should
+# work the same way with those. scipy shrinks the indices to 32 bits if it can,
+# so I set them explicitly
+Jsparse_int64 = csr_matrix((data, indices, indptr))
+Jsparse_int64.indices = Jsparse_int64.indices.astype(np.int64)
+Jsparse_int64.indptr  = Jsparse_int64.indptr .astype(np.int64)
+testutils.confirm(Jsparse_int64.indices.dtype == np.int64 and \
+                  Jsparse_int64.indptr .dtype == np.int64,
+                  msg = "The sparse J has 64-bit indices")
+
+F_int64  = mrcal.CHOLMOD_factorization(Jsparse_int64)
+xt_int64 = F_int64.solve_xt_JtJ_bt(bt)
+
+testutils.confirm_equal(xt_int64, xt,
+                        relative  = True,
+                        worstcase = True,
+                        eps       = 1e-12,
+                        msg       = "solve_xt_JtJ_bt produces the same result with 64-bit indices")
+
 testutils.finish()
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../mrcal.h"
+
+#include "test-harness.h"
+
+/* Binary camera models are normally written by mrcal.cameramodel.write() in
+   Python. Here I construct one by hand, as described in mrcal.h, and make sure
+   that it's parsed properly, both from a buffer and from a memory-mapped file.
+   Corrupted models must be rejected
+ */
+
+#define ALIGNMENT MRCAL_CAMERAMODEL_BINARY_ALIGNMENT
+
+static uint8_t buffer[4096] __attribute__((aligned(ALIGNMENT)));
+
+static size_t make_model(void)
+{
+    memset(buffer, 0, sizeof(buffer));
+
+    const int Nsections = 6;
+    mrcal_cameramodel_binary_header_t*  header   = (mrcal_cameramodel_binary_header_t*)buffer;
+    mrcal_cameramodel_binary_section_t* sections = (mrcal_cameramodel_binary_section_t*)&header[1];
+    uint64_t offset = sizeof(*header) + Nsections*sizeof(*sections);
+
+    int isection = 0;
+    void add(const char* name, const char* dtype,
+             int Ndims, const uint64_t* shape,
+             const void* data, uint64_t size)
+    {
+        offset = (offset + ALIGNMENT-1) / ALIGNMENT * ALIGNMENT;
+
+        mrcal_cameramodel_binary_section_t* s = &sections[isection++];
+        strcpy(s->name,  name);
+        strcpy(s->dtype, dtype);
+        s->Ndims  = Ndims;
+        for(int i=0; i<Ndims; i++) s->shape[i] = shape[i];
+        s->offset = offset;
+        s->size   = size;
+        memcpy(&buffer[offset], data, size);
+        offset += size;
+    }
+
+    const char   lensmodel[]  = "LENSMODEL_OPENCV4";
+    const double intrinsics[] = {1000., 1010., 500., 300., 0.1, -0.05, 0.001, 0.002};
+    const double rt_cam_ref[] = {0.1, 0.2, 0.3, 1., 2., 3.};
+    const int32_t imagersize[] = {1000, 600};
+    const double region[]     = {0,0, 0,10, 10,10, 0,0};
+    const int32_t icam_intrinsics = 2;
+
+    add("lensmodel",  "str", 1, (uint64_t[]){sizeof(lensmodel)},
+        lensmodel,  sizeof(lensmodel));
+    add("intrinsics", "<f8", 1, (uint64_t[]){8},
+        intrinsics, sizeof(intrinsics));
+    add("extrinsics", "<f8", 1, (uint64_t[]){6},
+        rt_cam_ref, sizeof(rt_cam_ref));
+    add("imagersize", "<i4", 1, (uint64_t[]){2},
+        imagersize, sizeof(imagersize));
+    add("valid_intrinsics_region", "<f8", 2, (uint64_t[]){4,2},
+        region, sizeof(region));
+    add("icam_intrinsics", "<i4", 0, NULL,
+        &icam_intrinsics, sizeof(icam_intrinsics));
+
+    offset = (offset + ALIGNMENT-1) / ALIGNMENT * ALIGNMENT;
+    memcpy(header->magic, MRCAL_CAMERAMODEL_BINARY_MAGIC, sizeof(header->magic));
+    header->version   = MRCAL_CAMERAMODEL_BINARY_VERSION;
+    header->Nsections = Nsections;
+    header->size      = offset;
+    return offset;
+}
+
+static void check_model(const mrcal_cameramodel_binary_t* model)
+{
+    confirm_eq_int(model->lensmodel.type, MRCAL_LENSMODEL_OPENCV4);
+    confirm_eq_int(model->Nintrinsics, 8);
+    confirm_eq_double(model->intrinsics[1],  1010., 1e-12);
+    confirm_eq_double(model->intrinsics[7],  0.002, 1e-12);
+    confirm_eq_double(model->rt_cam_ref[5],  3.,    1e-12);
+    confirm_eq_int(model->imagersize[0], 1000);
+    confirm_eq_int(model->imagersize[1], 600);
+    confirm(model->valid_intrinsics_region != NULL);
+    confirm_eq_int(model->Nvalid_intrinsics_region, 4);
+    confirm_eq_double(model->valid_intrinsics_region[5], 10., 1e-12);
+    confirm_eq_int(model->icam_intrinsics, 2);
+
+    const mrcal_cameramodel_binary_section_t* section;
+    const double* extrinsics =
+        mrcal_cameramodel_binary_find(&section, model, "extrinsics");
+    confirm(extrinsics == model->rt_cam_ref);
+    confirm_eq_int((int)section->shape[0], 6);
+    confirm(NULL == mrcal_cameramodel_binary_find(NULL, model, "optimization_inputs/intrinsics"));
+}
+
+int main(int argc, char* argv[])
+{
+    mrcal_cameramodel_binary_t model;
+
+    size_t size = make_model();
+    confirm(mrcal_cameramodel_binary_parse(&model, buffer, size));
+    check_model(&model);
+
+    // The data is used in-place
+    confirm((const uint8_t*)model.intrinsics >= buffer &&
+            (const uint8_t*)model.intrinsics <  &buffer[size]);
+
+    // Memory-mapped from a file
+    char filename[] = "/tmp/test-cameramodel-binary.XXXXXX";
+    int fd = mkstemp(filename);
+    confirm(fd >= 0);
+    if(fd >= 0)
+    {
+        confirm(write(fd, buffer, size) == (ssize_t)size);
+        close(fd);
+
+        confirm(mrcal_cameramodel_binary_map(&model, filename));
+        confirm(model.mapped);
+        check_model(&model);
+        mrcal_cameramodel_binary_unmap(&model);
+
+        // The generic reader recognizes binary models too
+        mrcal_cameramodel_t* cameramodel = mrcal_read_cameramodel_file(filename);
+        confirm(cameramodel != NULL);
+        if(cameramodel != NULL)
+        {
+            confirm_eq_int(cameramodel->lensmodel.type, MRCAL_LENSMODEL_OPENCV4);
+            confirm_eq_double(cameramodel->intrinsics[7], 0.002, 1e-12);
+            confirm_eq_double(cameramodel->rt_cam_ref[5], 3.,    1e-12);
+            confirm_eq_int(cameramodel->imagersize[1], 600);
+            mrcal_free_cameramodel(&cameramodel);
+        }
+        unlink(filename);
+    }
+    confirm(!mrcal_cameramodel_binary_map(&model, "/nonexistent/model.cameramodelb"));
+
+    // Corrupted models are rejected
+    mrcal_cameramodel_binary_header_t*  header   = (mrcal_cameramodel_binary_header_t*)buffer;
+    mrcal_cameramodel_binary_section_t* sections = (mrcal_cameramodel_binary_section_t*)&header[1];
+
+    // truncated
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size - ALIGNMENT));
+    // not a model
+    make_model();
+    buffer[0] = 'X';
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+    // from the future
+    make_model();
+    header->version = MRCAL_CAMERAMODEL_BINARY_VERSION + 1;
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+    // misaligned
+    make_model();
+    confirm(!mrcal_cameramodel_binary_parse(&model, &buffer[8], size - 8));
+    // a section points past the end
+    make_model();
+    sections[1].offset = size;
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+    // the size doesn't match the shape
+    make_model();
+    sections[1].shape[0] = 7;
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+    // the intrinsics don't match the lens model
+    make_model();
+    strcpy((char*)&buffer[sections[0].offset], "LENSMODEL_OPENCV5");
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+    // a required section is missing
+    make_model();
+    strcpy(sections[3].name, "imagersize_");
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+    // unknown dtype
+    make_model();
+    strcpy(sections[2].dtype, "<c16");
+    confirm(!mrcal_cameramodel_binary_parse(&model, buffer, size));
+
+    TEST_FOOTER();
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+
+#include "../mrcal.h"
+
+#include "test-harness.h"
+
+/* mrcal_read_cameramodel_...() read .cameramodel files in C. I read the models
+   in test/data, and a number of hand-written models that exercise the parts of
+   the syntax that mrcal can write: comments, trailing commas, both kinds of
+   quotes, nested lists, bytes, and the legacy key names. Invalid models must be
+   rejected
+ */
+
+static void check_string(const char* string,
+                         const char* lensmodel_name,
+                         const double* intrinsics,
+                         const double* rt_cam_ref,
+                         unsigned int width, unsigned int height)
+{
+    mrcal_cameramodel_t* model = mrcal_read_cameramodel_string(string, 0);
+    confirm(model != NULL);
+    if(model == NULL)
+        return;
+
+    char name[1024];
+    confirm(mrcal_lensmodel_name(name, sizeof(name), model->lensmodel));
+    confirm(0 == strcmp(name, lensmodel_name));
+
+    const int Nintrinsics = mrcal_lensmodel_num_params(model->lensmodel);
+    for(int i=0; i<Nintrinsics; i++)
+        confirm_eq_double(model->intrinsics[i], intrinsics[i], 1e-12);
+    for(int i=0; i<6; i++)
+        confirm_eq_double(model->rt_cam_ref[i], rt_cam_ref[i], 1e-12);
+    confirm_eq_int(model->imagersize[0], width);
+    confirm_eq_int(model->imagersize[1], height);
+
+    mrcal_free_cameramodel(&model);
+    confirm(model == NULL);
+}
+
+int main(int argc, char* argv[])
+{
+    const double intrinsics[] = {1761.181055, 1761.250444, 1965.706996, 1087.518797,
+                                 -0.01266096516, 0.03590794372, -0.0002547045941, 0.0005275929652,
+                                 0.01968883397, 0.01482863541, -0.0562239888, 0.0500223357};
+    const double rt_cam_ref[] = {2e-2, -3e-1, -1e-2, 1., 2, -3.};
+
+    // The model on disk
+    char filename[1024];
+    snprintf(filename, sizeof(filename), "%s/data/cam0.opencv8.cameramodel",
+             dirname(strdup(argv[0])));
+    mrcal_cameramodel_t* model = mrcal_read_cameramodel_file(filename);
+    confirm(model != NULL);
+    if(model != NULL)
+    {
+        confirm_eq_int(model->lensmodel.type, MRCAL_LENSMODEL_OPENCV8);
+        for(int i=0; i<12; i++)
+            confirm_eq_double(model->intrinsics[i], intrinsics[i], 1e-12);
+        for(int i=0; i<6; i++)
+            confirm_eq_double(model->rt_cam_ref[i], rt_cam_ref[i], 1e-12);
+        confirm_eq_int(model->imagersize[0], 4000);
+        confirm_eq_int(model->imagersize[1], 2200);
+        mrcal_free_cameramodel(&model);
+    }
+    confirm(NULL == mrcal_read_cameramodel_file("/nonexistent/model.cameramodel"));
+
+    // Everything mrcal writes, with the keys in an unusual order
+    check_string("# a comment\n"
+                 "{\n"
+                 "  \"imagersize\": [ 640, 480, ],\n"
+                 "  'valid_intrinsics_region': [\n"
+                 "  [ 0, 0 ],\n"
+                 "  [ 10, 10 ],\n"
+                 "  ],\n"
+                 "  # intrinsics are fx,fy,cx,cy,distortion0,distortion1,....\n"
+                 "  'intrinsics': [ 1761.181055, 1761.250444, 1965.706996, 1087.518797,],\n"
+                 "  'extrinsics': [ 2e-2, -3e-1, -1e-2,  1., 2, -3., ],\n"
+                 "  'icam_intrinsics': 1,\n"
+                 "  'optimization_inputs': b'ABC}]#\\'xyz',\n"
+                 "  'lensmodel': 'LENSMODEL_PINHOLE',\n"
+                 "}\n",
+                 "LENSMODEL_PINHOLE", intrinsics, rt_cam_ref, 640, 480);
+
+    // Legacy key and lens model names. No trailing comma
+    check_string("{'distortion_model': 'DISTORTION_OPENCV4',"
+                 " 'intrinsics': [1761.181055, 1761.250444, 1965.706996, 1087.518797,"
+                 "                -0.01266096516, 0.03590794372, -0.0002547045941, 0.0005275929652],"
+                 " 'extrinsics': [2e-2, -3e-1, -1e-2, 1., 2, -3.],"
+                 " 'imagersize': [4000, 2200]}",
+                 "LENSMODEL_OPENCV4", intrinsics, rt_cam_ref, 4000, 2200);
+
+    // Invalid models
+    const char* invalid[] =
+        { // missing 'imagersize'
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0]}",
+          // the wrong number of intrinsics
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]}",
+          // the wrong number of extrinsics
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0], 'imagersize': [1,1]}",
+          // non-integer imagersize
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1.5,1]}",
+          // unknown lens model
+          "{'lensmodel': 'LENSMODEL_XXX', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]}",
+          // not a number
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,x], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]}",
+          // unterminated string
+          "{'lensmodel': 'LENSMODEL_PINHOLE, 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]}",
+          // unterminated dict
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]",
+          // garbage at the end
+          "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]} x",
+          "" };
+    for(int i=0; i<(int)(sizeof(invalid)/sizeof(invalid[0])); i++)
+        confirm(NULL == mrcal_read_cameramodel_string(invalid[i], 0));
+
+    // The length is respected: the string doesn't need to be NUL-terminated
+    const char* s = "{'lensmodel': 'LENSMODEL_PINHOLE', 'intrinsics': [1,2,3,4], 'extrinsics': [0,0,0,0,0,0], 'imagersize': [1,1]} garbage";
+    model = mrcal_read_cameramodel_string(s, (int)(strchr(s,'}') - s + 1));
+    confirm(model != NULL);
+    mrcal_free_cameramodel(&model);
+
+    TEST_FOOTER();
+}
@@ -96,4 +96,101 @@ m1 = mrcal.cameramodel(f'{workdir}/out.cameramodel')
 testutils.confirm_equal( m1.valid_intrinsics_region(), r_empty,
                          "read empty valid_intrinsics_region properly")
 
+# The binary format. Everything survives a write/read cycle, including the
+# valid-intrinsics region and the optimization inputs
+m.valid_intrinsics_region(r_open)
+optimization_inputs = dict( intrinsics            = np.arange(24, dtype=float).reshape(2,12),
+                            extrinsics_rt_fromref = np.arange(6,  dtype=float).reshape(1,6) / 10.,
+                            indices_frame_camintrinsics_camextrinsics = np.arange(12, dtype=np.int32).reshape(4,3),
+                            lensmodel             = 'LENSMODEL_OPENCV8',
+                            do_optimize_frames    = True,
+                            verbose               = False,
+                            Npoints_fixed         = 3,
+                            point_min_range       = 1.5,
+                            observations_point    = None )
+m.intrinsics( m.intrinsics(),
+              optimization_inputs = optimization_inputs,
+              icam_intrinsics     = 1 )
+m.write(f'{workdir}/out.cameramodel', binary = True)
+
+with open(f'{workdir}/out.cameramodel', 'rb') as f:
+    testutils.confirm( f.read(8) == b'MRCALBIN',
+                       msg = "binary=True writes a binary model")
+
+m1 = mrcal.cameramodel(f'{workdir}/out.cameramodel')
+testutils.confirm_equal( m1.intrinsics()[0], m.intrinsics()[0],
+                         msg = "binary model: lensmodel")
+testutils.confirm_equal( m1.intrinsics()[1], m.intrinsics()[1],
+                         worstcase = True, eps = 0,
+                         msg = "binary model: intrinsics")
+testutils.confirm_equal( m1.extrinsics_rt_fromref(), m.extrinsics_rt_fromref(),
+                         worstcase = True, eps = 0,
+                         msg = "binary model: extrinsics")
+testutils.confirm_equal( m1.imagersize(), m.imagersize(),
+                         msg = "binary model: imagersize")
+testutils.confirm_equal( m1.valid_intrinsics_region(), r_closed,
+                         msg = "binary model: valid_intrinsics_region")
+testutils.confirm_equal( m1.icam_intrinsics(), 1,
+                         msg = "binary model: icam_intrinsics")
+
+optimization_inputs1 = m1.optimization_inputs()
+testutils.confirm_equal( sorted(optimization_inputs1.keys()), sorted(optimization_inputs.keys()),
+                         msg = "binary model: optimization_inputs keys")
+for k in optimization_inputs.keys():
+    v0 = optimization_inputs [k]
+    v1 = optimization_inputs1[k]
+    if isinstance(v0, np.ndarray):
+        testutils.confirm( isinstance(v1, np.ndarray) and \
+                           v1.dtype == v0.dtype and \
+                           v1.flags['WRITEABLE'],
+                           msg = f"binary model: optimization_inputs['{k}'] is a writeable array with the right dtype")
+        testutils.confirm_equal( v1, v0,
+                                 worstcase = True, eps = 0,
+                                 msg = f"binary model: optimization_inputs['{k}']")
+    else:
+        testutils.confirm( type(v1) is type(v0) and v1 == v0,
+                           msg = f"binary model: optimization_inputs['{k}']")
+
+# The getters return copies, even though the binary model is memory-mapped
+intrinsics = m1.intrinsics()[1]
+intrinsics[0] += 1.
+testutils.confirm_equal( m1.intrinsics()[1], m.intrinsics()[1],
+                         worstcase = True, eps = 0,
+                         msg = "binary model: the getters return copies")
+
+# Converting back to text preserves everything
+m1.write(f'{workdir}/out-text.cameramodel')
+m2 = mrcal.cameramodel(f'{workdir}/out-text.cameramodel')
+testutils.confirm_equal( m2.intrinsics()[1], m.intrinsics()[1],
+                         worstcase = True, eps = 0,
+                         msg = "binary -> text: intrinsics")
+testutils.confirm_equal( m2.optimization_inputs()['intrinsics'], optimization_inputs['intrinsics'],
+                         worstcase = True, eps = 0,
+                         msg = "binary -> text: optimization_inputs")
+testutils.confirm_equal( m2.optimization_inputs()['lensmodel'], 'LENSMODEL_OPENCV8',
+                         msg = "binary -> text: optimization_inputs strings")
+
+# Copying a binary model
+m3 = mrcal.cameramodel(m1)
+testutils.confirm_equal( m3.optimization_inputs()['extrinsics_rt_fromref'],
+                         optimization_inputs['extrinsics_rt_fromref'],
+                         worstcase = True, eps = 0,
+                         msg = "binary model: copy")
+
+# A model given as a bytes object
+with open(f'{workdir}/out.cameramodel', 'rb') as f:
+    m4 = mrcal.cameramodel(f.read())
+testutils.confirm_equal( m4.intrinsics()[1], m.intrinsics()[1],
+                         worstcase = True, eps = 0,
+                         msg = "binary model: read from bytes")
+
+# A truncated model is rejected
+with open(f'{workdir}/out.cameramodel', 'rb') as f:
+    b = f.read()
+try:
+    mrcal.cameramodel(b[:len(b)//2])
+    testutils.confirm(False, msg = "binary model: truncated model is rejected")
+except Exception:
+    testutils.confirm(True,  msg = "binary model: truncated model is rejected")
+
 testutils.finish()
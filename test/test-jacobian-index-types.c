@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <suitesparse/cholmod.h>
+
+#include "../mrcal.h"
+
+#include "test-harness.h"
+
+/* mrcal_optimizer_callback() writes the jacobian with 32-bit (CHOLMOD_INT) or
+   64-bit (CHOLMOD_LONG) indices, as selected by Jt->itype. Huge problems need
+   the latter. Small problems don't, but they can still ask for it. So I
+   evaluate a small problem both ways, and make sure that the results are
+   identical: the same measurements, the same jacobian values and the same
+   sparsity pattern */
+
+#define Ncameras     2
+#define Nframes      3
+#define Npoints      2
+#define W            4
+#define H            3
+#define SPACING      0.1
+
+static const mrcal_problem_selections_t problem_selections =
+    { .do_optimize_intrinsics_core        = true,
+      .do_optimize_intrinsics_distortions = true,
+      .do_optimize_extrinsics             = true,
+      .do_optimize_frames                 = true,
+      .do_optimize_calobject_warp         = true,
+      .do_apply_regularization            = true };
+
+static bool evaluate(// out
+                     double* p_packed, double* x, cholmod_sparse* Jt,
+                     // in
+                     int Nstate, int Nmeasurements,
+                     const double* intrinsics,
+                     const mrcal_pose_t* extrinsics,
+                     const mrcal_pose_t* frames,
+                     const mrcal_point3_t* points,
+                     const mrcal_point2_t* calobject_warp,
+                     const mrcal_observation_board_t* observations_board,
+                     const mrcal_observation_point_t* observations_point,
+                     const mrcal_point3_t* observations_board_pool,
+                     mrcal_lensmodel_t lensmodel,
+                     const int* imagersizes)
+{
+    mrcal_problem_constants_t problem_constants =
+        { .point_min_range = 0.1,
+          .point_max_range = 100.,
+          .Nthreads        = 2 };
+
+    return
+        mrcal_optimizer_callback(p_packed, Nstate*sizeof(double),
+                                 x,        Nmeasurements*sizeof(double),
+                                 Jt,
+                                 intrinsics, extrinsics, frames, points, calobject_warp,
+                                 Ncameras, Ncameras-1, Nframes,
+                                 Npoints, 0,
+                                 observations_board,
+                                 observations_point,
+                                 Ncameras*Nframes,
+                                 Ncameras*Npoints,
+                                 observations_board_pool,
+                                 lensmodel,
+                                 1.0,
+                                 imagersizes,
+                                 problem_selections, &problem_constants,
+                                 SPACING, W, H,
+                                 false,
+                                 NULL);
+}
+
+int main(int argc, char* argv[])
+{
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name("LENSMODEL_OPENCV4");
+
+    const double intrinsics[Ncameras][8] =
+        { {1500., 1510., 1000., 760., -0.1,  0.02,  0.001, -0.002},
+          {1450., 1460., 990.,  740., -0.08, 0.015, 0.002,  0.001} };
+    const int imagersizes[Ncameras*2] = {2000, 1500, 2000, 1500};
+
+    const mrcal_pose_t   extrinsics[Ncameras-1] =
+        { { .r = {.xyz = {0.01, -0.2, 0.005}}, .t = {.xyz = {0.3, 0.01, -0.02}} } };
+    mrcal_pose_t         frames[Nframes];
+    mrcal_point3_t       points[Npoints];
+    const mrcal_point2_t calobject_warp = {.x = 0.001, .y = -0.002};
+
+    for(int i=0; i<Nframes; i++)
+        frames[i] = (mrcal_pose_t)
+            { .r = {.xyz = {  0.3*sin(i),  0.3*cos(1.3*i), 0.1*sin(2.*i) }},
+              .t = {.xyz = { -0.15 + 0.1*sin(3.*i), -0.1 + 0.1*cos(i), 2. + 0.3*sin(0.7*i) }} };
+    for(int i=0; i<Npoints; i++)
+        points[i] = (mrcal_point3_t){ .x = -0.5 + 0.2*i,
+                                      .y = 0.3*sin(i),
+                                      .z = 3. + 0.5*cos(i) };
+
+    // The observations don't need to be consistent with the geometry: I'm not
+    // solving anything
+    mrcal_observation_board_t observations_board     [Ncameras*Nframes];
+    mrcal_point3_t            observations_board_pool[Ncameras*Nframes*W*H];
+    mrcal_observation_point_t observations_point     [Ncameras*Npoints];
+    for(int icam=0; icam<Ncameras; icam++)
+    {
+        for(int iframe=0; iframe<Nframes; iframe++)
+            observations_board[icam*Nframes + iframe] = (mrcal_observation_board_t)
+                { .icam   = { .intrinsics = icam, .extrinsics = icam-1 },
+                  .iframe = iframe };
+        for(int i=0; i<Npoints; i++)
+            observations_point[icam*Npoints + i] = (mrcal_observation_point_t)
+                { .icam    = { .intrinsics = icam, .extrinsics = icam-1 },
+                  .i_point = i,
+                  .px      = { .x = 900. + 10.*i, .y = 700. - 5.*i, .z = 1.0 } };
+    }
+    for(int i=0; i<Ncameras*Nframes*W*H; i++)
+        observations_board_pool[i] = (mrcal_point3_t){ .x = 800. + 3.*(i%W),
+                                                       .y = 600. + 2.*(i/W),
+                                                       .z = 1.0 };
+    // An outlier
+    observations_board_pool[5].z = -1.0;
+
+    const int Nstate =
+        mrcal_num_states(Ncameras, Ncameras-1, Nframes, Npoints, 0, Ncameras*Nframes,
+                         problem_selections, lensmodel);
+    const int Nmeasurements =
+        mrcal_num_measurements(Ncameras*Nframes, Ncameras*Npoints, W, H,
+                               Ncameras, Ncameras-1, Nframes, Npoints, 0,
+                               problem_selections, lensmodel);
+    const int64_t N_j_nonzero =
+        _mrcal_num_j_nonzero(Ncameras*Nframes, Ncameras*Npoints, W, H,
+                             Ncameras, Ncameras-1, Nframes, Npoints, 0,
+                             observations_board, observations_point,
+                             problem_selections, lensmodel);
+
+    double p_int [Nstate],        p_long [Nstate];
+    double x_int [Nmeasurements], x_long [Nmeasurements];
+    int     Jp_int [Nmeasurements+1];
+    int     Ji_int [N_j_nonzero];
+    double  Jx_int [N_j_nonzero];
+    int64_t Jp_long[Nmeasurements+1];
+    int64_t Ji_long[N_j_nonzero];
+    double  Jx_long[N_j_nonzero];
+
+    cholmod_sparse Jt_int =
+        { .nrow   = Nstate,
+          .ncol   = Nmeasurements,
+          .nzmax  = N_j_nonzero,
+          .p      = Jp_int,
+          .i      = Ji_int,
+          .x      = Jx_int,
+          .stype  = 0,
+          .itype  = CHOLMOD_INT,
+          .xtype  = CHOLMOD_REAL,
+          .dtype  = CHOLMOD_DOUBLE,
+          .sorted = 1,
+          .packed = 1 };
+    cholmod_sparse Jt_long = Jt_int;
+    Jt_long.p     = Jp_long;
+    Jt_long.i     = Ji_long;
+    Jt_long.x     = Jx_long;
+    Jt_long.itype = CHOLMOD_LONG;
+
+    confirm(evaluate(p_int, x_int, &Jt_int,
+                     Nstate, Nmeasurements,
+                     &intrinsics[0][0], extrinsics, frames, points, &calobject_warp,
+                     observations_board, observations_point, observations_board_pool,
+                     lensmodel, imagersizes));
+    confirm(evaluate(p_long, x_long, &Jt_long,
+                     Nstate, Nmeasurements,
+                     &intrinsics[0][0], extrinsics, frames, points, &calobject_warp,
+                     observations_board, observations_point, observations_board_pool,
+                     lensmodel, imagersizes));
+
+    confirm(0 == memcmp(p_int, p_long, sizeof(p_int)));
+    confirm(0 == memcmp(x_int, x_long, sizeof(x_int)));
+    confirm(0 == memcmp(Jx_int, Jx_long, sizeof(Jx_int)));
+
+    confirm_eq_int((int)Jp_long[Nmeasurements], (int)N_j_nonzero);
+    bool same_pattern = true;
+    for(int i=0; i<=Nmeasurements; i++)
+        if(Jp_int[i] != Jp_long[i])
+            same_pattern = false;
+    for(int64_t i=0; i<N_j_nonzero; i++)
+        if(Ji_int[i] != Ji_long[i])
+            same_pattern = false;
+    confirm(same_pattern);
+
+    TEST_FOOTER();
+}
@@ -150,6 +150,16 @@ for kwargs in all_test_kwargs:
     x,J = mrcal.optimizer_callback( **optimization_inputs )[1:3]
     J = J.toarray()
 
+    # the threaded evaluation must produce exactly the same result
+    x_threaded,J_threaded = mrcal.optimizer_callback( **optimization_inputs,
+                                                      Nthreads = 3 )[1:3]
+    testutils.confirm_equal( x_threaded, x,
+                             worstcase = True, eps = 0,
+                             msg = f"threaded x identical for case {itest}")
+    testutils.confirm_equal( J_threaded.toarray(), J,
+                             worstcase = True, eps = 0,
+                             msg = f"threaded J identical for case {itest}")
+
     # let's make sure that pack and unpack work correctly
     J2 = J.copy()
     mrcal.pack_state(   J2, **optimization_inputs)
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../mrcal.h"
+#include "../poseutils.h"
+
+#include "test-harness.h"
+
+/* Applications that solve many problems can keep the optimizer's scratch memory
+   in a mrcal_workspace_t, and pass it to each solve. The workspace grows as
+   needed, and is never shrunk. So a solve of a small problem after a big one
+   uses a buffer that's larger than it needs, laid out for the small problem.
+
+   I make a big and a small synthetic problem (different numbers of cameras,
+   frames, points and different chessboard sizes), and solve them alternately,
+   all using the same workspace. Each solution must be identical to a solution
+   of the same problem without a shared workspace
+
+   Applications that solve the same problem repeatedly can also keep the whole
+   problem in a mrcal_problem_t. I set one up with each solver, and solve it
+   three times: from the seed, from a perturbed seed, and after re-weighting
+   some of the observations. Each solution must be identical to a solution from
+   a fresh mrcal_optimize() call, given the same inputs */
+
+#define Ncameras_max 2
+#define Nframes_max  8
+#define Npoints_max  6
+#define W_max        10
+#define H_max        9
+#define SPACING      0.1
+#define NOISE        0.3 // pixels
+
+static const double intrinsics_true[Ncameras_max][8] =
+    { {1500., 1510., 1000., 760., -0.1,  0.02,  0.001, -0.002},
+      {1450., 1460., 990.,  740., -0.08, 0.015, 0.002,  0.001} };
+static const mrcal_pose_t extrinsics_true[Ncameras_max-1] =
+    { { .r = {.xyz = {0.01, -0.2, 0.005}}, .t = {.xyz = {0.3, 0.01, -0.02}} } };
+static const int imagersizes[Ncameras_max*2] = {2000, 1500, 2000, 1500};
+
+// noise in [-NOISE,NOISE]
+static double noise(void)
+{
+    return (drand48()*2. - 1.) * NOISE;
+}
+
+static void transform(double* out, const mrcal_pose_t* rt, const double* in)
+{
+    mrcal_transform_point_rt(out, NULL, NULL, (const double*)rt, in);
+}
+
+typedef struct
+{
+    double         intrinsics[Ncameras_max][8];
+    mrcal_pose_t   extrinsics[Ncameras_max-1];
+    mrcal_pose_t   frames    [Nframes_max];
+    mrcal_point3_t points    [Npoints_max];
+    mrcal_point2_t calobject_warp;
+} state_t;
+
+typedef struct
+{
+    int Ncameras, Nframes, Npoints, W, H;
+
+    state_t                   seed;
+    mrcal_observation_board_t observations_board     [Ncameras_max*Nframes_max];
+    mrcal_point3_t            observations_board_pool[Ncameras_max*Nframes_max*W_max*H_max];
+    mrcal_observation_point_t observations_point     [Ncameras_max*Npoints_max];
+} problem_t;
+
+// Each camera observes each frame and each point. The seed is the truth,
+// perturbed
+static void make_problem(// out
+                         problem_t* problem,
+                         // in
+                         int Ncameras, int Nframes, int Npoints, int W, int H)
+{
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name("LENSMODEL_OPENCV4");
+
+    *problem = (problem_t){ .Ncameras = Ncameras,
+                            .Nframes  = Nframes,
+                            .Npoints  = Npoints,
+                            .W        = W,
+                            .H        = H };
+
+    state_t truth = {};
+    memcpy(truth.intrinsics, intrinsics_true, sizeof(intrinsics_true));
+    memcpy(truth.extrinsics, extrinsics_true, sizeof(extrinsics_true));
+    for(int i=0; i<Nframes; i++)
+        truth.frames[i] = (mrcal_pose_t)
+            { .r = {.xyz = {  0.3*sin(i),  0.3*cos(1.3*i), 0.1*sin(2.*i) }},
+              .t = {.xyz = { -0.45 + 0.1*sin(3.*i), -0.4 + 0.1*cos(i), 2. + 0.3*sin(0.7*i) }} };
+    for(int i=0; i<Npoints; i++)
+        truth.points[i] = (mrcal_point3_t){ .x = -0.5 + 0.2*i,
+                                            .y = 0.3*sin(i),
+                                            .z = 3. + 0.5*cos(i) };
+
+    for(int icam=0; icam<Ncameras; icam++)
+    {
+        for(int iframe=0; iframe<Nframes; iframe++)
+        {
+            const int iobservation = icam*Nframes + iframe;
+            problem->observations_board[iobservation] = (mrcal_observation_board_t)
+                { .icam   = { .intrinsics = icam, .extrinsics = icam-1 },
+                  .iframe = iframe };
+            for(int y=0; y<H; y++)
+                for(int x=0; x<W; x++)
+                {
+                    double p_ref[3], p_cam[3];
+                    transform(p_ref, &truth.frames[iframe],
+                              (double[]){x*SPACING, y*SPACING, 0.});
+                    if(icam > 0) transform(p_cam, &truth.extrinsics[icam-1], p_ref);
+                    else         memcpy(p_cam, p_ref, sizeof(p_cam));
+
+                    mrcal_point2_t q;
+                    mrcal_project(&q, NULL, NULL,
+                                  (const mrcal_point3_t*)p_cam, 1,
+                                  lensmodel, truth.intrinsics[icam]);
+                    problem->observations_board_pool[(iobservation*H + y)*W + x] =
+                        (mrcal_point3_t){ .x = q.x + noise(),
+                                          .y = q.y + noise(),
+                                          .z = 1.0 };
+                }
+        }
+
+        for(int i=0; i<Npoints; i++)
+        {
+            double p_cam[3];
+            if(icam > 0) transform(p_cam, &truth.extrinsics[icam-1], truth.points[i].xyz);
+            else         memcpy(p_cam, truth.points[i].xyz, sizeof(p_cam));
+
+            mrcal_point2_t q;
+            mrcal_project(&q, NULL, NULL,
+                          (const mrcal_point3_t*)p_cam, 1,
+                          lensmodel, truth.intrinsics[icam]);
+            problem->observations_point[icam*Npoints + i] = (mrcal_observation_point_t)
+                { .icam    = { .intrinsics = icam, .extrinsics = icam-1 },
+                  .i_point = i,
+                  .px      = { .x = q.x + noise(), .y = q.y + noise(), .z = 1.0 } };
+        }
+    }
+
+    problem->seed = truth;
+    for(int icam=0; icam<Ncameras; icam++)
+    {
+        problem->seed.intrinsics[icam][0] *= 1.02;
+        problem->seed.intrinsics[icam][1] *= 0.98;
+        problem->seed.intrinsics[icam][2] += 5.;
+        problem->seed.intrinsics[icam][3] -= 5.;
+        for(int i=4; i<8; i++)
+            problem->seed.intrinsics[icam][i] = 0.;
+    }
+    for(int icam=0; icam<Ncameras-1; icam++)
+    {
+        problem->seed.extrinsics[icam].t.x += 0.01;
+        problem->seed.extrinsics[icam].r.y += 0.01;
+    }
+    for(int i=0; i<Nframes; i++)
+    {
+        problem->seed.frames[i].r.x += 0.01;
+        problem->seed.frames[i].t.z += 0.05;
+    }
+    for(int i=0; i<Npoints; i++)
+        problem->seed.points[i].z += 0.1;
+}
+
+static const mrcal_problem_selections_t problem_selections =
+    { .do_optimize_intrinsics_core        = true,
+      .do_optimize_intrinsics_distortions = true,
+      .do_optimize_extrinsics             = true,
+      .do_optimize_frames                 = true,
+      .do_optimize_calobject_warp         = true,
+      .do_apply_regularization            = true,
+      .do_apply_outlier_rejection         = true };
+
+static mrcal_stats_t solve(// out
+                           state_t* state,
+                           mrcal_point3_t* observations_board_pool,
+                           // in
+                           const problem_t* problem,
+                           const state_t* seed,
+                           const mrcal_point3_t* observations_board_pool_input,
+                           mrcal_solver_t solver,
+                           mrcal_workspace_t* workspace)
+{
+    *state = *seed;
+    memcpy(observations_board_pool, observations_board_pool_input,
+           sizeof(problem->observations_board_pool));
+
+    mrcal_problem_constants_t problem_constants =
+        { .point_min_range = 0.1,
+          .point_max_range = 100.,
+          .solver          = solver };
+
+    return
+        mrcal_optimize(NULL, 0, NULL, 0,
+                       &state->intrinsics[0][0],
+                       state->extrinsics,
+                       state->frames,
+                       state->points,
+                       &state->calobject_warp,
+                       problem->Ncameras, problem->Ncameras-1, problem->Nframes,
+                       problem->Npoints, 0,
+                       problem->observations_board,
+                       problem->observations_point,
+                       problem->Ncameras*problem->Nframes,
+                       problem->Ncameras*problem->Npoints,
+                       observations_board_pool,
+                       mrcal_lensmodel_from_name("LENSMODEL_OPENCV4"),
+                       NOISE,
+                       imagersizes,
+                       problem_selections, &problem_constants,
+                       SPACING, problem->W, problem->H,
+                       false, false, workspace);
+}
+
+static void confirm_same_solution(const mrcal_stats_t*  stats,
+                                  const state_t*        solution,
+                                  const mrcal_point3_t* pool,
+                                  const mrcal_stats_t*  stats_ref,
+                                  const state_t*        solution_ref,
+                                  const mrcal_point3_t* pool_ref)
+{
+    confirm(stats_ref->rms_reproj_error__pixels > 0);
+    confirm(stats->rms_reproj_error__pixels == stats_ref->rms_reproj_error__pixels);
+    confirm_eq_int(stats->Noutliers, stats_ref->Noutliers);
+    confirm(0 == memcmp(solution, solution_ref, sizeof(*solution)));
+    confirm(0 == memcmp(pool, pool_ref,
+                        Ncameras_max*Nframes_max*W_max*H_max*sizeof(mrcal_point3_t)));
+}
+
+static void check_solve(const problem_t* problem, mrcal_workspace_t* workspace)
+{
+    state_t        solution_ref,   solution;
+    mrcal_point3_t pool_ref[Ncameras_max*Nframes_max*W_max*H_max];
+    mrcal_point3_t pool    [Ncameras_max*Nframes_max*W_max*H_max];
+
+    // Unused entries are compared too, so they must match
+    memset(&solution_ref, 0, sizeof(solution_ref));
+    memset(&solution,     0, sizeof(solution));
+
+    mrcal_stats_t stats_ref =
+        solve(&solution_ref, pool_ref,
+              problem, &problem->seed, problem->observations_board_pool,
+              MRCAL_SOLVER_CHOLMOD, NULL);
+    mrcal_stats_t stats =
+        solve(&solution, pool,
+              problem, &problem->seed, problem->observations_board_pool,
+              MRCAL_SOLVER_CHOLMOD, workspace);
+
+    confirm_same_solution(&stats,     &solution,     pool,
+                          &stats_ref, &solution_ref, pool_ref);
+}
+
+// Solves the problem handle from whatever is in state and pool now, and makes
+// sure that a fresh mrcal_optimize() from the same inputs gets the same answer
+static void check_problem_optimize(mrcal_problem_t*      handle,
+                                   const state_t*        state,
+                                   const mrcal_point3_t* pool,
+                                   const problem_t*      problem,
+                                   mrcal_solver_t        solver)
+{
+    state_t        seed = *state;
+    mrcal_point3_t pool_input[Ncameras_max*Nframes_max*W_max*H_max];
+    memcpy(pool_input, pool, sizeof(pool_input));
+
+    mrcal_stats_t stats = mrcal_problem_optimize(NULL, 0, NULL, 0, handle, false);
+
+    state_t        solution_ref;
+    mrcal_point3_t pool_ref[Ncameras_max*Nframes_max*W_max*H_max];
+    mrcal_stats_t  stats_ref =
+        solve(&solution_ref, pool_ref,
+              problem, &seed, pool_input,
+              solver, NULL);
+
+    confirm_same_solution(&stats,     state,         pool,
+                          &stats_ref, &solution_ref, pool_ref);
+}
+
+static void check_problem_handle(const problem_t* problem, mrcal_solver_t solver)
+{
+    // The problem handle references these, so they stay put
+    state_t        state = problem->seed;
+    mrcal_point3_t pool[Ncameras_max*Nframes_max*W_max*H_max];
+    memcpy(pool, problem->observations_board_pool, sizeof(pool));
+
+    mrcal_problem_constants_t problem_constants =
+        { .point_min_range = 0.1,
+          .point_max_range = 100.,
+          .solver          = solver };
+
+    mrcal_problem_t* handle =
+        mrcal_problem_new(&state.intrinsics[0][0],
+                          state.extrinsics,
+                          state.frames,
+                          state.points,
+                          &state.calobject_warp,
+                          problem->Ncameras, problem->Ncameras-1, problem->Nframes,
+                          problem->Npoints, 0,
+                          problem->observations_board,
+                          problem->observations_point,
+                          problem->Ncameras*problem->Nframes,
+                          problem->Ncameras*problem->Npoints,
+                          pool,
+                          mrcal_lensmodel_from_name("LENSMODEL_OPENCV4"),
+                          NOISE,
+                          imagersizes,
+                          problem_selections, &problem_constants,
+                          SPACING, problem->W, problem->H,
+                          false,
+                          NULL);
+    confirm(handle != NULL);
+    if(handle == NULL)
+        return;
+
+    printf("Solving the problem handle from the seed\n");
+    check_problem_optimize(handle, &state, pool, problem, solver);
+
+    // A different seed. The outliers found by the previous solve stay marked
+    printf("Solving the problem handle from a perturbed seed\n");
+    state = problem->seed;
+    for(int icam=0; icam<problem->Ncameras; icam++)
+        state.intrinsics[icam][0] += 10.;
+    for(int i=0; i<problem->Nframes; i++)
+        state.frames[i].t.z -= 0.03;
+    check_problem_optimize(handle, &state, pool, problem, solver);
+
+    // Different weights
+    printf("Solving the problem handle after re-weighting\n");
+    state = problem->seed;
+    for(int i=0; i<problem->Ncameras*problem->Nframes*problem->W*problem->H; i+=3)
+        if(pool[i].z > 0)
+            pool[i].z = 0.5;
+    check_problem_optimize(handle, &state, pool, problem, solver);
+
+    mrcal_problem_free(handle);
+}
+
+int main(int argc, char* argv[])
+{
+    srand48(0);
+
+    static problem_t problem_big, problem_small;
+    make_problem(&problem_big,   2, Nframes_max, Npoints_max, W_max, H_max);
+    make_problem(&problem_small, 1, 3,           0,           6,     5);
+
+    mrcal_workspace_t* workspace = mrcal_workspace_new();
+    confirm(workspace != NULL);
+
+    // The workspace starts empty, and is grown by the first solve. The next
+    // solves use it as is, or grow it
+    printf("Solving the small problem\n");
+    check_solve(&problem_small, workspace);
+    printf("Solving the big problem\n");
+    check_solve(&problem_big,   workspace);
+    printf("Solving the small problem again\n");
+    check_solve(&problem_small, workspace);
+    printf("Solving the big problem again\n");
+    check_solve(&problem_big,   workspace);
+
+    mrcal_workspace_free(workspace);
+
+    const mrcal_solver_t solvers[] = {MRCAL_SOLVER_CHOLMOD, MRCAL_SOLVER_SCHUR, MRCAL_SOLVER_PCG,
+                                      MRCAL_SOLVER_CHOLMOD_LM};
+    for(int isolver=0; isolver<(int)(sizeof(solvers)/sizeof(solvers[0])); isolver++)
+    {
+        printf("Checking the problem handle with solver %d\n", solvers[isolver]);
+        check_problem_handle(&problem_big, solvers[isolver]);
+    }
+
+    TEST_FOOTER();
+}
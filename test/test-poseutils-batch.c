@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../poseutils.h"
+
+#include "test-harness.h"
+
+/* The mrcal_..._batch_full() poseutils functions apply one rotation or
+   transformation to many points at a time. This makes sure that each produces
+   the same results as the per-point functions, with contiguous and strided
+   arrays, when transforming in-place, and with inverted=true
+ */
+
+#define N 37 // not a multiple of any SIMD width, to exercise the leftovers
+
+static double worst_error(const double* x, const double* xref, int n)
+{
+    double worst = 0.0;
+    for(int i=0; i<n; i++)
+    {
+        double err = fabs(x[i] - xref[i]);
+        if(err > worst) worst = err;
+    }
+    return worst;
+}
+
+int main(int argc, char* argv[])
+{
+    const double rt[6] = { 0.3, -0.2, 0.7,   1.5, -3.0, 2.2 };
+    double Rt[4*3];
+    mrcal_Rt_from_rt(Rt, NULL, rt);
+
+    double x_in[N*3];
+    for(int i=0; i<N; i++)
+    {
+        x_in[3*i + 0] = -2.0 + 0.1 *i;
+        x_in[3*i + 1] =  1.0 - 0.05*i;
+        x_in[3*i + 2] =  5.0 + 0.3 *i;
+    }
+
+    // A strided copy of x_in: each point in a row of 5 values, with the
+    // coordinates 2 values apart
+    double x_in_strided[N*5*2];
+    const int x_strided_stride0 = 5*2*sizeof(double);
+    const int x_strided_stride1 = 2*sizeof(double);
+    for(int i=0; i<N; i++)
+        for(int j=0; j<3; j++)
+            x_in_strided[i*5*2 + j*2] = x_in[3*i + j];
+
+    double x_ref[N*3];
+    double x_out[N*3];
+    double x_out_strided[N*5*2];
+
+    for(int inverted=0; inverted<2; inverted++)
+    {
+        // rotate_point_r
+        for(int i=0; i<N; i++)
+            mrcal_rotate_point_r_full(&x_ref[3*i],0, NULL,0,0, NULL,0,0,
+                                      rt,0, &x_in[3*i],0, inverted);
+        mrcal_rotate_point_r_batch_full(x_out,0,0, rt,0, x_in,0,0, N, inverted);
+        confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+
+        mrcal_rotate_point_r_batch_full(x_out_strided, x_strided_stride0, x_strided_stride1,
+                                        rt,0,
+                                        x_in_strided, x_strided_stride0, x_strided_stride1,
+                                        N, inverted);
+        for(int i=0; i<N; i++)
+            for(int j=0; j<3; j++)
+                x_out[3*i + j] = x_out_strided[i*5*2 + j*2];
+        confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+
+        // transform_point_rt
+        for(int i=0; i<N; i++)
+            mrcal_transform_point_rt_full(&x_ref[3*i],0, NULL,0,0, NULL,0,0,
+                                          rt,0, &x_in[3*i],0, inverted);
+        mrcal_transform_point_rt_batch_full(x_out,0,0, rt,0, x_in,0,0, N, inverted);
+        confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+
+        // in-place
+        memcpy(x_out, x_in, sizeof(x_in));
+        mrcal_transform_point_rt_batch_full(x_out,0,0, rt,0, x_out,0,0, N, inverted);
+        confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+    }
+
+    // rotate_point_R
+    for(int i=0; i<N; i++)
+        mrcal_rotate_point_R(&x_ref[3*i], NULL, NULL, Rt, &x_in[3*i]);
+    mrcal_rotate_point_R_batch(x_out, Rt, x_in, N);
+    confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+
+    // transform_point_Rt
+    for(int i=0; i<N; i++)
+        mrcal_transform_point_Rt(&x_ref[3*i], NULL, NULL, Rt, &x_in[3*i]);
+    mrcal_transform_point_Rt_batch(x_out, Rt, x_in, N);
+    confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+
+    mrcal_transform_point_Rt_batch_full(x_out_strided, x_strided_stride0, x_strided_stride1,
+                                        Rt,0,0,
+                                        x_in_strided, x_strided_stride0, x_strided_stride1,
+                                        N);
+    for(int i=0; i<N; i++)
+        for(int j=0; j<3; j++)
+            x_out[3*i + j] = x_out_strided[i*5*2 + j*2];
+    confirm_eq_double(worst_error(x_out, x_ref, N*3), 0, 1e-12);
+
+    TEST_FOOTER();
+}
@@ -94,6 +94,36 @@ testutils.confirm_equal( mrcal.transform_point_rt( mrcal.invert_rt(mrcal.rt_from
                          p,
                          msg = 'transform_point_rt inverse')
 
+# A single transformation applied to many points is evaluated by the batch
+# functions, in one C call. Make sure those agree with the one-transformation-
+# per-point path, with non-contiguous arrays and with extra broadcasted
+# dimensions
+rt          = mrcal.rt_from_Rt(Rt)
+rt_perpoint = rt + np.zeros((len(p),6))
+p_noncontiguous = nps.transpose(nps.transpose(p).copy())
+p_broadcasted   = nps.cat(p, Tp)
+
+testutils.confirm_equal( mrcal.transform_point_rt( rt, p, inverted = True ),
+                         mrcal.transform_point_rt( rt_perpoint, p, inverted = True ),
+                         msg = 'transform_point_rt batch, inverted')
+testutils.confirm_equal( mrcal.rotate_point_r( rt[:3], p_noncontiguous ),
+                         mrcal.rotate_point_r( rt_perpoint[:,:3], p ),
+                         msg = 'rotate_point_r batch, non-contiguous')
+testutils.confirm_equal( mrcal.rotate_point_r( rt[:3], p, inverted = True ),
+                         mrcal.rotate_point_r( rt_perpoint[:,:3], p, inverted = True ),
+                         msg = 'rotate_point_r batch, inverted')
+testutils.confirm_equal( mrcal.rotate_point_R( R, p_broadcasted ),
+                         nps.matmult( p_broadcasted, nps.transpose(R) ),
+                         msg = 'rotate_point_R batch, broadcasted')
+testutils.confirm_equal( mrcal.transform_point_Rt( Rt, p_broadcasted ),
+                         nps.cat(Tp, mrcal.transform_point_Rt( Rt + np.zeros((len(p),4,3)), Tp )),
+                         msg = 'transform_point_Rt batch, broadcasted')
+
+p_out = p.copy()
+mrcal.transform_point_rt( rt, p_out, out = p_out )
+testutils.confirm_equal( p_out, Tp,
+                         msg = 'transform_point_rt batch, in-place')
+
 testutils.confirm_equal( mrcal.R_from_quat( mrcal.quat_from_R(R) ),
                          R,
                          msg = 'quaternion stuff')
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../mrcal.h"
+#include "../mrcal_internal.h"
+
+#include "test-harness.h"
+
+/* The batch projection kernels compute the pinhole and opencv projections many
+   points at a time. This makes sure that each kernel (scalar, AVX2, AVX-512)
+   produces the same results as the general-purpose projection path, with and
+   without gradients. The kernels that the CPU running this test doesn't
+   support are skipped
+
+   The splined models have their own batched evaluator, which bins the points
+   by spline cell. That is checked against the general-purpose path too
+ */
+
+#define N 37 // not a multiple of any SIMD width, to exercise the leftovers
+
+static double worst_relative_error(const double* x, const double* xref, int n)
+{
+    double worst = 0.0;
+    for(int i=0; i<n; i++)
+    {
+        double err = fabs(x[i] - xref[i]) / (fabs(xref[i]) + 1e-6);
+        if(err > worst) worst = err;
+    }
+    return worst;
+}
+
+static void check_model(const char* lensmodel_name,
+                        const double* intrinsics,
+                        const mrcal_point3_t* p,
+                        const double* px, const double* py, const double* pz)
+{
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name(lensmodel_name);
+    if(!mrcal_lensmodel_type_is_valid(lensmodel.type))
+    {
+        printf(RED "FAIL: couldn't parse '%s'" COLOR_RESET "\n", lensmodel_name);
+        Ntests++;
+        NtestsFailed++;
+        return;
+    }
+    const int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
+
+    // The reference: the general-purpose path
+    mrcal_projection_precomputed_t precomputed;
+    _mrcal_precompute_lensmodel_data(&precomputed, lensmodel);
+    mrcal_point2_t q_ref             [N];
+    mrcal_point3_t dq_dp_ref         [N*2];
+    double         dq_dintrinsics_ref[N*2*Nintrinsics];
+    memset(dq_dintrinsics_ref, 0, sizeof(dq_dintrinsics_ref));
+    confirm(_mrcal_project_internal(q_ref, dq_dp_ref, dq_dintrinsics_ref,
+                                    p, N, lensmodel, intrinsics,
+                                    Nintrinsics, &precomputed));
+
+    const int Nlanes_all[] = {1, 4, 8};
+    for(int i=0; i<(int)(sizeof(Nlanes_all)/sizeof(Nlanes_all[0])); i++)
+    {
+        const int Nlanes = Nlanes_all[i];
+
+        mrcal_point2_t q             [N];
+        mrcal_point3_t dq_dp         [N*2];
+        double         dq_dintrinsics[N*2*Nintrinsics];
+
+        if(!_mrcal_project_batch_internal(q, dq_dp, dq_dintrinsics,
+                                          px, py, pz, 1, N,
+                                          intrinsics, Nintrinsics, Nlanes))
+        {
+            printf("%s: the %d-lane kernel isn't available here. Skipping\n",
+                   lensmodel_name, Nlanes);
+            continue;
+        }
+
+        printf("%s, %d lanes:\n", lensmodel_name, Nlanes);
+        confirm_eq_double(worst_relative_error((double*)q, (double*)q_ref, N*2),
+                          0, 1e-12);
+        confirm_eq_double(worst_relative_error((double*)dq_dp, (double*)dq_dp_ref, N*2*3),
+                          0, 1e-9);
+        confirm_eq_double(worst_relative_error(dq_dintrinsics, dq_dintrinsics_ref, N*2*Nintrinsics),
+                          0, 1e-9);
+
+        // No gradients. Same projections
+        mrcal_point2_t q_nograd[N];
+        confirm(_mrcal_project_batch_internal(q_nograd, NULL, NULL,
+                                              px, py, pz, 1, N,
+                                              intrinsics, Nintrinsics, Nlanes));
+        confirm(0 == memcmp(q_nograd, q, sizeof(q)));
+
+        // Strided input, as mrcal_project() uses it. Same projections
+        mrcal_point2_t q_strided[N];
+        confirm(_mrcal_project_batch_internal(q_strided, NULL, NULL,
+                                              &p[0].x, &p[0].y, &p[0].z, 3, N,
+                                              intrinsics, Nintrinsics, Nlanes));
+        confirm(0 == memcmp(q_strided, q, sizeof(q)));
+    }
+}
+
+static void check_splined(const char* lensmodel_name,
+                          const mrcal_point3_t* p)
+{
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name(lensmodel_name);
+    if(!mrcal_lensmodel_type_is_valid(lensmodel.type))
+    {
+        printf(RED "FAIL: couldn't parse '%s'" COLOR_RESET "\n", lensmodel_name);
+        Ntests++;
+        NtestsFailed++;
+        return;
+    }
+    const int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
+
+    // Arbitrary, non-trivial spline surfaces
+    double intrinsics[Nintrinsics];
+    intrinsics[0] = 1512.;
+    intrinsics[1] = 1491.;
+    intrinsics[2] = 1012.;
+    intrinsics[3] = 754.;
+    for(int i=4; i<Nintrinsics; i++)
+        intrinsics[i] = 0.01 * sin(0.7*(double)i) + 0.003*cos(2.3*(double)i);
+
+    mrcal_projection_precomputed_t precomputed;
+    _mrcal_precompute_lensmodel_data(&precomputed, lensmodel);
+    mrcal_point2_t q_ref             [N];
+    mrcal_point3_t dq_dp_ref         [N*2];
+    double         dq_dintrinsics_ref[N*2*Nintrinsics];
+    memset(dq_dintrinsics_ref, 0, sizeof(dq_dintrinsics_ref));
+    confirm(_mrcal_project_internal(q_ref, dq_dp_ref, dq_dintrinsics_ref,
+                                    p, N, lensmodel, intrinsics,
+                                    Nintrinsics, &precomputed));
+
+    printf("%s, batched:\n", lensmodel_name);
+
+    // mrcal_project() uses the batched evaluator, and densifies its sparse
+    // gradients
+    mrcal_point2_t q             [N];
+    mrcal_point3_t dq_dp         [N*2];
+    double         dq_dintrinsics[N*2*Nintrinsics];
+    confirm(mrcal_project(q, dq_dp, dq_dintrinsics,
+                          p, N, lensmodel, intrinsics));
+    confirm_eq_double(worst_relative_error((double*)q, (double*)q_ref, N*2),
+                      0, 1e-12);
+    confirm_eq_double(worst_relative_error((double*)dq_dp, (double*)dq_dp_ref, N*2*3),
+                      0, 1e-9);
+    confirm_eq_double(worst_relative_error(dq_dintrinsics, dq_dintrinsics_ref, N*2*Nintrinsics),
+                      0, 1e-9);
+
+    // No gradients. Same projections
+    mrcal_point2_t q_nograd[N];
+    confirm(_mrcal_project_splined_batch(q_nograd, NULL, NULL, NULL, NULL,
+                                         p, N,
+                                         &lensmodel.LENSMODEL_SPLINED_STEREOGRAPHIC__config,
+                                         intrinsics,
+                                         &precomputed.LENSMODEL_SPLINED_STEREOGRAPHIC__precomputed));
+    confirm(0 == memcmp(q_nograd, q, sizeof(q)));
+}
+
+int main(int argc, char* argv[])
+{
+    mrcal_point3_t p[N];
+    double px[N], py[N], pz[N];
+    for(int i=0; i<N; i++)
+    {
+        // Deterministic points in front of the camera, spread over a wide field
+        // of view
+        p[i].x = px[i] = -3.0 + 6.0 * (double)(i*7 % N) / (double)N;
+        p[i].y = py[i] = -2.0 + 4.0 * (double)(i*11 % N) / (double)N;
+        p[i].z = pz[i] =  4.0 + 0.1*(double)i;
+    }
+
+    const double intrinsics[] =
+        { 1512., 1491., 1012., 754.,
+          -0.12,  0.031, 0.0012, -0.0007, 0.002,
+          0.01,   0.004, 0.0003, 0.0013, -0.0021, 0.0004, 0.0002 };
+
+    check_model("LENSMODEL_PINHOLE",  intrinsics, p, px, py, pz);
+    check_model("LENSMODEL_OPENCV4",  intrinsics, p, px, py, pz);
+    check_model("LENSMODEL_OPENCV5",  intrinsics, p, px, py, pz);
+    check_model("LENSMODEL_OPENCV8",  intrinsics, p, px, py, pz);
+    check_model("LENSMODEL_OPENCV12", intrinsics, p, px, py, pz);
+
+    // Some of these points are outside the field of view of the splined models,
+    // so the clamping to the edge cells is exercised too
+    check_splined("LENSMODEL_SPLINED_STEREOGRAPHIC_order=3_Nx=11_Ny=8_fov_x_deg=60", p);
+    check_splined("LENSMODEL_SPLINED_STEREOGRAPHIC_order=2_Nx=12_Ny=9_fov_x_deg=60", p);
+
+    // The public wrapper rejects the models it doesn't support
+    mrcal_lensmodel_t lensmodel_stereographic = {.type = MRCAL_LENSMODEL_STEREOGRAPHIC};
+    mrcal_point2_t q[N];
+    confirm(!mrcal_project_batch(q, NULL, NULL, px, py, pz, N,
+                                 lensmodel_stereographic, intrinsics));
+
+    TEST_FOOTER();
+}
@@ -813,6 +813,51 @@ for icam in (0,3):
                             relative  = True,
                             msg = f"var(dq) (infinity) is invariant to point scale for camera {icam}")
 
+    # The points are processed in memory-bounded chunks. Tiny chunks must
+    # produce the same result as processing everything at once
+    p_cam_many = nps.cat(p_cam_baseline * 1.0,
+                         p_cam_baseline * 2.0,
+                         p_cam_baseline * 5.0)
+
+    # The precomputed covariances produce the same results without the
+    # optimization_inputs. I store them in a model without optimization_inputs,
+    # and write it to disk and read it back
+    model_precomputed = \
+        mrcal.cameramodel( intrinsics            = models_baseline[icam].intrinsics(),
+                           imagersize            = models_baseline[icam].imagersize(),
+                           extrinsics_rt_fromref = models_baseline[icam].extrinsics_rt_fromref() )
+    model_precomputed.projection_uncertainty_precomputed( \
+        mrcal.precompute_projection_uncertainty(models_baseline[icam]) )
+    model_precomputed.write(f'{workdir}/precomputed.cameramodel')
+    model_precomputed = mrcal.cameramodel(f'{workdir}/precomputed.cameramodel')
+
+    for atinfinity in (False,True):
+        Var_dq_many = \
+            mrcal.projection_uncertainty( p_cam_many,
+                                          model      = models_baseline[icam],
+                                          atinfinity = atinfinity )
+        Var_dq_many_precomputed = \
+            mrcal.projection_uncertainty( p_cam_many,
+                                          model      = model_precomputed,
+                                          atinfinity = atinfinity )
+        testutils.confirm_equal(Var_dq_many_precomputed, Var_dq_many,
+                                eps = 1e-6,
+                                worstcase = True,
+                                relative  = True,
+                                msg = f"var(dq) (atinfinity={atinfinity}) from the precomputed covariance matches for camera {icam}")
+        max_bytes = mrcal.model_analysis._projection_uncertainty_max_bytes
+        mrcal.model_analysis._projection_uncertainty_max_bytes = 1
+        Var_dq_many_chunked = \
+            mrcal.projection_uncertainty( p_cam_many,
+                                          model      = models_baseline[icam],
+                                          atinfinity = atinfinity )
+        mrcal.model_analysis._projection_uncertainty_max_bytes = max_bytes
+        testutils.confirm_equal(Var_dq_many_chunked, Var_dq_many,
+                                eps = 1e-8,
+                                worstcase = True,
+                                relative  = True,
+                                msg = f"var(dq) (atinfinity={atinfinity}) computed in chunks matches for camera {icam}")
+
 if args.no_sampling:
     testutils.finish()
     sys.exit()
@@ -106,4 +106,101 @@ err_msg = \
 testutils.confirm( err_msg == '',
                    msg = 'scale_focal__best_pinhole_fit' + err_msg)
 
+
+# image_transformation_map() computes its map in C. I compare it against the
+# same computation in numpy
+def transformation_map_reference(model_from, model_to, R_from_to = None):
+    W,H = model_to.imagersize()
+    q = np.ascontiguousarray(nps.mv(nps.cat(*np.meshgrid(np.arange(W),
+                                                         np.arange(H))),
+                                    0,-1),
+                             dtype = float)
+    v = mrcal.unproject(q, *model_to.intrinsics())
+    if R_from_to is not None:
+        v = nps.matmult(v, nps.transpose(R_from_to))
+    return mrcal.project(v, *model_from.intrinsics()).astype(np.float32)
+
+def downsampled_model(model, rt_fromref = np.zeros((6,))):
+    r'''The same lens, with a 4x smaller imager. To keep the test fast'''
+    lensmodel,intrinsics = model.intrinsics()
+    intrinsics = intrinsics.copy()
+    intrinsics[:4] /= 4.
+    W,H = model.imagersize()
+    return mrcal.cameramodel( intrinsics            = (lensmodel, intrinsics),
+                              imagersize            = (W//4, H//4),
+                              extrinsics_rt_fromref = rt_fromref )
+
+m_splined = mrcal.cameramodel(f"{testdir}/data/cam0.splined.cameramodel")
+m_pinhole = mrcal.cameramodel( intrinsics = ('LENSMODEL_PINHOLE', intrinsics_core),
+                               imagersize = (W,H) )
+rt_to_from = np.array((0.01, -0.02, 0.03, 0., 0., 0.))
+
+for model_from, model_to, what in ( (m_splined, m_pinhole, 'splined -> pinhole'),
+                                    (m,         m_splined, 'opencv8 -> splined') ):
+    model_from = mrcal.cameramodel(intrinsics = model_from.intrinsics(),
+                                   imagersize = model_from.imagersize())
+
+    model_to_small = downsampled_model(model_to)
+    mapxy = mrcal.image_transformation_map(model_from, model_to_small,
+                                           Nthreads = 3)
+    testutils.confirm( mapxy.dtype == np.float32,
+                       msg = f'image_transformation_map() {what}: float32 map')
+    testutils.confirm_equal( mapxy,
+                             transformation_map_reference(model_from, model_to_small),
+                             worstcase = True, eps = 1e-3,
+                             msg = f'image_transformation_map() {what}')
+
+    # With a rotation
+    model_to_small = downsampled_model(model_to, rt_fromref = rt_to_from)
+    mapxy = mrcal.image_transformation_map(model_from, model_to_small,
+                                           use_rotation = True)
+    testutils.confirm_equal( mapxy,
+                             transformation_map_reference(model_from, model_to_small,
+                                                          R_from_to = mrcal.R_from_r(-rt_to_from[:3])),
+                             worstcase = True, eps = 1e-3,
+                             msg = f'image_transformation_map() {what}, with a rotation')
+
+
+# transform_image() remaps in C. I compare it against a bilinear interpolation
+# here, with the float and the compact maps, and with multiple channels
+image = (np.arange(60*80*3, dtype=np.uint32).reshape(60,80,3) * 37 % 251).astype(np.uint8)
+y,x   = np.mgrid[0:45,0:70].astype(np.float32)
+mapxy = nps.glue( nps.dummy(1.1*x + 0.02*y + 1.3, -1),
+                  nps.dummy(1.2*y + 1.7,          -1),
+                  axis = -1).astype(np.float32)
+
+ix  = np.floor(mapxy[...,0]).astype(int)
+iy  = np.floor(mapxy[...,1]).astype(int)
+tx  = nps.dummy(mapxy[...,0] - ix, -1)
+ty  = nps.dummy(mapxy[...,1] - iy, -1)
+image_ref = \
+    (1-ty)*((1-tx)*image[iy,  ix] + tx*image[iy,  ix+1]) + \
+    ty    *((1-tx)*image[iy+1,ix] + tx*image[iy+1,ix+1])
+
+image_transformed = mrcal.transform_image(image, mapxy, Nthreads = 3)
+testutils.confirm( image_transformed.dtype == np.uint8 and \
+                   image_transformed.shape == mapxy.shape[:2] + (3,),
+                   msg = 'transform_image(): output dtype, shape')
+testutils.confirm_equal( image_transformed, image_ref,
+                         worstcase = True, eps = 1.01,
+                         msg = 'transform_image(): bilinear')
+testutils.confirm_equal( mrcal.transform_image(image[...,0], mapxy),
+                         image_transformed[...,0],
+                         worstcase = True, eps = 0,
+                         msg = 'transform_image(): single channel')
+testutils.confirm_equal( mrcal.transform_image(image.astype(np.float32), mapxy),
+                         image_ref,
+                         worstcase = True, eps = 1e-3,
+                         msg = 'transform_image(): float32 image')
+testutils.confirm_equal( mrcal.transform_image(image, mrcal.transformation_map_compact(mapxy)),
+                         image_ref,
+                         worstcase = True, eps = 256./32.,
+                         msg = 'transform_image(): compact map')
+testutils.confirm_equal( mrcal.transform_image(np.full((60,80),1000, dtype=np.uint16),
+                                               mapxy,
+                                               interpolation = 'bicubic')[2:-2,2:-2],
+                         1000,
+                         worstcase = True, eps = 0,
+                         msg = 'transform_image(): bicubic interpolation of a constant image')
+
 testutils.finish()
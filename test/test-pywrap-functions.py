@@ -37,4 +37,30 @@ meta_ref = {'has_core': 1,
 testutils.confirm_equal(meta, meta_ref,
                         msg="lensmodel_metadata() keys")
 
+
+# _A_Jt_J_At() takes a sparse J with 32-bit or 64-bit indices. Huge problems use
+# the latter
+from scipy.sparse import csr_matrix
+indptr  = np.array([0, 2, 3, 6, 8])
+indices = np.array([0, 2, 2, 0, 1, 2, 1, 2])
+data    = np.array([1, 2, 3, 4, 5, 6, 7, 8], dtype=float)
+Jdense  = csr_matrix((data, indices, indptr)).toarray()
+A       = np.array(((1., -2., 0.5),
+                    (0.3, 4., -1.)))
+
+Nleading_rows_J = 3
+A_Jt_J_At_ref = nps.matmult(A,
+                            nps.transpose(Jdense[:Nleading_rows_J]),
+                            Jdense[:Nleading_rows_J],
+                            nps.transpose(A))
+for itype in (np.int32, np.int64):
+    testutils.confirm_equal(mrcal._mrcal_npsp._A_Jt_J_At(A,
+                                                         indptr .astype(itype),
+                                                         indices.astype(itype),
+                                                         data,
+                                                         Nleading_rows_J = Nleading_rows_J),
+                            A_Jt_J_At_ref,
+                            worstcase = True,
+                            msg = f"_A_Jt_J_At() with {np.dtype(itype).name} indices")
+
 testutils.finish()
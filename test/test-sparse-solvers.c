@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../mrcal.h"
+#include "../poseutils.h"
+
+#include "test-harness.h"
+
+/* mrcal has solvers other than the default libdogleg/CHOLMOD one:
+
+   - The Schur-complement solver eliminates the frame poses and the discrete
+     points from each linear system, and solves the reduced camera system
+
+   - The PCG solver solves each linear system iteratively, without ever forming
+     JtJ
+
+   - The CHOLMOD Levenberg-Marquardt solver factors the full JtJ, like
+     libdogleg, but analyzes its sparsity pattern only once
+
+   These should find the same optimum as the default solver. I make a small
+   synthetic problem (2 cameras observing a chessboard in several poses, and
+   some discrete points), and solve it with each solver, from the same seed
+
+   One of the chessboard observations is an outlier. All the solvers should
+   find it
+
+   I also solve with each robust loss. These should find the outlier after a
+   single solve, and should still find a solution near the truth. The returned
+   measurements and RMS error should be in pixels, without the loss applied */
+
+#define Ncameras     2
+#define Nframes      8
+#define Npoints      6
+#define W            10
+#define H            9
+#define SPACING      0.1
+#define NOISE        0.3 // pixels
+
+static const double intrinsics_true[Ncameras][8] =
+    { {1500., 1510., 1000., 760., -0.1,  0.02,  0.001, -0.002},
+      {1450., 1460., 990.,  740., -0.08, 0.015, 0.002,  0.001} };
+static const int imagersizes[Ncameras*2] = {2000, 1500, 2000, 1500};
+
+// noise in [-NOISE,NOISE]
+static double noise(void)
+{
+    return (drand48()*2. - 1.) * NOISE;
+}
+
+static void transform(double* out, const mrcal_pose_t* rt, const double* in)
+{
+    mrcal_transform_point_rt(out, NULL, NULL, (const double*)rt, in);
+}
+
+static const mrcal_problem_selections_t problem_selections =
+    { .do_optimize_intrinsics_core        = true,
+      .do_optimize_intrinsics_distortions = true,
+      .do_optimize_extrinsics             = true,
+      .do_optimize_frames                 = true,
+      .do_optimize_calobject_warp         = true,
+      .do_apply_regularization            = true,
+      .do_apply_outlier_rejection         = true };
+
+typedef struct
+{
+    double         intrinsics[Ncameras][8];
+    mrcal_pose_t   extrinsics[Ncameras-1];
+    mrcal_pose_t   frames    [Nframes];
+    mrcal_point3_t points    [Npoints];
+    mrcal_point2_t calobject_warp;
+} state_t;
+
+static mrcal_stats_t solve(// out
+                           state_t* state,
+                           mrcal_point3_t* observations_board_pool,
+                           // May be NULL. Nmeasurements of these
+                           double* x,
+                           // in
+                           const state_t* seed,
+                           const mrcal_point3_t* observations_board_pool_input,
+                           const mrcal_observation_board_t* observations_board,
+                           const mrcal_observation_point_t* observations_point,
+                           int Nobservations_point,
+                           mrcal_solver_t solver,
+                           mrcal_loss_t   loss)
+{
+    *state = *seed;
+    memcpy(observations_board_pool, observations_board_pool_input,
+           Ncameras*Nframes*W*H*sizeof(mrcal_point3_t));
+
+    mrcal_problem_constants_t problem_constants =
+        { .point_min_range = 0.1,
+          .point_max_range = 100.,
+          .solver          = solver,
+          .loss            = loss,
+          .loss_scale      = 3.*NOISE };
+
+    const int Nmeasurements =
+        mrcal_num_measurements(Ncameras*Nframes, Nobservations_point, W, H,
+                               Ncameras, Ncameras-1, Nframes, Npoints, 0,
+                               problem_selections,
+                               mrcal_lensmodel_from_name("LENSMODEL_OPENCV4"));
+
+    return
+        mrcal_optimize(NULL, 0,
+                       x, x != NULL ? Nmeasurements*sizeof(double) : 0,
+                       &state->intrinsics[0][0],
+                       state->extrinsics,
+                       state->frames,
+                       state->points,
+                       &state->calobject_warp,
+                       Ncameras, Ncameras-1, Nframes,
+                       Npoints, 0,
+                       observations_board,
+                       observations_point,
+                       Ncameras*Nframes,
+                       Nobservations_point,
+                       observations_board_pool,
+                       mrcal_lensmodel_from_name("LENSMODEL_OPENCV4"),
+                       NOISE,
+                       imagersizes,
+                       problem_selections, &problem_constants,
+                       SPACING, W, H,
+                       false, false, NULL);
+}
+
+int main(int argc, char* argv[])
+{
+    srand48(0);
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name("LENSMODEL_OPENCV4");
+
+    state_t truth = { .extrinsics = { { .r = {.xyz = {0.01, -0.2, 0.005}}, .t = {.xyz = {0.3, 0.01, -0.02}} } } };
+    memcpy(truth.intrinsics, intrinsics_true, sizeof(intrinsics_true));
+    for(int i=0; i<Nframes; i++)
+        truth.frames[i] = (mrcal_pose_t)
+            { .r = {.xyz = {  0.3*sin(i),  0.3*cos(1.3*i), 0.1*sin(2.*i) }},
+              .t = {.xyz = { -0.45 + 0.1*sin(3.*i), -0.4 + 0.1*cos(i), 2. + 0.3*sin(0.7*i) }} };
+    for(int i=0; i<Npoints; i++)
+        truth.points[i] = (mrcal_point3_t){ .x = -0.5 + 0.2*i,
+                                            .y = 0.3*sin(i),
+                                            .z = 3. + 0.5*cos(i) };
+
+    // Each camera observes each frame and each point
+    mrcal_observation_board_t observations_board     [Ncameras*Nframes];
+    mrcal_point3_t            observations_board_pool[Ncameras*Nframes*W*H];
+    mrcal_observation_point_t observations_point     [Ncameras*Npoints];
+
+    for(int icam=0; icam<Ncameras; icam++)
+    {
+        for(int iframe=0; iframe<Nframes; iframe++)
+        {
+            const int iobservation = icam*Nframes + iframe;
+            observations_board[iobservation] = (mrcal_observation_board_t)
+                { .icam   = { .intrinsics = icam, .extrinsics = icam-1 },
+                  .iframe = iframe };
+            for(int y=0; y<H; y++)
+                for(int x=0; x<W; x++)
+                {
+                    double p_ref[3], p_cam[3];
+                    transform(p_ref, &truth.frames[iframe],
+                              (double[]){x*SPACING, y*SPACING, 0.});
+                    if(icam > 0) transform(p_cam, &truth.extrinsics[icam-1], p_ref);
+                    else         memcpy(p_cam, p_ref, sizeof(p_cam));
+
+                    mrcal_point2_t q;
+                    mrcal_project(&q, NULL, NULL,
+                                  (const mrcal_point3_t*)p_cam, 1,
+                                  lensmodel, truth.intrinsics[icam]);
+                    observations_board_pool[(iobservation*H + y)*W + x] =
+                        (mrcal_point3_t){ .x = q.x + noise(),
+                                          .y = q.y + noise(),
+                                          .z = 1.0 };
+                }
+        }
+
+        for(int i=0; i<Npoints; i++)
+        {
+            double p_cam[3];
+            if(icam > 0) transform(p_cam, &truth.extrinsics[icam-1], truth.points[i].xyz);
+            else         memcpy(p_cam, truth.points[i].xyz, sizeof(p_cam));
+
+            mrcal_point2_t q;
+            mrcal_project(&q, NULL, NULL,
+                          (const mrcal_point3_t*)p_cam, 1,
+                          lensmodel, truth.intrinsics[icam]);
+            observations_point[icam*Npoints + i] = (mrcal_observation_point_t)
+                { .icam    = { .intrinsics = icam, .extrinsics = icam-1 },
+                  .i_point = i,
+                  .px      = { .x = q.x + noise(), .y = q.y + noise(), .z = 1.0 } };
+        }
+    }
+
+    // A gross outlier
+    const int ioutlier = (3*H + 4)*W + 5;
+    observations_board_pool[ioutlier].x += 40.;
+
+    // The seed is the truth, perturbed
+    state_t seed = truth;
+    for(int icam=0; icam<Ncameras; icam++)
+    {
+        seed.intrinsics[icam][0] *= 1.02;
+        seed.intrinsics[icam][1] *= 0.98;
+        seed.intrinsics[icam][2] += 5.;
+        seed.intrinsics[icam][3] -= 5.;
+        for(int i=4; i<8; i++)
+            seed.intrinsics[icam][i] = 0.;
+    }
+    seed.extrinsics[0].t.x += 0.01;
+    seed.extrinsics[0].r.y += 0.01;
+    for(int i=0; i<Nframes; i++)
+    {
+        seed.frames[i].r.x += 0.01;
+        seed.frames[i].t.z += 0.05;
+    }
+    for(int i=0; i<Npoints; i++)
+        seed.points[i].z += 0.1;
+
+
+    state_t        solution_cholmod;
+    mrcal_point3_t pool_cholmod[Ncameras*Nframes*W*H];
+    mrcal_stats_t  stats_cholmod =
+        solve(&solution_cholmod, pool_cholmod, NULL,
+              &seed, observations_board_pool,
+              observations_board, observations_point, Ncameras*Npoints,
+              MRCAL_SOLVER_CHOLMOD, MRCAL_LOSS_SQUARED);
+    confirm(stats_cholmod.rms_reproj_error__pixels > 0);
+    confirm(pool_cholmod[ioutlier].z < 0);
+
+    const mrcal_solver_t solvers[] = {MRCAL_SOLVER_SCHUR, MRCAL_SOLVER_PCG, MRCAL_SOLVER_CHOLMOD_LM};
+    for(int isolver=0; isolver<(int)(sizeof(solvers)/sizeof(solvers[0])); isolver++)
+    {
+        printf("Checking solver %d\n", solvers[isolver]);
+
+        state_t        solution;
+        mrcal_point3_t pool[Ncameras*Nframes*W*H];
+        mrcal_stats_t  stats =
+            solve(&solution, pool, NULL,
+                  &seed, observations_board_pool,
+                  observations_board, observations_point, Ncameras*Npoints,
+                  solvers[isolver], MRCAL_LOSS_SQUARED);
+
+        confirm(stats.rms_reproj_error__pixels > 0);
+        confirm_eq_double(stats.rms_reproj_error__pixels,
+                          stats_cholmod.rms_reproj_error__pixels, 1e-6);
+        confirm_eq_int(stats.Noutliers, stats_cholmod.Noutliers);
+        confirm(pool[ioutlier].z < 0);
+
+        double worst_intrinsics = 0., worst_poses = 0., worst_points = 0.;
+        for(int icam=0; icam<Ncameras; icam++)
+            for(int i=0; i<8; i++)
+            {
+                double err = fabs(solution.intrinsics[icam][i] - solution_cholmod.intrinsics[icam][i]);
+                if(err > worst_intrinsics) worst_intrinsics = err;
+            }
+        for(int i=0; i<Nframes; i++)
+            for(int j=0; j<6; j++)
+            {
+                double err = fabs(((double*)&solution.frames[i])[j] - ((double*)&solution_cholmod.frames[i])[j]);
+                if(err > worst_poses) worst_poses = err;
+            }
+        for(int j=0; j<6; j++)
+        {
+            double err = fabs(((double*)&solution.extrinsics[0])[j] - ((double*)&solution_cholmod.extrinsics[0])[j]);
+            if(err > worst_poses) worst_poses = err;
+        }
+        for(int i=0; i<Npoints; i++)
+            for(int j=0; j<3; j++)
+            {
+                double err = fabs(solution.points[i].xyz[j] - solution_cholmod.points[i].xyz[j]);
+                if(err > worst_points) worst_points = err;
+            }
+        confirm_eq_double(worst_intrinsics, 0., 1e-3);
+        confirm_eq_double(worst_poses,      0., 1e-6);
+        confirm_eq_double(worst_points,     0., 1e-6);
+
+        // And the solution is near the truth
+        confirm_eq_double(solution.intrinsics[0][0], truth.intrinsics[0][0], 5.);
+        confirm_eq_double(solution.extrinsics[0].t.x, truth.extrinsics[0].t.x, 1e-2);
+    }
+
+    const mrcal_loss_t losses[] = {MRCAL_LOSS_HUBER, MRCAL_LOSS_CAUCHY};
+    for(int iloss=0; iloss<(int)(sizeof(losses)/sizeof(losses[0])); iloss++)
+    {
+        printf("Checking loss %d\n", losses[iloss]);
+
+        const int Nmeasurements =
+            mrcal_num_measurements(Ncameras*Nframes, Ncameras*Npoints, W, H,
+                                   Ncameras, Ncameras-1, Nframes, Npoints, 0,
+                                   problem_selections, lensmodel);
+
+        state_t        solution;
+        mrcal_point3_t pool[Ncameras*Nframes*W*H];
+        double         x[Nmeasurements];
+        mrcal_stats_t  stats =
+            solve(&solution, pool, x,
+                  &seed, observations_board_pool,
+                  observations_board, observations_point, Ncameras*Npoints,
+                  MRCAL_SOLVER_CHOLMOD, losses[iloss]);
+
+        confirm(stats.rms_reproj_error__pixels > 0);
+        confirm_eq_int(stats.Nsolver_rounds, 1);
+        confirm(pool[ioutlier].z < 0);
+
+        // The outlier was found after the one solve, so it's still in x. Its
+        // error is about 40 pixels. The loss would have shrunk that a lot
+        confirm(fabs(fabs(x[2*ioutlier]) - 40.) < 1.);
+
+        // The RMS error is computed from the same x
+        double norm2_x = 0.;
+        for(int i=0; i<Nmeasurements; i++)
+            norm2_x += x[i]*x[i];
+        confirm_eq_double(stats.rms_reproj_error__pixels,
+                          sqrt(norm2_x / ((double)Nmeasurements / 2.)), 1e-9);
+
+        confirm_eq_double(solution.intrinsics[0][0], truth.intrinsics[0][0], 5.);
+        confirm_eq_double(solution.extrinsics[0].t.x, truth.extrinsics[0].t.x, 1e-2);
+        for(int i=0; i<Nframes; i++)
+            confirm_eq_double(solution.frames[i].t.z, truth.frames[i].t.z, 1e-2);
+    }
+
+    TEST_FOOTER();
+}
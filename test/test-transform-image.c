@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../mrcal.h"
+#include "../mrcal_internal.h"
+
+#include "test-harness.h"
+
+/* The image remapper interpolates with SIMD kernels of several widths, for
+   several pixel types. This checks each kernel against a simple reference
+   implementation here, with the float and the compact maps, with 1 and 3
+   channels, and with multiple threads. The kernels that the CPU running this
+   test doesn't support are skipped
+ */
+
+#define W     23
+#define H     17
+#define W_OUT 37 // not a multiple of any SIMD width, to exercise the leftovers
+#define H_OUT 11
+
+// OpenCV's INTER_CUBIC kernel
+static void cubic_weights(double* w, double t)
+{
+    const double A = -0.75;
+    w[0] = ((A*(t+1) - 5*A)*(t+1) + 8*A)*(t+1) - 4*A;
+    w[1] = ((A+2)*t - (A+3))*t*t + 1;
+    w[2] = ((A+2)*(1-t) - (A+3))*(1-t)*(1-t) + 1;
+    w[3] = 1 - w[0] - w[1] - w[2];
+}
+
+// This is built with -ffast-math, so isfinite() can't be relied upon. I look
+// at the exponent bits instead
+static bool is_finite(float x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return (u & 0x7f800000) != 0x7f800000;
+}
+
+// The reference: interpolate a double-precision copy of the image at (x,y).
+// Points far off the image produce 0
+static double reference_pixel(const double* image, int Nchannels, int c,
+                              float x, float y, bool bicubic)
+{
+    if(!(is_finite(x) && is_finite(y)) ||
+       fabsf(x) > 1e6f || fabsf(y) > 1e6f)
+        return 0.;
+
+    const int    ix = (int)floor(x);
+    const int    iy = (int)floor(y);
+    const double tx = x - ix;
+    const double ty = y - iy;
+
+    double wx[4], wy[4];
+    int    Ntaps, tap_min;
+    if(bicubic)
+    {
+        cubic_weights(wx, tx);
+        cubic_weights(wy, ty);
+        Ntaps   = 4;
+        tap_min = -1;
+    }
+    else
+    {
+        wx[0] = 1-tx; wx[1] = tx;
+        wy[0] = 1-ty; wy[1] = ty;
+        Ntaps   = 2;
+        tap_min = 0;
+    }
+
+    double acc = 0.;
+    for(int j=0; j<Ntaps; j++)
+        for(int i=0; i<Ntaps; i++)
+        {
+            int xx = ix + tap_min + i;
+            int yy = iy + tap_min + j;
+            if(xx >= 0 && xx < W && yy >= 0 && yy < H)
+                acc += wx[i]*wy[j]*image[(yy*W + xx)*Nchannels + c];
+        }
+    return acc;
+}
+
+static double pixel_as_double(const void* p, mrcal_image_type_t type, int i)
+{
+    switch(type)
+    {
+    case MRCAL_IMAGE_UINT8:  return (double)((const uint8_t *)p)[i];
+    case MRCAL_IMAGE_UINT16: return (double)((const uint16_t*)p)[i];
+    default:                 return (double)((const float   *)p)[i];
+    }
+}
+
+static void check(mrcal_image_type_t type, const char* type_name,
+                  int Nchannels, bool bicubic, bool compact,
+                  const float* mapxy)
+{
+    const int pixel_size =
+        type == MRCAL_IMAGE_UINT8  ? 1 :
+        type == MRCAL_IMAGE_UINT16 ? 2 : 4;
+    const double pixel_max =
+        type == MRCAL_IMAGE_UINT8  ? 255. :
+        type == MRCAL_IMAGE_UINT16 ? 65535. : 1e10;
+
+    // Deterministic, non-smooth image
+    uint8_t image[W*H*Nchannels*pixel_size];
+    double  image_double[W*H*Nchannels];
+    for(int i=0; i<W*H*Nchannels; i++)
+    {
+        double v = (double)((i*37 + (i/W)*11) % 251);
+        if(type == MRCAL_IMAGE_UINT16) v *= 251.;
+        if(type == MRCAL_IMAGE_FLOAT)  v = v/10. - 12.;
+        image_double[i] = v;
+        switch(type)
+        {
+        case MRCAL_IMAGE_UINT8:  ((uint8_t *)image)[i] = (uint8_t) v; break;
+        case MRCAL_IMAGE_UINT16: ((uint16_t*)image)[i] = (uint16_t)v; break;
+        default:                 ((float   *)image)[i] = (float)   v; break;
+        }
+    }
+
+    // The compact map quantizes the coordinates. The reference uses the
+    // quantized coordinates in that case
+    int16_t  mapxy_int [H_OUT*W_OUT*2];
+    uint16_t mapxy_frac[H_OUT*W_OUT];
+    float    mapxy_ref [H_OUT*W_OUT*2];
+    mrcal_transformation_map_compact(mapxy_int, mapxy_frac, mapxy, H_OUT*W_OUT);
+    for(int i=0; i<H_OUT*W_OUT; i++)
+    {
+        if(!compact)
+        {
+            mapxy_ref[2*i+0] = mapxy[2*i+0];
+            mapxy_ref[2*i+1] = mapxy[2*i+1];
+        }
+        else if(mapxy_int[2*i+0] == INT16_MIN)
+            mapxy_ref[2*i+0] = mapxy_ref[2*i+1] = NAN;
+        else
+        {
+            mapxy_ref[2*i+0] = mapxy_int[2*i+0] + (float)(mapxy_frac[i] & 31)        / 32.f;
+            mapxy_ref[2*i+1] = mapxy_int[2*i+1] + (float)((mapxy_frac[i] >> 5) & 31) / 32.f;
+        }
+    }
+
+    const int Nlanes_all[] = {1, 8, 16};
+    for(int ilanes=0; ilanes<(int)(sizeof(Nlanes_all)/sizeof(Nlanes_all[0])); ilanes++)
+    {
+        const int Nlanes = Nlanes_all[ilanes];
+
+        uint8_t out[W_OUT*H_OUT*Nchannels*pixel_size];
+        if(!_mrcal_transform_image_internal(out, image, W, H, Nchannels, type,
+                                            W_OUT, H_OUT,
+                                            compact ? NULL       : mapxy,
+                                            compact ? mapxy_int  : NULL,
+                                            compact ? mapxy_frac : NULL,
+                                            bicubic, 1, Nlanes))
+        {
+            printf("%s: the %d-lane kernel isn't available here. Skipping\n",
+                   type_name, Nlanes);
+            continue;
+        }
+
+        printf("%s, %d channels, %s, %s map, %d lanes:\n",
+               type_name, Nchannels,
+               bicubic ? "bicubic" : "bilinear",
+               compact ? "compact" : "float",
+               Nlanes);
+
+        double worst = 0.;
+        for(int i=0; i<W_OUT*H_OUT; i++)
+            for(int c=0; c<Nchannels; c++)
+            {
+                double ref = reference_pixel(image_double, Nchannels, c,
+                                             mapxy_ref[2*i+0], mapxy_ref[2*i+1],
+                                             bicubic);
+                if(type != MRCAL_IMAGE_FLOAT)
+                {
+                    ref = round(ref);
+                    if(ref < 0)         ref = 0;
+                    if(ref > pixel_max) ref = pixel_max;
+                }
+                double err = fabs(pixel_as_double(out, type, i*Nchannels + c) - ref);
+                if(err > worst) worst = err;
+            }
+        // Integer pixels can round differently from the double-precision
+        // reference. The SIMD kernels may use fused multiply-adds, so they
+        // don't match each other exactly either
+        confirm_eq_double(worst, 0, type == MRCAL_IMAGE_FLOAT ? 1e-3 : 1.01);
+    }
+
+    // Threaded. Same results as the single-threaded run
+    uint8_t out          [W_OUT*H_OUT*Nchannels*pixel_size];
+    uint8_t out_threaded [W_OUT*H_OUT*Nchannels*pixel_size];
+    confirm(mrcal_transform_image(out, image, W, H, Nchannels, type,
+                                  W_OUT, H_OUT,
+                                  compact ? NULL       : mapxy,
+                                  compact ? mapxy_int  : NULL,
+                                  compact ? mapxy_frac : NULL,
+                                  bicubic, 1));
+    confirm(mrcal_transform_image(out_threaded, image, W, H, Nchannels, type,
+                                  W_OUT, H_OUT,
+                                  compact ? NULL       : mapxy,
+                                  compact ? mapxy_int  : NULL,
+                                  compact ? mapxy_frac : NULL,
+                                  bicubic, 4));
+    confirm(0 == memcmp(out_threaded, out, sizeof(out)));
+}
+
+int main(int argc, char* argv[])
+{
+    // A smooth distortion-like map, covering the image and going past its
+    // edges, so the borders are exercised. A few pixels map to nan
+    float mapxy[H_OUT*W_OUT*2];
+    for(int y=0; y<H_OUT; y++)
+        for(int x=0; x<W_OUT; x++)
+        {
+            float u = (float)x/(W_OUT-1)*2.f - 1.f;
+            float v = (float)y/(H_OUT-1)*2.f - 1.f;
+            float r2 = u*u + v*v;
+            mapxy[2*(y*W_OUT+x) + 0] = (W-1)/2.f + (W/2.f+1.7f)*u*(1.f + 0.1f*r2) + 0.13f*v;
+            mapxy[2*(y*W_OUT+x) + 1] = (H-1)/2.f + (H/2.f+1.3f)*v*(1.f - 0.05f*r2);
+        }
+    mapxy[2*5 + 0] = NAN;
+    mapxy[2*(3*W_OUT + 17) + 1] = NAN;
+    mapxy[2*(4*W_OUT + 2) + 0]  = 1e20f;
+
+    // The compact map stores the coordinates in 1/32 pixel
+    int16_t  mapxy_int [2];
+    uint16_t mapxy_frac[1];
+    const float q[] = {-3.53125f, 10.25f};
+    mrcal_transformation_map_compact(mapxy_int, mapxy_frac, q, 1);
+    confirm_eq_int(mapxy_int[0], -4);
+    confirm_eq_int(mapxy_int[1], 10);
+    confirm_eq_int(mapxy_frac[0] & 31,        15);
+    confirm_eq_int((mapxy_frac[0] >> 5) & 31, 8);
+
+#define CHECK_TYPE(name, ctype)                                         \
+    for(int Nchannels=1; Nchannels<=3; Nchannels+=2)                    \
+        for(int bicubic=0; bicubic<2; bicubic++)                        \
+            for(int compact=0; compact<2; compact++)                    \
+                check(MRCAL_IMAGE_ ## name, #name,                      \
+                      Nchannels, bicubic, compact, mapxy);
+    MRCAL_IMAGE_TYPE_LIST(CHECK_TYPE);
+#undef CHECK_TYPE
+
+    // Exactly one map must be given
+    uint8_t image[W*H], out[W_OUT*H_OUT];
+    memset(image, 0, sizeof(image));
+    confirm(!mrcal_transform_image(out, image, W, H, 1, MRCAL_IMAGE_UINT8,
+                                   W_OUT, H_OUT,
+                                   NULL, NULL, NULL,
+                                   false, 1));
+
+    TEST_FOOTER();
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../mrcal.h"
+
+#include "test-harness.h"
+
+/* Unprojection uses Newton's method, seeding each point from the previous one
+   if they're close. This makes sure that unproject(project(v)) = v on a grid of
+   pixels, that isolated points work too, and that the threaded unprojection
+   produces the same results
+ */
+
+#define W 41
+#define H 23
+#define N (W*H)
+
+static void check_model(const char* lensmodel_name,
+                        const double* intrinsics,
+                        int Nintrinsics_given)
+{
+    mrcal_lensmodel_t lensmodel = mrcal_lensmodel_from_name(lensmodel_name);
+    if(!mrcal_lensmodel_type_is_valid(lensmodel.type))
+    {
+        printf(RED "FAIL: couldn't parse '%s'" COLOR_RESET "\n", lensmodel_name);
+        Ntests++;
+        NtestsFailed++;
+        return;
+    }
+    const int Nintrinsics = mrcal_lensmodel_num_params(lensmodel);
+
+    // The given intrinsics, with any remaining ones filled with arbitrary small
+    // values
+    double intrinsics_all[Nintrinsics];
+    for(int i=0; i<Nintrinsics; i++)
+        intrinsics_all[i] =
+            i < Nintrinsics_given ?
+            intrinsics[i] :
+            0.01 * sin(0.7*(double)i) + 0.003*cos(2.3*(double)i);
+
+    printf("%s:\n", lensmodel_name);
+
+    // A grid of pixels, in row-major order, as when unprojecting an imager
+    mrcal_point2_t q[N];
+    for(int i=0; i<N; i++)
+    {
+        q[i].x = 100. + 3800. * (double)(i%W) / (double)(W-1);
+        q[i].y = 100. + 2000. * (double)(i/W) / (double)(H-1);
+    }
+
+    mrcal_point3_t v[N];
+    confirm(mrcal_unproject(v, q, N, lensmodel, intrinsics_all));
+
+    mrcal_point2_t q_roundtrip[N];
+    confirm(mrcal_project(q_roundtrip, NULL, NULL, v, N, lensmodel, intrinsics_all));
+    double worst = 0.0;
+    for(int i=0; i<N; i++)
+    {
+        double err = hypot(q_roundtrip[i].x - q[i].x,
+                           q_roundtrip[i].y - q[i].y);
+        if(!(err <= worst)) worst = err; // catches nan also
+    }
+    confirm_eq_double(worst, 0, 1e-8);
+
+    // Each point by itself: no neighbor seeding. Same directions
+    double worst_direction = 0.0;
+    bool   all_succeeded   = true;
+    for(int i=0; i<N; i++)
+    {
+        mrcal_point3_t v1;
+        all_succeeded = all_succeeded &&
+            mrcal_unproject(&v1, &q[i], 1, lensmodel, intrinsics_all);
+        double cross[3] = { v1.y*v[i].z - v1.z*v[i].y,
+                            v1.z*v[i].x - v1.x*v[i].z,
+                            v1.x*v[i].y - v1.y*v[i].x };
+        double err =
+            sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]) /
+            sqrt(v1.x*v1.x + v1.y*v1.y + v1.z*v1.z) /
+            sqrt(v[i].x*v[i].x + v[i].y*v[i].y + v[i].z*v[i].z);
+        if(!(err <= worst_direction)) worst_direction = err;
+    }
+    confirm(all_succeeded);
+    confirm_eq_double(worst_direction, 0, 1e-10);
+
+    // Threaded. Same directions
+    mrcal_point3_t v_threaded[N];
+    confirm(mrcal_unproject_threaded(v_threaded, q, N, lensmodel, intrinsics_all, 4));
+    double worst_threaded = 0.0;
+    for(int i=0; i<N; i++)
+        for(int j=0; j<3; j++)
+        {
+            double err = fabs(v_threaded[i].xyz[j] - v[i].xyz[j]);
+            if(!(err <= worst_threaded)) worst_threaded = err;
+        }
+    confirm_eq_double(worst_threaded, 0, 1e-10);
+}
+
+int main(int argc, char* argv[])
+{
+    const double intrinsics[] =
+        { 1761.2, 1761.3, 1965.7, 1087.5,
+          -0.0127, 0.0359, -0.00025, 0.00053, 0.0197, 0.0148, -0.0562, 0.0500 };
+
+    check_model("LENSMODEL_OPENCV4",  intrinsics, 8);
+    check_model("LENSMODEL_OPENCV8",  intrinsics, 12);
+    check_model("LENSMODEL_CAHVOR",   intrinsics, 4);
+    check_model("LENSMODEL_SPLINED_STEREOGRAPHIC_order=3_Nx=16_Ny=11_fov_x_deg=120",
+                intrinsics, 4);
+
+    TEST_FOOTER();
+}
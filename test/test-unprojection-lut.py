@@ -0,0 +1,115 @@
+#!/usr/bin/python3
+
+r'''Tests the unprojection lookup tables
+
+I make sure that the tables meet their error bound, that they survive a
+write/read cycle, and that a table on disk is recomputed if it doesn't match the
+model we're asking for
+
+'''
+
+import sys
+import numpy as np
+import numpysane as nps
+import os
+
+testdir = os.path.dirname(os.path.realpath(__file__))
+
+# I import the LOCAL mrcal since that's what I'm testing
+sys.path[:0] = f"{testdir}/..",
+import mrcal
+import testutils
+
+
+import tempfile
+import atexit
+import shutil
+workdir = tempfile.mkdtemp()
+def cleanup():
+    global workdir
+    try:
+        shutil.rmtree(workdir)
+        workdir = None
+    except:
+        pass
+atexit.register(cleanup)
+
+
+def angle_error(v0, v1):
+    v0 = v0 / nps.dummy(nps.mag(v0), -1)
+    v1 = v1 / nps.dummy(nps.mag(v1), -1)
+    return np.arcsin( np.clip(nps.mag(np.cross(v0, v1)), 0, 1) )
+
+
+m   = mrcal.cameramodel(f"{testdir}/data/cam0.opencv8.cameramodel")
+W,H = m.imagersize()
+
+np.random.seed(0)
+q = np.random.rand(2000,2) * np.array((W-1, H-1), dtype=float)
+v_ref = mrcal.unproject(q, *m.intrinsics(), normalize = True)
+
+for interpolation in ('bicubic', 'bilinear'):
+    max_error_rad = 1e-6 if interpolation == 'bicubic' else 1e-5
+    lut = mrcal.unprojection_lut(m,
+                                 max_error_rad = max_error_rad,
+                                 interpolation = interpolation)
+
+    testutils.confirm( lut.max_error_rad() <= max_error_rad,
+                       msg = f"{interpolation}: the achieved error bound is within the requested one")
+
+    err = angle_error(lut.unproject(q), v_ref)
+    testutils.confirm( np.max(err) <= lut.max_error_rad(),
+                       msg = f"{interpolation}: the error at random pixels is within the bound")
+
+    testutils.confirm_equal( nps.mag(lut.unproject(q, normalize = True)),
+                             np.ones((len(q),)),
+                             worstcase = True,
+                             msg = f"{interpolation}: normalize=True produces unit vectors")
+
+    # broadcasting
+    testutils.confirm_equal( lut.unproject(q.reshape(40,50,2)),
+                             lut.unproject(q).reshape(40,50,3),
+                             worstcase = True, eps = 0,
+                             msg = f"{interpolation}: broadcasting")
+
+    # The grid points themselves are reproduced exactly
+    gridn_height,gridn_width = lut._v.shape[:2]
+    q_grid = mrcal.sample_imager(gridn_width, gridn_height, W, H)
+    testutils.confirm_equal( lut.unproject(q_grid),
+                             lut._v,
+                             worstcase = True,
+                             msg = f"{interpolation}: the grid points are reproduced")
+
+# write/read cycle
+filename = f"{workdir}/lut.npz"
+lut = mrcal.unprojection_lut(m, file = filename)
+testutils.confirm( os.path.exists(filename),
+                   msg = "the computed table was written to disk")
+
+lut_read = mrcal.unprojection_lut(file = filename)
+testutils.confirm_equal( lut_read.unproject(q), lut.unproject(q),
+                         worstcase = True, eps = 0,
+                         msg = "the table read from disk unprojects identically")
+testutils.confirm_equal( lut_read.max_error_rad(), lut.max_error_rad(),
+                         eps = 0,
+                         msg = "the table read from disk has the same error bound")
+
+# A table for a different model must not be used. I perturb the intrinsics: the
+# table should be recomputed, and should reflect the new intrinsics
+lensmodel,intrinsics_data = m.intrinsics()
+intrinsics_data = intrinsics_data.copy()
+intrinsics_data[2] += 10.
+m2 = mrcal.cameramodel(m)
+m2.intrinsics( (lensmodel, intrinsics_data) )
+
+lut2 = mrcal.unprojection_lut(m2, file = filename)
+err = angle_error(lut2.unproject(q),
+                  mrcal.unproject(q, *m2.intrinsics()))
+testutils.confirm( np.max(err) <= lut2.max_error_rad(),
+                   msg = "a stale table on disk is recomputed")
+testutils.confirm_equal( mrcal.unprojection_lut(file = filename)._intrinsics_data,
+                         intrinsics_data,
+                         worstcase = True, eps = 0,
+                         msg = "the recomputed table replaced the stale one on disk")
+
+testutils.finish()